@@ -0,0 +1,92 @@
+/*
+  Scarto del lavoro in base al ritardo di coda, con l'algoritmo CoDel (Controlled Delay, RFC 8289).
+
+  Il server chiama CoDelScarta() ogni volta che preleva un lavoro che si può rifiutare a basso costo (una nuova
+  connessione, un messaggio binario), passando da quanto tempo quel lavoro aspetta. Finché il ritardo scende sotto
+  l'obiettivo almeno una volta per intervallo la coda è "buona" (assorbe un picco) e non si scarta niente. Se invece il
+  ritardo resta sopra l'obiettivo per un intervallo intero la coda è fissa: CoDel entra nello stato di scarto e rifiuta
+  un lavoro, poi il successivo dopo intervallo / sqrt(2), intervallo / sqrt(3) e così via, finché il ritardo non torna
+  sotto l'obiettivo. Un nuovo stato di scarto poco dopo il precedente riparte vicino al ritmo raggiunto.
+
+  Lo stato è di un solo thread (un worker del server): nessuna sincronizzazione. Tempi in nanosecondi.
+*/
+#ifndef AMMISSIONE_G35_H
+#define AMMISSIONE_G35_H
+
+#include <stdint.h>
+
+#define OBIETTIVO_CODEL_MS 5                /* ritardo di coda accettabile (default dell'opzione del server) */
+#define INTERVALLO_CODEL_MS 100             /* finestra in cui il ritardo deve scendere sotto l'obiettivo */
+
+typedef struct
+{
+    uint64_t obiettivo, intervallo;
+    uint64_t primo_sopra;                   /* istante in cui il ritardo sarà sopra l'obiettivo da un intervallo (0 = sotto) */
+    uint64_t prossimo_scarto;               /* nello stato di scarto: istante del prossimo rifiuto */
+    uint32_t conteggio;                     /* rifiuti dall'inizio dello stato di scarto */
+    int scartando;
+} ControlloCoDel;
+
+static inline void InizializzaCoDel(ControlloCoDel *codel, uint64_t obiettivo, uint64_t intervallo)
+{
+    codel->obiettivo = obiettivo;
+    codel->intervallo = intervallo;
+    codel->primo_sopra = codel->prossimo_scarto = 0;
+    codel->conteggio = 0;
+    codel->scartando = 0;
+}
+
+/* Radice quadrata intera per difetto (evita di collegare libm) */
+static inline uint32_t RadiceIntera(uint32_t n)
+{
+    uint32_t radice = 0, bit = 1u << 30;
+    while (bit > n) bit >>= 2;
+    while (bit != 0)
+    {
+        if (n >= radice + bit)
+        {
+            n -= radice + bit;
+            radice = (radice >> 1) + bit;
+        }
+        else radice >>= 1;
+        bit >>= 2;
+    }
+    return radice;
+}
+
+/* Istante del prossimo rifiuto: gli scarti si infittiscono con la radice del conteggio */
+static inline uint64_t LeggeControlloCoDel(const ControlloCoDel *codel, uint64_t istante)
+{
+    return istante + codel->intervallo / RadiceIntera(codel->conteggio);
+}
+
+/* 1 se il lavoro prelevato all'istante 'ora', dopo 'ritardo' in coda, va rifiutato */
+static inline int CoDelScarta(ControlloCoDel *codel, uint64_t ritardo, uint64_t ora)
+{
+    int sopra = 0;
+
+    if (ritardo < codel->obiettivo) codel->primo_sopra = 0;
+    else if (codel->primo_sopra == 0) codel->primo_sopra = ora + codel->intervallo;
+    else sopra = (ora >= codel->primo_sopra);
+
+    if (codel->scartando)
+    {
+        if (!sopra)
+        {
+            codel->scartando = 0;
+            return 0;
+        }
+        if (ora < codel->prossimo_scarto) return 0;
+        codel->conteggio++;
+        codel->prossimo_scarto = LeggeControlloCoDel(codel, codel->prossimo_scarto);
+        return 1;
+    }
+    if (!sopra) return 0;
+
+    codel->scartando = 1;
+    codel->conteggio = (codel->conteggio > 2 && ora - codel->prossimo_scarto < 16 * codel->intervallo) ? codel->conteggio - 2 : 1;
+    codel->prossimo_scarto = LeggeControlloCoDel(codel, ora);
+    return 1;
+}
+
+#endif /* AMMISSIONE_G35_H */
@@ -0,0 +1,309 @@
+/*
+  Trasporto a memoria condivisa fra il server TCP e i client sulla stessa macchina (solo Linux).
+
+  Il client crea una regione di memoria (memfd_create()) con due code circolari a un solo produttore e un solo
+  consumatore: le richieste, scritte dal client e lette dal server, e le risposte, nel verso opposto. Ogni posizione di
+  una coda contiene un messaggio binario di protocollo_g35.h (intestazione e carico utile) preceduto dalla lunghezza.
+  ApriAnelloClient() passa il descrittore della regione al server su una connessione AF_UNIX (SCM_RIGHTS), che resta
+  aperta finché l'anello è in uso: la sua chiusura dice all'altro lato che il processo è terminato. Dopo l'apertura
+  richieste e risposte non passano dal kernel: il produttore scrive il messaggio nella posizione e pubblica la nuova
+  testa con uno store release, il consumatore la legge con un load acquire.
+
+  Attesa (AttendiMessaggio()): il consumatore che trova la coda vuota la ricontrolla per 'giri' volte (attesa attiva:
+  latenza minima al prezzo di un core occupato), poi dorme su un futex nella regione condivisa. Il futex è un
+  contatore di eventi: il consumatore ne legge il valore, segnala che sta per dormire e ricontrolla la coda; il
+  produttore, dopo aver pubblicato, incrementa il contatore e chiama FUTEX_WAKE solo se il consumatore dorme. Le due
+  barriere seq_cst garantiscono che almeno uno dei due veda l'altro, e se il contatore cambia prima della FUTEX_WAIT
+  il kernel non addormenta il consumatore. Un'attesa dura al massimo ATTESA_ANELLO_MS: poi il chiamante controlla la
+  connessione AF_UNIX (AltroLatoChiuso()) e riprende.
+
+  Controllo di flusso: il client non ha mai più di POSIZIONI_ANELLO richieste senza una risposta già letta, quindi
+  nessuna delle due code si riempie. Il server non si fida della regione: la vuole sigillata contro i cambi di
+  dimensione, limita indici e lunghezze, copia ogni richiesta prima di elaborarla (il client potrebbe ancora
+  modificarla) e chiude l'anello se la coda delle risposte è piena.
+
+  Esempio:
+    AnelloClient *client = ApriAnelloClient("/tmp/calcolatrice.anello", 0);
+    int32_t risultato;
+    if (CalcolaAnello(client, 'M', 6, 7, &risultato) == ESITO_OK) printf("%d\n", risultato);
+    ChiudiAnelloClient(client);
+
+  Il file contiene solo funzioni static inline, come gli altri file di comune/.
+*/
+#ifndef ANELLO_CONDIVISO_G35_H
+#define ANELLO_CONDIVISO_G35_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "protocollo_g35.h"
+
+#define MAGIC_ANELLO 0x414E4C31u            /* "ANL1": formato della regione */
+#define POSIZIONI_ANELLO 64                 /* messaggi per coda (potenza di 2) */
+#define DIM_POSIZIONE_ANELLO 4096           /* byte di una posizione, lunghezza compresa */
+#define MAX_MESSAGGIO_ANELLO (DIM_POSIZIONE_ANELLO - 4)
+#define MAX_COPPIE_ANELLO ((MAX_MESSAGGIO_ANELLO - DIM_INTESTAZIONE - 4) / 8)   /* coppie massime di un batch */
+#define ATTESA_ANELLO_MS 200                /* durata massima di un'attesa sul futex */
+#define TIMEOUT_APERTURA_ANELLO 5           /* secondi per la conferma del server all'apertura */
+#define ESITO_ANELLO_CHIUSO (-1)            /* esito locale: il server ha chiuso l'anello o non ha risposto */
+
+#if defined (__x86_64__) || defined (__i386__)
+#define PAUSA_ANELLO() __builtin_ia32_pause()    /* attesa attiva: cede le risorse del core all'altro thread SMT */
+#else
+#define PAUSA_ANELLO() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+typedef struct
+{
+    uint32_t lunghezza;
+    unsigned char dati[MAX_MESSAGGIO_ANELLO];
+} PosizioneAnello;
+
+/* Una coda: testa e coda su linee di cache diverse, così produttore e consumatore non si contendono la stessa */
+typedef struct
+{
+    _Alignas(64) atomic_uint testa;         /* messaggi pubblicati: scritto solo dal produttore */
+    _Alignas(64) atomic_uint coda;          /* messaggi consumati: scritto solo dal consumatore */
+    _Alignas(64) atomic_uint evento;        /* futex: incrementato dal produttore per svegliare il consumatore */
+    atomic_uint in_attesa;                  /* 1 mentre il consumatore dorme (o sta per dormire) sul futex */
+    _Alignas(64) PosizioneAnello posizioni[POSIZIONI_ANELLO];
+} CodaCondivisa;
+
+typedef struct
+{
+    uint32_t magic;                         /* scritti dal client prima di passare la regione */
+    uint32_t dimensione;
+    CodaCondivisa richieste;                /* client -> server */
+    CodaCondivisa risposte;                 /* server -> client */
+} AnelloCondiviso;
+
+/* Lato client: un anello per thread, usato da un thread alla volta */
+typedef struct
+{
+    AnelloCondiviso *anello;
+    int sock;                               /* connessione AF_UNIX con il server, aperta quanto l'anello */
+    int giri;                               /* giri di attesa attiva prima di dormire sul futex */
+    uint32_t prossimo_id;
+} AnelloClient;
+
+static inline long FutexAnello(atomic_uint *parola, int operazione, uint32_t valore, const struct timespec *timeout)
+{
+    /* Senza FUTEX_PRIVATE_FLAG: la parola è condivisa fra processi */
+    return syscall(SYS_futex, (uint32_t *)parola, operazione, valore, timeout, NULL, 0);
+}
+
+/* Messaggi pubblicati e non ancora consumati (oltre POSIZIONI_ANELLO se l'altro lato ha scritto indici incoerenti) */
+static inline uint32_t MessaggiInCoda(CodaCondivisa *coda)
+{
+    return atomic_load_explicit(&coda->testa, memory_order_acquire) - atomic_load_explicit(&coda->coda, memory_order_relaxed);
+}
+
+/*
+  Consumatore: primo messaggio della coda, NULL se è vuota. Il messaggio resta nella posizione fino a ConsumaMessaggio().
+  Con indici incoerenti *lunghezza vale UINT32_MAX, cioè un messaggio troppo lungo per qualsiasi controllo.
+*/
+static inline const unsigned char *ProssimoMessaggio(CodaCondivisa *coda, uint32_t *lunghezza)
+{
+    uint32_t presenti = MessaggiInCoda(coda);
+    PosizioneAnello *posizione = &coda->posizioni[atomic_load_explicit(&coda->coda, memory_order_relaxed) & (POSIZIONI_ANELLO - 1)];
+    if (presenti == 0) return NULL;
+    *lunghezza = presenti > POSIZIONI_ANELLO ? UINT32_MAX : posizione->lunghezza;
+    return posizione->dati;
+}
+
+/* Consumatore: libera la posizione del primo messaggio */
+static inline void ConsumaMessaggio(CodaCondivisa *coda)
+{
+    atomic_store_explicit(&coda->coda, atomic_load_explicit(&coda->coda, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/* Produttore: posizione in cui scrivere il prossimo messaggio (MAX_MESSAGGIO_ANELLO byte), NULL se la coda è piena */
+static inline unsigned char *SpazioMessaggio(CodaCondivisa *coda)
+{
+    uint32_t testa = atomic_load_explicit(&coda->testa, memory_order_relaxed);
+    if (testa - atomic_load_explicit(&coda->coda, memory_order_acquire) >= POSIZIONI_ANELLO) return NULL;
+    return coda->posizioni[testa & (POSIZIONI_ANELLO - 1)].dati;
+}
+
+/* Produttore: pubblica il messaggio scritto in SpazioMessaggio(). Restituisce 1 se ha svegliato il consumatore. */
+static inline int PubblicaMessaggio(CodaCondivisa *coda, uint32_t lunghezza)
+{
+    uint32_t testa = atomic_load_explicit(&coda->testa, memory_order_relaxed);
+    coda->posizioni[testa & (POSIZIONI_ANELLO - 1)].lunghezza = lunghezza;
+    atomic_store_explicit(&coda->testa, testa + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&coda->in_attesa, memory_order_relaxed)) return 0;
+    atomic_fetch_add_explicit(&coda->evento, 1, memory_order_release);
+    FutexAnello(&coda->evento, FUTEX_WAKE, 1, NULL);
+    return 1;
+}
+
+/*
+  Consumatore: attende un messaggio, prima con 'giri' controlli attivi e poi sul futex per al massimo ATTESA_ANELLO_MS.
+  Restituisce 1 se la coda contiene un messaggio, 0 se l'attesa è scaduta. Le chiamate al futex si sommano a *chiamate.
+*/
+static inline int AttendiMessaggio(CodaCondivisa *coda, int giri, uint64_t *chiamate)
+{
+    struct timespec limite = { ATTESA_ANELLO_MS / 1000, (ATTESA_ANELLO_MS % 1000) * 1000000L };
+    uint32_t evento;
+    int i;
+
+    for (i = 0; i < giri; i++)
+    {
+        if (MessaggiInCoda(coda) != 0) return 1;
+        PAUSA_ANELLO();
+    }
+    evento = atomic_load_explicit(&coda->evento, memory_order_acquire);
+    atomic_store_explicit(&coda->in_attesa, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (MessaggiInCoda(coda) == 0)
+    {
+        FutexAnello(&coda->evento, FUTEX_WAIT, evento, &limite);
+        (*chiamate)++;
+    }
+    atomic_store_explicit(&coda->in_attesa, 0, memory_order_relaxed);
+    return MessaggiInCoda(coda) != 0;
+}
+
+/* 1 se l'altro lato ha chiuso la connessione AF_UNIX: dopo l'apertura nessuno vi scrive, quindi POLLIN è la chiusura */
+static inline int AltroLatoChiuso(int sock)
+{
+    struct pollfd controllo = { sock, POLLIN, 0 };
+    return poll(&controllo, 1, 0) != 0;
+}
+
+/* Indirizzo AF_UNIX di 'percorso'; -1 se il percorso è troppo lungo */
+static inline int IndirizzoLocale(const char *percorso, struct sockaddr_un *indirizzo)
+{
+    memset(indirizzo, 0, sizeof(*indirizzo));
+    indirizzo->sun_family = AF_UNIX;
+    if (strlen(percorso) >= sizeof(indirizzo->sun_path)) return -1;
+    strcpy(indirizzo->sun_path, percorso);
+    return 0;
+}
+
+/*
+  Crea la regione, la sigilla contro i cambi di dimensione e la passa al server in ascolto su 'percorso' (opzione -M del
+  server); 'giri' sono i controlli attivi prima di dormire in attesa di una risposta (0 = subito sul futex).
+  Restituisce NULL se la regione non si crea o il server non la accetta entro TIMEOUT_APERTURA_ANELLO secondi.
+*/
+static inline AnelloClient *ApriAnelloClient(const char *percorso, int giri)
+{
+    struct timeval timeout = { TIMEOUT_APERTURA_ANELLO, 0 };
+    struct sockaddr_un indirizzo;
+    AnelloClient *client;
+    char controllo[CMSG_SPACE(sizeof(int))], conferma = ESITO_OK;
+    struct iovec parte = { &conferma, 1 };
+    struct msghdr messaggio;
+    struct cmsghdr *descrittore;
+    int regione;
+
+    if (IndirizzoLocale(percorso, &indirizzo) < 0 || (client = calloc(1, sizeof(AnelloClient))) == NULL) return NULL;
+    client->giri = giri;
+    client->sock = -1;
+    client->anello = MAP_FAILED;
+    if ((regione = memfd_create("anello_calcolatrice", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0) goto errore;
+    if (ftruncate(regione, sizeof(AnelloCondiviso)) < 0
+        || fcntl(regione, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0
+        || (client->anello = mmap(NULL, sizeof(AnelloCondiviso), PROT_READ | PROT_WRITE, MAP_SHARED, regione, 0)) == MAP_FAILED) goto errore;
+    client->anello->magic = MAGIC_ANELLO;           /* la regione è già azzerata: indici e futex partono da 0 */
+    client->anello->dimensione = sizeof(AnelloCondiviso);
+
+    if ((client->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+        || setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0
+        || connect(client->sock, (struct sockaddr *)&indirizzo, sizeof(indirizzo)) < 0) goto errore;
+
+    memset(&messaggio, 0, sizeof(messaggio));
+    memset(controllo, 0, sizeof(controllo));
+    messaggio.msg_iov = &parte;
+    messaggio.msg_iovlen = 1;
+    messaggio.msg_control = controllo;
+    messaggio.msg_controllen = sizeof(controllo);
+    descrittore = CMSG_FIRSTHDR(&messaggio);
+    descrittore->cmsg_level = SOL_SOCKET;
+    descrittore->cmsg_type = SCM_RIGHTS;
+    descrittore->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(descrittore), &regione, sizeof(int));
+    if (sendmsg(client->sock, &messaggio, MSG_NOSIGNAL) != 1 || recv(client->sock, &conferma, 1, 0) != 1 || conferma != ESITO_OK) goto errore;
+    close(regione);         /* la regione resta in vita finché è mappata */
+    return client;
+
+errore:
+    if (regione >= 0) close(regione);
+    if (client->sock >= 0) close(client->sock);
+    if (client->anello != MAP_FAILED) munmap(client->anello, sizeof(AnelloCondiviso));
+    free(client);
+    return NULL;
+}
+
+/*
+  Invia il messaggio 'richiesta' di 'lunghezza' byte e attende la risposta, che copia in 'risposta' (al massimo 'max'
+  byte). Restituisce la lunghezza della risposta, oppure ESITO_ANELLO_CHIUSO se il server ha chiuso l'anello o la
+  risposta non sta in 'risposta'.
+*/
+static inline int ScambiaAnello(AnelloClient *client, const unsigned char *richiesta, int lunghezza, unsigned char *risposta, int max)
+{
+    unsigned char *posizione = SpazioMessaggio(&client->anello->richieste);
+    const unsigned char *messaggio;
+    uint32_t ricevuti;
+    uint64_t chiamate = 0;
+
+    if (posizione == NULL || lunghezza < 0 || lunghezza > MAX_MESSAGGIO_ANELLO) return ESITO_ANELLO_CHIUSO;
+    memcpy(posizione, richiesta, lunghezza);
+    PubblicaMessaggio(&client->anello->richieste, (uint32_t)lunghezza);
+
+    while ((messaggio = ProssimoMessaggio(&client->anello->risposte, &ricevuti)) == NULL)
+    {
+        if (!AttendiMessaggio(&client->anello->risposte, client->giri, &chiamate) && AltroLatoChiuso(client->sock)) return ESITO_ANELLO_CHIUSO;
+    }
+    if (ricevuti > (uint32_t)max) return ESITO_ANELLO_CHIUSO;
+    memcpy(risposta, messaggio, ricevuti);
+    ConsumaMessaggio(&client->anello->risposte);
+    return (int)ricevuti;
+}
+
+/* Operazione singola sull'anello: restituisce l'esito del server (ESITO_*) oppure ESITO_ANELLO_CHIUSO */
+static inline int CalcolaAnello(AnelloClient *client, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    unsigned char richiesta[DIM_INTESTAZIONE + 8], risposta[DIM_INTESTAZIONE + 4];
+    uint32_t valori[2] = { htonl((uint32_t)a), htonl((uint32_t)b) }, net_result;
+    uint32_t id = client->prossimo_id++;
+    Intestazione intestazione;
+    int n;
+
+    ScriviIntestazione(richiesta, (uint8_t)op, 0, sizeof(valori), id);
+    memcpy(richiesta + DIM_INTESTAZIONE, valori, sizeof(valori));
+    if ((n = ScambiaAnello(client, richiesta, sizeof(richiesta), risposta, sizeof(risposta))) < 0) return ESITO_ANELLO_CHIUSO;
+    if (!LeggiIntestazione(risposta, n, &intestazione) || intestazione.id != id) return ESITO_ANELLO_CHIUSO;
+    if (intestazione.flag_esito == ESITO_OK || intestazione.flag_esito == ESITO_DIVISIONE_PER_ZERO)
+    {
+        if (n != DIM_INTESTAZIONE + 4) return ESITO_ANELLO_CHIUSO;
+        memcpy(&net_result, risposta + DIM_INTESTAZIONE, sizeof(net_result));
+        *risultato = (int32_t)ntohl(net_result);
+    }
+    return intestazione.flag_esito;
+}
+
+/* Chiude la connessione (il server libera l'anello) e la regione */
+static inline void ChiudiAnelloClient(AnelloClient *client)
+{
+    if (client == NULL) return;
+    close(client->sock);
+    munmap(client->anello, sizeof(AnelloCondiviso));
+    free(client);
+}
+
+#endif /* ANELLO_CONDIVISO_G35_H */
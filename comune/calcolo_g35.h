@@ -0,0 +1,189 @@
+/*
+  Calcolo delle operazioni della calcolatrice, condiviso dai server TCP e UDP.
+
+  Semantica, identica per l'operazione singola e per il batch (scalare o SIMD):
+  - A, S, M: aritmetica intera a 32 bit in complemento a due, con wrap-around in caso di overflow;
+  - D: divisione intera troncata verso zero; divisore 0 -> risultato 0; INT32_MIN / -1 -> INT32_MIN (wrap-around).
+
+  Il file contiene solo funzioni static inline: basta includerlo nel sorgente che lo usa, senza compilare altri file,
+  e le funzioni non usate non producono avvisi.
+*/
+#ifndef CALCOLO_G35_H
+#define CALCOLO_G35_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined (_WIN32)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+/* Kernel SIMD solo su x86 con GCC/Clang: la scelta fra AVX2, SSE4.1 e codice scalare avviene a runtime */
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define CALCOLO_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#define OP_BATCH 'B'                /* Carattere operazione che introduce una richiesta batch */
+#define BATCH_STRING "BATCH"        /* Risposta del server alla richiesta batch */
+#define DIM_INTESTAZIONE_BATCH 8    /* Operazione (1 byte) + 3 byte riservati + numero di coppie (uint32_t) */
+
+/*
+  Richiesta batch:  [operazione][0][0][0][n (uint32_t)][a0 b0 a1 b1 ... (n coppie di uint32_t)]
+  Risposta batch:   [n (uint32_t)][r0 r1 ... (n uint32_t)]
+  Tutti gli interi sono in network order. Se l'operazione non è valida o n è fuori dai limiti del server,
+  la risposta contiene n = 0 e nessun risultato.
+*/
+
+/* 1 se il carattere corrisponde a una delle quattro operazioni */
+static inline int OperazioneValida(char op)
+{
+    switch (op)
+    {
+        case 'A': case 'a': case 'S': case 's':
+        case 'M': case 'm': case 'D': case 'd':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Operazione singola su operandi in host order, con la semantica descritta sopra */
+static inline int32_t CalcolaScalare(char op, int32_t op1, int32_t op2)
+{
+    switch (op)
+    {
+        case 'A': case 'a': return (int32_t)((uint32_t)op1 + (uint32_t)op2);
+        case 'S': case 's': return (int32_t)((uint32_t)op1 - (uint32_t)op2);
+        case 'M': case 'm': return (int32_t)((uint32_t)op1 * (uint32_t)op2);
+        case 'D': case 'd':
+            if (op2 == 0) return 0;
+            if (op2 == -1) return (int32_t)(0u - (uint32_t)op1);   /* evita la trap di INT32_MIN / -1 */
+            return op1 / op2;
+        default:
+            return 0;
+    }
+}
+
+/* Versione scalare del batch, usata anche per gli elementi che avanzano dai blocchi SIMD */
+static inline uint32_t CalcolaBatchScalare(char op, const unsigned char *coppie, unsigned char *risultati, uint32_t da, uint32_t n)
+{
+    uint32_t i, zeri = 0;
+    uint32_t operandi[2], net_result;
+
+    for (i = da; i < n; i++)
+    {
+        memcpy(operandi, coppie + (size_t)i * 8, sizeof(operandi));   /* i buffer di rete non sono necessariamente allineati */
+        int32_t op1 = (int32_t)ntohl(operandi[0]);
+        int32_t op2 = (int32_t)ntohl(operandi[1]);
+        if (op2 == 0 && (op == 'D' || op == 'd')) zeri++;
+        net_result = htonl((uint32_t)CalcolaScalare(op, op1, op2));
+        memcpy(risultati + (size_t)i * 4, &net_result, sizeof(net_result));
+    }
+    return zeri;
+}
+
+#if defined (CALCOLO_SIMD_X86)
+/*
+  AVX2: 8 coppie per iterazione. Le coppie arrivano interlacciate (a0 b0 a1 b1 ...) e in network order:
+  si invertono i byte con un shuffle, si separano gli a dai b, si calcola e si riconverte il risultato.
+  La divisione passa per i double (esatta per interi a 32 bit); dove il divisore è 0 il risultato viene azzerato,
+  mentre INT32_MIN / -1 produce già INT32_MIN (valore "indefinito" della conversione).
+*/
+__attribute__((target("avx2")))
+static inline uint32_t CalcolaBatchAVX2(char op, const unsigned char *coppie, unsigned char *risultati, uint32_t n)
+{
+    const __m256i inverti = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i, zeri = 0;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256i v0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(coppie + (size_t)i * 8)), inverti);
+        __m256i v1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(coppie + (size_t)i * 8 + 32)), inverti);
+
+        /* [a0 b0 a1 b1 | a2 b2 a3 b3] e [a4 b4 a5 b5 | a6 b6 a7 b7] -> [a0 .. a7] e [b0 .. b7] */
+        __m256 f0 = _mm256_castsi256_ps(v0), f1 = _mm256_castsi256_ps(v1);
+        __m256i a = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i b = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i r;
+
+        switch (op)
+        {
+            case 'A': case 'a': r = _mm256_add_epi32(a, b); break;
+            case 'S': case 's': r = _mm256_sub_epi32(a, b); break;
+            case 'M': case 'm': r = _mm256_mullo_epi32(a, b); break;
+            default:
+            {
+                __m256i divisore_zero = _mm256_cmpeq_epi32(b, zero);
+                __m128i q_basso = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)),
+                                                                    _mm256_cvtepi32_pd(_mm256_castsi256_si128(b))));
+                __m128i q_alto = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)),
+                                                                   _mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1))));
+                r = _mm256_inserti128_si256(_mm256_castsi128_si256(q_basso), q_alto, 1);
+                r = _mm256_andnot_si256(divisore_zero, r);
+                zeri += (uint32_t)__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(divisore_zero)));
+                break;
+            }
+        }
+        _mm256_storeu_si256((__m256i *)(risultati + (size_t)i * 4), _mm256_shuffle_epi8(r, inverti));
+    }
+    return zeri + CalcolaBatchScalare(op, coppie, risultati, i, n);
+}
+
+/* SSE4.1: stesso schema su 4 coppie per iterazione */
+__attribute__((target("sse4.1")))
+static inline uint32_t CalcolaBatchSSE41(char op, const unsigned char *coppie, unsigned char *risultati, uint32_t n)
+{
+    const __m128i inverti = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i, zeri = 0;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128 f0 = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(coppie + (size_t)i * 8)), inverti));
+        __m128 f1 = _mm_castsi128_ps(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(coppie + (size_t)i * 8 + 16)), inverti));
+        __m128i a = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i b = _mm_castps_si128(_mm_shuffle_ps(f0, f1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i r;
+
+        switch (op)
+        {
+            case 'A': case 'a': r = _mm_add_epi32(a, b); break;
+            case 'S': case 's': r = _mm_sub_epi32(a, b); break;
+            case 'M': case 'm': r = _mm_mullo_epi32(a, b); break;
+            default:
+            {
+                __m128i divisore_zero = _mm_cmpeq_epi32(b, zero);
+                __m128i q_basso = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b)));
+                __m128i q_alto = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(a, 8)), _mm_cvtepi32_pd(_mm_srli_si128(b, 8))));
+                r = _mm_unpacklo_epi64(q_basso, q_alto);
+                r = _mm_andnot_si128(divisore_zero, r);
+                zeri += (uint32_t)__builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(divisore_zero)));
+                break;
+            }
+        }
+        _mm_storeu_si128((__m128i *)(risultati + (size_t)i * 4), _mm_shuffle_epi8(r, inverti));
+    }
+    return zeri + CalcolaBatchScalare(op, coppie, risultati, i, n);
+}
+#endif
+
+/*
+  Calcola l'operazione 'op' su n coppie di operandi interlacciate e in network order ('coppie', 8 * n byte)
+  e scrive gli n risultati in network order in 'risultati' (4 * n byte, area distinta da 'coppie').
+  Restituisce quante coppie avevano divisore 0 (significativo solo per la divisione).
+*/
+static inline uint32_t CalcolaBatch(char op, const void *coppie, void *risultati, uint32_t n)
+{
+#if defined (CALCOLO_SIMD_X86)
+    if (__builtin_cpu_supports("avx2")) return CalcolaBatchAVX2(op, coppie, risultati, n);
+    if (__builtin_cpu_supports("sse4.1")) return CalcolaBatchSSE41(op, coppie, risultati, n);
+#endif
+    return CalcolaBatchScalare(op, coppie, risultati, 0, n);
+}
+
+#endif /* CALCOLO_G35_H */
@@ -0,0 +1,259 @@
+/*
+  Cattura del traffico dei server: ogni richiesta ricevuta finisce in un registro binario compatto, da riprodurre poi
+  con strumenti/riproduci_g35.c per ripetere un carico reale in modo deterministico.
+
+  Il file inizia con una testa di DIM_TESTA_CATTURA byte (TestaCattura) seguita da blocchi di DIM_BLOCCO_CATTURA byte.
+  Ogni thread che cattura possiede un blocco alla volta, mappato in memoria (mmap MAP_SHARED): registrare una richiesta
+  è una copia nella mappa, senza lock e senza chiamate di sistema. Solo quando il blocco è pieno il thread ne riserva
+  un altro in fondo al file (sotto un mutex, con ftruncate()) e lo mappa già popolato (MAP_POPULATE), così nemmeno i
+  page fault cadono sul percorso delle richieste. Le pagine scritte arrivano al file dalla cache del kernel: anche se
+  il server termina all'improvviso le richieste registrate restano.
+
+  Un blocco contiene record consecutivi, allineati a 8 byte: un RecordCattura seguito dal messaggio. Il messaggio è
+  sempre nel formato di protocollo_g35.h (intestazione e carico utile), anche per le richieste del vecchio protocollo:
+  un'operazione singola diventa un messaggio con due operandi, un batch un messaggio FLAG_BATCH; il campo 'formato' dice
+  da dove veniva. La lunghezza si scrive per ultima: un record con lunghezza 0 segna la fine dei record del blocco
+  (il resto del blocco è a zero, come l'ha lasciato ftruncate()). Un messaggio che non sta in un blocco si conta fra i
+  persi. I campi di testa e record sono nell'ordine dei byte della macchina che ha catturato.
+
+  I blocchi dei thread si alternano nel file: i record non sono in ordine di tempo fra un blocco e l'altro, chi legge
+  li ordina per 'istante' (ns dall'apertura, CLOCK_MONOTONIC).
+
+  L'origine (trasporto, indirizzo e porta del client) è uno stato del thread: il server la imposta con
+  OrigineCattura() quando inizia a servire un client e le funzioni di cattura la ricopiano nei record.
+
+  Solo Linux: altrove AvviaCattura() fallisce e le altre funzioni non fanno niente. Come gli altri file di comune/,
+  contiene solo funzioni static inline.
+*/
+#ifndef CATTURA_G35_H
+#define CATTURA_G35_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "protocollo_g35.h"
+
+#if defined (__linux__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define CATTURA_LOCALE_THREAD _Thread_local
+#else
+#define CATTURA_LOCALE_THREAD
+#endif
+
+#define MAGIC_CATTURA "G35CATT1"
+#define VERSIONE_CATTURA 1
+#define DIM_TESTA_CATTURA 4096              /* byte della testa del file (una pagina) */
+#define DIM_BLOCCO_CATTURA (4 << 20)        /* byte di un blocco: multiplo della pagina */
+
+/* Trasporto della richiesta catturata */
+enum { TRASPORTO_TCP, TRASPORTO_UDP, TRASPORTO_LOCALE };
+
+/* Protocollo con cui la richiesta è arrivata al server */
+enum { FORMATO_SINGOLA, FORMATO_SESSIONE, FORMATO_BATCH, FORMATO_BINARIO };
+
+typedef struct
+{
+    char magic[8];                          /* MAGIC_CATTURA */
+    uint32_t versione;
+    uint32_t dim_blocco;
+    uint64_t inizio_reale;                  /* CLOCK_REALTIME all'apertura, in ns */
+    uint64_t inizio;                        /* CLOCK_MONOTONIC all'apertura, in ns: l'istante 0 dei record */
+} TestaCattura;
+
+typedef struct
+{
+    uint32_t lunghezza;                     /* byte del messaggio che segue (0 = fine dei record del blocco) */
+    uint32_t indirizzo;                     /* IPv4 del client in network order (0 per le connessioni locali) */
+    uint64_t istante;                       /* ns dall'apertura del file */
+    uint16_t porta;                         /* porta del client in network order */
+    uint8_t trasporto;                      /* TRASPORTO_* */
+    uint8_t formato;                        /* FORMATO_* */
+    uint32_t riservato;
+} RecordCattura;
+
+/* Byte occupati da un record con un messaggio di 'lunghezza' byte */
+static inline size_t DimensioneRecordCattura(uint32_t lunghezza)
+{
+    return (sizeof(RecordCattura) + (size_t)lunghezza + 7) & ~(size_t)7;
+}
+
+#if defined (__linux__)
+
+typedef struct
+{
+    int fd;
+    uint64_t inizio;                        /* CLOCK_MONOTONIC all'apertura */
+    pthread_mutex_t blocchi;                /* solo per riservare un blocco */
+    uint64_t fine_file;
+    atomic_ulong registrate, perse;
+} Cattura;
+
+static Cattura *cattura_attiva;             /* impostata prima di creare i thread, poi solo letta */
+static CATTURA_LOCALE_THREAD unsigned char *blocco_cattura;
+static CATTURA_LOCALE_THREAD size_t usati_cattura;
+static CATTURA_LOCALE_THREAD RecordCattura origine_cattura;
+
+static inline uint64_t OraCattura(clockid_t orologio)
+{
+    struct timespec ts;
+    clock_gettime(orologio, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+  Crea (o tronca) il file di cattura e attiva la cattura per tutti i thread. Va chiamata dal thread principale prima
+  di creare gli altri thread. Restituisce 0, o -1 se il file non si può creare.
+*/
+static inline int AvviaCattura(const char *percorso)
+{
+    TestaCattura testa;
+    Cattura *cattura = calloc(1, sizeof(Cattura));
+    if (cattura == NULL) return -1;
+
+    cattura->fd = open(percorso, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (cattura->fd < 0)
+    {
+        free(cattura);
+        return -1;
+    }
+    memset(&testa, 0, sizeof(testa));
+    memcpy(testa.magic, MAGIC_CATTURA, sizeof(testa.magic));
+    testa.versione = VERSIONE_CATTURA;
+    testa.dim_blocco = DIM_BLOCCO_CATTURA;
+    testa.inizio_reale = OraCattura(CLOCK_REALTIME);
+    testa.inizio = cattura->inizio = OraCattura(CLOCK_MONOTONIC);
+    if (ftruncate(cattura->fd, DIM_TESTA_CATTURA) != 0 || pwrite(cattura->fd, &testa, sizeof(testa), 0) != (ssize_t)sizeof(testa))
+    {
+        close(cattura->fd);
+        free(cattura);
+        return -1;
+    }
+    cattura->fine_file = DIM_TESTA_CATTURA;
+    pthread_mutex_init(&cattura->blocchi, NULL);
+    cattura_attiva = cattura;
+    return 0;
+}
+
+static inline int CatturaAttiva(void)
+{
+    return cattura_attiva != NULL;
+}
+
+/* Origine delle prossime richieste catturate dal thread; 'indirizzo' e 'porta' in network order */
+static inline void OrigineCattura(uint8_t trasporto, uint32_t indirizzo, uint16_t porta)
+{
+    if (cattura_attiva == NULL) return;
+    origine_cattura.trasporto = trasporto;
+    origine_cattura.indirizzo = indirizzo;
+    origine_cattura.porta = porta;
+}
+
+/* Cambia il blocco del thread: percorso raro, l'unico con lock e chiamate di sistema. 0 se non c'è spazio. */
+static inline int NuovoBloccoCattura(Cattura *cattura)
+{
+    uint64_t posizione;
+    void *mappa;
+
+    if (blocco_cattura != NULL) munmap(blocco_cattura, DIM_BLOCCO_CATTURA);
+    blocco_cattura = NULL;
+    pthread_mutex_lock(&cattura->blocchi);
+    posizione = cattura->fine_file;
+    if (ftruncate(cattura->fd, (off_t)(posizione + DIM_BLOCCO_CATTURA)) == 0) cattura->fine_file += DIM_BLOCCO_CATTURA;
+    else posizione = 0;
+    pthread_mutex_unlock(&cattura->blocchi);
+    if (posizione == 0) return 0;
+
+    mappa = mmap(NULL, DIM_BLOCCO_CATTURA, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, cattura->fd, (off_t)posizione);
+    if (mappa == MAP_FAILED) return 0;
+    blocco_cattura = mappa;
+    usati_cattura = 0;
+    return 1;
+}
+
+/* Registra un messaggio composto da due parti consecutive (la seconda può mancare) */
+static inline void CatturaParti(uint8_t formato, const void *parte1, uint32_t lunghezza1, const void *parte2, uint32_t lunghezza2)
+{
+    Cattura *cattura = cattura_attiva;
+    uint32_t lunghezza = lunghezza1 + lunghezza2;
+    size_t dimensione = DimensioneRecordCattura(lunghezza);
+    RecordCattura *record;
+
+    if (cattura == NULL) return;
+    /* Serve sempre spazio anche per la lunghezza 0 che chiude il blocco */
+    if (dimensione + sizeof(uint32_t) > DIM_BLOCCO_CATTURA)
+    {
+        atomic_fetch_add_explicit(&cattura->perse, 1, memory_order_relaxed);
+        return;
+    }
+    if ((blocco_cattura == NULL || usati_cattura + dimensione + sizeof(uint32_t) > DIM_BLOCCO_CATTURA) && !NuovoBloccoCattura(cattura))
+    {
+        atomic_fetch_add_explicit(&cattura->perse, 1, memory_order_relaxed);
+        return;
+    }
+
+    record = (RecordCattura *)(blocco_cattura + usati_cattura);
+    record->indirizzo = origine_cattura.indirizzo;
+    record->istante = OraCattura(CLOCK_MONOTONIC) - cattura->inizio;
+    record->porta = origine_cattura.porta;
+    record->trasporto = origine_cattura.trasporto;
+    record->formato = formato;
+    memcpy(record + 1, parte1, lunghezza1);
+    if (lunghezza2 > 0) memcpy((unsigned char *)(record + 1) + lunghezza1, parte2, lunghezza2);
+    __atomic_store_n(&record->lunghezza, lunghezza, __ATOMIC_RELEASE);
+    usati_cattura += dimensione;
+    atomic_fetch_add_explicit(&cattura->registrate, 1, memory_order_relaxed);
+}
+
+/* Registra un messaggio binario (intestazione e carico utile) */
+static inline void CatturaMessaggio(uint8_t formato, const void *messaggio, uint32_t lunghezza)
+{
+    CatturaParti(formato, messaggio, lunghezza, NULL, 0);
+}
+
+/* Registra un'operazione singola del vecchio protocollo: due operandi consecutivi in network order, anche non allineati */
+static inline void CatturaOperazione(uint8_t formato, char operazione, const void *operandi)
+{
+    unsigned char messaggio[DIM_INTESTAZIONE + 2 * sizeof(uint32_t)];
+    if (cattura_attiva == NULL) return;
+    ScriviIntestazione(messaggio, (uint8_t)operazione, 0, 2 * sizeof(uint32_t), 0);
+    memcpy(messaggio + DIM_INTESTAZIONE, operandi, 2 * sizeof(uint32_t));
+    CatturaParti(formato, messaggio, sizeof(messaggio), NULL, 0);
+}
+
+/* Registra un batch del vecchio protocollo: 'n' coppie consecutive in network order */
+static inline void CatturaBatch(char operazione, uint32_t n, const void *coppie)
+{
+    unsigned char intestazione[DIM_INTESTAZIONE + sizeof(uint32_t)];
+    uint32_t net_n = htonl(n);
+    if (cattura_attiva == NULL) return;
+    ScriviIntestazione(intestazione, (uint8_t)operazione, FLAG_BATCH, sizeof(uint32_t) + n * 2 * sizeof(uint32_t), 0);
+    memcpy(intestazione + DIM_INTESTAZIONE, &net_n, sizeof(net_n));
+    CatturaParti(FORMATO_BATCH, intestazione, sizeof(intestazione), coppie, n * 2 * sizeof(uint32_t));
+}
+
+/* Richieste registrate e perse dall'avvio (0 senza cattura) */
+static inline void StatisticheCattura(uint64_t *registrate, uint64_t *perse)
+{
+    *registrate = cattura_attiva != NULL ? atomic_load_explicit(&cattura_attiva->registrate, memory_order_relaxed) : 0;
+    *perse = cattura_attiva != NULL ? atomic_load_explicit(&cattura_attiva->perse, memory_order_relaxed) : 0;
+}
+
+#else
+
+static inline int AvviaCattura(const char *percorso) { (void)percorso; return -1; }
+static inline int CatturaAttiva(void) { return 0; }
+static inline void OrigineCattura(uint8_t trasporto, uint32_t indirizzo, uint16_t porta) { (void)trasporto; (void)indirizzo; (void)porta; }
+static inline void CatturaMessaggio(uint8_t formato, const void *messaggio, uint32_t lunghezza) { (void)formato; (void)messaggio; (void)lunghezza; }
+static inline void CatturaOperazione(uint8_t formato, char operazione, const void *operandi) { (void)formato; (void)operazione; (void)operandi; }
+static inline void CatturaBatch(char operazione, uint32_t n, const void *coppie) { (void)operazione; (void)n; (void)coppie; }
+static inline void StatisticheCattura(uint64_t *registrate, uint64_t *perse) { *registrate = *perse = 0; }
+
+#endif
+
+#endif /* CATTURA_G35_H */
@@ -0,0 +1,580 @@
+/*
+  Libreria client della calcolatrice per i programmi che usano il server TCP a messaggi binari (protocollo_g35.h), al
+  posto di una copia di consegnaTCP/client-TCP_g35.c.
+
+  Un ClientCalcolatrice risolve il nome del server una volta sola (ApriClient()) e tiene aperto un gruppo di connessioni
+  persistenti, già negoziate. Le richieste non bloccano: InviaCalcolo() e InviaCalcoli() mettono le operazioni in coda e
+  restituiscono subito un FuturoCalcolo per ciascuna. Un thread della libreria assegna le richieste alla connessione con
+  meno richieste in volo, le scrive in pipeline (fino a MAX_IN_VOLO_CONNESSIONE senza risposta per connessione) e legge
+  le risposte, che su ogni connessione arrivano nell'ordine delle richieste. A ogni risposta il futuro diventa pronto:
+
+    - AttendiFuturo() attende il risultato, FuturoPronto() controlla senza bloccare;
+    - la funzione di completamento passata all'invio (se non è NULL) viene chiamata dal thread della libreria prima che
+      il futuro risulti pronto: deve essere breve, non deve bloccarsi e non deve chiamare AttendiFuturo() o
+      ChiudiClient(), ma può inviare nuove richieste e liberare il futuro;
+    - CalcolaSincrono() è l'involucro bloccante: invia, attende e libera.
+
+  Ogni futuro va liberato con LiberaFuturo(), anche prima che sia pronto: in quel caso lo libera la libreria quando
+  arriva la risposta. Una connessione che si chiude o riceve dati non validi completa le sue richieste in volo con
+  ESITO_CONNESSIONE_PERSA e viene riaperta alla richiesta successiva. La riapertura (connessione, saluto e negoziazione)
+  è bloccante per il thread della libreria, con un limite di TIMEOUT_APERTURA_CLIENT secondi.
+
+  Esempio:
+    ClientCalcolatrice *client = ApriClient("localhost", 48000, 4);
+    FuturoCalcolo *futuro = InviaCalcolo(client, 'M', 6, 7, NULL, NULL);
+    int32_t risultato;
+    if (AttendiFuturo(futuro, &risultato) == ESITO_OK) printf("%d\n", risultato);
+    LiberaFuturo(futuro);
+    ChiudiClient(client);
+
+  Solo sistemi POSIX (thread POSIX, poll(), pipe()); si compila con -pthread. Il file contiene solo funzioni static
+  inline, come gli altri file di comune/.
+*/
+#ifndef CLIENT_G35_H
+#define CLIENT_G35_H
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "protocollo_g35.h"
+#include "lettore_g35.h"
+
+#define MAX_CONNESSIONI_CLIENT 64           /* connessioni massime di un client */
+#define MAX_IN_VOLO_CONNESSIONE 256         /* richieste inviate e senza risposta su una connessione */
+#define DIM_RICHIESTA_CLIENT (DIM_INTESTAZIONE + 8)
+#define DIM_INGRESSO_CLIENT 4096            /* buffer di ricezione di una connessione */
+#define TIMEOUT_APERTURA_CLIENT 5           /* secondi per connessione, saluto e negoziazione */
+#define SALUTO_SERVER_CALCOLATRICE "connessione avvenuta"
+#define ESITO_CONNESSIONE_PERSA (-1)        /* esito locale: la richiesta non ha avuto risposta dal server */
+
+#if defined (MSG_NOSIGNAL)
+#define FLAG_INVIO_CLIENT MSG_NOSIGNAL      /* una connessione chiusa dal server non deve terminare il processo */
+#else
+#define FLAG_INVIO_CLIENT 0
+#endif
+
+typedef struct FuturoCalcolo FuturoCalcolo;
+typedef void (*CompletamentoCalcolo)(FuturoCalcolo *futuro, void *contesto);
+
+/* Una richiesta e il suo risultato. I campi si leggono con AttendiFuturo(); nel completamento anche direttamente. */
+struct FuturoCalcolo
+{
+    int32_t a, b;
+    int32_t risultato;
+    int esito;                              /* ESITO_* del server oppure ESITO_CONNESSIONE_PERSA */
+    char operazione;
+    void *contesto;                         /* passato alla funzione di completamento */
+
+    /* Stato interno della libreria */
+    struct ClientCalcolatrice *client;
+    CompletamentoCalcolo completamento;
+    FuturoCalcolo *successivo;              /* coda di invio o coda delle risposte attese di una connessione */
+    pthread_cond_t *attesa;                 /* condizione di un AttendiFuturo() in corso */
+    uint32_t id;
+    int pronto;                             /* protetto dal mutex del client, come 'abbandonato' e 'attesa' */
+    int abbandonato;                        /* liberato prima di essere pronto */
+};
+
+/* Connessione del gruppo: usata solo dal thread della libreria */
+typedef struct
+{
+    int sock;                               /* -1 se chiusa */
+    FuturoCalcolo *testa, *coda;            /* richieste scritte nel buffer di uscita o inviate, in ordine */
+    int in_volo;
+    unsigned char uscita[MAX_IN_VOLO_CONNESSIONE * DIM_RICHIESTA_CLIENT];
+    int inizio_uscita, fine_uscita;         /* byte ancora da inviare: uscita[inizio .. fine) */
+    char ingresso[DIM_INGRESSO_CLIENT];
+    Lettore lettore;
+} ConnessioneClient;
+
+typedef struct ClientCalcolatrice
+{
+    struct sockaddr_in server;              /* indirizzo risolto all'apertura */
+    int num_connessioni;
+    ConnessioneClient *connessioni;
+    FuturoCalcolo *in_sospeso, *ultimo_in_sospeso;   /* thread della libreria: richieste che aspettano posto */
+    unsigned long riaperture;               /* connessioni riaperte dopo una chiusura */
+    struct pollfd *attese;                  /* num_connessioni + 1 descrittori per il poll() del thread */
+    pthread_t thread;
+
+    pthread_mutex_t mutex;                  /* protegge i campi seguenti e lo stato dei futuri */
+    FuturoCalcolo *da_inviare, *ultimo_da_inviare;
+    uint32_t prossimo_id;
+    int risveglio[2];                       /* pipe: un byte sveglia il thread della libreria */
+    int svegliato;                          /* c'è già un byte nella pipe */
+    int chiusura;
+    int terminato;                          /* il thread della libreria è uscito: gli invii falliscono subito */
+} ClientCalcolatrice;
+
+/* Apre una connessione: saluto del server e negoziazione dei messaggi binari, poi la socket diventa non bloccante */
+static inline int ApriConnessioneClient(ClientCalcolatrice *client, ConnessioneClient *conn)
+{
+    struct timeval limite = { TIMEOUT_APERTURA_CLIENT, 0 };
+    unsigned char negoziazione[DIM_INTESTAZIONE];
+    const char *saluto, *risposta;
+    Intestazione intestazione;
+    int attiva = 1;
+
+    conn->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (conn->sock < 0) return -1;
+    setsockopt(conn->sock, IPPROTO_TCP, TCP_NODELAY, &attiva, sizeof(attiva));
+    setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, &limite, sizeof(limite));
+    setsockopt(conn->sock, SOL_SOCKET, SO_SNDTIMEO, &limite, sizeof(limite));
+    InizializzaLettore(&conn->lettore, conn->ingresso, sizeof(conn->ingresso));
+    conn->inizio_uscita = conn->fine_uscita = 0;
+
+    ScriviIntestazione(negoziazione, OP_NEGOZIAZIONE, 0, 0, 0);
+    if (connect(conn->sock, (struct sockaddr *)&client->server, sizeof(client->server)) < 0
+        || (saluto = LeggiLettore(&conn->lettore, conn->sock, sizeof(SALUTO_SERVER_CALCOLATRICE))) == NULL
+        || memcmp(saluto, SALUTO_SERVER_CALCOLATRICE, sizeof(SALUTO_SERVER_CALCOLATRICE)) != 0
+        || send(conn->sock, (char *)negoziazione, DIM_INTESTAZIONE, FLAG_INVIO_CLIENT) != DIM_INTESTAZIONE
+        || (risposta = LeggiLettore(&conn->lettore, conn->sock, DIM_INTESTAZIONE)) == NULL
+        || !LeggiIntestazione((const unsigned char *)risposta, DIM_INTESTAZIONE, &intestazione)
+        || intestazione.flag_esito != ESITO_OK || intestazione.lunghezza != 0
+        || fcntl(conn->sock, F_SETFL, fcntl(conn->sock, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(conn->sock);
+        conn->sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+  Completa il futuro: prima la funzione di completamento, poi il futuro diventa pronto e si sveglia chi lo attende.
+  Un futuro già liberato dal chiamante viene liberato qui.
+*/
+static inline void CompletaFuturo(ClientCalcolatrice *client, FuturoCalcolo *futuro, int esito, int32_t risultato)
+{
+    futuro->esito = esito;
+    futuro->risultato = risultato;
+    futuro->successivo = NULL;
+    if (futuro->completamento != NULL) futuro->completamento(futuro, futuro->contesto);
+
+    pthread_mutex_lock(&client->mutex);
+    futuro->pronto = 1;
+    if (futuro->abbandonato)
+    {
+        pthread_mutex_unlock(&client->mutex);
+        free(futuro);
+        return;
+    }
+    if (futuro->attesa != NULL) pthread_cond_signal(futuro->attesa);
+    pthread_mutex_unlock(&client->mutex);
+}
+
+/* Completa con ESITO_CONNESSIONE_PERSA tutti i futuri della lista */
+static inline void FallisciFuturi(ClientCalcolatrice *client, FuturoCalcolo *futuro)
+{
+    while (futuro != NULL)
+    {
+        FuturoCalcolo *successivo = futuro->successivo;
+        CompletaFuturo(client, futuro, ESITO_CONNESSIONE_PERSA, 0);
+        futuro = successivo;
+    }
+}
+
+/* Chiude la connessione; le richieste in volo non avranno risposta */
+static inline void ChiudiConnessioneClient(ClientCalcolatrice *client, ConnessioneClient *conn)
+{
+    FuturoCalcolo *in_volo = conn->testa;
+    close(conn->sock);
+    conn->sock = -1;
+    conn->testa = conn->coda = NULL;
+    conn->in_volo = 0;
+    FallisciFuturi(client, in_volo);
+}
+
+/* Invia quanto possibile del buffer di uscita senza bloccare; -1 se la connessione va chiusa */
+static inline int SvuotaUscita(ConnessioneClient *conn)
+{
+    while (conn->inizio_uscita < conn->fine_uscita)
+    {
+        int n = send(conn->sock, (char *)conn->uscita + conn->inizio_uscita, conn->fine_uscita - conn->inizio_uscita,
+                     FLAG_INVIO_CLIENT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        conn->inizio_uscita += n;
+    }
+    conn->inizio_uscita = conn->fine_uscita = 0;
+    return 0;
+}
+
+/* Scrive la richiesta nel buffer di uscita della connessione e la accoda alle risposte attese */
+static inline void AccodaRichiesta(ConnessioneClient *conn, FuturoCalcolo *futuro)
+{
+    uint32_t valori[2] = { htonl((uint32_t)futuro->a), htonl((uint32_t)futuro->b) };
+
+    /* Il buffer contiene solo richieste in volo: dopo lo spostamento all'inizio c'è sempre posto */
+    if (conn->fine_uscita + DIM_RICHIESTA_CLIENT > (int)sizeof(conn->uscita))
+    {
+        memmove(conn->uscita, conn->uscita + conn->inizio_uscita, conn->fine_uscita - conn->inizio_uscita);
+        conn->fine_uscita -= conn->inizio_uscita;
+        conn->inizio_uscita = 0;
+    }
+    ScriviIntestazione(conn->uscita + conn->fine_uscita, (uint8_t)futuro->operazione, 0, sizeof(valori), futuro->id);
+    memcpy(conn->uscita + conn->fine_uscita + DIM_INTESTAZIONE, valori, sizeof(valori));
+    conn->fine_uscita += DIM_RICHIESTA_CLIENT;
+
+    futuro->successivo = NULL;
+    if (conn->coda != NULL) conn->coda->successivo = futuro;
+    else conn->testa = futuro;
+    conn->coda = futuro;
+    conn->in_volo++;
+}
+
+/*
+  Assegna le richieste in sospeso alla connessione aperta con meno richieste in volo. Una connessione chiusa si riapre
+  solo se le aperte sono tutte piene; se il server non è raggiungibile la richiesta fallisce. Le richieste che non
+  trovano posto restano in sospeso fino alle prossime risposte.
+*/
+static inline void AssegnaRichieste(ClientCalcolatrice *client)
+{
+    while (client->in_sospeso != NULL)
+    {
+        ConnessioneClient *scelta = NULL, *chiusa = NULL;
+        int i;
+
+        for (i = 0; i < client->num_connessioni; i++)
+        {
+            ConnessioneClient *conn = &client->connessioni[i];
+            if (conn->sock < 0)
+            {
+                if (chiusa == NULL) chiusa = conn;
+            }
+            else if (conn->in_volo < MAX_IN_VOLO_CONNESSIONE && (scelta == NULL || conn->in_volo < scelta->in_volo)) scelta = conn;
+        }
+
+        FuturoCalcolo *futuro = client->in_sospeso;
+        if (scelta == NULL && chiusa != NULL)
+        {
+            if (ApriConnessioneClient(client, chiusa) == 0)
+            {
+                client->riaperture++;
+                scelta = chiusa;
+            }
+            else
+            {
+                client->in_sospeso = futuro->successivo;
+                CompletaFuturo(client, futuro, ESITO_CONNESSIONE_PERSA, 0);
+                continue;
+            }
+        }
+        if (scelta == NULL) break;
+
+        client->in_sospeso = futuro->successivo;
+        AccodaRichiesta(scelta, futuro);
+    }
+    if (client->in_sospeso == NULL) client->ultimo_in_sospeso = NULL;
+}
+
+/* Legge le risposte arrivate sulla connessione e completa i futuri; -1 se la connessione va chiusa */
+static inline int LeggiRisposte(ClientCalcolatrice *client, ConnessioneClient *conn)
+{
+    Intestazione intestazione;
+    uint32_t valore;
+    int n, lunghezza;
+
+    n = RiempiLettore(&conn->lettore, conn->sock);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    if (n <= 0) return -1;
+
+    while ((lunghezza = LunghezzaMessaggio((const unsigned char *)DatiLettore(&conn->lettore),
+                                           DisponibiliLettore(&conn->lettore), DIM_INGRESSO_CLIENT)) > 0)
+    {
+        const unsigned char *messaggio = (const unsigned char *)DatiLettore(&conn->lettore);
+        FuturoCalcolo *futuro = conn->testa;
+
+        /* Le risposte seguono l'ordine delle richieste: un id diverso è un errore di protocollo */
+        LeggiIntestazione(messaggio, lunghezza, &intestazione);
+        if (futuro == NULL || intestazione.id != futuro->id) return -1;
+        conn->testa = futuro->successivo;
+        if (conn->testa == NULL) conn->coda = NULL;
+        conn->in_volo--;
+
+        valore = 0;
+        if (intestazione.lunghezza == sizeof(valore)) memcpy(&valore, messaggio + DIM_INTESTAZIONE, sizeof(valore));
+        ConsumaLettore(&conn->lettore, lunghezza);
+        CompletaFuturo(client, futuro, intestazione.flag_esito, (int32_t)ntohl(valore));
+    }
+    return lunghezza < 0 ? -1 : 0;
+}
+
+/* Corpo del thread della libreria: invio delle richieste in coda, attesa con poll() e lettura delle risposte */
+static inline void *ThreadClientCalcolatrice(void *arg)
+{
+    ClientCalcolatrice *client = arg;
+    struct pollfd *attese = client->attese;
+    char scarto[64];
+    int i, chiusura = 0;
+
+    while (!chiusura)
+    {
+        /* Prima si svuota la pipe, poi si prende la coda: un invio successivo scrive un nuovo byte */
+        while (read(client->risveglio[0], scarto, sizeof(scarto)) > 0);
+        pthread_mutex_lock(&client->mutex);
+        if (client->da_inviare != NULL)
+        {
+            if (client->ultimo_in_sospeso != NULL) client->ultimo_in_sospeso->successivo = client->da_inviare;
+            else client->in_sospeso = client->da_inviare;
+            client->ultimo_in_sospeso = client->ultimo_da_inviare;
+            client->da_inviare = client->ultimo_da_inviare = NULL;
+        }
+        client->svegliato = 0;
+        chiusura = client->chiusura;
+        pthread_mutex_unlock(&client->mutex);
+        if (chiusura) break;
+
+        AssegnaRichieste(client);
+
+        attese[0].fd = client->risveglio[0];
+        attese[0].events = POLLIN;
+        for (i = 0; i < client->num_connessioni; i++)
+        {
+            ConnessioneClient *conn = &client->connessioni[i];
+            if (conn->sock >= 0 && SvuotaUscita(conn) < 0) ChiudiConnessioneClient(client, conn);
+            attese[i + 1].fd = conn->sock;   /* poll() ignora i descrittori negativi */
+            attese[i + 1].events = (short)(POLLIN | (conn->fine_uscita > conn->inizio_uscita ? POLLOUT : 0));
+            attese[i + 1].revents = 0;
+        }
+        if (poll(attese, (nfds_t)client->num_connessioni + 1, -1) < 0 && errno != EINTR) break;
+
+        for (i = 0; i < client->num_connessioni; i++)
+        {
+            ConnessioneClient *conn = &client->connessioni[i];
+            short eventi = attese[i + 1].revents;
+            if (conn->sock < 0 || eventi == 0) continue;
+            if (((eventi & (POLLIN | POLLERR | POLLHUP)) && LeggiRisposte(client, conn) < 0)
+                || ((eventi & POLLOUT) && SvuotaUscita(conn) < 0)) ChiudiConnessioneClient(client, conn);
+        }
+    }
+
+    /* Chiusura (o poll() fallita): le richieste rimaste non avranno risposta, né quelle inviate dopo */
+    for (i = 0; i < client->num_connessioni; i++)
+    {
+        if (client->connessioni[i].sock >= 0) ChiudiConnessioneClient(client, &client->connessioni[i]);
+    }
+    FallisciFuturi(client, client->in_sospeso);
+    client->in_sospeso = client->ultimo_in_sospeso = NULL;
+    pthread_mutex_lock(&client->mutex);
+    FuturoCalcolo *rimasti = client->da_inviare;
+    client->da_inviare = client->ultimo_da_inviare = NULL;
+    client->terminato = 1;
+    pthread_mutex_unlock(&client->mutex);
+    FallisciFuturi(client, rimasti);
+    return NULL;
+}
+
+/*
+  Risolve 'host', apre 'connessioni' connessioni persistenti (1 .. MAX_CONNESSIONI_CLIENT) e avvia il thread della
+  libreria. Restituisce NULL se il nome non si risolve o la prima connessione non si apre; le altre connessioni che non
+  si aprono vengono riprovate quando servono.
+*/
+static inline ClientCalcolatrice *ApriClient(const char *host, uint16_t porta, int connessioni)
+{
+    struct addrinfo suggerimenti, *risolto;
+    ClientCalcolatrice *client;
+    int i;
+
+    if (connessioni < 1 || connessioni > MAX_CONNESSIONI_CLIENT) return NULL;
+    memset(&suggerimenti, 0, sizeof(suggerimenti));
+    suggerimenti.ai_family = AF_INET;
+    suggerimenti.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &suggerimenti, &risolto) != 0) return NULL;
+
+    client = calloc(1, sizeof(ClientCalcolatrice));
+    if (client != NULL)
+    {
+        client->connessioni = calloc((size_t)connessioni, sizeof(ConnessioneClient));
+        client->attese = calloc((size_t)connessioni + 1, sizeof(struct pollfd));
+    }
+    if (client == NULL || client->connessioni == NULL || client->attese == NULL)
+    {
+        if (client != NULL)
+        {
+            free(client->connessioni);
+            free(client->attese);
+        }
+        free(client);
+        freeaddrinfo(risolto);
+        return NULL;
+    }
+    memcpy(&client->server, risolto->ai_addr, sizeof(client->server));
+    client->server.sin_port = htons(porta);
+    freeaddrinfo(risolto);
+
+    client->num_connessioni = connessioni;
+    for (i = 0; i < connessioni; i++)
+    {
+        if (ApriConnessioneClient(client, &client->connessioni[i]) < 0 && i == 0) break;
+    }
+    if (i < connessioni || pipe(client->risveglio) < 0)
+    {
+        while (--i >= 0) if (client->connessioni[i].sock >= 0) close(client->connessioni[i].sock);
+        free(client->connessioni);
+        free(client->attese);
+        free(client);
+        return NULL;
+    }
+    fcntl(client->risveglio[0], F_SETFL, fcntl(client->risveglio[0], F_GETFL) | O_NONBLOCK);
+    pthread_mutex_init(&client->mutex, NULL);
+    if (pthread_create(&client->thread, NULL, ThreadClientCalcolatrice, client) != 0)
+    {
+        for (i = 0; i < connessioni; i++) if (client->connessioni[i].sock >= 0) close(client->connessioni[i].sock);
+        close(client->risveglio[0]);
+        close(client->risveglio[1]);
+        pthread_mutex_destroy(&client->mutex);
+        free(client->connessioni);
+        free(client->attese);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+/*
+  Invio a lotti: mette in coda n operazioni ops[i] fra a[i] e b[i] con una sola acquisizione del mutex e un solo
+  risveglio del thread della libreria, e scrive i futuri in futuri[0 .. n-1]. Le richieste dello stesso lotto partono
+  di solito con una sola send() per connessione. Restituisce 0, oppure -1 se manca la memoria (nessuna richiesta inviata).
+  Se il thread della libreria è già uscito, i futuri si completano subito nel thread chiamante con ESITO_CONNESSIONE_PERSA.
+*/
+static inline int InviaCalcoli(ClientCalcolatrice *client, int n, const char *ops, const int32_t *a, const int32_t *b,
+                               FuturoCalcolo **futuri, CompletamentoCalcolo completamento, void *contesto)
+{
+    int i;
+
+    if (n <= 0) return 0;
+    for (i = 0; i < n; i++)
+    {
+        if ((futuri[i] = calloc(1, sizeof(FuturoCalcolo))) == NULL)
+        {
+            while (--i >= 0) free(futuri[i]);
+            return -1;
+        }
+        futuri[i]->operazione = ops[i];
+        futuri[i]->a = a[i];
+        futuri[i]->b = b[i];
+        futuri[i]->client = client;
+        futuri[i]->completamento = completamento;
+        futuri[i]->contesto = contesto;
+        if (i > 0) futuri[i - 1]->successivo = futuri[i];
+    }
+
+    pthread_mutex_lock(&client->mutex);
+    if (client->terminato)
+    {
+        /* Nessuno invierà più: i futuri restano validi e si completano subito con ESITO_CONNESSIONE_PERSA */
+        pthread_mutex_unlock(&client->mutex);
+        FallisciFuturi(client, futuri[0]);
+        return 0;
+    }
+    for (i = 0; i < n; i++) futuri[i]->id = client->prossimo_id++;
+    if (client->ultimo_da_inviare != NULL) client->ultimo_da_inviare->successivo = futuri[0];
+    else client->da_inviare = futuri[0];
+    client->ultimo_da_inviare = futuri[n - 1];
+    if (!client->svegliato)
+    {
+        client->svegliato = 1;
+        if (write(client->risveglio[1], "x", 1) != 1) client->svegliato = 0;
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return 0;
+}
+
+/* Una sola operazione: restituisce il futuro, NULL se manca la memoria */
+static inline FuturoCalcolo *InviaCalcolo(ClientCalcolatrice *client, char op, int32_t a, int32_t b,
+                                          CompletamentoCalcolo completamento, void *contesto)
+{
+    FuturoCalcolo *futuro;
+    return InviaCalcoli(client, 1, &op, &a, &b, &futuro, completamento, contesto) == 0 ? futuro : NULL;
+}
+
+/* 1 se il risultato è arrivato (o la richiesta è fallita), 0 altrimenti; non blocca */
+static inline int FuturoPronto(FuturoCalcolo *futuro)
+{
+    int pronto;
+    pthread_mutex_lock(&futuro->client->mutex);
+    pronto = futuro->pronto;
+    pthread_mutex_unlock(&futuro->client->mutex);
+    return pronto;
+}
+
+/* Attende il futuro e ne restituisce l'esito; con ESITO_OK e ESITO_DIVISIONE_PER_ZERO scrive il risultato */
+static inline int AttendiFuturo(FuturoCalcolo *futuro, int32_t *risultato)
+{
+    ClientCalcolatrice *client = futuro->client;
+
+    pthread_mutex_lock(&client->mutex);
+    if (!futuro->pronto)
+    {
+        pthread_cond_t attesa;
+        pthread_cond_init(&attesa, NULL);
+        futuro->attesa = &attesa;
+        while (!futuro->pronto) pthread_cond_wait(&attesa, &client->mutex);
+        futuro->attesa = NULL;
+        pthread_cond_destroy(&attesa);
+    }
+    pthread_mutex_unlock(&client->mutex);
+    if (risultato != NULL && (futuro->esito == ESITO_OK || futuro->esito == ESITO_DIVISIONE_PER_ZERO)) *risultato = futuro->risultato;
+    return futuro->esito;
+}
+
+/* Libera il futuro; se non è ancora pronto lo libera la libreria al completamento */
+static inline void LiberaFuturo(FuturoCalcolo *futuro)
+{
+    ClientCalcolatrice *client = futuro->client;
+    int pronto;
+
+    pthread_mutex_lock(&client->mutex);
+    pronto = futuro->pronto;
+    if (!pronto) futuro->abbandonato = 1;
+    pthread_mutex_unlock(&client->mutex);
+    if (pronto) free(futuro);
+}
+
+/* Involucro sincrono: invia l'operazione e ne attende l'esito */
+static inline int CalcolaSincrono(ClientCalcolatrice *client, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    FuturoCalcolo *futuro = InviaCalcolo(client, op, a, b, NULL, NULL);
+    int esito;
+
+    if (futuro == NULL) return ESITO_CONNESSIONE_PERSA;
+    esito = AttendiFuturo(futuro, risultato);
+    LiberaFuturo(futuro);
+    return esito;
+}
+
+/*
+  Ferma il thread della libreria e chiude le connessioni: le richieste senza risposta si completano con
+  ESITO_CONNESSIONE_PERSA. Nessun altro thread deve usare il client durante e dopo la chiamata.
+*/
+static inline void ChiudiClient(ClientCalcolatrice *client)
+{
+    pthread_mutex_lock(&client->mutex);
+    client->chiusura = 1;
+    if (!client->svegliato && write(client->risveglio[1], "x", 1) == 1) client->svegliato = 1;
+    pthread_mutex_unlock(&client->mutex);
+    pthread_join(client->thread, NULL);
+
+    close(client->risveglio[0]);
+    close(client->risveglio[1]);
+    pthread_mutex_destroy(&client->mutex);
+    free(client->connessioni);
+    free(client->attese);
+    free(client);
+}
+
+#endif /* CLIENT_G35_H */
@@ -0,0 +1,517 @@
+/*
+  Espressioni aritmetiche con variabili, compilate in un bytecode a pila e conservate in una cache LRU.
+
+  Sintassi: interi decimali, variabili di una lettera minuscola (a-z), operatori binari + - * / % con le precedenze
+  abituali e associatività a sinistra, meno e più unari, parentesi. Gli spazi sono ignorati. Esempio: (a+b)*c/d.
+  I valori delle variabili si danno nell'ordine alfabetico delle lettere usate: per (a+b)*c/d sono a, b, c, d;
+  per x*x+y sono x, y.
+
+  Semantica: la stessa delle operazioni singole (calcolo_g35.h), interi a 32 bit con wrap-around. Un divisore 0 dà
+  risultato 0 anche per il resto; INT32_MIN / -1 dà INT32_MIN e INT32_MIN % -1 dà 0.
+
+  Il compilatore (discesa ricorsiva) produce una sequenza di istruzioni di un byte, con l'operando subito dopo per le
+  costanti (4 byte) e le variabili (1 byte), e calcola la profondità massima della pila: l'esecuzione usa una pila
+  di dimensione fissa senza controlli. Le sottoespressioni senza variabili sono calcolate in compilazione.
+
+  Ogni thread di servizio ha la propria cache (nessun lock): NUM_PROGRAMMI_CACHE programmi in una tabella hash
+  indicizzata dall'hash del testo, con una lista LRU per scegliere quale sostituire. Una richiesta con un testo già
+  compilato non passa dal compilatore. Le cache si registrano in una tabella globale (solo Linux) da cui
+  StatisticheCacheEspressioni() somma successi e mancati per le metriche.
+
+  Come gli altri file di comune/, contiene solo funzioni static inline.
+*/
+#ifndef ESPRESSIONI_G35_H
+#define ESPRESSIONI_G35_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (_WIN32)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#if defined (__linux__)
+#include <stdatomic.h>
+#define ESPRESSIONI_LOCALE_THREAD _Thread_local
+#else
+#define ESPRESSIONI_LOCALE_THREAD
+#endif
+
+#define MAX_TESTO_ESPRESSIONE 256           /* byte del testo di un'espressione */
+#define MAX_CODICE_ESPRESSIONE (3 * MAX_TESTO_ESPRESSIONE)   /* al più 3 byte di bytecode per carattere ("1+" -> 6 byte) */
+#define MAX_PILA_ESPRESSIONE 64             /* profondità della pila di valutazione (e dell'annidamento) */
+#define MAX_VARIABILI_ESPRESSIONE 26
+#define NUM_PROGRAMMI_CACHE 64              /* programmi nella cache di un thread */
+#define NUM_SECCHI_CACHE 128                /* secchi della tabella hash (potenza di 2) */
+#define MAX_CACHE_ESPRESSIONI 512           /* cache registrate al massimo (una per thread di servizio) */
+
+/* Istruzioni del bytecode */
+enum { ISTR_COSTANTE, ISTR_VARIABILE, ISTR_SOMMA, ISTR_DIFFERENZA, ISTR_PRODOTTO, ISTR_QUOZIENTE, ISTR_RESTO, ISTR_OPPOSTO };
+
+typedef struct
+{
+    uint64_t hash;                          /* hash del testo */
+    int lunghezza_testo;
+    char testo[MAX_TESTO_ESPRESSIONE];
+    int lunghezza_codice;
+    uint8_t codice[MAX_CODICE_ESPRESSIONE];
+    int variabili;                          /* valori attesi per ogni valutazione */
+    int pila;                               /* profondità massima della pila */
+} Programma;
+
+typedef struct
+{
+    Programma programmi[NUM_PROGRAMMI_CACHE];
+    int16_t secchi[NUM_SECCHI_CACHE];       /* primo programma di ogni secchio, -1 se vuoto */
+    int16_t catena[NUM_PROGRAMMI_CACHE];    /* programma successivo nello stesso secchio */
+    int16_t precedente[NUM_PROGRAMMI_CACHE], successivo[NUM_PROGRAMMI_CACHE];   /* lista LRU */
+    int16_t recente, vecchio;               /* estremi della lista LRU: usato più di recente e meno di recente */
+    int usati;
+    uint64_t successi, mancati;             /* scritti solo dal thread proprietario */
+} CacheEspressioni;
+
+/* ---------------------------------------------------------------- Compilazione */
+
+typedef struct
+{
+    const char *testo, *fine;
+    int indice_variabile[26];               /* posizione di ogni lettera fra i valori, -1 se non usata */
+    uint8_t *codice;
+    int lunghezza, pila, massimo, annidamento;
+    int errore;
+} Compilatore;
+
+static inline void SaltaSpazi(Compilatore *c)
+{
+    while (c->testo < c->fine && (*c->testo == ' ' || *c->testo == '\t')) c->testo++;
+}
+
+static inline void EmettiIstruzione(Compilatore *c, uint8_t istruzione, int effetto_pila)
+{
+    if (c->lunghezza + 1 > MAX_CODICE_ESPRESSIONE) c->errore = 1;
+    else c->codice[c->lunghezza++] = istruzione;
+    c->pila += effetto_pila;
+    if (c->pila > c->massimo) c->massimo = c->pila;
+}
+
+static inline void EmettiCostante(Compilatore *c, int32_t valore)
+{
+    EmettiIstruzione(c, ISTR_COSTANTE, 1);
+    if (c->lunghezza + 4 > MAX_CODICE_ESPRESSIONE) c->errore = 1;
+    else
+    {
+        memcpy(c->codice + c->lunghezza, &valore, sizeof(valore));
+        c->lunghezza += 4;
+    }
+}
+
+/* 1 se l'ultima istruzione emessa, a partire da 'inizio', è una sola costante (per il calcolo in compilazione) */
+static inline int SoloCostante(const Compilatore *c, int inizio)
+{
+    return c->lunghezza - inizio == 5 && c->codice[inizio] == ISTR_COSTANTE;
+}
+
+static inline int32_t CostanteA(const Compilatore *c, int posizione)
+{
+    int32_t valore;
+    memcpy(&valore, c->codice + posizione + 1, sizeof(valore));
+    return valore;
+}
+
+/* Un'operazione binaria con la semantica delle operazioni singole; *zero = 1 se il divisore era 0 */
+static inline int32_t ApplicaOperazione(uint8_t istruzione, int32_t x, int32_t y, int *zero)
+{
+    switch (istruzione)
+    {
+        case ISTR_SOMMA:      return (int32_t)((uint32_t)x + (uint32_t)y);
+        case ISTR_DIFFERENZA: return (int32_t)((uint32_t)x - (uint32_t)y);
+        case ISTR_PRODOTTO:   return (int32_t)((uint32_t)x * (uint32_t)y);
+        case ISTR_QUOZIENTE:
+            if (y == 0) return (*zero = 1, 0);
+            return y == -1 ? (int32_t)(0u - (uint32_t)x) : x / y;
+        default:   /* ISTR_RESTO */
+            if (y == 0) return (*zero = 1, 0);
+            return y == -1 ? 0 : x % y;
+    }
+}
+
+/*
+  Emette un'operazione binaria sui due operandi che iniziano in 'sinistro' e 'destro'. Se sono entrambi costanti li
+  sostituisce con il risultato, tranne le divisioni per una costante 0, lasciate all'esecuzione perché vengano contate.
+*/
+static inline void EmettiBinaria(Compilatore *c, uint8_t istruzione, int sinistro, int destro)
+{
+    int zero = 0;
+    if (SoloCostante(c, destro) && destro - sinistro == 5 && c->codice[sinistro] == ISTR_COSTANTE)
+    {
+        int32_t risultato = ApplicaOperazione(istruzione, CostanteA(c, sinistro), CostanteA(c, destro), &zero);
+        if (!zero)
+        {
+            c->lunghezza = sinistro;
+            c->pila -= 2;
+            EmettiCostante(c, risultato);
+            return;
+        }
+    }
+    EmettiIstruzione(c, istruzione, -1);
+}
+
+static inline void CompilaSomma(Compilatore *c);
+
+static inline void CompilaFattore(Compilatore *c)
+{
+    int inizio;
+    SaltaSpazi(c);
+    if (c->errore || c->testo >= c->fine)
+    {
+        c->errore = 1;
+        return;
+    }
+    if (*c->testo == '-' || *c->testo == '+')
+    {
+        int meno = (*c->testo++ == '-');
+        if (++c->annidamento > MAX_PILA_ESPRESSIONE)
+        {
+            c->errore = 1;
+            return;
+        }
+        inizio = c->lunghezza;
+        CompilaFattore(c);
+        c->annidamento--;
+        if (!meno || c->errore) return;
+        if (SoloCostante(c, inizio))
+        {
+            int32_t valore = CostanteA(c, inizio);
+            c->lunghezza = inizio;
+            c->pila--;
+            EmettiCostante(c, (int32_t)(0u - (uint32_t)valore));
+        }
+        else EmettiIstruzione(c, ISTR_OPPOSTO, 0);
+    }
+    else if (*c->testo >= '0' && *c->testo <= '9')
+    {
+        uint64_t valore = 0;
+        while (c->testo < c->fine && *c->testo >= '0' && *c->testo <= '9')
+        {
+            valore = valore * 10 + (uint64_t)(*c->testo++ - '0');
+            if (valore > UINT32_MAX)
+            {
+                c->errore = 1;
+                return;
+            }
+        }
+        EmettiCostante(c, (int32_t)(uint32_t)valore);   /* oltre INT32_MAX con wrap-around, come gli operandi */
+    }
+    else if (*c->testo >= 'a' && *c->testo <= 'z')
+    {
+        int indice = c->indice_variabile[*c->testo++ - 'a'];
+        if (c->testo < c->fine && *c->testo >= 'a' && *c->testo <= 'z')
+        {
+            c->errore = 1;   /* le variabili hanno una sola lettera */
+            return;
+        }
+        EmettiIstruzione(c, ISTR_VARIABILE, 1);
+        if (c->lunghezza + 1 > MAX_CODICE_ESPRESSIONE) c->errore = 1;
+        else c->codice[c->lunghezza++] = (uint8_t)indice;
+    }
+    else if (*c->testo == '(')
+    {
+        c->testo++;
+        if (++c->annidamento > MAX_PILA_ESPRESSIONE)
+        {
+            c->errore = 1;
+            return;
+        }
+        CompilaSomma(c);
+        c->annidamento--;
+        SaltaSpazi(c);
+        if (c->testo >= c->fine || *c->testo != ')') c->errore = 1;
+        else c->testo++;
+    }
+    else c->errore = 1;
+}
+
+static inline void CompilaProdotto(Compilatore *c)
+{
+    int sinistro = c->lunghezza, destro;
+    uint8_t istruzione;
+    CompilaFattore(c);
+    while (!c->errore)
+    {
+        SaltaSpazi(c);
+        if (c->testo >= c->fine) return;
+        if (*c->testo == '*') istruzione = ISTR_PRODOTTO;
+        else if (*c->testo == '/') istruzione = ISTR_QUOZIENTE;
+        else if (*c->testo == '%') istruzione = ISTR_RESTO;
+        else return;
+        c->testo++;
+        destro = c->lunghezza;
+        CompilaFattore(c);
+        if (!c->errore) EmettiBinaria(c, istruzione, sinistro, destro);
+    }
+}
+
+static inline void CompilaSomma(Compilatore *c)
+{
+    int sinistro = c->lunghezza, destro;
+    uint8_t istruzione;
+    CompilaProdotto(c);
+    while (!c->errore)
+    {
+        SaltaSpazi(c);
+        if (c->testo >= c->fine) return;
+        if (*c->testo == '+') istruzione = ISTR_SOMMA;
+        else if (*c->testo == '-') istruzione = ISTR_DIFFERENZA;
+        else return;
+        c->testo++;
+        destro = c->lunghezza;
+        CompilaProdotto(c);
+        if (!c->errore) EmettiBinaria(c, istruzione, sinistro, destro);
+    }
+}
+
+/*
+  Compila i 'lunghezza' byte di 'testo' in 'programma' (hash escluso): 0 se l'espressione è valida, -1 altrimenti
+  (sintassi, costante oltre 32 bit, annidamento o pila oltre MAX_PILA_ESPRESSIONE, testo troppo lungo).
+*/
+static inline int CompilaEspressione(Programma *programma, const char *testo, int lunghezza)
+{
+    Compilatore c;
+    int i, variabili = 0;
+
+    if (lunghezza <= 0 || lunghezza > MAX_TESTO_ESPRESSIONE) return -1;
+    memset(&c, 0, sizeof(c));
+    c.testo = testo;
+    c.fine = testo + lunghezza;
+    c.codice = programma->codice;
+
+    /* Prima passata: le lettere usate, numerate in ordine alfabetico */
+    for (i = 0; i < 26; i++) c.indice_variabile[i] = -1;
+    for (i = 0; i < lunghezza; i++)
+        if (testo[i] >= 'a' && testo[i] <= 'z') c.indice_variabile[testo[i] - 'a'] = 0;
+    for (i = 0; i < 26; i++)
+        if (c.indice_variabile[i] == 0) c.indice_variabile[i] = variabili++;
+
+    CompilaSomma(&c);
+    SaltaSpazi(&c);
+    if (c.errore || c.testo != c.fine || c.massimo > MAX_PILA_ESPRESSIONE) return -1;
+
+    memcpy(programma->testo, testo, (size_t)lunghezza);
+    programma->lunghezza_testo = lunghezza;
+    programma->lunghezza_codice = c.lunghezza;
+    programma->variabili = variabili;
+    programma->pila = c.massimo;
+    return 0;
+}
+
+/* ---------------------------------------------------------------- Esecuzione */
+
+/* Valuta il programma con i valori delle variabili in 'valori' (host order); *zeri conta le divisioni per zero */
+static inline int32_t EseguiProgramma(const Programma *programma, const int32_t *valori, uint32_t *zeri)
+{
+    int32_t pila[MAX_PILA_ESPRESSIONE];
+    const uint8_t *ip = programma->codice, *fine = ip + programma->lunghezza_codice;
+    int cima = -1, zero = 0;
+
+    while (ip < fine)
+    {
+        uint8_t istruzione = *ip++;
+        switch (istruzione)
+        {
+            case ISTR_COSTANTE:
+                memcpy(&pila[++cima], ip, sizeof(int32_t));
+                ip += 4;
+                break;
+            case ISTR_VARIABILE:
+                pila[++cima] = valori[*ip++];
+                break;
+            case ISTR_OPPOSTO:
+                pila[cima] = (int32_t)(0u - (uint32_t)pila[cima]);
+                break;
+            default:
+                cima--;
+                pila[cima] = ApplicaOperazione(istruzione, pila[cima], pila[cima + 1], &zero);
+                if (zero)
+                {
+                    (*zeri)++;
+                    zero = 0;
+                }
+                break;
+        }
+    }
+    return pila[0];
+}
+
+/*
+  Valuta il programma per n assegnazioni di valori consecutive in 'valori' (programma->variabili interi in network
+  order ciascuna) e scrive gli n risultati in network order in 'risultati'. Restituisce le divisioni per zero.
+*/
+static inline uint32_t EseguiProgrammaSuValori(const Programma *programma, const unsigned char *valori, unsigned char *risultati, uint32_t n)
+{
+    int32_t variabili[MAX_VARIABILI_ESPRESSIONE];
+    uint32_t i, zeri = 0, valore;
+    int k = programma->variabili, j;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < k; j++)
+        {
+            memcpy(&valore, valori + ((size_t)i * k + j) * 4, sizeof(valore));
+            variabili[j] = (int32_t)ntohl(valore);
+        }
+        valore = htonl((uint32_t)EseguiProgramma(programma, variabili, &zeri));
+        memcpy(risultati + (size_t)i * 4, &valore, sizeof(valore));
+    }
+    return zeri;
+}
+
+/* ---------------------------------------------------------------- Cache LRU */
+
+/* FNV-1a a 64 bit del testo */
+static inline uint64_t HashEspressione(const char *testo, int lunghezza)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < lunghezza; i++)
+    {
+        hash ^= (unsigned char)testo[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static inline void InizializzaCacheEspressioni(CacheEspressioni *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    memset(cache->secchi, 0xFF, sizeof(cache->secchi));   /* -1 */
+    cache->recente = cache->vecchio = -1;
+}
+
+/* Toglie il programma i dalla lista LRU */
+static inline void StaccaLRU(CacheEspressioni *cache, int i)
+{
+    if (cache->precedente[i] >= 0) cache->successivo[cache->precedente[i]] = cache->successivo[i];
+    else cache->recente = cache->successivo[i];
+    if (cache->successivo[i] >= 0) cache->precedente[cache->successivo[i]] = cache->precedente[i];
+    else cache->vecchio = cache->precedente[i];
+}
+
+/* Mette il programma i in testa alla lista LRU (usato più di recente) */
+static inline void InTestaLRU(CacheEspressioni *cache, int i)
+{
+    cache->precedente[i] = -1;
+    cache->successivo[i] = cache->recente;
+    if (cache->recente >= 0) cache->precedente[cache->recente] = (int16_t)i;
+    cache->recente = (int16_t)i;
+    if (cache->vecchio < 0) cache->vecchio = (int16_t)i;
+}
+
+static inline void IncrementaContatoreCache(uint64_t *contatore)
+{
+#if defined (__GNUC__)
+    __atomic_store_n(contatore, __atomic_load_n(contatore, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+#else
+    (*contatore)++;
+#endif
+}
+
+/*
+  Programma compilato per il testo indicato: dalla cache se c'è (senza compilare), altrimenti compilato e inserito al
+  posto del meno usato di recente. NULL se l'espressione non è valida.
+*/
+static inline const Programma *ProgrammaEspressione(CacheEspressioni *cache, const char *testo, int lunghezza)
+{
+    uint64_t hash = HashEspressione(testo, lunghezza);
+    int secchio = (int)(hash & (NUM_SECCHI_CACHE - 1)), i;
+    int16_t *collegamento;
+
+    for (i = cache->secchi[secchio]; i >= 0; i = cache->catena[i])
+    {
+        const Programma *programma = &cache->programmi[i];
+        if (programma->hash == hash && programma->lunghezza_testo == lunghezza && memcmp(programma->testo, testo, (size_t)lunghezza) == 0)
+        {
+            IncrementaContatoreCache(&cache->successi);
+            if (cache->recente != i)
+            {
+                StaccaLRU(cache, i);
+                InTestaLRU(cache, i);
+            }
+            return programma;
+        }
+    }
+    IncrementaContatoreCache(&cache->mancati);
+
+    /* Posto libero o, con la cache piena, il programma meno usato di recente (tolto dal suo secchio se è valido) */
+    if (cache->usati < NUM_PROGRAMMI_CACHE) i = cache->usati++;
+    else
+    {
+        i = cache->vecchio;
+        StaccaLRU(cache, i);
+        if (cache->programmi[i].lunghezza_testo >= 0)
+        {
+            for (collegamento = &cache->secchi[cache->programmi[i].hash & (NUM_SECCHI_CACHE - 1)]; *collegamento != i;
+                 collegamento = &cache->catena[*collegamento]);
+            *collegamento = cache->catena[i];
+        }
+    }
+
+    if (CompilaEspressione(&cache->programmi[i], testo, lunghezza) != 0)
+    {
+        /* Il posto resta vuoto, fuori dai secchi, in coda alla lista: è il primo a essere riusato */
+        cache->programmi[i].lunghezza_testo = -1;
+        cache->precedente[i] = cache->vecchio;
+        cache->successivo[i] = -1;
+        if (cache->vecchio >= 0) cache->successivo[cache->vecchio] = (int16_t)i;
+        else cache->recente = (int16_t)i;
+        cache->vecchio = (int16_t)i;
+        return NULL;
+    }
+    cache->programmi[i].hash = hash;
+    cache->catena[i] = cache->secchi[secchio];
+    cache->secchi[secchio] = (int16_t)i;
+    InTestaLRU(cache, i);
+    return &cache->programmi[i];
+}
+
+/* ---------------------------------------------------------------- Cache di ogni thread */
+
+#if defined (__linux__)
+static _Atomic(CacheEspressioni *) cache_espressioni[MAX_CACHE_ESPRESSIONI];
+static atomic_int num_cache_espressioni;
+#endif
+static ESPRESSIONI_LOCALE_THREAD CacheEspressioni *cache_del_thread;
+
+/* Cache del thread chiamante, creata e registrata alla prima espressione (NULL se manca la memoria) */
+static inline CacheEspressioni *CacheEspressioniThread(void)
+{
+    if (cache_del_thread != NULL) return cache_del_thread;
+    CacheEspressioni *cache = malloc(sizeof(CacheEspressioni));
+    if (cache == NULL) return NULL;
+    InizializzaCacheEspressioni(cache);
+#if defined (__linux__)
+    int posto = atomic_fetch_add(&num_cache_espressioni, 1);
+    if (posto < MAX_CACHE_ESPRESSIONI) atomic_store_explicit(&cache_espressioni[posto], cache, memory_order_release);
+#endif
+    return cache_del_thread = cache;
+}
+
+#if defined (__linux__)
+/* Somma di successi e mancati di tutte le cache registrate */
+static inline void StatisticheCacheEspressioni(uint64_t *successi, uint64_t *mancati)
+{
+    int n = atomic_load_explicit(&num_cache_espressioni, memory_order_acquire), i;
+    *successi = *mancati = 0;
+    if (n > MAX_CACHE_ESPRESSIONI) n = MAX_CACHE_ESPRESSIONI;
+    for (i = 0; i < n; i++)
+    {
+        CacheEspressioni *cache = atomic_load_explicit(&cache_espressioni[i], memory_order_acquire);
+        if (cache == NULL) continue;   /* posto preso ma non ancora pubblicato */
+        *successi += __atomic_load_n(&cache->successi, __ATOMIC_RELAXED);
+        *mancati += __atomic_load_n(&cache->mancati, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+#endif /* ESPRESSIONI_G35_H */
@@ -0,0 +1,1070 @@
+/*
+  Interi con segno di lunghezza arbitraria per i messaggi binari a numeri grandi (FLAG_GRANDI, vedi protocollo_g35.h).
+
+  Un Numero è il segno più il modulo, una sequenza di cifre in base 2^32 dalla meno significativa alla più significativa.
+  Le operazioni sui moduli ("naturali") lavorano su vettori di cifre con lunghezza esplicita; quelle sui Numero gestiscono
+  il segno e la memoria e accettano che il risultato coincida con un operando.
+
+  Moltiplicazione:
+  - scolastica (n * m prodotti di cifre) sotto SOGLIA_KARATSUBA cifre;
+  - Karatsuba fino a SOGLIA_TOOM3 cifre: tre prodotti di metà lunghezza invece di quattro, O(n^1.585);
+  - Toom-3 sopra: cinque prodotti di un terzo della lunghezza (punti 0, 1, -1, -2, infinito, interpolazione di Bodrato),
+    O(n^1.465).
+  Se un operando è lungo almeno il doppio dell'altro lo si divide in blocchi lunghi quanto il più corto.
+
+  Divisione:
+  - algoritmo D di Knuth (scolastico, O(n * m));
+  - Burnikel-Ziegler quando divisore e quoziente arrivano a SOGLIA_BURNIKEL_ZIEGLER cifre: una divisione di 2n cifre
+    per n diventa due divisioni 3n/2n, ognuna con una divisione n/(n/2) e un prodotto (n/2) * (n/2). Il costo segue
+    quello della moltiplicazione, quindi sfrutta Karatsuba e Toom-3. La ricorsione torna all'algoritmo D sotto
+    FOGLIA_BURNIKEL_ZIEGLER cifre.
+
+  Le soglie si possono cambiare in compilazione (-DSOGLIA_KARATSUBA=...). I valori predefiniti vengono da
+  strumenti/misura_grandi_g35.c, che misura i punti di incrocio fra gli algoritmi: su x86-64 con gcc -O2 Karatsuba
+  supera il prodotto scolastico verso 40-48 cifre, Toom-3 raggiunge Karatsuba verso 256 cifre (e lo supera di poco
+  oltre), Burnikel-Ziegler supera l'algoritmo D verso 320 cifre; la foglia della ricorsione conta poco fra 40 e 120.
+
+  Le funzioni restituiscono GRANDI_OK oppure un codice GRANDI_* (memoria esaurita, divisione per zero, risultato
+  oltre il limite indicato dal chiamante). La memoria delle cifre viene da AllocaArena() (pool_g35.h): nell'arena del
+  thread se il chiamante l'ha aperta, altrimenti dall'heap. Come gli altri file di comune/, contiene solo funzioni
+  static inline.
+*/
+#ifndef GRANDI_G35_H
+#define GRANDI_G35_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool_g35.h"
+
+#if defined (_WIN32)
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#ifndef SOGLIA_KARATSUBA
+#define SOGLIA_KARATSUBA 48                 /* cifre dell'operando più corto sotto cui si usa il prodotto scolastico */
+#endif
+#ifndef SOGLIA_TOOM3
+#define SOGLIA_TOOM3 256                    /* cifre dell'operando più corto da cui si usa Toom-3 */
+#endif
+#ifndef SOGLIA_BURNIKEL_ZIEGLER
+#define SOGLIA_BURNIKEL_ZIEGLER 320         /* cifre di divisore e quoziente da cui si usa Burnikel-Ziegler */
+#endif
+#ifndef FOGLIA_BURNIKEL_ZIEGLER
+#define FOGLIA_BURNIKEL_ZIEGLER 60          /* cifre sotto cui la ricorsione di Burnikel-Ziegler usa l'algoritmo D */
+#endif
+
+/* Esiti delle operazioni */
+#define GRANDI_OK 0
+#define GRANDI_MEMORIA -1
+#define GRANDI_DIVISIONE_PER_ZERO 1         /* divisore 0 (o base 0 con esponente negativo): il risultato vale 0 */
+#define GRANDI_TROPPO_GRANDE 2              /* il risultato supererebbe il limite di cifre indicato */
+
+typedef uint32_t Cifra;                     /* cifra in base 2^32 */
+typedef uint64_t CifraDoppia;
+
+typedef struct
+{
+    Cifra *cifre;                           /* modulo, dalla cifra meno significativa; NULL finché non serve memoria */
+    int lunghezza;                          /* cifre significative, 0 per lo zero */
+    int capacita;                           /* cifre allocate */
+    int negativo;                           /* 1 se il numero è negativo (mai per lo zero) */
+} Numero;
+
+/* ---------------------------------------------------------------- Naturali: vettori di cifre */
+
+/* Bit a zero in testa a una cifra non nulla */
+static inline int ZeriInTesta(Cifra c)
+{
+#if defined (__GNUC__)
+    return __builtin_clz(c);
+#else
+    int n = 0;
+    while (!(c & 0x80000000u))
+    {
+        c <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Lunghezza senza le cifre più significative nulle */
+static inline int LunghezzaNaturale(const Cifra *a, int n)
+{
+    while (n > 0 && a[n - 1] == 0) n--;
+    return n;
+}
+
+/* -1, 0 o 1 secondo a < b, a == b, a > b (le cifre nulle in testa non contano) */
+static inline int ConfrontaNaturali(const Cifra *a, int na, const Cifra *b, int nb)
+{
+    na = LunghezzaNaturale(a, na);
+    nb = LunghezzaNaturale(b, nb);
+    if (na != nb) return na < nb ? -1 : 1;
+    while (na-- > 0)
+        if (a[na] != b[na]) return a[na] < b[na] ? -1 : 1;
+    return 0;
+}
+
+/* r[0..na) = a + b, con na >= nb; restituisce il riporto. r può coincidere con a. */
+static inline Cifra SommaNaturali(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    CifraDoppia t = 0;
+    int i;
+    for (i = 0; i < nb; i++)
+    {
+        t += (CifraDoppia)a[i] + b[i];
+        r[i] = (Cifra)t;
+        t >>= 32;
+    }
+    for (; i < na; i++)
+    {
+        t += a[i];
+        r[i] = (Cifra)t;
+        t >>= 32;
+    }
+    return (Cifra)t;
+}
+
+/* r[0..na) = a - b, con na >= nb; restituisce il prestito (1 se b > a). r può coincidere con a. */
+static inline Cifra SottraiNaturali(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    CifraDoppia t;
+    Cifra prestito = 0;
+    int i;
+    for (i = 0; i < nb; i++)
+    {
+        t = (CifraDoppia)a[i] - b[i] - prestito;
+        r[i] = (Cifra)t;
+        prestito = (Cifra)(t >> 63);
+    }
+    for (; i < na; i++)
+    {
+        t = (CifraDoppia)a[i] - prestito;
+        r[i] = (Cifra)t;
+        prestito = (Cifra)(t >> 63);
+    }
+    return prestito;
+}
+
+/* r[0..nr) += a[0..na), con na <= nr: il riporto si propaga solo finché serve. Restituisce il riporto finale. */
+static inline Cifra AggiungiNaturale(Cifra *r, int nr, const Cifra *a, int na)
+{
+    CifraDoppia t = 0;
+    int i;
+    for (i = 0; i < na; i++)
+    {
+        t += (CifraDoppia)r[i] + a[i];
+        r[i] = (Cifra)t;
+        t >>= 32;
+    }
+    for (; t != 0 && i < nr; i++)
+    {
+        t += r[i];
+        r[i] = (Cifra)t;
+        t >>= 32;
+    }
+    return (Cifra)t;
+}
+
+/* r[0..nr) -= a[0..na), con na <= nr: il prestito si propaga solo finché serve. Restituisce il prestito finale. */
+static inline Cifra TogliNaturale(Cifra *r, int nr, const Cifra *a, int na)
+{
+    CifraDoppia t;
+    Cifra prestito = 0;
+    int i;
+    for (i = 0; i < na; i++)
+    {
+        t = (CifraDoppia)r[i] - a[i] - prestito;
+        r[i] = (Cifra)t;
+        prestito = (Cifra)(t >> 63);
+    }
+    for (; prestito != 0 && i < nr; i++)
+    {
+        t = (CifraDoppia)r[i] - prestito;
+        r[i] = (Cifra)t;
+        prestito = (Cifra)(t >> 63);
+    }
+    return prestito;
+}
+
+/* r[0..n) = a << bit (0 <= bit < 32); restituisce i bit usciti dalla cifra più alta. r può coincidere con a. */
+static inline Cifra SpostaSinistraNaturale(Cifra *r, const Cifra *a, int n, int bit)
+{
+    Cifra uscita = 0, c;
+    int i;
+    if (bit == 0)
+    {
+        memmove(r, a, (size_t)n * sizeof(Cifra));
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        c = a[i];
+        r[i] = (c << bit) | uscita;
+        uscita = c >> (32 - bit);
+    }
+    return uscita;
+}
+
+/* r[0..n) = a[0..n) >> bit (0 <= bit < 32), con 'sopra' come cifra successiva ad a[n - 1]. r può coincidere con a. */
+static inline void SpostaDestraNaturale(Cifra *r, const Cifra *a, int n, int bit, Cifra sopra)
+{
+    int i;
+    if (bit == 0)
+    {
+        memmove(r, a, (size_t)n * sizeof(Cifra));
+        return;
+    }
+    for (i = 0; i < n; i++) r[i] = (a[i] >> bit) | ((i + 1 < n ? a[i + 1] : sopra) << (32 - bit));
+}
+
+/* q[0..n) = a / d per una sola cifra d != 0; restituisce il resto. q può coincidere con a. */
+static inline Cifra DividiNaturalePerCifra(Cifra *q, const Cifra *a, int n, Cifra d)
+{
+    CifraDoppia resto = 0;
+    while (n-- > 0)
+    {
+        resto = (resto << 32) | a[n];
+        q[n] = (Cifra)(resto / d);
+        resto %= d;
+    }
+    return (Cifra)resto;
+}
+
+/* ---------------------------------------------------------------- Moltiplicazione */
+
+static inline int ProdottoNaturali(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb);
+
+/* r[0..na + nb) = a * b, prodotto scolastico. r non deve sovrapporsi agli operandi. */
+static inline void ProdottoScolastico(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    CifraDoppia riporto;
+    int i, j;
+    memset(r, 0, (size_t)(na + nb) * sizeof(Cifra));
+    for (j = 0; j < nb; j++)
+    {
+        Cifra bj = b[j];
+        if (bj == 0) continue;
+        riporto = 0;
+        for (i = 0; i < na; i++)
+        {
+            riporto += (CifraDoppia)a[i] * bj + r[i + j];   /* al più (2^32 - 1)^2 + 2 * (2^32 - 1) = 2^64 - 1 */
+            r[i + j] = (Cifra)riporto;
+            riporto >>= 32;
+        }
+        r[j + na] = (Cifra)riporto;
+    }
+}
+
+/* Operandi sbilanciati (na >= 2 * nb): a si divide in blocchi di nb cifre, ognuno moltiplicato per b */
+static inline int ProdottoSbilanciato(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    Cifra *parziale = AllocaArena((size_t)2 * nb * sizeof(Cifra));
+    int i, l;
+    if (parziale == NULL) return GRANDI_MEMORIA;
+    memset(r, 0, (size_t)(na + nb) * sizeof(Cifra));
+    for (i = 0; i < na; i += nb)
+    {
+        l = (na - i < nb) ? na - i : nb;
+        if (ProdottoNaturali(parziale, a + i, l, b, nb) != GRANDI_OK)
+        {
+            LiberaArena(parziale);
+            return GRANDI_MEMORIA;
+        }
+        AggiungiNaturale(r + i, na + nb - i, parziale, l + nb);
+    }
+    LiberaArena(parziale);
+    return GRANDI_OK;
+}
+
+/*
+  Karatsuba, con na >= nb > na / 2. Con a = a1 * B^h + a0 e b = b1 * B^h + b0 (B = 2^32):
+  a * b = z2 * B^2h + (z1 - z2 - z0) * B^h + z0, dove z0 = a0 * b0, z2 = a1 * b1, z1 = (a0 + a1) * (b0 + b1).
+  z0 e z2 si scrivono direttamente nelle due metà di r.
+*/
+static inline int ProdottoKaratsuba(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    int h = (na + 1) / 2, la1 = na - h, lb1 = nb - h, ls, lt, lz;
+    Cifra *sa, *sb, *z1;
+
+    if (lb1 <= 0) return ProdottoSbilanciato(r, a, na, b, nb);   /* b non ha una metà alta */
+    if ((sa = AllocaArena((size_t)(4 * h + 4) * sizeof(Cifra))) == NULL) return GRANDI_MEMORIA;
+    sb = sa + h + 1;
+    z1 = sb + h + 1;
+
+    sa[h] = SommaNaturali(sa, a, h, a + h, la1);
+    sb[h] = SommaNaturali(sb, b, h, b + h, lb1);
+    ls = LunghezzaNaturale(sa, h + 1);
+    lt = LunghezzaNaturale(sb, h + 1);
+    if (ProdottoNaturali(r, a, h, b, h) != GRANDI_OK
+        || ProdottoNaturali(r + 2 * h, a + h, la1, b + h, lb1) != GRANDI_OK
+        || ProdottoNaturali(z1, sa, ls, sb, lt) != GRANDI_OK)
+    {
+        LiberaArena(sa);
+        return GRANDI_MEMORIA;
+    }
+    lz = ls + lt;
+    TogliNaturale(z1, lz, r, LunghezzaNaturale(r, 2 * h));
+    TogliNaturale(z1, lz, r + 2 * h, LunghezzaNaturale(r + 2 * h, la1 + lb1));
+    AggiungiNaturale(r + h, na + nb - h, z1, LunghezzaNaturale(z1, lz));
+    LiberaArena(sa);
+    return GRANDI_OK;
+}
+
+static inline int ProdottoToom3(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb);
+
+/* r[0..na + nb) = a * b: sceglie l'algoritmo in base alle lunghezze. r non deve sovrapporsi agli operandi. */
+static inline int ProdottoNaturali(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    if (na < nb)
+    {
+        const Cifra *t = a;
+        int nt = na;
+        a = b; na = nb;
+        b = t; nb = nt;
+    }
+    if (nb < SOGLIA_KARATSUBA)
+    {
+        ProdottoScolastico(r, a, na, b, nb);
+        return GRANDI_OK;
+    }
+    if (na >= 2 * nb) return ProdottoSbilanciato(r, a, na, b, nb);
+    if (nb >= SOGLIA_TOOM3) return ProdottoToom3(r, a, na, b, nb);
+    return ProdottoKaratsuba(r, a, na, b, nb);
+}
+
+/* ---------------------------------------------------------------- Numero: segno e memoria */
+
+static inline void InizializzaNumero(Numero *n)
+{
+    memset(n, 0, sizeof(*n));
+}
+
+static inline void LiberaNumero(Numero *n)
+{
+    LiberaArena(n->cifre);
+    InizializzaNumero(n);
+}
+
+/* Garantisce spazio per 'capacita' cifre, conservando il valore */
+static inline int RiservaNumero(Numero *n, int capacita)
+{
+    Cifra *cifre;
+    if (capacita < 1) capacita = 1;
+    if (n->capacita >= capacita) return GRANDI_OK;
+    if ((cifre = RiallocaArena(n->cifre, (size_t)n->capacita * sizeof(Cifra), (size_t)capacita * sizeof(Cifra))) == NULL) return GRANDI_MEMORIA;
+    n->cifre = cifre;
+    n->capacita = capacita;
+    return GRANDI_OK;
+}
+
+/* Sistema lunghezza e segno dopo aver scritto 'lunghezza' cifre */
+static inline void NormalizzaNumero(Numero *n, int lunghezza, int negativo)
+{
+    n->lunghezza = LunghezzaNaturale(n->cifre, lunghezza);
+    n->negativo = n->lunghezza > 0 ? negativo : 0;
+}
+
+/* Sostituisce il valore di 'destinazione' con 'sorgente', che viene svuotato */
+static inline void SostituisciNumero(Numero *destinazione, Numero *sorgente)
+{
+    LiberaArena(destinazione->cifre);
+    *destinazione = *sorgente;
+    InizializzaNumero(sorgente);
+}
+
+/* Vista in sola lettura su cifre altrui (non va liberata né usata come risultato) */
+static inline Numero VistaNumero(const Cifra *cifre, int lunghezza)
+{
+    Numero n;
+    n.cifre = (Cifra *)cifre;
+    n.lunghezza = LunghezzaNaturale(cifre, lunghezza);
+    n.capacita = 0;
+    n.negativo = 0;
+    return n;
+}
+
+static inline int CopiaNumero(Numero *destinazione, const Numero *sorgente)
+{
+    if (destinazione == sorgente) return GRANDI_OK;
+    if (RiservaNumero(destinazione, sorgente->lunghezza) != GRANDI_OK) return GRANDI_MEMORIA;
+    if (sorgente->lunghezza > 0) memcpy(destinazione->cifre, sorgente->cifre, (size_t)sorgente->lunghezza * sizeof(Cifra));
+    destinazione->lunghezza = sorgente->lunghezza;
+    destinazione->negativo = sorgente->negativo;
+    return GRANDI_OK;
+}
+
+static inline int NumeroDaIntero(Numero *n, int64_t valore)
+{
+    uint64_t modulo = valore < 0 ? (uint64_t)0 - (uint64_t)valore : (uint64_t)valore;
+    if (RiservaNumero(n, 2) != GRANDI_OK) return GRANDI_MEMORIA;
+    n->cifre[0] = (Cifra)modulo;
+    n->cifre[1] = (Cifra)(modulo >> 32);
+    NormalizzaNumero(n, 2, valore < 0);
+    return GRANDI_OK;
+}
+
+/* Bit significativi del modulo (0 per lo zero) */
+static inline long BitNumero(const Numero *n)
+{
+    if (n->lunghezza == 0) return 0;
+    return (long)(n->lunghezza - 1) * 32 + (32 - ZeriInTesta(n->cifre[n->lunghezza - 1]));
+}
+
+/* Vista sulle cifre [inizio, inizio + lunghezza) di a, limitate alle na cifre presenti */
+static inline Numero ParteNumero(const Cifra *a, int na, int inizio, int lunghezza)
+{
+    if (inizio >= na) return VistaNumero(a, 0);
+    if (lunghezza > na - inizio) lunghezza = na - inizio;
+    return VistaNumero(a + inizio, lunghezza);
+}
+
+/* r = a + b se 'sottrai' vale 0, r = a - b altrimenti */
+static inline int SommaAlgebrica(Numero *r, const Numero *a, const Numero *b, int sottrai)
+{
+    Numero t;
+    const Numero *x = a, *y = b;
+    int sx = a->negativo, sy = b->negativo ^ (sottrai && b->lunghezza > 0);
+
+    InizializzaNumero(&t);
+    if (sx == sy)
+    {
+        if (x->lunghezza < y->lunghezza)
+        {
+            x = b;
+            y = a;
+        }
+        if (RiservaNumero(&t, x->lunghezza + 1) != GRANDI_OK) return GRANDI_MEMORIA;
+        t.cifre[x->lunghezza] = SommaNaturali(t.cifre, x->cifre, x->lunghezza, y->cifre, y->lunghezza);
+        NormalizzaNumero(&t, x->lunghezza + 1, sx);
+    }
+    else
+    {
+        if (ConfrontaNaturali(x->cifre, x->lunghezza, y->cifre, y->lunghezza) < 0)
+        {
+            x = b;
+            y = a;
+            sx = sy;
+        }
+        if (RiservaNumero(&t, x->lunghezza) != GRANDI_OK) return GRANDI_MEMORIA;
+        SottraiNaturali(t.cifre, x->cifre, x->lunghezza, y->cifre, y->lunghezza);
+        NormalizzaNumero(&t, x->lunghezza, sx);
+    }
+    SostituisciNumero(r, &t);
+    return GRANDI_OK;
+}
+
+static inline int SommaNumeri(Numero *r, const Numero *a, const Numero *b)
+{
+    return SommaAlgebrica(r, a, b, 0);
+}
+
+static inline int SottraiNumeri(Numero *r, const Numero *a, const Numero *b)
+{
+    return SommaAlgebrica(r, a, b, 1);
+}
+
+static inline int MoltiplicaNumeri(Numero *r, const Numero *a, const Numero *b)
+{
+    Numero t;
+    InizializzaNumero(&t);
+    if (a->lunghezza == 0 || b->lunghezza == 0)
+    {
+        LiberaNumero(r);
+        return GRANDI_OK;
+    }
+    if (RiservaNumero(&t, a->lunghezza + b->lunghezza) != GRANDI_OK
+        || ProdottoNaturali(t.cifre, a->cifre, a->lunghezza, b->cifre, b->lunghezza) != GRANDI_OK)
+    {
+        LiberaNumero(&t);
+        return GRANDI_MEMORIA;
+    }
+    NormalizzaNumero(&t, a->lunghezza + b->lunghezza, a->negativo ^ b->negativo);
+    SostituisciNumero(r, &t);
+    return GRANDI_OK;
+}
+
+/* n /= d per una cifra d != 0, in place; la divisione è esatta nei punti in cui la usa Toom-3 */
+static inline void DividiNumeroPerCifra(Numero *n, Cifra d)
+{
+    DividiNaturalePerCifra(n->cifre, n->cifre, n->lunghezza, d);
+    NormalizzaNumero(n, n->lunghezza, n->negativo);
+}
+
+/*
+  Toom-3, con na >= nb > na / 2. Gli operandi si dividono in tre parti di k cifre (a = a2 * B^2k + a1 * B^k + a0) e
+  si vedono come polinomi di secondo grado in B^k. Il prodotto (quarto grado) si ricava dai valori in 0, 1, -1, -2 e
+  all'infinito: cinque prodotti di circa k cifre. I valori in -1 e -2 possono essere negativi, quindi la valutazione
+  e l'interpolazione usano i Numero con segno. La sequenza di interpolazione è quella di Bodrato.
+*/
+static inline int ProdottoToom3(Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    int k = (na + 2) / 3, i, esito = GRANDI_MEMORIA;
+    Numero p[3], q[3];                              /* parti degli operandi (viste, senza copia) */
+    Numero vp[4], vq[4], w[5];                      /* valori in 1, -1, -2 (più uno di appoggio) e prodotti */
+    Numero t;
+    SegnoArena segno = SegnaArena();                /* i temporanei si liberano in un ordine qualsiasi */
+
+    for (i = 0; i < 3; i++)
+    {
+        p[i] = ParteNumero(a, na, i * k, i < 2 ? k : na);   /* la parte alta prende tutte le cifre rimaste */
+        q[i] = ParteNumero(b, nb, i * k, i < 2 ? k : nb);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        InizializzaNumero(&vp[i]);
+        InizializzaNumero(&vq[i]);
+    }
+    for (i = 0; i < 5; i++) InizializzaNumero(&w[i]);
+    InizializzaNumero(&t);
+
+    /* Valutazione: vp[3] = a0 + a2, vp[0] = p(1), vp[1] = p(-1), vp[2] = p(-2) = 2 * (p(-1) + a2) - a0 */
+    for (i = 0; i < 2; i++)
+    {
+        Numero *v = i == 0 ? vp : vq, *parte = i == 0 ? p : q;
+        if (SommaNumeri(&v[3], &parte[0], &parte[2]) != GRANDI_OK
+            || SommaNumeri(&v[0], &v[3], &parte[1]) != GRANDI_OK
+            || SottraiNumeri(&v[1], &v[3], &parte[1]) != GRANDI_OK
+            || SommaNumeri(&v[2], &v[1], &parte[2]) != GRANDI_OK
+            || SommaNumeri(&v[2], &v[2], &v[2]) != GRANDI_OK
+            || SottraiNumeri(&v[2], &v[2], &parte[0]) != GRANDI_OK)
+            goto fine;
+    }
+
+    /* Prodotti: w0 = r(0), w1 = r(1), w2 = r(-1), w3 = r(-2), w4 = r(infinito) */
+    if (MoltiplicaNumeri(&w[0], &p[0], &q[0]) != GRANDI_OK
+        || MoltiplicaNumeri(&w[1], &vp[0], &vq[0]) != GRANDI_OK
+        || MoltiplicaNumeri(&w[2], &vp[1], &vq[1]) != GRANDI_OK
+        || MoltiplicaNumeri(&w[3], &vp[2], &vq[2]) != GRANDI_OK
+        || MoltiplicaNumeri(&w[4], &p[2], &q[2]) != GRANDI_OK)
+        goto fine;
+
+    /* Interpolazione: alla fine w[i] è il coefficiente di grado i, non negativo */
+    if (SottraiNumeri(&w[3], &w[3], &w[1]) != GRANDI_OK) goto fine;       /* w3 = (r(-2) - r(1)) / 3 */
+    DividiNumeroPerCifra(&w[3], 3);
+    if (SottraiNumeri(&t, &w[1], &w[2]) != GRANDI_OK) goto fine;          /* t = (r(1) - r(-1)) / 2 */
+    DividiNumeroPerCifra(&t, 2);
+    if (SottraiNumeri(&w[2], &w[2], &w[0]) != GRANDI_OK) goto fine;       /* w2 = r(-1) - r(0) */
+    if (SottraiNumeri(&w[3], &w[2], &w[3]) != GRANDI_OK) goto fine;       /* w3 = (w2 - w3) / 2 + 2 * r(inf) */
+    DividiNumeroPerCifra(&w[3], 2);
+    if (SommaNumeri(&w[3], &w[3], &w[4]) != GRANDI_OK
+        || SommaNumeri(&w[3], &w[3], &w[4]) != GRANDI_OK
+        || SommaNumeri(&w[2], &w[2], &t) != GRANDI_OK                     /* w2 = w2 + t - r(inf) */
+        || SottraiNumeri(&w[2], &w[2], &w[4]) != GRANDI_OK
+        || SottraiNumeri(&w[1], &t, &w[3]) != GRANDI_OK)                  /* w1 = t - w3 */
+        goto fine;
+
+    /* Ricomposizione: r = somma di w[i] * B^(i k) */
+    memset(r, 0, (size_t)(na + nb) * sizeof(Cifra));
+    for (i = 0; i < 5; i++)
+        if (w[i].lunghezza > 0 && i * k < na + nb) AggiungiNaturale(r + i * k, na + nb - i * k, w[i].cifre, w[i].lunghezza);
+    esito = GRANDI_OK;
+
+fine:
+    for (i = 0; i < 4; i++)
+    {
+        LiberaNumero(&vp[i]);
+        LiberaNumero(&vq[i]);
+    }
+    for (i = 0; i < 5; i++) LiberaNumero(&w[i]);
+    LiberaNumero(&t);
+    RitornaArena(segno);
+    return esito;
+}
+
+/* ---------------------------------------------------------------- Divisione */
+
+/*
+  Algoritmo D di Knuth: q[0..na - nb + 1) = a / b e r[0..nb) = a % b, con na >= nb >= 2 e b[nb - 1] != 0.
+  a può avere cifre nulle in testa. q e r non devono sovrapporsi agli operandi.
+*/
+static inline int DivisioneScolastica(Cifra *q, Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    const CifraDoppia base = (CifraDoppia)1 << 32;
+    int s = ZeriInTesta(b[nb - 1]), i, j;
+    Cifra *u = AllocaArena((size_t)(na + 1 + nb) * sizeof(Cifra)), *v;
+    CifraDoppia qhat, rhat, prodotto, t, riporto;
+    Cifra prestito;
+
+    if (u == NULL) return GRANDI_MEMORIA;
+    v = u + na + 1;
+    SpostaSinistraNaturale(v, b, nb, s);                    /* divisore normalizzato: bit più alto a 1 */
+    u[na] = SpostaSinistraNaturale(u, a, na, s);
+
+    for (j = na - nb; j >= 0; j--)
+    {
+        /* Stima della cifra del quoziente dalle due cifre più alte, corretta al più di 2 */
+        t = ((CifraDoppia)u[j + nb] << 32) | u[j + nb - 1];
+        qhat = t / v[nb - 1];
+        rhat = t % v[nb - 1];
+        while (qhat >= base || qhat * v[nb - 2] > ((rhat << 32) | u[j + nb - 2]))
+        {
+            qhat--;
+            rhat += v[nb - 1];
+            if (rhat >= base) break;
+        }
+
+        /* u[j..j + nb] -= qhat * v */
+        riporto = 0;
+        prestito = 0;
+        for (i = 0; i < nb; i++)
+        {
+            prodotto = qhat * v[i] + riporto;
+            riporto = prodotto >> 32;
+            t = (CifraDoppia)u[i + j] - (Cifra)prodotto - prestito;
+            u[i + j] = (Cifra)t;
+            prestito = (Cifra)(t >> 63);
+        }
+        t = (CifraDoppia)u[j + nb] - riporto - prestito;
+        u[j + nb] = (Cifra)t;
+
+        /* Stima troppo alta di uno (raro): si riaggiunge il divisore */
+        if (t >> 63)
+        {
+            qhat--;
+            u[j + nb] += SommaNaturali(u + j, u + j, nb, v, nb);
+        }
+        q[j] = (Cifra)qhat;
+    }
+
+    SpostaDestraNaturale(r, u, nb, s, u[nb]);
+    LiberaArena(u);
+    return GRANDI_OK;
+}
+
+static inline int Divisione2n1n(Cifra *q, Cifra *r, const Cifra *a, const Cifra *b, int n);
+
+/*
+  Burnikel-Ziegler, passo 3n/2n: q[0..h) e r[0..2h) di a[0..3h) / b[0..2h), con b normalizzato e a < b * B^h.
+  Con a = [A1 A2 A3] e b = [B1 B2] (parti di h cifre, dalla più significativa) la cifra "grande" del quoziente si
+  stima dividendo [A1 A2] per B1 (o vale B^h - 1 se A1 = B1) e si corregge al più due volte.
+*/
+static inline int Divisione3n2n(Cifra *q, Cifra *r, const Cifra *a, const Cifra *b, int h)
+{
+    const Cifra uno = 1;
+    const Cifra *a1 = a + 2 * h, *b1 = b + h;
+    Cifra *spazio = AllocaArena((size_t)(7 * h + 3) * sizeof(Cifra));
+    Cifra *r1, *d, *t;
+
+    if (spazio == NULL) return GRANDI_MEMORIA;
+    r1 = spazio;                /* 2h + 1 cifre: resto della stima */
+    d = r1 + 2 * h + 1;         /* 2h cifre: stima * B2 */
+    t = d + 2 * h;              /* 2h + 1 cifre: [R1 A3] */
+
+    if (ConfrontaNaturali(a1, h, b1, h) < 0)
+    {
+        if (Divisione2n1n(q, r1, a + h, b1, h) != GRANDI_OK)
+        {
+            LiberaArena(spazio);
+            return GRANDI_MEMORIA;
+        }
+        memset(r1 + h, 0, (size_t)(h + 1) * sizeof(Cifra));
+    }
+    else
+    {
+        /* Stima B^h - 1: R1 = [A1 A2] - B1 * B^h + B1 */
+        memset(q, 0xFF, (size_t)h * sizeof(Cifra));
+        memcpy(r1, a + h, (size_t)2 * h * sizeof(Cifra));
+        r1[2 * h] = AggiungiNaturale(r1, 2 * h, b1, h);
+        TogliNaturale(r1 + h, h + 1, b1, h);
+    }
+
+    /* [R1 A3] - stima * B2: se è negativo la stima era troppo alta */
+    if (ProdottoNaturali(d, q, h, b, h) != GRANDI_OK)
+    {
+        LiberaArena(spazio);
+        return GRANDI_MEMORIA;
+    }
+    memcpy(t, a, (size_t)h * sizeof(Cifra));
+    memcpy(t + h, r1, (size_t)(h + 1) * sizeof(Cifra));
+    if (ConfrontaNaturali(t, 2 * h + 1, d, 2 * h) >= 0)
+    {
+        TogliNaturale(t, 2 * h + 1, d, 2 * h);
+        memcpy(r, t, (size_t)2 * h * sizeof(Cifra));
+    }
+    else
+    {
+        /* deficit = stima * B2 - [R1 A3]; si toglie b finché il deficit non è coperto */
+        memcpy(r1, d, (size_t)2 * h * sizeof(Cifra));
+        r1[2 * h] = 0;
+        TogliNaturale(r1, 2 * h + 1, t, 2 * h + 1);
+        while (1)
+        {
+            TogliNaturale(q, h, &uno, 1);
+            if (ConfrontaNaturali(r1, 2 * h + 1, b, 2 * h) <= 0)
+            {
+                memcpy(r, b, (size_t)2 * h * sizeof(Cifra));
+                TogliNaturale(r, 2 * h, r1, LunghezzaNaturale(r1, 2 * h + 1));
+                break;
+            }
+            TogliNaturale(r1, 2 * h + 1, b, 2 * h);
+        }
+    }
+    LiberaArena(spazio);
+    return GRANDI_OK;
+}
+
+/*
+  Burnikel-Ziegler, passo 2n/n: q[0..n) e r[0..n) di a[0..2n) / b[0..n), con b normalizzato (bit più alto a 1) e
+  a < b * B^n. Due passi 3n/2n sulle metà; sotto FOGLIA_BURNIKEL_ZIEGLER (o con n dispari) si usa l'algoritmo D.
+*/
+static inline int Divisione2n1n(Cifra *q, Cifra *r, const Cifra *a, const Cifra *b, int n)
+{
+    int h = n / 2;
+    Cifra *spazio;
+
+    if ((n & 1) || n < FOGLIA_BURNIKEL_ZIEGLER)
+    {
+        if (n == 1)
+        {
+            /* a < b * B: il quoziente sta in una cifra */
+            Cifra quoziente[2];
+            r[0] = DividiNaturalePerCifra(quoziente, a, 2, b[0]);
+            q[0] = quoziente[0];
+            return GRANDI_OK;
+        }
+        if ((spazio = AllocaArena((size_t)(n + 1) * sizeof(Cifra))) == NULL) return GRANDI_MEMORIA;
+        if (DivisioneScolastica(spazio, r, a, 2 * n, b, n) != GRANDI_OK)
+        {
+            LiberaArena(spazio);
+            return GRANDI_MEMORIA;
+        }
+        memcpy(q, spazio, (size_t)n * sizeof(Cifra));   /* la cifra n del quoziente è 0 */
+        LiberaArena(spazio);
+        return GRANDI_OK;
+    }
+
+    if ((spazio = AllocaArena((size_t)3 * h * sizeof(Cifra))) == NULL) return GRANDI_MEMORIA;
+    /* [A1 A2 A3] / b: prima metà del quoziente e resto (2h cifre) subito sopra A4 */
+    if (Divisione3n2n(q + h, spazio + h, a + h, b, h) != GRANDI_OK)
+    {
+        LiberaArena(spazio);
+        return GRANDI_MEMORIA;
+    }
+    memcpy(spazio, a, (size_t)h * sizeof(Cifra));
+    /* [R A4] / b: seconda metà del quoziente e resto finale */
+    if (Divisione3n2n(q, r, spazio, b, h) != GRANDI_OK)
+    {
+        LiberaArena(spazio);
+        return GRANDI_MEMORIA;
+    }
+    LiberaArena(spazio);
+    return GRANDI_OK;
+}
+
+/*
+  Burnikel-Ziegler completo: q[0..na - nb + 1) e r[0..nb). Il divisore si allunga a n = j * 2^k cifre (j sotto
+  FOGLIA_BURNIKEL_ZIEGLER, così la ricorsione arriva all'algoritmo D con metà pari) e si normalizza; il dividendo, spostato allo
+  stesso modo, si divide a blocchi di n cifre con il passo 2n/n.
+*/
+static inline int DivisioneBurnikelZiegler(Cifra *q, Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    int m = 1, n, t, i, sposta_cifre, sposta_bit, la, esito = GRANDI_MEMORIA;
+    long bit;
+    Cifra *bn = NULL, *an = NULL, *z = NULL, *qn = NULL, *rn;
+
+    while (m * FOGLIA_BURNIKEL_ZIEGLER <= nb) m <<= 1;
+    n = ((nb + m - 1) / m) * m;
+    sposta_cifre = n - nb;
+    sposta_bit = ZeriInTesta(b[nb - 1]);
+
+    /* Dividendo spostato: na + sposta_cifre + 1 cifre, in t blocchi da n con il primo sotto B^n / 2 */
+    la = na + sposta_cifre + 1;
+    bit = (long)la * 32;
+    t = (int)(bit / ((long)n * 32)) + 1;
+    if (t < 2) t = 2;
+
+    if ((bn = AllocaArena((size_t)n * sizeof(Cifra))) == NULL
+        || (an = AllocaArena((size_t)t * n * sizeof(Cifra))) == NULL
+        || (z = AllocaArena((size_t)3 * n * sizeof(Cifra))) == NULL
+        || (qn = AllocaArena((size_t)(t - 1) * n * sizeof(Cifra))) == NULL)
+        goto fine;
+    rn = z + 2 * n;
+
+    memset(an, 0, (size_t)t * n * sizeof(Cifra));
+    memset(bn, 0, (size_t)sposta_cifre * sizeof(Cifra));
+    SpostaSinistraNaturale(bn + sposta_cifre, b, nb, sposta_bit);
+    an[na + sposta_cifre] = SpostaSinistraNaturale(an + sposta_cifre, a, na, sposta_bit);
+
+    memcpy(z, an + (size_t)(t - 2) * n, (size_t)2 * n * sizeof(Cifra));
+    for (i = t - 2; i >= 0; i--)
+    {
+        if (Divisione2n1n(qn + (size_t)i * n, rn, z, bn, n) != GRANDI_OK) goto fine;
+        if (i > 0)
+        {
+            memcpy(z + n, rn, (size_t)n * sizeof(Cifra));
+            memcpy(z, an + (size_t)(i - 1) * n, (size_t)n * sizeof(Cifra));
+        }
+    }
+
+    /* Il quoziente non cambia con lo spostamento; il resto va riportato indietro */
+    memset(q, 0, (size_t)(na - nb + 1) * sizeof(Cifra));
+    memcpy(q, qn, (size_t)((na - nb + 1) < (t - 1) * n ? (na - nb + 1) : (t - 1) * n) * sizeof(Cifra));
+    SpostaDestraNaturale(r, rn + sposta_cifre, nb, sposta_bit, 0);
+    esito = GRANDI_OK;
+
+fine:
+    LiberaArena(qn);   /* in ordine inverso: lo spazio nell'arena torna subito libero */
+    LiberaArena(z);
+    LiberaArena(an);
+    LiberaArena(bn);
+    return esito;
+}
+
+/* q[0..na - nb + 1) = a / b e r[0..nb) = a % b, con na >= nb >= 1 e b[nb - 1] != 0: sceglie l'algoritmo */
+static inline int DivisioneNaturali(Cifra *q, Cifra *r, const Cifra *a, int na, const Cifra *b, int nb)
+{
+    if (nb == 1)
+    {
+        r[0] = DividiNaturalePerCifra(q, a, na, b[0]);
+        return GRANDI_OK;
+    }
+    if (nb < SOGLIA_BURNIKEL_ZIEGLER || na - nb < SOGLIA_BURNIKEL_ZIEGLER) return DivisioneScolastica(q, r, a, na, b, nb);
+    return DivisioneBurnikelZiegler(q, r, a, na, b, nb);
+}
+
+/*
+  Divisione troncata verso zero, come per gli interi a 32 bit: il resto ha il segno del dividendo.
+  'quoziente' o 'resto' possono essere NULL. Con divisore 0 entrambi valgono 0 e l'esito è GRANDI_DIVISIONE_PER_ZERO.
+*/
+static inline int DividiNumeri(Numero *quoziente, Numero *resto, const Numero *a, const Numero *b)
+{
+    Numero q, r;
+    int negativo_q = a->negativo ^ b->negativo, negativo_r = a->negativo;
+
+    if (b->lunghezza == 0)
+    {
+        if (quoziente != NULL) LiberaNumero(quoziente);
+        if (resto != NULL) LiberaNumero(resto);
+        return GRANDI_DIVISIONE_PER_ZERO;
+    }
+    InizializzaNumero(&q);
+    InizializzaNumero(&r);
+    if (a->lunghezza < b->lunghezza)
+    {
+        if (resto != NULL && CopiaNumero(resto, a) != GRANDI_OK) return GRANDI_MEMORIA;
+        if (quoziente != NULL) LiberaNumero(quoziente);
+        return GRANDI_OK;
+    }
+    if (RiservaNumero(&q, a->lunghezza - b->lunghezza + 1) != GRANDI_OK || RiservaNumero(&r, b->lunghezza) != GRANDI_OK
+        || DivisioneNaturali(q.cifre, r.cifre, a->cifre, a->lunghezza, b->cifre, b->lunghezza) != GRANDI_OK)
+    {
+        LiberaNumero(&q);
+        LiberaNumero(&r);
+        return GRANDI_MEMORIA;
+    }
+    NormalizzaNumero(&q, a->lunghezza - b->lunghezza + 1, negativo_q);
+    NormalizzaNumero(&r, b->lunghezza, negativo_r);
+    if (quoziente != NULL) SostituisciNumero(quoziente, &q);
+    if (resto != NULL) SostituisciNumero(resto, &r);
+    LiberaNumero(&q);
+    LiberaNumero(&r);
+    return GRANDI_OK;
+}
+
+/*
+  r = base ^ esponente, con il risultato limitato a 'max_cifre' cifre (GRANDI_TROPPO_GRANDE oltre).
+  Un esponente negativo dà la divisione troncata 1 / base^|esponente|: 0, oppure +-1 se |base| = 1.
+*/
+static inline int PotenzaNumero(Numero *r, const Numero *base, const Numero *esponente, int max_cifre)
+{
+    Numero risultato, quadrato;
+    uint32_t e;
+    long bit_base = BitNumero(base);
+    int dispari = esponente->lunghezza > 0 && (esponente->cifre[0] & 1);
+
+    if (esponente->lunghezza == 0) return NumeroDaIntero(r, 1);
+    if (bit_base == 0)
+    {
+        LiberaNumero(r);
+        return esponente->negativo ? GRANDI_DIVISIONE_PER_ZERO : GRANDI_OK;
+    }
+    if (bit_base == 1)   /* |base| = 1 */
+        return NumeroDaIntero(r, (base->negativo && dispari) ? -1 : 1);
+    if (esponente->negativo)
+    {
+        LiberaNumero(r);
+        return GRANDI_OK;
+    }
+
+    /* Il risultato ha almeno (bit_base - 1) * e + 1 bit: si rifiuta prima di calcolarlo */
+    if (esponente->lunghezza > 1 || (double)(bit_base - 1) * esponente->cifre[0] + 1 > (double)max_cifre * 32)
+        return GRANDI_TROPPO_GRANDE;
+    e = esponente->cifre[0];
+
+    InizializzaNumero(&risultato);
+    InizializzaNumero(&quadrato);
+    if (NumeroDaIntero(&risultato, 1) != GRANDI_OK || CopiaNumero(&quadrato, base) != GRANDI_OK) goto memoria;
+    while (1)
+    {
+        if ((e & 1) && MoltiplicaNumeri(&risultato, &risultato, &quadrato) != GRANDI_OK) goto memoria;
+        if ((e >>= 1) == 0) break;
+        if (MoltiplicaNumeri(&quadrato, &quadrato, &quadrato) != GRANDI_OK) goto memoria;
+    }
+    LiberaNumero(&quadrato);
+    if (risultato.lunghezza > max_cifre)
+    {
+        LiberaNumero(&risultato);
+        return GRANDI_TROPPO_GRANDE;
+    }
+    SostituisciNumero(r, &risultato);
+    return GRANDI_OK;
+
+memoria:
+    LiberaNumero(&risultato);
+    LiberaNumero(&quadrato);
+    return GRANDI_MEMORIA;
+}
+
+/* 1 se l'operazione è disponibile sui numeri grandi: A, S, M, D (quoziente), R (resto), E (potenza) */
+static inline int OperazioneGrandiValida(char op)
+{
+    switch (op)
+    {
+        case 'A': case 'a': case 'S': case 's': case 'M': case 'm':
+        case 'D': case 'd': case 'R': case 'r': case 'E': case 'e':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* r = a op b; 'max_cifre' limita il risultato della potenza (le altre operazioni sono limitate dagli operandi) */
+static inline int CalcolaGrandi(char op, Numero *r, const Numero *a, const Numero *b, int max_cifre)
+{
+    switch (op)
+    {
+        case 'A': case 'a': return SommaNumeri(r, a, b);
+        case 'S': case 's': return SottraiNumeri(r, a, b);
+        case 'M': case 'm': return MoltiplicaNumeri(r, a, b);
+        case 'D': case 'd': return DividiNumeri(r, NULL, a, b);
+        case 'R': case 'r': return DividiNumeri(NULL, r, a, b);
+        case 'E': case 'e': return PotenzaNumero(r, a, b, max_cifre);
+        default: return GRANDI_MEMORIA;
+    }
+}
+
+/* ---------------------------------------------------------------- Formato di scambio e testo */
+
+/*
+  Nei messaggi un Numero occupa 4 + L byte: un uint32_t in network order con il segno nel bit 31 e L (byte del
+  modulo) nei bit 0-30, poi il modulo in big-endian. Lo zero ha L = 0; in ingresso si accettano zeri in testa.
+*/
+#define MAX_BYTE_NUMERO 0x7FFFFFFF
+
+/* Byte occupati da n nel formato di scambio */
+static inline uint32_t DimensioneNumero(const Numero *n)
+{
+    return 4 + (uint32_t)((BitNumero(n) + 7) / 8);
+}
+
+/* Scrive n in 'buf' (almeno DimensioneNumero(n) byte); restituisce i byte scritti */
+static inline uint32_t ScriviNumero(unsigned char *buf, const Numero *n)
+{
+    uint32_t byte = DimensioneNumero(n) - 4, i;
+    uint32_t intestazione = htonl(byte | (n->negativo ? 0x80000000u : 0));
+    memcpy(buf, &intestazione, sizeof(intestazione));
+    for (i = 0; i < byte; i++) buf[4 + byte - 1 - i] = (unsigned char)(n->cifre[i / 4] >> (8 * (i % 4)));
+    return 4 + byte;
+}
+
+/*
+  Legge un numero da 'buf' (disponibili 'len' byte): restituisce i byte letti, -1 se il formato non è valido o il numero
+  supera 'max_cifre' cifre, GRANDI_MEMORIA (-1) anche se manca memoria.
+*/
+static inline long LeggiNumero(Numero *n, const unsigned char *buf, uint32_t len, int max_cifre)
+{
+    uint32_t intestazione, byte, inizio = 4, letti, i;
+    if (len < 4) return -1;
+    memcpy(&intestazione, buf, sizeof(intestazione));
+    intestazione = ntohl(intestazione);
+    byte = intestazione & MAX_BYTE_NUMERO;
+    if (byte > len - 4) return -1;
+    letti = 4 + byte;
+    while (byte > 0 && buf[inizio] == 0)   /* zeri in testa */
+    {
+        inizio++;
+        byte--;
+    }
+    if (byte > (uint32_t)max_cifre * 4) return -1;
+    if (RiservaNumero(n, (int)((byte + 3) / 4)) != GRANDI_OK) return -1;
+    memset(n->cifre, 0, (size_t)((byte + 3) / 4) * sizeof(Cifra));
+    for (i = 0; i < byte; i++) n->cifre[i / 4] |= (Cifra)buf[inizio + byte - 1 - i] << (8 * (i % 4));
+    NormalizzaNumero(n, (int)((byte + 3) / 4), (intestazione & 0x80000000u) != 0);
+    return (long)letti;
+}
+
+/* Converte un intero decimale (segno facoltativo, poi solo cifre): 0 se va bene, -1 se il testo non è valido o manca memoria */
+static inline int NumeroDaTesto(Numero *n, const char *testo)
+{
+    int negativo = 0, cifre = 0;
+    Cifra blocco, moltiplicatore;
+    if (*testo == '-' || *testo == '+') negativo = (*testo++ == '-');
+    LiberaNumero(n);
+    while (*testo != '\0')
+    {
+        /* Si aggiungono 9 cifre decimali alla volta: n = n * 10^k + blocco */
+        blocco = 0;
+        moltiplicatore = 1;
+        while (*testo != '\0' && moltiplicatore < 1000000000u)
+        {
+            if (*testo < '0' || *testo > '9') return -1;
+            blocco = blocco * 10 + (Cifra)(*testo++ - '0');
+            moltiplicatore *= 10;
+            cifre++;
+        }
+        if (RiservaNumero(n, n->lunghezza + 1) != GRANDI_OK) return -1;
+        CifraDoppia t = blocco;
+        for (int i = 0; i < n->lunghezza; i++)
+        {
+            t += (CifraDoppia)n->cifre[i] * moltiplicatore;
+            n->cifre[i] = (Cifra)t;
+            t >>= 32;
+        }
+        n->cifre[n->lunghezza] = (Cifra)t;
+        NormalizzaNumero(n, n->lunghezza + 1, 0);
+    }
+    if (cifre == 0) return -1;
+    n->negativo = n->lunghezza > 0 ? negativo : 0;
+    return 0;
+}
+
+/* Testo decimale di n in memoria allocata (da liberare con free()), NULL se manca memoria */
+static inline char *TestoDaNumero(const Numero *n)
+{
+    /* Ogni cifra in base 2^32 vale meno di 10 cifre decimali: blocchi di 9 cifre ottenuti dividendo per 10^9 */
+    size_t capacita = (size_t)n->lunghezza * 10 + 2, pos = capacita - 1;
+    char *testo = malloc(capacita);
+    Cifra *copia = malloc(((size_t)n->lunghezza + 1) * sizeof(Cifra));
+    int lunghezza = n->lunghezza, i;
+
+    if (testo == NULL || copia == NULL)
+    {
+        free(testo);
+        free(copia);
+        return NULL;
+    }
+    if (lunghezza > 0) memcpy(copia, n->cifre, (size_t)lunghezza * sizeof(Cifra));
+    testo[pos] = '\0';
+    do
+    {
+        Cifra blocco = DividiNaturalePerCifra(copia, copia, lunghezza, 1000000000u);
+        lunghezza = LunghezzaNaturale(copia, lunghezza);
+        for (i = 0; i < 9 && (lunghezza > 0 || blocco != 0 || i == 0); i++)
+        {
+            testo[--pos] = (char)('0' + blocco % 10);
+            blocco /= 10;
+        }
+    } while (lunghezza > 0);
+    if (n->negativo) testo[--pos] = '-';
+    memmove(testo, testo + pos, capacita - pos);
+    free(copia);
+    return testo;
+}
+
+#endif /* GRANDI_G35_H */
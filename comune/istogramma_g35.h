@@ -0,0 +1,96 @@
+/*
+  Istogramma delle latenze in stile HDR (High Dynamic Range): valori interi (nanosecondi) da 0 a 2^ISTOGRAMMA_BIT_MAX
+  con errore relativo costante, in memoria fissa e senza allocazioni.
+
+  I valori minori di ISTOGRAMMA_SOTTOPOSTI hanno un posto ciascuno; oltre, ogni potenza di 2 è divisa in
+  ISTOGRAMMA_SOTTOPOSTI / 2 posti di uguale ampiezza. L'errore relativo è quindi al più 2 / ISTOGRAMMA_SOTTOPOSTI
+  (0,8% con 256 sottoposti), sia per 1 microsecondo sia per 10 secondi.
+
+  Registrare un valore costa un conteggio di zeri iniziali e un incremento: l'istogramma si può aggiornare sul
+  percorso critico. Non è protetto da lock: ogni thread usa il proprio e gli istogrammi si uniscono alla fine.
+*/
+#ifndef ISTOGRAMMA_G35_H
+#define ISTOGRAMMA_G35_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define ISTOGRAMMA_BIT_PRECISIONE 8                                 /* 2^8 sottoposti per potenza di 2 */
+#define ISTOGRAMMA_SOTTOPOSTI (1 << ISTOGRAMMA_BIT_PRECISIONE)
+#define ISTOGRAMMA_BIT_MAX 40                                       /* valori fino a 2^40 ns, circa 18 minuti */
+#define ISTOGRAMMA_POSTI ((ISTOGRAMMA_BIT_MAX - ISTOGRAMMA_BIT_PRECISIONE + 2) * (ISTOGRAMMA_SOTTOPOSTI / 2))
+
+typedef struct
+{
+    uint64_t conteggi[ISTOGRAMMA_POSTI];
+    uint64_t totale;            /* valori registrati */
+    uint64_t minimo, massimo;   /* valori esatti, non arrotondati al posto */
+    double somma;               /* per la media */
+} Istogramma;
+
+static inline void AzzeraIstogramma(Istogramma *istogramma)
+{
+    memset(istogramma, 0, sizeof(*istogramma));
+    istogramma->minimo = UINT64_MAX;
+}
+
+/* Posto dell'istogramma che contiene il valore */
+static inline int IndiceIstogramma(uint64_t valore)
+{
+    if (valore >= ((uint64_t)1 << ISTOGRAMMA_BIT_MAX)) valore = ((uint64_t)1 << ISTOGRAMMA_BIT_MAX) - 1;
+    if (valore < ISTOGRAMMA_SOTTOPOSTI) return (int)valore;
+
+    /* Si tengono i ISTOGRAMMA_BIT_PRECISIONE bit più significativi: (valore >> spostamento) sta in [SOTTOPOSTI/2, SOTTOPOSTI) */
+    int spostamento = (63 - __builtin_clzll(valore)) - (ISTOGRAMMA_BIT_PRECISIONE - 1);
+    return spostamento * (ISTOGRAMMA_SOTTOPOSTI / 2) + (int)(valore >> spostamento);
+}
+
+/* Valore più alto che finisce nel posto 'indice' (il percentile riportato non sottostima mai la latenza) */
+static inline uint64_t ValoreIstogramma(int indice)
+{
+    if (indice < ISTOGRAMMA_SOTTOPOSTI) return (uint64_t)indice;
+    int spostamento = indice / (ISTOGRAMMA_SOTTOPOSTI / 2) - 1;
+    uint64_t mantissa = (uint64_t)(indice - spostamento * (ISTOGRAMMA_SOTTOPOSTI / 2));
+    return ((mantissa + 1) << spostamento) - 1;
+}
+
+static inline void RegistraValore(Istogramma *istogramma, uint64_t valore)
+{
+    istogramma->conteggi[IndiceIstogramma(valore)]++;
+    istogramma->totale++;
+    istogramma->somma += (double)valore;
+    if (valore < istogramma->minimo) istogramma->minimo = valore;
+    if (valore > istogramma->massimo) istogramma->massimo = valore;
+}
+
+static inline void UnisciIstogrammi(Istogramma *destinazione, const Istogramma *sorgente)
+{
+    for (int i = 0; i < ISTOGRAMMA_POSTI; i++) destinazione->conteggi[i] += sorgente->conteggi[i];
+    destinazione->totale += sorgente->totale;
+    destinazione->somma += sorgente->somma;
+    if (sorgente->minimo < destinazione->minimo) destinazione->minimo = sorgente->minimo;
+    if (sorgente->massimo > destinazione->massimo) destinazione->massimo = sorgente->massimo;
+}
+
+/* Valore sotto cui cade la frazione 'percentile' (0-100) dei valori registrati; 100 restituisce il massimo esatto */
+static inline uint64_t PercentileIstogramma(const Istogramma *istogramma, double percentile)
+{
+    if (istogramma->totale == 0) return 0;
+    if (percentile >= 100.0) return istogramma->massimo;
+
+    uint64_t soglia = (uint64_t)(percentile / 100.0 * (double)istogramma->totale + 0.5);
+    uint64_t cumulati = 0;
+    if (soglia == 0) soglia = 1;
+    for (int i = 0; i < ISTOGRAMMA_POSTI; i++)
+    {
+        cumulati += istogramma->conteggi[i];
+        if (cumulati >= soglia)
+        {
+            uint64_t valore = ValoreIstogramma(i);
+            return valore < istogramma->massimo ? valore : istogramma->massimo;
+        }
+    }
+    return istogramma->massimo;
+}
+
+#endif /* ISTOGRAMMA_G35_H */
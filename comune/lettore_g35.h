@@ -0,0 +1,132 @@
+/*
+  Lettore bufferizzato per le connessioni TCP: sostituisce lo schema "una recv() per ogni campo" di RecvExact().
+
+  Ogni connessione ha un buffer di ricezione. Una lettura chiede tutto lo spazio libero, quindi una sola recv() porta
+  di solito l'intera richiesta (o più richieste in pipeline). I campi e i messaggi completi si leggono sul posto, con
+  un puntatore dentro il buffer: non si copiano. I byte di una richiesta incompleta vengono spostati all'inizio del
+  buffer solo quando serve spazio per la lettura successiva.
+
+  'esaurito' vale 1 se l'ultima lettura ha restituito meno byte dello spazio offerto: la socket non aveva altro.
+  Con una socket non bloccante e epoll (level-triggered) si può attendere il prossimo EPOLLIN senza tentare una recv()
+  che fallirebbe con EAGAIN.
+
+  Il file contiene solo funzioni static inline, come gli altri file di comune/.
+*/
+#ifndef LETTORE_G35_H
+#define LETTORE_G35_H
+
+#include <string.h>
+
+#if defined (_WIN32)
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+typedef struct
+{
+    char *dati;                 /* buffer di ricezione, fornito dal chiamante */
+    int capacita;
+    int inizio, fine;           /* byte ricevuti e non ancora consumati: dati[inizio .. fine) */
+    int esaurito;               /* 1 se l'ultima lettura non ha riempito lo spazio offerto */
+    unsigned long chiamate;     /* recv() eseguite */
+    unsigned long parziali;     /* recv() che non hanno completato il campo atteso da LeggiLettore() */
+} Lettore;
+
+static inline void InizializzaLettore(Lettore *lettore, char *buffer, int capacita)
+{
+    memset(lettore, 0, sizeof(*lettore));
+    lettore->dati = buffer;
+    lettore->capacita = capacita;
+}
+
+static inline int DisponibiliLettore(const Lettore *lettore)
+{
+    return lettore->fine - lettore->inizio;
+}
+
+/* Primo byte non ancora consumato */
+static inline const char *DatiLettore(const Lettore *lettore)
+{
+    return lettore->dati + lettore->inizio;
+}
+
+/* Segna come consumati n byte. I puntatori di DatiLettore() restano validi fino alla lettura successiva. */
+static inline void ConsumaLettore(Lettore *lettore, int n)
+{
+    lettore->inizio += n;
+    if (lettore->inizio == lettore->fine) lettore->inizio = lettore->fine = 0;
+}
+
+/* Spazio libero in coda al buffer, dopo aver spostato all'inizio i byte non consumati; *spazio = 0 se il buffer è pieno */
+static inline char *SpazioLettore(Lettore *lettore, int *spazio)
+{
+    if (lettore->inizio > 0)
+    {
+        memmove(lettore->dati, lettore->dati + lettore->inizio, lettore->fine - lettore->inizio);
+        lettore->fine -= lettore->inizio;
+        lettore->inizio = 0;
+    }
+    *spazio = lettore->capacita - lettore->fine;
+    return lettore->dati + lettore->fine;
+}
+
+/* Registra l'esito di una lettura di 'richiesti' byte nello spazio restituito da SpazioLettore() */
+static inline void AggiungiLettore(Lettore *lettore, int ricevuti, int richiesti)
+{
+    lettore->chiamate++;
+    if (ricevuti > 0) lettore->fine += ricevuti;
+    lettore->esaurito = (ricevuti >= 0 && ricevuti < richiesti);
+}
+
+/* Una recv() di tutto lo spazio libero: stessa semantica di recv(); -1 anche se il buffer è già pieno */
+static inline int RiempiLettore(Lettore *lettore, int sock)
+{
+    int spazio, n;
+    char *coda = SpazioLettore(lettore, &spazio);
+    if (spazio == 0) return -1;
+    n = recv(sock, coda, spazio, 0);
+    AggiungiLettore(lettore, n, spazio);
+    return n;
+}
+
+/*
+  Equivalente bloccante di RecvExact(): restituisce il puntatore ai prossimi 'len' byte (len <= capacita), letti sul
+  posto e già consumati, oppure NULL se la connessione si chiude o va in errore prima.
+*/
+static inline const char *LeggiLettore(Lettore *lettore, int sock, int len)
+{
+    const char *campo;
+    while (DisponibiliLettore(lettore) < len)
+    {
+        if (len > lettore->capacita || RiempiLettore(lettore, sock) <= 0) return NULL;
+        if (DisponibiliLettore(lettore) < len) lettore->parziali++;
+    }
+    campo = DatiLettore(lettore);
+    ConsumaLettore(lettore, len);
+    return campo;
+}
+
+/*
+  Per i carichi più grandi del buffer (coppie di un batch): copia in 'destinazione' i byte già ricevuti e riceve il
+  resto direttamente lì, senza passare dal buffer. Restituisce len, oppure <= 0 come recv() in caso di chiusura o errore.
+*/
+static inline int CopiaDaLettore(Lettore *lettore, int sock, char *destinazione, int len)
+{
+    int copiati = DisponibiliLettore(lettore), n;
+    if (copiati > len) copiati = len;
+    memcpy(destinazione, DatiLettore(lettore), copiati);
+    ConsumaLettore(lettore, copiati);
+    while (copiati < len)
+    {
+        n = recv(sock, destinazione + copiati, len - copiati, 0);
+        lettore->chiamate++;
+        if (n <= 0) return n;
+        if (n < len - copiati) lettore->parziali++;
+        copiati += n;
+    }
+    return len;
+}
+
+#endif /* LETTORE_G35_H */
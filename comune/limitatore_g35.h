@@ -0,0 +1,144 @@
+/*
+  Limite di frequenza per indirizzo del client: richieste al secondo e byte al secondo, condiviso da tutti i thread.
+
+  Ogni indirizzo IPv4 ha due secchi di gettoni (richieste e byte) gestiti con GCRA (Generic Cell Rate Algorithm), la
+  forma "a calendario" del secchio di gettoni: invece di contare i gettoni rimasti si conserva un solo istante, il
+  TAT (theoretical arrival time), cioè quando il secchio sarebbe di nuovo pieno. Una richiesta che costa c unità sposta
+  il TAT di c * (1 s / frequenza) ed è ammessa se il TAT non supera l'istante corrente di più della tolleranza (un
+  secondo di frequenza: il burst). Stato e aggiornamento stanno in una sola parola da 64 bit, aggiornata con una CAS.
+
+  Le voci stanno in una tabella di dimensione fissa a indirizzamento aperto: un indirizzo si cerca nelle SONDE_LIMITATORE
+  caselle a partire dal suo hash. Una casella libera si occupa con una CAS sulla chiave; se la finestra è piena si
+  sfratta la voce usata meno di recente (approssimazione di LRU limitata alla finestra). Nessun lock: un thread che
+  perde una gara con uno sfratto può addebitare una richiesta alla voce sbagliata, un errore raro e limitato a un burst.
+
+  Su una richiesta rifiutata il server risponde con un esito breve (ESITO_LIMITE_SUPERATO, o il rifiuto della
+  connessione): non fa il lavoro e non alloca niente.
+*/
+#ifndef LIMITATORE_G35_H
+#define LIMITATORE_G35_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define VOCI_LIMITATORE 4096                /* indirizzi seguiti contemporaneamente (potenza di 2) */
+#define SONDE_LIMITATORE 8                  /* caselle esaminate per indirizzo */
+#define TOLLERANZA_LIMITATORE 1000000000ull /* burst: un secondo di frequenza, in ns */
+
+enum { SECCHIO_RICHIESTE, SECCHIO_BYTE, NUM_SECCHI };
+
+typedef struct
+{
+    atomic_uint_least32_t chiave;           /* indirizzo IPv4 in network order (0 = casella libera) */
+    atomic_uint_least64_t ultimo_uso;       /* ns, per lo sfratto */
+    atomic_uint_least64_t tat[NUM_SECCHI];  /* ns */
+} VoceLimitatore;
+
+typedef struct
+{
+    uint64_t frequenza[NUM_SECCHI];         /* unità al secondo (0 = nessun limite per quel secchio) */
+    atomic_ulong sfratti;
+    VoceLimitatore voci[VOCI_LIMITATORE];
+} Limitatore;
+
+/* Tabella vuota; frequenze 0 = nessun limite. NULL se manca la memoria. */
+static inline Limitatore *CreaLimitatore(uint64_t richieste, uint64_t byte)
+{
+    Limitatore *limitatore = calloc(1, sizeof(Limitatore));
+    if (limitatore == NULL) return NULL;
+    limitatore->frequenza[SECCHIO_RICHIESTE] = richieste;
+    limitatore->frequenza[SECCHIO_BYTE] = byte;
+    return limitatore;
+}
+
+/* Voce dell'indirizzo, creata se manca (sfrattando la meno recente della finestra) */
+static inline VoceLimitatore *VoceLimitatoreIndirizzo(Limitatore *limitatore, uint32_t indirizzo, uint64_t ora)
+{
+    unsigned casella = (indirizzo * 0x9E3779B1u) >> (32 - __builtin_ctz(VOCI_LIMITATORE));
+    VoceLimitatore *voce, *meno_recente = NULL;
+    uint_least32_t chiave, libera;
+    uint64_t uso, uso_minimo = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < SONDE_LIMITATORE; i++)
+    {
+        voce = &limitatore->voci[(casella + i) & (VOCI_LIMITATORE - 1)];
+        chiave = atomic_load_explicit(&voce->chiave, memory_order_acquire);
+        if (chiave == 0)
+        {
+            libera = 0;
+            if (atomic_compare_exchange_strong_explicit(&voce->chiave, &libera, indirizzo, memory_order_acq_rel, memory_order_acquire)
+                || libera == indirizzo)
+            {
+                atomic_store_explicit(&voce->ultimo_uso, ora, memory_order_relaxed);
+                return voce;
+            }
+            chiave = libera;   /* un altro thread l'ha occupata per un altro indirizzo */
+        }
+        if (chiave == indirizzo)
+        {
+            /* L'uso si aggiorna al più una volta per millisecondo: meno scritture sulla riga condivisa */
+            if (atomic_load_explicit(&voce->ultimo_uso, memory_order_relaxed) + 1000000 < ora)
+                atomic_store_explicit(&voce->ultimo_uso, ora, memory_order_relaxed);
+            return voce;
+        }
+        uso = atomic_load_explicit(&voce->ultimo_uso, memory_order_relaxed);
+        if (uso < uso_minimo)
+        {
+            uso_minimo = uso;
+            meno_recente = voce;
+        }
+    }
+
+    /* Finestra piena: la voce meno recente passa al nuovo indirizzo con i secchi pieni */
+    chiave = atomic_load_explicit(&meno_recente->chiave, memory_order_relaxed);
+    if (chiave != indirizzo
+        && atomic_compare_exchange_strong_explicit(&meno_recente->chiave, &chiave, indirizzo, memory_order_acq_rel, memory_order_relaxed))
+    {
+        atomic_store_explicit(&meno_recente->tat[SECCHIO_RICHIESTE], 0, memory_order_relaxed);
+        atomic_store_explicit(&meno_recente->tat[SECCHIO_BYTE], 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&limitatore->sfratti, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&meno_recente->ultimo_uso, ora, memory_order_relaxed);
+    return meno_recente;
+}
+
+/* GCRA: prende 'unita' dal secchio se la tolleranza lo consente. Un secchio pieno ammette anche una richiesta più
+   grande del burst, che lascia il secchio in debito. Restituisce il costo addebitato in ns, -1 se la richiesta è rifiutata. */
+static inline int64_t PrendiSecchio(atomic_uint_least64_t *tat, uint64_t frequenza, uint64_t unita, uint64_t ora)
+{
+    uint64_t costo = unita * 1000000000ull / frequenza, precedente, base;
+
+    precedente = atomic_load_explicit(tat, memory_order_relaxed);
+    do
+    {
+        base = precedente > ora ? precedente : ora;
+        if (base > ora && base + costo > ora + TOLLERANZA_LIMITATORE) return -1;
+    } while (!atomic_compare_exchange_weak_explicit(tat, &precedente, base + costo, memory_order_relaxed, memory_order_relaxed));
+    return (int64_t)costo;
+}
+
+/*
+  1 se l'indirizzo può inviare ora una richiesta di 'byte' byte (e la addebita), 0 se supera uno dei due limiti.
+  Se il secondo secchio rifiuta, il costo già preso dal primo viene restituito.
+*/
+static inline int AmmessoDalLimitatore(Limitatore *limitatore, uint32_t indirizzo, uint64_t byte, uint64_t ora)
+{
+    VoceLimitatore *voce;
+    int64_t costo = 0;
+
+    if (limitatore == NULL || indirizzo == 0) return 1;   /* nessun limite, o client locale senza indirizzo */
+    voce = VoceLimitatoreIndirizzo(limitatore, indirizzo, ora);
+    if (limitatore->frequenza[SECCHIO_RICHIESTE] > 0
+        && (costo = PrendiSecchio(&voce->tat[SECCHIO_RICHIESTE], limitatore->frequenza[SECCHIO_RICHIESTE], 1, ora)) < 0) return 0;
+    if (limitatore->frequenza[SECCHIO_BYTE] > 0 && byte > 0
+        && PrendiSecchio(&voce->tat[SECCHIO_BYTE], limitatore->frequenza[SECCHIO_BYTE], byte, ora) < 0)
+    {
+        if (costo > 0) atomic_fetch_sub_explicit(&voce->tat[SECCHIO_RICHIESTE], (uint64_t)costo, memory_order_relaxed);
+        return 0;
+    }
+    return 1;
+}
+
+#endif /* LIMITATORE_G35_H */
@@ -0,0 +1,452 @@
+/*
+  Metriche dei server: durata delle fasi di ogni richiesta e contatori, esportati in formato testo Prometheus.
+
+  Ogni thread che serve richieste ha il proprio insieme di metriche (NuoveMetriche()) e ne è l'unico scrittore: sul
+  percorso delle richieste non ci sono lock, solo una lettura dell'orologio monotono per fase (ChiudiFase()) e
+  incrementi non atomici di un solo scrittore. Chi legge (endpoint di amministrazione e SIGUSR1, solo Linux) somma gli
+  insiemi registrati senza fermare i thread: i contatori si leggono con accessi relaxed, gli istogrammi con letture
+  a 64 bit allineate; un'istantanea può quindi essere leggermente incoerente fra una metrica e l'altra, mai corrotta.
+
+  Esposizione (AvviaMetriche()):
+  - endpoint di amministrazione: socket TCP su 127.0.0.1 che a ogni connessione risponde con una pagina HTTP/1.0
+    contenente le metriche (curl http://127.0.0.1:PORTA/metrics, o come target di Prometheus);
+  - SIGUSR1: le stesse metriche vengono stampate sullo standard output. Il segnale è bloccato in tutti i thread e
+    raccolto da un thread dedicato con sigwait(), quindi non interrompe le chiamate di sistema dei thread di servizio.
+*/
+#ifndef METRICHE_G35_H
+#define METRICHE_G35_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined (_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "istogramma_g35.h"
+#include "espressioni_g35.h"         /* successi e mancati delle cache delle espressioni */
+#include "pool_g35.h"                /* occupazione di slab, buffer e arene */
+#include "cattura_g35.h"             /* richieste registrate e perse dalla cattura del traffico */
+
+#if defined (__linux__)
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#define MAX_FASI_METRICHE 8             /* fasi di una richiesta misurate al massimo da un server */
+#define MAX_INSIEMI_METRICHE 512        /* insiemi di metriche registrati (uno per thread di servizio) */
+
+/*
+  Operazioni contate separatamente: le quattro operazioni, batch, sessione, numeri grandi, espressioni e caratteri
+  non riconosciuti
+*/
+enum { METRICA_ADDIZIONE, METRICA_SOTTRAZIONE, METRICA_MOLTIPLICAZIONE, METRICA_DIVISIONE, METRICA_BATCH,
+       METRICA_SESSIONE, METRICA_GRANDI, METRICA_ESPRESSIONE, METRICA_NON_VALIDA, NUM_OPERAZIONI_METRICHE };
+
+/* Motivi per cui il controllo di ammissione rifiuta del lavoro */
+enum { SCARTO_LIMITE_CONNESSIONI, SCARTO_CODEL_CONNESSIONE, SCARTO_CODEL_MESSAGGIO, SCARTO_LIMITE_INDIRIZZO, NUM_MOTIVI_SCARTO };
+
+/* Scadenze delle connessioni: inattività fra le richieste, intestazione e richiesta incomplete */
+enum { SCADENZA_ATTESA, SCADENZA_INTESTAZIONE, SCADENZA_RICHIESTA, NUM_SCADENZE };
+
+/* Code della pipeline a stadi (comune/pipeline_g35.h): verso i thread di calcolo e di ritorno ai thread di I/O */
+enum { STADIO_CALCOLO, STADIO_COMPLETAMENTO, NUM_STADI };
+
+typedef struct
+{
+    Istogramma fasi[MAX_FASI_METRICHE];             /* durata di ogni fase in nanosecondi */
+    uint64_t richieste[NUM_OPERAZIONI_METRICHE];    /* richieste per operazione */
+    uint64_t divisioni_per_zero;
+    uint64_t letture_corte;                         /* ricezioni con meno byte di quelli attesi */
+    uint64_t invii_falliti;                         /* invii con errore o incompleti */
+    uint64_t chiamate_sistema;                      /* chiamate di sistema sul percorso delle richieste (ricezione, invio, attesa) */
+    uint64_t richieste_duplicate;                   /* ritrasmissioni servite con una risposta già calcolata (UDP) */
+    uint64_t scarti[NUM_MOTIVI_SCARTO];             /* lavoro rifiutato dal controllo di ammissione, per motivo */
+    uint64_t scadenze[NUM_SCADENZE];                /* connessioni chiuse per una scadenza, per fase */
+    Istogramma attese_stadi[NUM_STADI];             /* tempo passato nella coda di ogni stadio in nanosecondi */
+    uint64_t accodati[NUM_STADI];                   /* lavori entrati nella coda (scritto da chi accoda) */
+    uint64_t prelevati[NUM_STADI];                  /* lavori usciti dalla coda (scritto da chi preleva) */
+} Metriche;
+
+/* Orologio monotono in nanosecondi */
+static inline uint64_t OraMetriche(void)
+{
+#if defined (_WIN32)
+    LARGE_INTEGER frequenza, contatore;
+    QueryPerformanceFrequency(&frequenza);
+    QueryPerformanceCounter(&contatore);
+    return (uint64_t)((double)contatore.QuadPart * 1e9 / (double)frequenza.QuadPart);
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+#endif
+}
+
+/* Incremento di un contatore da parte del suo unico scrittore: load + store relaxed, letto senza lock da altri thread */
+static inline void AggiornaMetrica(uint64_t *contatore, uint64_t delta)
+{
+#if defined (__GNUC__)
+    __atomic_store_n(contatore, __atomic_load_n(contatore, __ATOMIC_RELAXED) + delta, __ATOMIC_RELAXED);
+#else
+    *contatore += delta;
+#endif
+}
+
+static inline uint64_t LeggiMetrica(const uint64_t *contatore)
+{
+#if defined (__GNUC__)
+    return __atomic_load_n(contatore, __ATOMIC_RELAXED);
+#else
+    return *contatore;
+#endif
+}
+
+/* Registra la durata della fase iniziata all'istante 'inizio' e restituisce l'istante attuale, inizio della fase successiva */
+static inline uint64_t ChiudiFase(Metriche *metriche, int fase, uint64_t inizio)
+{
+    uint64_t ora = OraMetriche();
+    RegistraValore(&metriche->fasi[fase], ora - inizio);
+    return ora;
+}
+
+/* Conta una richiesta dell'operazione 'op' (carattere del protocollo) */
+static inline void ContaOperazione(Metriche *metriche, char op)
+{
+    int indice;
+    switch (toupper((unsigned char)op))
+    {
+        case 'A': indice = METRICA_ADDIZIONE; break;
+        case 'S': indice = METRICA_SOTTRAZIONE; break;
+        case 'M': indice = METRICA_MOLTIPLICAZIONE; break;
+        case 'D': indice = METRICA_DIVISIONE; break;
+        case 'B': indice = METRICA_BATCH; break;
+        case 'P': indice = METRICA_SESSIONE; break;
+        case 'G': indice = METRICA_GRANDI; break;
+        case 'X': indice = METRICA_ESPRESSIONE; break;
+        default:  indice = METRICA_NON_VALIDA; break;
+    }
+    AggiornaMetrica(&metriche->richieste[indice], 1);
+}
+
+/* Configurazione dell'esportazione, impostata da AvviaMetriche() */
+static const char *server_metriche = "";
+static const char *const *nomi_fasi_metriche;
+static int num_fasi_metriche;
+
+#if defined (__linux__)
+static _Atomic(Metriche *) insiemi_metriche[MAX_INSIEMI_METRICHE];
+static atomic_int num_insiemi_metriche;
+#endif
+
+/* Alloca e registra l'insieme di metriche di un thread di servizio (NULL se manca la memoria) */
+static inline Metriche *NuoveMetriche(void)
+{
+    Metriche *metriche = malloc(sizeof(Metriche));
+    if (metriche == NULL) return NULL;
+    memset(metriche, 0, sizeof(Metriche));
+    for (int i = 0; i < MAX_FASI_METRICHE; i++) AzzeraIstogramma(&metriche->fasi[i]);
+    for (int i = 0; i < NUM_STADI; i++) AzzeraIstogramma(&metriche->attese_stadi[i]);
+
+#if defined (__linux__)
+    /* Più thread si registrano insieme (worker, thread di calcolo): il posto si prende con un incremento atomico e
+       chi legge vede l'insieme solo dopo che è stato inizializzato (store release del puntatore) */
+    int posto = atomic_fetch_add(&num_insiemi_metriche, 1);
+    if (posto < MAX_INSIEMI_METRICHE) atomic_store_explicit(&insiemi_metriche[posto], metriche, memory_order_release);
+#endif
+    return metriche;
+}
+
+#if defined (__linux__)
+/* Scrive su 'out' la somma di tutti gli insiemi registrati in formato testo Prometheus */
+static inline void ScriviMetriche(FILE *out)
+{
+    static const char *const nomi_operazioni[NUM_OPERAZIONI_METRICHE] = { "A", "S", "M", "D", "B", "P", "G", "X", "non_valida" };
+    static const char *const nomi_scarti[NUM_MOTIVI_SCARTO] = { "limite_connessioni", "codel_connessione", "codel_messaggio",
+                                                                 "limite_indirizzo" };
+    static const char *const nomi_scadenze[NUM_SCADENZE] = { "attesa", "intestazione", "richiesta" };
+    static const char *const nomi_stadi[NUM_STADI] = { "calcolo", "completamento" };
+    static const char *const nomi_pool[NUM_TIPI_POOL] = { "connessioni", "buffer", "arena" };
+    static const double quantili[] = { 0.5, 0.9, 0.99, 0.999 };
+    Metriche *somma = malloc(sizeof(Metriche));
+    int n = atomic_load_explicit(&num_insiemi_metriche, memory_order_acquire);
+    int i, f, q;
+
+    if (somma == NULL) return;
+    if (n > MAX_INSIEMI_METRICHE) n = MAX_INSIEMI_METRICHE;
+    memset(somma, 0, sizeof(Metriche));
+    for (f = 0; f < num_fasi_metriche; f++) AzzeraIstogramma(&somma->fasi[f]);
+    for (f = 0; f < NUM_STADI; f++) AzzeraIstogramma(&somma->attese_stadi[f]);
+    for (i = 0; i < n; i++)
+    {
+        const Metriche *insieme = atomic_load_explicit(&insiemi_metriche[i], memory_order_acquire);
+        if (insieme == NULL) continue;   /* posto preso ma non ancora pubblicato */
+        for (f = 0; f < num_fasi_metriche; f++) UnisciIstogrammi(&somma->fasi[f], &insieme->fasi[f]);
+        for (q = 0; q < NUM_OPERAZIONI_METRICHE; q++) somma->richieste[q] += LeggiMetrica(&insieme->richieste[q]);
+        somma->divisioni_per_zero += LeggiMetrica(&insieme->divisioni_per_zero);
+        somma->letture_corte += LeggiMetrica(&insieme->letture_corte);
+        somma->invii_falliti += LeggiMetrica(&insieme->invii_falliti);
+        somma->chiamate_sistema += LeggiMetrica(&insieme->chiamate_sistema);
+        somma->richieste_duplicate += LeggiMetrica(&insieme->richieste_duplicate);
+        for (q = 0; q < NUM_MOTIVI_SCARTO; q++) somma->scarti[q] += LeggiMetrica(&insieme->scarti[q]);
+        for (q = 0; q < NUM_SCADENZE; q++) somma->scadenze[q] += LeggiMetrica(&insieme->scadenze[q]);
+        for (q = 0; q < NUM_STADI; q++)
+        {
+            UnisciIstogrammi(&somma->attese_stadi[q], &insieme->attese_stadi[q]);
+            somma->accodati[q] += LeggiMetrica(&insieme->accodati[q]);
+            somma->prelevati[q] += LeggiMetrica(&insieme->prelevati[q]);
+        }
+    }
+
+    fprintf(out, "# HELP calcolatrice_fase_secondi Durata delle fasi di una richiesta.\n");
+    fprintf(out, "# TYPE calcolatrice_fase_secondi summary\n");
+    for (f = 0; f < num_fasi_metriche; f++)
+    {
+        const Istogramma *istogramma = &somma->fasi[f];
+        for (q = 0; q < (int)(sizeof(quantili) / sizeof(quantili[0])); q++)
+        {
+            fprintf(out, "calcolatrice_fase_secondi{server=\"%s\",fase=\"%s\",quantile=\"%g\"} %.9f\n", server_metriche,
+                    nomi_fasi_metriche[f], quantili[q], PercentileIstogramma(istogramma, quantili[q] * 100.0) / 1e9);
+        }
+        fprintf(out, "calcolatrice_fase_secondi_sum{server=\"%s\",fase=\"%s\"} %.9f\n", server_metriche, nomi_fasi_metriche[f], istogramma->somma / 1e9);
+        fprintf(out, "calcolatrice_fase_secondi_count{server=\"%s\",fase=\"%s\"} %llu\n", server_metriche, nomi_fasi_metriche[f],
+                (unsigned long long)istogramma->totale);
+    }
+    fprintf(out, "# HELP calcolatrice_fase_massimo_secondi Durata massima di ogni fase dall'avvio.\n");
+    fprintf(out, "# TYPE calcolatrice_fase_massimo_secondi gauge\n");
+    for (f = 0; f < num_fasi_metriche; f++)
+    {
+        fprintf(out, "calcolatrice_fase_massimo_secondi{server=\"%s\",fase=\"%s\"} %.9f\n", server_metriche, nomi_fasi_metriche[f],
+                somma->fasi[f].massimo / 1e9);
+    }
+
+    fprintf(out, "# HELP calcolatrice_richieste_totali Richieste ricevute per operazione.\n");
+    fprintf(out, "# TYPE calcolatrice_richieste_totali counter\n");
+    for (q = 0; q < NUM_OPERAZIONI_METRICHE; q++)
+    {
+        fprintf(out, "calcolatrice_richieste_totali{server=\"%s\",operazione=\"%s\"} %llu\n", server_metriche, nomi_operazioni[q],
+                (unsigned long long)somma->richieste[q]);
+    }
+    fprintf(out, "# HELP calcolatrice_divisioni_per_zero_totali Divisioni con divisore 0 (risultato 0).\n");
+    fprintf(out, "# TYPE calcolatrice_divisioni_per_zero_totali counter\n");
+    fprintf(out, "calcolatrice_divisioni_per_zero_totali{server=\"%s\"} %llu\n", server_metriche, (unsigned long long)somma->divisioni_per_zero);
+    fprintf(out, "# HELP calcolatrice_letture_corte_totali Ricezioni con meno byte di quelli attesi.\n");
+    fprintf(out, "# TYPE calcolatrice_letture_corte_totali counter\n");
+    fprintf(out, "calcolatrice_letture_corte_totali{server=\"%s\"} %llu\n", server_metriche, (unsigned long long)somma->letture_corte);
+    fprintf(out, "# HELP calcolatrice_invii_falliti_totali Invii falliti o incompleti.\n");
+    fprintf(out, "# TYPE calcolatrice_invii_falliti_totali counter\n");
+    fprintf(out, "calcolatrice_invii_falliti_totali{server=\"%s\"} %llu\n", server_metriche, (unsigned long long)somma->invii_falliti);
+    fprintf(out, "# HELP calcolatrice_chiamate_sistema_totali Chiamate di sistema per ricevere, inviare e attendere le richieste.\n");
+    fprintf(out, "# TYPE calcolatrice_chiamate_sistema_totali counter\n");
+    fprintf(out, "calcolatrice_chiamate_sistema_totali{server=\"%s\"} %llu\n", server_metriche, (unsigned long long)somma->chiamate_sistema);
+    fprintf(out, "# HELP calcolatrice_richieste_duplicate_totali Richieste ritrasmesse servite con la risposta già calcolata.\n");
+    fprintf(out, "# TYPE calcolatrice_richieste_duplicate_totali counter\n");
+    fprintf(out, "calcolatrice_richieste_duplicate_totali{server=\"%s\"} %llu\n", server_metriche, (unsigned long long)somma->richieste_duplicate);
+    fprintf(out, "# HELP calcolatrice_scarti_totali Connessioni e messaggi rifiutati dal controllo di ammissione, per motivo.\n");
+    fprintf(out, "# TYPE calcolatrice_scarti_totali counter\n");
+    for (q = 0; q < NUM_MOTIVI_SCARTO; q++)
+    {
+        fprintf(out, "calcolatrice_scarti_totali{server=\"%s\",motivo=\"%s\"} %llu\n", server_metriche, nomi_scarti[q],
+                (unsigned long long)somma->scarti[q]);
+    }
+    fprintf(out, "# HELP calcolatrice_scadenze_totali Connessioni chiuse per una scadenza, per fase.\n");
+    fprintf(out, "# TYPE calcolatrice_scadenze_totali counter\n");
+    for (q = 0; q < NUM_SCADENZE; q++)
+    {
+        fprintf(out, "calcolatrice_scadenze_totali{server=\"%s\",fase=\"%s\"} %llu\n", server_metriche, nomi_scadenze[q],
+                (unsigned long long)somma->scadenze[q]);
+    }
+    /* Profondità: differenza fra due somme lette in momenti diversi, quindi approssimata (e limitata a 0) */
+    fprintf(out, "# HELP calcolatrice_stadio_coda Lavori in attesa nella coda di ogni stadio della pipeline.\n");
+    fprintf(out, "# TYPE calcolatrice_stadio_coda gauge\n");
+    for (q = 0; q < NUM_STADI; q++)
+    {
+        fprintf(out, "calcolatrice_stadio_coda{server=\"%s\",stadio=\"%s\"} %lld\n", server_metriche, nomi_stadi[q],
+                somma->accodati[q] > somma->prelevati[q] ? (long long)(somma->accodati[q] - somma->prelevati[q]) : 0LL);
+    }
+    fprintf(out, "# HELP calcolatrice_stadio_attesa_secondi Tempo passato nella coda di ogni stadio della pipeline.\n");
+    fprintf(out, "# TYPE calcolatrice_stadio_attesa_secondi summary\n");
+    for (q = 0; q < NUM_STADI; q++)
+    {
+        const Istogramma *istogramma = &somma->attese_stadi[q];
+        for (f = 0; f < (int)(sizeof(quantili) / sizeof(quantili[0])); f++)
+        {
+            fprintf(out, "calcolatrice_stadio_attesa_secondi{server=\"%s\",stadio=\"%s\",quantile=\"%g\"} %.9f\n", server_metriche,
+                    nomi_stadi[q], quantili[f], PercentileIstogramma(istogramma, quantili[f] * 100.0) / 1e9);
+        }
+        fprintf(out, "calcolatrice_stadio_attesa_secondi_sum{server=\"%s\",stadio=\"%s\"} %.9f\n", server_metriche, nomi_stadi[q],
+                istogramma->somma / 1e9);
+        fprintf(out, "calcolatrice_stadio_attesa_secondi_count{server=\"%s\",stadio=\"%s\"} %llu\n", server_metriche, nomi_stadi[q],
+                (unsigned long long)istogramma->totale);
+    }
+
+    uint64_t successi, mancati;
+    ContatoriPool pool[NUM_TIPI_POOL];
+    StatisticheCacheEspressioni(&successi, &mancati);
+    fprintf(out, "# HELP calcolatrice_cache_espressioni_totali Ricerche nella cache delle espressioni compilate.\n");
+    fprintf(out, "# TYPE calcolatrice_cache_espressioni_totali counter\n");
+    fprintf(out, "calcolatrice_cache_espressioni_totali{server=\"%s\",esito=\"successo\"} %llu\n", server_metriche, (unsigned long long)successi);
+    fprintf(out, "calcolatrice_cache_espressioni_totali{server=\"%s\",esito=\"mancato\"} %llu\n", server_metriche, (unsigned long long)mancati);
+    fprintf(out, "# HELP calcolatrice_cache_espressioni_successo Frazione delle ricerche trovate in cache dall'avvio.\n");
+    fprintf(out, "# TYPE calcolatrice_cache_espressioni_successo gauge\n");
+    fprintf(out, "calcolatrice_cache_espressioni_successo{server=\"%s\"} %.6f\n", server_metriche,
+            successi + mancati > 0 ? (double)successi / (double)(successi + mancati) : 0.0);
+
+    StatistichePool(pool);
+    fprintf(out, "# HELP calcolatrice_pool_in_uso Occupazione corrente dei pool di memoria (oggetti per le connessioni, byte per buffer e arena).\n");
+    fprintf(out, "# TYPE calcolatrice_pool_in_uso gauge\n");
+    for (q = 0; q < NUM_TIPI_POOL; q++)
+        fprintf(out, "calcolatrice_pool_in_uso{server=\"%s\",pool=\"%s\"} %llu\n", server_metriche, nomi_pool[q], (unsigned long long)pool[q].in_uso);
+    fprintf(out, "# HELP calcolatrice_pool_massimo Massima occupazione dall'avvio (per l'arena: la richiesta più grande), somma dei pool dei thread.\n");
+    fprintf(out, "# TYPE calcolatrice_pool_massimo gauge\n");
+    for (q = 0; q < NUM_TIPI_POOL; q++)
+        fprintf(out, "calcolatrice_pool_massimo{server=\"%s\",pool=\"%s\"} %llu\n", server_metriche, nomi_pool[q], (unsigned long long)pool[q].massimo);
+    fprintf(out, "# HELP calcolatrice_pool_riservati Memoria presa dall'heap e trattenuta dai pool, in uso o inattiva.\n");
+    fprintf(out, "# TYPE calcolatrice_pool_riservati gauge\n");
+    for (q = 0; q < NUM_TIPI_POOL; q++)
+        fprintf(out, "calcolatrice_pool_riservati{server=\"%s\",pool=\"%s\"} %llu\n", server_metriche, nomi_pool[q], (unsigned long long)pool[q].riservati);
+    fprintf(out, "# HELP calcolatrice_pool_allocazioni_totali Richieste all'allocatore di sistema (a regime non crescono).\n");
+    fprintf(out, "# TYPE calcolatrice_pool_allocazioni_totali counter\n");
+    for (q = 0; q < NUM_TIPI_POOL; q++)
+        fprintf(out, "calcolatrice_pool_allocazioni_totali{server=\"%s\",pool=\"%s\"} %llu\n", server_metriche, nomi_pool[q],
+                (unsigned long long)pool[q].allocazioni);
+
+    uint64_t registrate, perse;
+    StatisticheCattura(&registrate, &perse);
+    fprintf(out, "# HELP calcolatrice_cattura_richieste_totali Richieste scritte nel file di cattura (-R) o perse.\n");
+    fprintf(out, "# TYPE calcolatrice_cattura_richieste_totali counter\n");
+    fprintf(out, "calcolatrice_cattura_richieste_totali{server=\"%s\",esito=\"registrata\"} %llu\n", server_metriche, (unsigned long long)registrate);
+    fprintf(out, "calcolatrice_cattura_richieste_totali{server=\"%s\",esito=\"persa\"} %llu\n", server_metriche, (unsigned long long)perse);
+    free(somma);
+}
+
+/* Thread che raccoglie SIGUSR1 e stampa le metriche */
+static void *ThreadSegnaleMetriche(void *arg)
+{
+    sigset_t segnali;
+    int segnale;
+    (void)arg;
+
+    sigemptyset(&segnali);
+    sigaddset(&segnali, SIGUSR1);
+    while (1)
+    {
+        if (sigwait(&segnali, &segnale) != 0) continue;
+        printf("\n--- Metriche (SIGUSR1) ---\n");
+        ScriviMetriche(stdout);
+        fflush(stdout);
+    }
+    return NULL;
+}
+
+/* Thread dell'endpoint di amministrazione: una risposta HTTP/1.0 con le metriche per ogni connessione */
+static void *ThreadAmministrazione(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    char richiesta[1024];
+    struct timeval timeout = { 1, 0 };
+
+    while (1)
+    {
+        int client = accept(sock, NULL, NULL);
+        if (client < 0) continue;
+
+        /* Si legge (e si ignora) la richiesta HTTP, se arriva; anche una connessione senza richiesta riceve le metriche */
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        recv(client, richiesta, sizeof(richiesta), 0);
+
+        char *testo = NULL;
+        size_t lunghezza = 0;
+        FILE *out = open_memstream(&testo, &lunghezza);
+        if (out != NULL)
+        {
+            fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+            ScriviMetriche(out);
+            fclose(out);
+            for (size_t inviati = 0; inviati < lunghezza; )
+            {
+                ssize_t n = send(client, testo + inviati, lunghezza - inviati, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                inviati += (size_t)n;
+            }
+            free(testo);
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+/* Apre la socket dell'endpoint di amministrazione su 127.0.0.1:porta */
+static inline int ApriSocketAmministrazione(int porta)
+{
+    struct sockaddr_in indirizzo;
+    int sock, attiva = 1;
+
+    if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) return -1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &attiva, sizeof(attiva));
+    memset(&indirizzo, 0, sizeof(indirizzo));
+    indirizzo.sin_family = AF_INET;
+    indirizzo.sin_addr.s_addr = htonl(INADDR_LOOPBACK);   /* solo locale */
+    indirizzo.sin_port = htons((uint16_t)porta);
+    if (bind(sock, (struct sockaddr *)&indirizzo, sizeof(indirizzo)) < 0 || listen(sock, 8) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+#endif
+
+/*
+  Avvia l'esportazione delle metriche di 'server' ("tcp" o "udp"), con le fasi 'nomi_fasi'. Va chiamata dal thread
+  principale prima di creare gli altri thread, che ereditano SIGUSR1 bloccato. 'porta_admin' = 0: solo SIGUSR1.
+  Restituisce 0, oppure -1 se l'endpoint di amministrazione non si è potuto aprire.
+*/
+static inline int AvviaMetriche(const char *server, const char *const *nomi_fasi, int num_fasi, int porta_admin)
+{
+    server_metriche = server;
+    nomi_fasi_metriche = nomi_fasi;
+    num_fasi_metriche = num_fasi < MAX_FASI_METRICHE ? num_fasi : MAX_FASI_METRICHE;
+
+#if defined (__linux__)
+    pthread_t thread;
+    sigset_t segnali;
+    sigemptyset(&segnali);
+    sigaddset(&segnali, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &segnali, NULL);
+    if (pthread_create(&thread, NULL, ThreadSegnaleMetriche, NULL) == 0) pthread_detach(thread);
+
+    if (porta_admin > 0)
+    {
+        int sock = ApriSocketAmministrazione(porta_admin);
+        if (sock < 0)
+        {
+            printf("Impossibile aprire l'endpoint delle metriche sulla porta %d.\n", porta_admin);
+            return -1;
+        }
+        if (pthread_create(&thread, NULL, ThreadAmministrazione, (void *)(intptr_t)sock) != 0)
+        {
+            close(sock);
+            return -1;
+        }
+        pthread_detach(thread);
+        printf("Metriche su http://127.0.0.1:%d/metrics (kill -USR1 %d per stamparle).\n", porta_admin, (int)getpid());
+    }
+#else
+    if (porta_admin > 0) printf("Endpoint delle metriche non disponibile su questo sistema.\n");
+#endif
+    return 0;
+}
+
+#endif /* METRICHE_G35_H */
@@ -0,0 +1,364 @@
+/*
+  Pipeline a stadi (SEDA) fra i thread di I/O dei server e un gruppo di thread di calcolo (solo Linux).
+
+  Un thread di I/O che riceve una richiesta pesante (batch, numeri grandi, espressioni) non la calcola fra la recv() e
+  la send(): ne accoda il descrittore (LavoroPipeline, un campo della struttura del server che contiene richiesta e
+  spazio per la risposta) nella coda di calcolo e torna a servire le altre socket.
+
+  Stadio 1, coda di calcolo: coda limitata a più produttori e più consumatori senza lock (D. Vyukov). Ogni casella ha
+  un numero di sequenza che dice se è libera per il giro corrente dei produttori (sequenza == posizione) o pronta per
+  i consumatori (sequenza == posizione + 1); produttori e consumatori si prenotano una posizione con una CAS sul proprio
+  indice e non si toccano mai la stessa casella insieme. I thread di calcolo prelevano fino a LOTTO_PIPELINE lavori per
+  volta e li eseguono con la funzione del server.
+
+  Stadio 2, completamenti: ogni lavoro torna al thread di I/O che l'ha accodato su un anello a un solo produttore e un
+  solo consumatore: ogni thread di I/O ha un anello per thread di calcolo e un eventfd registrato nel suo ciclo ad
+  eventi. Finito un lotto, il thread di calcolo scrive sull'eventfd di ogni thread di I/O servito, ma solo se il suo
+  flag 'segnalato' era spento: più completamenti arrivati insieme costano una sola scrittura e una sola lettura.
+
+  Contropressione: un thread di I/O non ha mai più di POSIZIONI_COMPLETAMENTI lavori in volo, così un anello di
+  completamento non può riempirsi. Se il limite è raggiunto o la coda di calcolo è piena, InviaLavoro() restituisce 0
+  e il chiamante calcola sul posto, come senza pipeline: nessuno attende.
+
+  Un thread di calcolo che trova la coda vuota la ricontrolla GIRI_PIPELINE volte, poi dorme su un futex (lo schema di
+  comune/anello_condiviso_g35.h): un produttore chiama FUTEX_WAKE solo se qualcuno dorme.
+
+  Metriche per stadio (STADIO_*, comune/metriche_g35.h): lavori accodati e prelevati, la cui differenza è la profondità
+  della coda, e tempo passato in coda. Ogni thread di calcolo ha il proprio insieme di metriche.
+
+  Il file contiene solo funzioni static inline, come gli altri file di comune/.
+*/
+#ifndef PIPELINE_G35_H
+#define PIPELINE_G35_H
+
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metriche_g35.h"
+
+#define POSIZIONI_CODA_CALCOLO 1024         /* lavori nella coda di calcolo (potenza di 2) */
+#define POSIZIONI_COMPLETAMENTI 256         /* lavori in volo al massimo per thread di I/O (potenza di 2) */
+#define LOTTO_PIPELINE 16                   /* lavori prelevati insieme da un thread di calcolo */
+#define GIRI_PIPELINE 200                   /* controlli della coda vuota prima di dormire */
+#define MAX_THREAD_CALCOLO 64
+
+#if defined (__x86_64__) || defined (__i386__)
+#define PAUSA_PIPELINE() __builtin_ia32_pause()
+#else
+#define PAUSA_PIPELINE() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+struct CompletamentiPipeline;
+
+typedef struct LavoroPipeline
+{
+    struct CompletamentiPipeline *ritorno;  /* thread di I/O che ha accodato il lavoro */
+    uint64_t accodato;                      /* ns: ingresso nella coda dello stadio corrente */
+} LavoroPipeline;
+
+/* Esegue un lavoro su un thread di calcolo; 'metriche' è l'insieme del thread */
+typedef void (*EseguiLavoro)(LavoroPipeline *lavoro, Metriche *metriche);
+
+typedef struct
+{
+    atomic_size_t sequenza;
+    LavoroPipeline *lavoro;
+} CasellaCalcolo;
+
+typedef struct
+{
+    _Alignas(64) atomic_size_t coda;        /* prossima posizione da scrivere (produttori) */
+    _Alignas(64) atomic_size_t testa;       /* prossima posizione da leggere (consumatori) */
+    _Alignas(64) atomic_uint evento;        /* futex: incrementato per svegliare un thread di calcolo */
+    atomic_int dormienti;                   /* thread di calcolo che dormono (o stanno per dormire) sul futex */
+    atomic_int fermata;                     /* 1: i thread di calcolo terminano (avvio della pipeline fallito) */
+    _Alignas(64) CasellaCalcolo caselle[POSIZIONI_CODA_CALCOLO];
+} CodaCalcolo;
+
+/* Completamenti da un thread di calcolo a un thread di I/O: testa e coda su linee di cache diverse */
+typedef struct
+{
+    _Alignas(64) atomic_uint testa;         /* scritto solo dal thread di calcolo */
+    _Alignas(64) atomic_uint coda;          /* scritto solo dal thread di I/O */
+    LavoroPipeline *lavori[POSIZIONI_COMPLETAMENTI];
+} AnelloCompletamenti;
+
+typedef struct PipelineCalcolo
+{
+    CodaCalcolo coda;
+    EseguiLavoro esegui;
+    int num_thread;
+    atomic_int avviati;                     /* indice del prossimo thread di calcolo */
+} PipelineCalcolo;
+
+/* Stato di un thread di I/O: gli anelli (uno per thread di calcolo) e l'eventfd che li segnala */
+typedef struct CompletamentiPipeline
+{
+    PipelineCalcolo *pipeline;
+    Metriche *metriche;                     /* del thread di I/O */
+    int eventfd;                            /* da registrare nel ciclo ad eventi del thread di I/O */
+    int in_volo;                            /* lavori accodati e non ancora raccolti (solo thread di I/O) */
+    _Alignas(64) atomic_int segnalato;      /* 1 se l'eventfd è già stato scritto e non ancora letto */
+    AnelloCompletamenti *anelli;            /* pipeline->num_thread anelli */
+} CompletamentiPipeline;
+
+static inline long FutexPipeline(atomic_uint *parola, int operazione, uint32_t valore)
+{
+    return syscall(SYS_futex, (uint32_t *)parola, operazione | FUTEX_PRIVATE_FLAG, valore, NULL, NULL, 0);
+}
+
+/* Produttore (thread di I/O): 1 se il lavoro è entrato nella coda, 0 se è piena */
+static inline int AccodaCalcolo(CodaCalcolo *coda, LavoroPipeline *lavoro)
+{
+    size_t posizione = atomic_load_explicit(&coda->coda, memory_order_relaxed), sequenza;
+    CasellaCalcolo *casella;
+
+    while (1)
+    {
+        casella = &coda->caselle[posizione & (POSIZIONI_CODA_CALCOLO - 1)];
+        sequenza = atomic_load_explicit(&casella->sequenza, memory_order_acquire);
+        if (sequenza == posizione)
+        {
+            if (atomic_compare_exchange_weak_explicit(&coda->coda, &posizione, posizione + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if ((intptr_t)(sequenza - posizione) < 0) return 0;   /* la casella ha ancora il lavoro di un giro fa */
+        else posizione = atomic_load_explicit(&coda->coda, memory_order_relaxed);
+    }
+    casella->lavoro = lavoro;
+    atomic_store_explicit(&casella->sequenza, posizione + 1, memory_order_release);
+    return 1;
+}
+
+/* Consumatore (thread di calcolo): primo lavoro della coda, NULL se è vuota */
+static inline LavoroPipeline *PrelevaCalcolo(CodaCalcolo *coda)
+{
+    size_t posizione = atomic_load_explicit(&coda->testa, memory_order_relaxed), sequenza;
+    CasellaCalcolo *casella;
+    LavoroPipeline *lavoro;
+
+    while (1)
+    {
+        casella = &coda->caselle[posizione & (POSIZIONI_CODA_CALCOLO - 1)];
+        sequenza = atomic_load_explicit(&casella->sequenza, memory_order_acquire);
+        if (sequenza == posizione + 1)
+        {
+            if (atomic_compare_exchange_weak_explicit(&coda->testa, &posizione, posizione + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if ((intptr_t)(sequenza - (posizione + 1)) < 0) return NULL;
+        else posizione = atomic_load_explicit(&coda->testa, memory_order_relaxed);
+    }
+    lavoro = casella->lavoro;
+    atomic_store_explicit(&casella->sequenza, posizione + POSIZIONI_CODA_CALCOLO, memory_order_release);   /* libera per il giro dopo */
+    return lavoro;
+}
+
+static inline int CodaCalcoloVuota(CodaCalcolo *coda)
+{
+    size_t posizione = atomic_load_explicit(&coda->testa, memory_order_relaxed);
+    return atomic_load_explicit(&coda->caselle[posizione & (POSIZIONI_CODA_CALCOLO - 1)].sequenza, memory_order_acquire) != posizione + 1;
+}
+
+/* Thread di calcolo con la coda vuota: qualche controllo attivo, poi il futex. Restituisce 1 se ha dormito. */
+static inline int AttendiCalcolo(CodaCalcolo *coda)
+{
+    uint32_t evento;
+    int i, dormito = 0;
+
+    for (i = 0; i < GIRI_PIPELINE; i++)
+    {
+        if (!CodaCalcoloVuota(coda)) return 0;
+        PAUSA_PIPELINE();
+    }
+    evento = atomic_load_explicit(&coda->evento, memory_order_acquire);
+    atomic_fetch_add_explicit(&coda->dormienti, 1, memory_order_seq_cst);
+    if (CodaCalcoloVuota(coda) && !atomic_load_explicit(&coda->fermata, memory_order_seq_cst))
+    {
+        FutexPipeline(&coda->evento, FUTEX_WAIT, evento);
+        dormito = 1;
+    }
+    atomic_fetch_sub_explicit(&coda->dormienti, 1, memory_order_relaxed);
+    return dormito;
+}
+
+/*
+  Thread di I/O: accoda un lavoro per la pipeline di 'completamenti'. Restituisce 1 se il lavoro è in volo (tornerà da
+  ProssimoCompletamento()), 0 se va calcolato sul posto (troppi lavori in volo o coda piena).
+*/
+static inline int InviaLavoro(CompletamentiPipeline *completamenti, LavoroPipeline *lavoro)
+{
+    CodaCalcolo *coda = &completamenti->pipeline->coda;
+
+    if (completamenti->in_volo >= POSIZIONI_COMPLETAMENTI) return 0;
+    lavoro->ritorno = completamenti;
+    lavoro->accodato = OraMetriche();
+    if (!AccodaCalcolo(coda, lavoro)) return 0;
+    completamenti->in_volo++;
+    AggiornaMetrica(&completamenti->metriche->accodati[STADIO_CALCOLO], 1);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&coda->dormienti, memory_order_relaxed) > 0)
+    {
+        atomic_fetch_add_explicit(&coda->evento, 1, memory_order_release);
+        FutexPipeline(&coda->evento, FUTEX_WAKE, 1);
+        AggiornaMetrica(&completamenti->metriche->chiamate_sistema, 1);
+    }
+    return 1;
+}
+
+/*
+  Thread di I/O, quando l'eventfd è leggibile: azzera la segnalazione. Va chiamata prima di raccogliere i completamenti
+  con ProssimoCompletamento(): un completamento pubblicato dopo scriverà di nuovo l'eventfd.
+*/
+static inline void RiarmaCompletamenti(CompletamentiPipeline *completamenti)
+{
+    uint64_t valore;
+    if (read(completamenti->eventfd, &valore, sizeof(valore)) < 0) { /* già letto: niente da fare */ }
+    AggiornaMetrica(&completamenti->metriche->chiamate_sistema, 1);
+    atomic_exchange_explicit(&completamenti->segnalato, 0, memory_order_acq_rel);
+}
+
+/* Thread di I/O: un lavoro completato, NULL se non ce ne sono altri */
+static inline LavoroPipeline *ProssimoCompletamento(CompletamentiPipeline *completamenti)
+{
+    AnelloCompletamenti *anello;
+    LavoroPipeline *lavoro;
+    uint32_t coda;
+    int i;
+
+    if (completamenti->in_volo == 0) return NULL;
+    for (i = 0; i < completamenti->pipeline->num_thread; i++)
+    {
+        anello = &completamenti->anelli[i];
+        coda = atomic_load_explicit(&anello->coda, memory_order_relaxed);
+        if (coda == atomic_load_explicit(&anello->testa, memory_order_acquire)) continue;
+        lavoro = anello->lavori[coda & (POSIZIONI_COMPLETAMENTI - 1)];
+        atomic_store_explicit(&anello->coda, coda + 1, memory_order_release);
+        completamenti->in_volo--;
+        RegistraValore(&completamenti->metriche->attese_stadi[STADIO_COMPLETAMENTO], OraMetriche() - lavoro->accodato);
+        AggiornaMetrica(&completamenti->metriche->prelevati[STADIO_COMPLETAMENTO], 1);
+        return lavoro;
+    }
+    return NULL;
+}
+
+/* Ciclo di un thread di calcolo: preleva un lotto, lo esegue e restituisce ogni lavoro al suo thread di I/O */
+static void *ThreadCalcolo(void *arg)
+{
+    PipelineCalcolo *pipeline = arg;
+    int indice = atomic_fetch_add_explicit(&pipeline->avviati, 1, memory_order_relaxed);
+    Metriche *metriche = NuoveMetriche();
+    LavoroPipeline *lotto[LOTTO_PIPELINE], *lavoro;
+    CompletamentiPipeline *serviti[LOTTO_PIPELINE];
+    int n, num_serviti, i, s;
+    uint64_t ora;
+
+    if (metriche == NULL) return NULL;
+    while (!atomic_load_explicit(&pipeline->coda.fermata, memory_order_acquire))
+    {
+        for (n = 0; n < LOTTO_PIPELINE && (lavoro = PrelevaCalcolo(&pipeline->coda)) != NULL; n++) lotto[n] = lavoro;
+        if (n == 0)
+        {
+            if (AttendiCalcolo(&pipeline->coda)) AggiornaMetrica(&metriche->chiamate_sistema, 1);
+            continue;
+        }
+        ora = OraMetriche();
+        AggiornaMetrica(&metriche->prelevati[STADIO_CALCOLO], (uint64_t)n);
+        for (i = 0; i < n; i++) RegistraValore(&metriche->attese_stadi[STADIO_CALCOLO], ora - lotto[i]->accodato);
+
+        for (i = 0; i < n; i++) pipeline->esegui(lotto[i], metriche);
+
+        /* Restituzione: l'anello di questo thread verso ogni thread di I/O non si riempie (vedi InviaLavoro()) */
+        ora = OraMetriche();
+        num_serviti = 0;
+        for (i = 0; i < n; i++)
+        {
+            CompletamentiPipeline *ritorno = lotto[i]->ritorno;
+            AnelloCompletamenti *anello = &ritorno->anelli[indice];
+            uint32_t testa = atomic_load_explicit(&anello->testa, memory_order_relaxed);
+            lotto[i]->accodato = ora;
+            anello->lavori[testa & (POSIZIONI_COMPLETAMENTI - 1)] = lotto[i];
+            atomic_store_explicit(&anello->testa, testa + 1, memory_order_release);
+            for (s = 0; s < num_serviti && serviti[s] != ritorno; s++) { }
+            if (s == num_serviti) serviti[num_serviti++] = ritorno;
+        }
+        AggiornaMetrica(&metriche->accodati[STADIO_COMPLETAMENTO], (uint64_t)n);
+        for (s = 0; s < num_serviti; s++)
+        {
+            uint64_t uno = 1;
+            if (atomic_exchange_explicit(&serviti[s]->segnalato, 1, memory_order_acq_rel)) continue;
+            if (write(serviti[s]->eventfd, &uno, sizeof(uno)) < 0) { /* contatore saturo: il thread di I/O è già segnalato */ }
+            AggiornaMetrica(&metriche->chiamate_sistema, 1);
+        }
+    }
+    return NULL;
+}
+
+/*
+  Crea la pipeline e avvia 'num_thread' thread di calcolo che eseguono 'esegui'. NULL in caso di errore: se un thread
+  non parte, quelli già avviati vengono fermati e attesi prima di liberare la pipeline che stanno leggendo.
+*/
+static inline PipelineCalcolo *AvviaPipeline(int num_thread, EseguiLavoro esegui)
+{
+    PipelineCalcolo *pipeline;
+    pthread_t threads[MAX_THREAD_CALCOLO];
+    size_t i, avviati;
+
+    if (num_thread < 1 || num_thread > MAX_THREAD_CALCOLO) return NULL;
+    if ((pipeline = aligned_alloc(64, (sizeof(PipelineCalcolo) + 63) & ~(size_t)63)) == NULL) return NULL;
+    memset(pipeline, 0, sizeof(PipelineCalcolo));
+    for (i = 0; i < POSIZIONI_CODA_CALCOLO; i++) atomic_init(&pipeline->coda.caselle[i].sequenza, i);
+    pipeline->esegui = esegui;
+    pipeline->num_thread = num_thread;
+
+    for (avviati = 0; avviati < (size_t)num_thread; avviati++)
+    {
+        if (pthread_create(&threads[avviati], NULL, ThreadCalcolo, pipeline) != 0) break;
+    }
+    if (avviati < (size_t)num_thread)
+    {
+        /* Chi sta per dormire rilegge 'fermata' dopo essersi contato fra i dormienti: il risveglio non si perde */
+        atomic_store_explicit(&pipeline->coda.fermata, 1, memory_order_seq_cst);
+        atomic_fetch_add_explicit(&pipeline->coda.evento, 1, memory_order_release);
+        FutexPipeline(&pipeline->coda.evento, FUTEX_WAKE, INT_MAX);
+        for (i = 0; i < avviati; i++) pthread_join(threads[i], NULL);
+        free(pipeline);
+        return NULL;
+    }
+    for (i = 0; i < avviati; i++) pthread_detach(threads[i]);
+    return pipeline;
+}
+
+/* Stato per un thread di I/O: un anello per thread di calcolo e l'eventfd (non bloccante). NULL in caso di errore. */
+static inline CompletamentiPipeline *CreaCompletamenti(PipelineCalcolo *pipeline, Metriche *metriche)
+{
+    CompletamentiPipeline *completamenti = aligned_alloc(64, (sizeof(CompletamentiPipeline) + 63) & ~(size_t)63);
+    size_t dimensione = (size_t)pipeline->num_thread * sizeof(AnelloCompletamenti);
+
+    if (completamenti == NULL) return NULL;
+    memset(completamenti, 0, sizeof(CompletamentiPipeline));
+    completamenti->pipeline = pipeline;
+    completamenti->metriche = metriche;
+    completamenti->anelli = aligned_alloc(64, dimensione);
+    completamenti->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (completamenti->anelli == NULL || completamenti->eventfd < 0)
+    {
+        if (completamenti->eventfd >= 0) close(completamenti->eventfd);
+        free(completamenti->anelli);
+        free(completamenti);
+        return NULL;
+    }
+    memset(completamenti->anelli, 0, dimensione);
+    return completamenti;
+}
+
+#endif /* PIPELINE_G35_H */
@@ -0,0 +1,393 @@
+/*
+  Memoria riusata dai server: a regime servire una richiesta non chiede niente all'allocatore di sistema.
+
+  - Slab: oggetti di dimensione fissa (le connessioni di un worker). La memoria arriva dall'heap a blocchi di
+    OGGETTI_BLOCCO_SLAB oggetti, che non vengono mai restituiti; un oggetto liberato va in una lista e la prossima
+    allocazione lo riprende in O(1). Gli oggetti sono allineati a 16 byte.
+  - PoolBuffer: buffer in classi di dimensione potenza di 2, da 2^MIN_CLASSE_POOL a 2^MAX_CLASSE_POOL byte (i buffer
+    di ricezione dei batch, i lavori della pipeline UDP). Ogni classe conserva MAX_LIBERI_CLASSE buffer inattivi, o
+    più se stanno in MAX_BYTE_LIBERI_CLASSE byte: il resto torna all'heap, così un picco non resta occupato per sempre. Oltre la classe più grande si usa
+    direttamente l'heap.
+  - Arena: una per thread, per la memoria temporanea di una richiesta (i numeri grandi). Si alloca spostando un indice
+    (bump); ogni allocazione ha davanti la posizione della precedente, così una liberazione in ordine inverso (quello
+    delle funzioni ricorsive) restituisce subito lo spazio. Una funzione che libera i suoi temporanei in un altro ordine
+    può segnare la cima all'inizio (SegnaArena()) e tornarci alla fine (RitornaArena()). FineArena(), dopo la risposta,
+    azzera l'arena. Se lo spazio finisce, o fuori da InizioArena()/FineArena(), si usa l'heap, e LiberaArena() lo
+    riconosce dall'indirizzo.
+
+  Slab e PoolBuffer appartengono a un solo thread (un worker): nessuna sincronizzazione. I contatori di ogni pool
+  (oggetti o byte in uso, massimo raggiunto, riservati, allocazioni dall'heap) sono scritti solo dal proprietario e
+  registrati per l'esportazione (comune/metriche_g35.h), come le cache delle espressioni.
+
+  Come gli altri file di comune/, contiene solo funzioni static inline.
+*/
+#ifndef POOL_G35_H
+#define POOL_G35_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__linux__)
+#include <stdatomic.h>
+#define POOL_LOCALE_THREAD _Thread_local
+#else
+#define POOL_LOCALE_THREAD
+#endif
+
+#define OGGETTI_BLOCCO_SLAB 64              /* oggetti chiesti all'heap quando lo slab è vuoto */
+#define MIN_CLASSE_POOL 12                  /* buffer più piccolo: 4 KiB */
+#define MAX_CLASSE_POOL 20                  /* buffer più grande: 1 MiB (un batch TCP di 65536 coppie) */
+#define NUM_CLASSI_POOL (MAX_CLASSE_POOL - MIN_CLASSE_POOL + 1)
+#define MAX_LIBERI_CLASSE 8                 /* buffer inattivi conservati per classe... */
+#define MAX_BYTE_LIBERI_CLASSE (8 << 20)    /* ...o più, finché stanno in questi byte */
+#define DIM_ARENA (1 << 20)                 /* byte dell'arena di un thread */
+#define MAX_POOL_REGISTRATI 1024
+
+/* Tipi di pool, per l'esportazione: in_uso, massimo e riservati contano oggetti per lo slab, byte per gli altri */
+enum { POOL_CONNESSIONI, POOL_BUFFER, POOL_ARENA, NUM_TIPI_POOL };
+
+typedef struct
+{
+    int tipo;                               /* POOL_* */
+    uint64_t in_uso;
+    uint64_t massimo;                       /* massimo di in_uso dall'avvio */
+    uint64_t riservati;                     /* in uso più inattivi conservati */
+    uint64_t allocazioni;                   /* richieste all'heap: a regime non crescono più */
+} ContatoriPool;
+
+/* Aggiornamenti del solo proprietario, letti senza lock dall'esportazione (come AggiornaMetrica()) */
+static inline void ScriviContatorePool(uint64_t *contatore, uint64_t valore)
+{
+#if defined (__GNUC__)
+    __atomic_store_n(contatore, valore, __ATOMIC_RELAXED);
+#else
+    *contatore = valore;
+#endif
+}
+
+static inline void UsoPool(ContatoriPool *contatori, int64_t delta)
+{
+    uint64_t in_uso = contatori->in_uso + (uint64_t)delta;
+    ScriviContatorePool(&contatori->in_uso, in_uso);
+    if (in_uso > contatori->massimo) ScriviContatorePool(&contatori->massimo, in_uso);
+}
+
+#if defined (__linux__)
+static _Atomic(ContatoriPool *) pool_registrati[MAX_POOL_REGISTRATI];
+static atomic_int num_pool_registrati;
+#endif
+
+static inline void RegistraPool(ContatoriPool *contatori, int tipo)
+{
+    memset(contatori, 0, sizeof(*contatori));
+    contatori->tipo = tipo;
+#if defined (__linux__)
+    int posto = atomic_fetch_add(&num_pool_registrati, 1);
+    if (posto < MAX_POOL_REGISTRATI) atomic_store_explicit(&pool_registrati[posto], contatori, memory_order_release);
+#endif
+}
+
+#if defined (__linux__)
+/* Somma per tipo dei contatori di tutti i pool registrati; il massimo è la somma dei massimi di ogni pool */
+static inline void StatistichePool(ContatoriPool somma[NUM_TIPI_POOL])
+{
+    int n = atomic_load_explicit(&num_pool_registrati, memory_order_acquire), i;
+    memset(somma, 0, NUM_TIPI_POOL * sizeof(ContatoriPool));
+    if (n > MAX_POOL_REGISTRATI) n = MAX_POOL_REGISTRATI;
+    for (i = 0; i < n; i++)
+    {
+        ContatoriPool *contatori = atomic_load_explicit(&pool_registrati[i], memory_order_acquire);
+        if (contatori == NULL) continue;   /* posto preso ma non ancora pubblicato */
+        somma[contatori->tipo].in_uso += __atomic_load_n(&contatori->in_uso, __ATOMIC_RELAXED);
+        somma[contatori->tipo].massimo += __atomic_load_n(&contatori->massimo, __ATOMIC_RELAXED);
+        somma[contatori->tipo].riservati += __atomic_load_n(&contatori->riservati, __ATOMIC_RELAXED);
+        somma[contatori->tipo].allocazioni += __atomic_load_n(&contatori->allocazioni, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+/* ---------------------------------------------------------------- Slab */
+
+typedef struct OggettoLibero
+{
+    struct OggettoLibero *prossimo;
+} OggettoLibero;
+
+typedef struct
+{
+    size_t dimensione;                      /* arrotondata a 16 byte */
+    OggettoLibero *liberi;
+    ContatoriPool contatori;
+} Slab;
+
+static inline void InizializzaSlab(Slab *slab, size_t dimensione, int tipo)
+{
+    slab->dimensione = (dimensione + 15) & ~(size_t)15;
+    slab->liberi = NULL;
+    RegistraPool(&slab->contatori, tipo);
+}
+
+/* Un oggetto non inizializzato, NULL se manca la memoria */
+static inline void *AllocaSlab(Slab *slab)
+{
+    OggettoLibero *oggetto = slab->liberi;
+    int i;
+
+    if (oggetto == NULL)
+    {
+        char *blocco = malloc(slab->dimensione * OGGETTI_BLOCCO_SLAB);
+        if (blocco == NULL) return NULL;
+        for (i = OGGETTI_BLOCCO_SLAB - 1; i >= 0; i--)
+        {
+            OggettoLibero *libero = (OggettoLibero *)(blocco + (size_t)i * slab->dimensione);
+            libero->prossimo = slab->liberi;
+            slab->liberi = libero;
+        }
+        ScriviContatorePool(&slab->contatori.allocazioni, slab->contatori.allocazioni + 1);
+        ScriviContatorePool(&slab->contatori.riservati, slab->contatori.riservati + OGGETTI_BLOCCO_SLAB);
+        oggetto = slab->liberi;
+    }
+    slab->liberi = oggetto->prossimo;
+    UsoPool(&slab->contatori, 1);
+    return oggetto;
+}
+
+static inline void LiberaSlab(Slab *slab, void *oggetto)
+{
+    OggettoLibero *libero = oggetto;
+    libero->prossimo = slab->liberi;
+    slab->liberi = libero;
+    UsoPool(&slab->contatori, -1);
+}
+
+/* ---------------------------------------------------------------- Buffer a classi di dimensione */
+
+typedef struct
+{
+    OggettoLibero *liberi[NUM_CLASSI_POOL];
+    int num_liberi[NUM_CLASSI_POOL];
+    ContatoriPool contatori;                /* byte */
+} PoolBuffer;
+
+static inline void InizializzaPoolBuffer(PoolBuffer *pool)
+{
+    memset(pool->liberi, 0, sizeof(pool->liberi));
+    memset(pool->num_liberi, 0, sizeof(pool->num_liberi));
+    RegistraPool(&pool->contatori, POOL_BUFFER);
+}
+
+/* Classe del buffer di 'dimensione' byte, -1 se supera la più grande */
+static inline int ClassePool(size_t dimensione)
+{
+    int classe = MIN_CLASSE_POOL;
+    while (classe <= MAX_CLASSE_POOL && ((size_t)1 << classe) < dimensione) classe++;
+    return classe <= MAX_CLASSE_POOL ? classe - MIN_CLASSE_POOL : -1;
+}
+
+/* Buffer di almeno 'dimensione' byte, non inizializzato; NULL se manca la memoria */
+static inline void *PrendiBufferPool(PoolBuffer *pool, size_t dimensione)
+{
+    int classe = ClassePool(dimensione);
+    size_t effettiva = classe >= 0 ? (size_t)1 << (classe + MIN_CLASSE_POOL) : dimensione;
+    void *buffer;
+
+    if (classe >= 0 && pool->liberi[classe] != NULL)
+    {
+        buffer = pool->liberi[classe];
+        pool->liberi[classe] = pool->liberi[classe]->prossimo;
+        pool->num_liberi[classe]--;
+    }
+    else
+    {
+        if ((buffer = malloc(effettiva)) == NULL) return NULL;
+        ScriviContatorePool(&pool->contatori.allocazioni, pool->contatori.allocazioni + 1);
+        ScriviContatorePool(&pool->contatori.riservati, pool->contatori.riservati + effettiva);
+    }
+    UsoPool(&pool->contatori, (int64_t)effettiva);
+    return buffer;
+}
+
+/* Restituisce un buffer preso con la stessa 'dimensione' (NULL è ammesso) */
+static inline void RendiBufferPool(PoolBuffer *pool, void *buffer, size_t dimensione)
+{
+    int classe = ClassePool(dimensione);
+    size_t effettiva = classe >= 0 ? (size_t)1 << (classe + MIN_CLASSE_POOL) : dimensione;
+    OggettoLibero *libero = buffer;
+
+    if (buffer == NULL) return;
+    UsoPool(&pool->contatori, -(int64_t)effettiva);
+    if (classe < 0 || (pool->num_liberi[classe] >= MAX_LIBERI_CLASSE
+                       && (size_t)(pool->num_liberi[classe] + 1) * effettiva > MAX_BYTE_LIBERI_CLASSE))
+    {
+        free(buffer);
+        ScriviContatorePool(&pool->contatori.riservati, pool->contatori.riservati - effettiva);
+        return;
+    }
+    libero->prossimo = pool->liberi[classe];
+    pool->liberi[classe] = libero;
+    pool->num_liberi[classe]++;
+}
+
+/* ---------------------------------------------------------------- Arena della richiesta */
+
+/* Intestazione di ogni allocazione nell'arena: la posizione dell'allocazione precedente */
+typedef struct
+{
+    size_t precedente;
+    size_t dimensione;
+} BloccoArena;
+
+typedef struct
+{
+    char *base;
+    size_t cima;                            /* primo byte libero */
+    size_t ultimo;                          /* intestazione dell'ultima allocazione (SIZE_MAX = nessuna) */
+    int attiva;                             /* fra InizioArena() e FineArena() */
+    ContatoriPool contatori;                /* byte: in_uso è la cima, massimo il picco di una richiesta */
+} Arena;
+
+static POOL_LOCALE_THREAD Arena *arena_del_thread;
+
+/* Apre l'arena del thread (creata alla prima richiesta): da qui le allocazioni di AllocaArena() sono temporanee */
+static inline void InizioArena(void)
+{
+    Arena *arena = arena_del_thread;
+    if (arena == NULL)
+    {
+        if ((arena = malloc(sizeof(Arena))) == NULL) return;
+        if ((arena->base = malloc(DIM_ARENA)) == NULL)
+        {
+            free(arena);
+            return;
+        }
+        arena->cima = 0;
+        arena->ultimo = SIZE_MAX;
+        RegistraPool(&arena->contatori, POOL_ARENA);
+        ScriviContatorePool(&arena->contatori.allocazioni, 1);
+        ScriviContatorePool(&arena->contatori.riservati, DIM_ARENA);
+        arena_del_thread = arena;
+    }
+    arena->attiva = 1;
+}
+
+/* Dopo la risposta: tutta la memoria dell'arena torna libera (quella presa dall'heap va già liberata) */
+static inline void FineArena(void)
+{
+    Arena *arena = arena_del_thread;
+    if (arena == NULL) return;
+    arena->attiva = 0;
+    arena->cima = 0;
+    arena->ultimo = SIZE_MAX;
+    ScriviContatorePool(&arena->contatori.in_uso, 0);
+}
+
+static inline int InArena(const Arena *arena, const void *p)
+{
+    return arena != NULL && (const char *)p >= arena->base && (const char *)p < arena->base + DIM_ARENA;
+}
+
+/* 'dimensione' byte allineati a 16, dall'arena se è aperta e ha spazio, altrimenti dall'heap; NULL se manca la memoria */
+static inline void *AllocaArena(size_t dimensione)
+{
+    Arena *arena = arena_del_thread;
+    size_t inizio, fine;
+    BloccoArena *blocco;
+    void *p;
+
+    if (arena != NULL && arena->attiva)
+    {
+        inizio = arena->cima;
+        fine = inizio + sizeof(BloccoArena) + ((dimensione + 15) & ~(size_t)15);
+        if (dimensione <= DIM_ARENA && fine <= DIM_ARENA)
+        {
+            blocco = (BloccoArena *)(arena->base + inizio);
+            blocco->precedente = arena->ultimo;
+            blocco->dimensione = fine - inizio - sizeof(BloccoArena);
+            arena->ultimo = inizio;
+            arena->cima = fine;
+            UsoPool(&arena->contatori, (int64_t)(fine - inizio));
+            return blocco + 1;
+        }
+    }
+    if ((p = malloc(dimensione)) != NULL && arena != NULL && arena->attiva)
+        ScriviContatorePool(&arena->contatori.allocazioni, arena->contatori.allocazioni + 1);   /* arena piena */
+    return p;
+}
+
+/* Libera 'p' (NULL è ammesso): nell'arena lo spazio torna subito disponibile se 'p' è l'ultima allocazione */
+static inline void LiberaArena(void *p)
+{
+    Arena *arena = arena_del_thread;
+    BloccoArena *blocco;
+
+    if (p == NULL) return;
+    if (!InArena(arena, p))
+    {
+        free(p);
+        return;
+    }
+    blocco = (BloccoArena *)p - 1;
+    if ((char *)blocco != arena->base + arena->ultimo) return;   /* non è l'ultima: si recupera con FineArena() */
+    UsoPool(&arena->contatori, -(int64_t)(arena->cima - arena->ultimo));
+    arena->cima = arena->ultimo;
+    arena->ultimo = blocco->precedente;
+}
+
+typedef struct
+{
+    size_t cima, ultimo;
+} SegnoArena;
+
+/* Posizione corrente dell'arena, per RitornaArena() */
+static inline SegnoArena SegnaArena(void)
+{
+    Arena *arena = arena_del_thread;
+    SegnoArena segno = { 0, SIZE_MAX };
+    if (arena != NULL && arena->attiva)
+    {
+        segno.cima = arena->cima;
+        segno.ultimo = arena->ultimo;
+    }
+    return segno;
+}
+
+/* Libera tutto ciò che è stato allocato nell'arena dopo SegnaArena(): quelle allocazioni non vanno più usate (la
+   memoria presa dall'heap va comunque liberata con LiberaArena()) */
+static inline void RitornaArena(SegnoArena segno)
+{
+    Arena *arena = arena_del_thread;
+    if (arena == NULL || !arena->attiva || arena->cima <= segno.cima) return;
+    UsoPool(&arena->contatori, -(int64_t)(arena->cima - segno.cima));
+    arena->cima = segno.cima;
+    arena->ultimo = segno.ultimo;
+}
+
+/* Come realloc(): 'vecchia' è la dimensione con cui 'p' è stato allocato. L'ultima allocazione dell'arena cresce
+   sul posto. */
+static inline void *RiallocaArena(void *p, size_t vecchia, size_t nuova)
+{
+    Arena *arena = arena_del_thread;
+    BloccoArena *blocco;
+    void *nuovo;
+
+    if (p == NULL) return AllocaArena(nuova);
+    if (!InArena(arena, p)) return realloc(p, nuova);
+    blocco = (BloccoArena *)p - 1;
+    if ((char *)blocco == arena->base + arena->ultimo && arena->ultimo + sizeof(BloccoArena) + nuova <= DIM_ARENA)
+    {
+        size_t fine = arena->ultimo + sizeof(BloccoArena) + ((nuova + 15) & ~(size_t)15);
+        if (fine > DIM_ARENA) fine = DIM_ARENA;
+        UsoPool(&arena->contatori, (int64_t)fine - (int64_t)arena->cima);
+        blocco->dimensione = fine - arena->ultimo - sizeof(BloccoArena);
+        arena->cima = fine;
+        return p;
+    }
+    if (nuova <= blocco->dimensione) return p;
+    if ((nuovo = AllocaArena(nuova)) == NULL) return NULL;
+    memcpy(nuovo, p, vecchia < nuova ? vecchia : nuova);
+    LiberaArena(p);
+    return nuovo;
+}
+
+#endif /* POOL_G35_H */
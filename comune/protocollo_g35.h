@@ -0,0 +1,321 @@
+/*
+  Messaggi binari con intestazione fissa, usati dal protocollo UDP senza stato e dalle connessioni TCP a messaggi binari.
+
+  Ogni messaggio (richiesta o risposta) è composto da un'intestazione di DIM_INTESTAZIONE byte seguita dal carico utile:
+
+    byte 0      MAGIC_PROTOCOLLO (non è un carattere ASCII: non si confonde con il carattere operazione del vecchio protocollo)
+    byte 1      versione del protocollo
+    byte 2      operazione ('A', 'S', 'M', 'D', OP_ESPRESSIONE, oppure OP_NEGOZIAZIONE)
+    byte 3      richiesta: flag (FLAG_*); risposta: esito (ESITO_*)
+    byte 4-7    lunghezza del carico utile in byte (uint32_t)
+    byte 8-11   identificativo della richiesta, scelto dal client e ricopiato nella risposta (uint32_t)
+
+  Carico utile (tutti gli interi sono uint32_t in network order):
+    operazione singola:  richiesta [op1][op2]                risposta [risultato]
+    batch (FLAG_BATCH):  richiesta [n][a0 b0 ... a(n-1) b(n-1)]   risposta [n][r0 ... r(n-1)]
+    numeri grandi (FLAG_GRANDI):  richiesta [a][b]               risposta [risultato]
+    espressione (OP_ESPRESSIONE): richiesta [L][testo di L byte][n][n gruppi di k valori]   risposta [n][r0 ... r(n-1)]
+
+  Con FLAG_GRANDI gli operandi e il risultato sono interi con segno di lunghezza arbitraria, nel formato di
+  grandi_g35.h (uint32_t con segno e byte del modulo, poi il modulo in big-endian), e le operazioni sono 'A', 'S', 'M',
+  'D' (quoziente troncato verso lo zero), 'R' (resto, con il segno del dividendo) ed 'E' (potenza a^b). I due numeri
+  devono occupare esattamente il carico utile. Solo la potenza può dare un risultato più lungo della richiesta: oltre
+  MAX_BYTE_POTENZA byte la risposta è ESITO_NUMERO_TROPPO_GRANDE. FLAG_GRANDI e FLAG_BATCH non si combinano.
+
+  Con OP_ESPRESSIONE il testo è un'espressione con variabili di una lettera (sintassi in espressioni_g35.h), valutata
+  n volte: ogni gruppo contiene i k valori delle variabili usate, in ordine alfabetico. Un'espressione senza variabili
+  (k = 0) ammette solo n = 1. Il server compila il testo una volta e conserva il programma in una cache LRU: le
+  richieste successive con lo stesso testo non lo analizzano di nuovo. Un testo non valido dà ESITO_ESPRESSIONE_NON_VALIDA.
+
+  Con un esito diverso da ESITO_OK e ESITO_DIVISIONE_PER_ZERO la risposta non ha carico utile. ESITO_SOVRACCARICO non
+  dipende dalla richiesta: il server l'ha rifiutata senza elaborarla per smaltire una coda, e la stessa richiesta
+  inviata più tardi può riuscire. Lo stesso vale per ESITO_LIMITE_SUPERATO, che riguarda un solo client: ha superato
+  le richieste o i byte al secondo concessi al suo indirizzo.
+  Ogni richiesta è indipendente dalle altre: il server non conserva alcuno stato fra un messaggio e il successivo.
+
+  Negoziazione: una richiesta OP_NEGOZIAZIONE senza carico utile riceve ESITO_OK (o ESITO_VERSIONE_NON_SUPPORTATA) e,
+  nel byte 1 della risposta, la versione parlata dal server. Su TCP il client la invia al posto del carattere operazione:
+  un server che conosce solo il vecchio protocollo risponde EXIT_STRING (il primo byte non è MAGIC_PROTOCOLLO) e chiude,
+  e il client torna allo scambio originale. Su TCP i messaggi si susseguono sulla stessa connessione e le risposte
+  arrivano nell'ordine delle richieste: LunghezzaMessaggio() delimita un messaggio direttamente nel buffer di ricezione.
+*/
+#ifndef PROTOCOLLO_G35_H
+#define PROTOCOLLO_G35_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "calcolo_g35.h"
+#include "grandi_g35.h"
+#include "espressioni_g35.h"
+
+#define MAGIC_PROTOCOLLO 0xC5
+#define VERSIONE_PROTOCOLLO 1
+#define DIM_INTESTAZIONE 12
+
+#define OP_NEGOZIAZIONE 'V'                /* richiesta senza carico utile: verifica che il server parli i messaggi binari */
+#define OP_GRANDI 'G'                      /* carattere con cui le metriche contano le richieste a numeri grandi */
+#define OP_ESPRESSIONE 'X'                 /* carico utile: espressione con variabili e valori su cui valutarla */
+
+/* Flag della richiesta */
+#define FLAG_BATCH 0x01                     /* carico utile: numero di coppie seguito dalle coppie */
+#define FLAG_GRANDI 0x02                    /* carico utile: due interi di lunghezza arbitraria */
+
+#define MAX_BYTE_POTENZA 2048               /* byte massimi del modulo di una potenza fra numeri grandi */
+
+/* Esiti della risposta */
+#define ESITO_OK 0
+#define ESITO_DIVISIONE_PER_ZERO 1          /* almeno un divisore era 0: il relativo risultato vale 0 */
+#define ESITO_OPERAZIONE_NON_VALIDA 2
+#define ESITO_RICHIESTA_MALFORMATA 3        /* lunghezza del carico utile incoerente */
+#define ESITO_VERSIONE_NON_SUPPORTATA 4
+#define ESITO_NUMERO_TROPPO_GRANDE 5        /* numeri grandi: risultato oltre MAX_BYTE_POTENZA o memoria esaurita */
+#define ESITO_ESPRESSIONE_NON_VALIDA 6      /* testo dell'espressione non valido (o cache non disponibile) */
+#define ESITO_SOVRACCARICO 7                /* richiesta non elaborata: il server è sovraccarico, riprovare più tardi */
+#define ESITO_LIMITE_SUPERATO 8             /* richiesta non elaborata: il client ha superato il limite di frequenza */
+
+typedef struct
+{
+    uint8_t versione;
+    uint8_t operazione;
+    uint8_t flag_esito;                     /* flag nella richiesta, esito nella risposta */
+    uint32_t lunghezza;                     /* byte di carico utile (host order) */
+    uint32_t id;                            /* identificativo della richiesta (host order) */
+} Intestazione;
+
+/* Scrive un'intestazione in 'buf' (almeno DIM_INTESTAZIONE byte) */
+static inline void ScriviIntestazione(unsigned char *buf, uint8_t operazione, uint8_t flag_esito, uint32_t lunghezza, uint32_t id)
+{
+    uint32_t net_lunghezza = htonl(lunghezza), net_id = htonl(id);
+    buf[0] = MAGIC_PROTOCOLLO;
+    buf[1] = VERSIONE_PROTOCOLLO;
+    buf[2] = operazione;
+    buf[3] = flag_esito;
+    memcpy(buf + 4, &net_lunghezza, sizeof(net_lunghezza));
+    memcpy(buf + 8, &net_id, sizeof(net_id));
+}
+
+/* Legge l'intestazione all'inizio di 'buf': restituisce 1 se i primi 'len' byte iniziano con un'intestazione, 0 altrimenti */
+static inline int LeggiIntestazione(const unsigned char *buf, int len, Intestazione *intestazione)
+{
+    uint32_t net_valore;
+    if (len < DIM_INTESTAZIONE || buf[0] != MAGIC_PROTOCOLLO) return 0;
+    intestazione->versione = buf[1];
+    intestazione->operazione = buf[2];
+    intestazione->flag_esito = buf[3];
+    memcpy(&net_valore, buf + 4, sizeof(net_valore));
+    intestazione->lunghezza = ntohl(net_valore);
+    memcpy(&net_valore, buf + 8, sizeof(net_valore));
+    intestazione->id = ntohl(net_valore);
+    return 1;
+}
+
+/*
+  Lunghezza totale (intestazione + carico utile) del messaggio che inizia in 'buf', di cui sono arrivati 'len' byte:
+  0 se i byte non bastano ancora a saperlo o a completarlo, -1 se non è un messaggio o supera 'max' byte.
+  Il messaggio si legge poi sul posto: intestazione con LeggiIntestazione() e carico utile da buf + DIM_INTESTAZIONE.
+*/
+static inline int LunghezzaMessaggio(const unsigned char *buf, int len, int max)
+{
+    uint32_t net_lunghezza;
+    if (len < 1) return 0;
+    if (buf[0] != MAGIC_PROTOCOLLO) return -1;
+    if (len < DIM_INTESTAZIONE) return 0;
+    memcpy(&net_lunghezza, buf + 4, sizeof(net_lunghezza));
+    if (ntohl(net_lunghezza) > (uint32_t)(max - DIM_INTESTAZIONE)) return -1;
+    int totale = DIM_INTESTAZIONE + (int)ntohl(net_lunghezza);
+    return len >= totale ? totale : 0;
+}
+
+/* Richieste il cui calcolo costa molto più della ricezione (batch, numeri grandi, espressioni): con -C i server le
+   passano ai thread di calcolo (comune/pipeline_g35.h) invece di calcolarle sul thread di I/O */
+static inline int RichiestaPesante(const Intestazione *richiesta)
+{
+    return (richiesta->flag_esito & (FLAG_BATCH | FLAG_GRANDI)) != 0 || richiesta->operazione == OP_ESPRESSIONE;
+}
+
+/* Carattere con cui ContaOperazione() conta la richiesta: batch e numeri grandi hanno un contatore proprio */
+static inline char OperazioneMetrica(const Intestazione *richiesta)
+{
+    if (richiesta->flag_esito & FLAG_BATCH) return OP_BATCH;
+    if (richiesta->flag_esito & FLAG_GRANDI) return OP_GRANDI;
+    return (char)richiesta->operazione;
+}
+
+/*
+  Spazio da riservare alla risposta del messaggio 'messaggio' (intestazione completa, 'lunghezza' byte in tutto): la
+  risposta non è mai più lunga della richiesta, tranne la potenza fra numeri grandi.
+*/
+static inline int LunghezzaMassimaRisposta(const unsigned char *messaggio, int lunghezza)
+{
+    int potenza = DIM_INTESTAZIONE + 4 + MAX_BYTE_POTENZA;
+    if ((messaggio[3] & FLAG_GRANDI) && (messaggio[2] == 'E' || messaggio[2] == 'e') && lunghezza < potenza) return potenza;
+    return lunghezza;
+}
+
+/*
+  Richiesta a numeri grandi: legge i due operandi dal carico utile, calcola e scrive il risultato in 'risposta'.
+  Restituisce la lunghezza della risposta. Le cifre temporanee stanno nell'arena del thread (pool_g35.h), azzerata
+  alla fine.
+*/
+static inline int RispondiGrandi(const Intestazione *richiesta, const unsigned char *carico, unsigned char *risposta)
+{
+    Numero a, b, r;
+    long letti_a, letti_b = -1;
+    int max_cifre = (int)(richiesta->lunghezza / 4) + 1, codice;
+    uint32_t lunghezza = 0;
+    uint8_t esito;
+
+    InizioArena();
+    InizializzaNumero(&a);
+    InizializzaNumero(&b);
+    InizializzaNumero(&r);
+    letti_a = LeggiNumero(&a, carico, richiesta->lunghezza, max_cifre);
+    if (letti_a > 0) letti_b = LeggiNumero(&b, carico + letti_a, richiesta->lunghezza - (uint32_t)letti_a, max_cifre);
+
+    if ((richiesta->flag_esito & FLAG_BATCH) || letti_b < 0 || (uint32_t)(letti_a + letti_b) != richiesta->lunghezza)
+        esito = ESITO_RICHIESTA_MALFORMATA;
+    else
+    {
+        codice = CalcolaGrandi((char)richiesta->operazione, &r, &a, &b, MAX_BYTE_POTENZA / 4);
+        if (codice == GRANDI_OK) esito = ESITO_OK;
+        else if (codice == GRANDI_DIVISIONE_PER_ZERO) esito = ESITO_DIVISIONE_PER_ZERO;
+        else esito = ESITO_NUMERO_TROPPO_GRANDE;
+        if (esito != ESITO_NUMERO_TROPPO_GRANDE) lunghezza = ScriviNumero(risposta + DIM_INTESTAZIONE, &r);
+    }
+    ScriviIntestazione(risposta, richiesta->operazione, esito, lunghezza, richiesta->id);
+
+    LiberaNumero(&a);
+    LiberaNumero(&b);
+    LiberaNumero(&r);
+    FineArena();
+    return DIM_INTESTAZIONE + (int)lunghezza;
+}
+
+/*
+  Richiesta OP_ESPRESSIONE: il programma viene dalla cache del thread (compilato solo la prima volta), poi si valuta su
+  ognuno degli n gruppi di valori. Restituisce la lunghezza della risposta, che non supera quella della richiesta.
+*/
+static inline int RispondiEspressione(const Intestazione *richiesta, const unsigned char *carico, unsigned char *risposta, uint32_t max_coppie)
+{
+    CacheEspressioni *cache;
+    const Programma *programma;
+    uint32_t lunghezza_testo, n, net_n, zeri;
+
+    if (richiesta->lunghezza < 8 || (richiesta->flag_esito & FLAG_BATCH)) goto malformata;
+    memcpy(&lunghezza_testo, carico, sizeof(lunghezza_testo));
+    lunghezza_testo = ntohl(lunghezza_testo);
+    if (lunghezza_testo > richiesta->lunghezza - 8) goto malformata;
+    memcpy(&n, carico + 4 + lunghezza_testo, sizeof(n));
+    n = ntohl(n);
+
+    if ((cache = CacheEspressioniThread()) == NULL
+        || (programma = ProgrammaEspressione(cache, (const char *)carico + 4, (int)lunghezza_testo)) == NULL)
+    {
+        ScriviIntestazione(risposta, richiesta->operazione, ESITO_ESPRESSIONE_NON_VALIDA, 0, richiesta->id);
+        return DIM_INTESTAZIONE;
+    }
+    if (n == 0 || n > max_coppie || (programma->variabili == 0 && n != 1)
+        || richiesta->lunghezza != 8 + lunghezza_testo + (uint64_t)n * programma->variabili * 4)
+        goto malformata;
+
+    zeri = EseguiProgrammaSuValori(programma, carico + 8 + lunghezza_testo, risposta + DIM_INTESTAZIONE + sizeof(uint32_t), n);
+    net_n = htonl(n);
+    memcpy(risposta + DIM_INTESTAZIONE, &net_n, sizeof(net_n));
+    ScriviIntestazione(risposta, richiesta->operazione, zeri ? ESITO_DIVISIONE_PER_ZERO : ESITO_OK, (n + 1) * sizeof(uint32_t), richiesta->id);
+    return DIM_INTESTAZIONE + (int)((n + 1) * sizeof(uint32_t));
+
+malformata:
+    ScriviIntestazione(risposta, richiesta->operazione, ESITO_RICHIESTA_MALFORMATA, 0, richiesta->id);
+    return DIM_INTESTAZIONE;
+}
+
+/*
+  Calcola la risposta alla richiesta descritta da 'richiesta' (carico utile in 'carico', già ricevuto per intero)
+  e la scrive in 'risposta', che deve avere spazio per DIM_INTESTAZIONE + 4 + 4 * (coppie del batch) byte, oppure
+  per LunghezzaMassimaRisposta() byte con FLAG_GRANDI.
+  'max_coppie' è il limite di coppie per un batch (e di valutazioni per un'espressione) imposto dal chiamante.
+  Restituisce la lunghezza della risposta.
+*/
+static inline int RispondiRichiesta(const Intestazione *richiesta, const unsigned char *carico, unsigned char *risposta, uint32_t max_coppie)
+{
+    uint32_t operandi[2], n, zeri;
+    uint8_t esito = ESITO_OK;
+
+    if (richiesta->versione != VERSIONE_PROTOCOLLO) esito = ESITO_VERSIONE_NON_SUPPORTATA;
+    else if (richiesta->flag_esito & FLAG_GRANDI)
+    {
+        if (OperazioneGrandiValida((char)richiesta->operazione)) return RispondiGrandi(richiesta, carico, risposta);
+        esito = ESITO_OPERAZIONE_NON_VALIDA;
+    }
+    else if (richiesta->operazione == OP_ESPRESSIONE) return RispondiEspressione(richiesta, carico, risposta, max_coppie);
+    else if (!OperazioneValida((char)richiesta->operazione) && richiesta->operazione != OP_NEGOZIAZIONE) esito = ESITO_OPERAZIONE_NON_VALIDA;
+    if (esito != ESITO_OK)
+    {
+        ScriviIntestazione(risposta, richiesta->operazione, esito, 0, richiesta->id);
+        return DIM_INTESTAZIONE;
+    }
+
+    if (richiesta->operazione == OP_NEGOZIAZIONE)
+    {
+        ScriviIntestazione(risposta, OP_NEGOZIAZIONE, richiesta->lunghezza == 0 ? ESITO_OK : ESITO_RICHIESTA_MALFORMATA, 0, richiesta->id);
+        return DIM_INTESTAZIONE;
+    }
+
+    if (richiesta->flag_esito & FLAG_BATCH)
+    {
+        if (richiesta->lunghezza < sizeof(uint32_t)) n = 0;
+        else
+        {
+            memcpy(&n, carico, sizeof(n));
+            n = ntohl(n);
+        }
+        if (n == 0 || n > max_coppie || richiesta->lunghezza != sizeof(uint32_t) + (uint64_t)n * 8)
+        {
+            ScriviIntestazione(risposta, richiesta->operazione, ESITO_RICHIESTA_MALFORMATA, 0, richiesta->id);
+            return DIM_INTESTAZIONE;
+        }
+
+        zeri = CalcolaBatch((char)richiesta->operazione, carico + sizeof(uint32_t), risposta + DIM_INTESTAZIONE + sizeof(uint32_t), n);
+        memcpy(risposta + DIM_INTESTAZIONE, carico, sizeof(uint32_t));   /* n, già in network order */
+        ScriviIntestazione(risposta, richiesta->operazione, zeri ? ESITO_DIVISIONE_PER_ZERO : ESITO_OK,
+                           (n + 1) * sizeof(uint32_t), richiesta->id);
+        return DIM_INTESTAZIONE + (int)((n + 1) * sizeof(uint32_t));
+    }
+
+    if (richiesta->lunghezza != sizeof(operandi))
+    {
+        ScriviIntestazione(risposta, richiesta->operazione, ESITO_RICHIESTA_MALFORMATA, 0, richiesta->id);
+        return DIM_INTESTAZIONE;
+    }
+    memcpy(operandi, carico, sizeof(operandi));
+    int32_t op2 = (int32_t)ntohl(operandi[1]);
+    uint32_t net_result = htonl((uint32_t)CalcolaScalare((char)richiesta->operazione, (int32_t)ntohl(operandi[0]), op2));
+    if (op2 == 0 && (richiesta->operazione == 'D' || richiesta->operazione == 'd')) esito = ESITO_DIVISIONE_PER_ZERO;
+    memcpy(risposta + DIM_INTESTAZIONE, &net_result, sizeof(net_result));
+    ScriviIntestazione(risposta, richiesta->operazione, esito, sizeof(net_result), richiesta->id);
+    return DIM_INTESTAZIONE + (int)sizeof(net_result);
+}
+
+/*
+  Divisori nulli della richiesta a cui 'risposta' ha risposto con ESITO_DIVISIONE_PER_ZERO (0 con qualsiasi altro esito):
+  l'esito dice solo che ce n'è almeno uno, nel batch si contano sul carico utile della richiesta. Un'espressione
+  conta 1 anche se ha diviso per zero più volte: contarle davvero richiederebbe di valutarla di nuovo.
+*/
+static inline uint32_t DivisioniPerZero(const Intestazione *richiesta, const unsigned char *carico, const unsigned char *risposta)
+{
+    uint32_t zeri = 0, divisore, i, n;
+    if (risposta[3] != ESITO_DIVISIONE_PER_ZERO) return 0;
+    if (!(richiesta->flag_esito & FLAG_BATCH)) return 1;
+
+    memcpy(&n, carico, sizeof(n));
+    n = ntohl(n);
+    for (i = 0; i < n; i++)
+    {
+        memcpy(&divisore, carico + sizeof(uint32_t) + (size_t)i * 8 + 4, sizeof(divisore));
+        if (divisore == 0) zeri++;
+    }
+    return zeri;
+}
+
+#endif /* PROTOCOLLO_G35_H */
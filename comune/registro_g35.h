@@ -0,0 +1,406 @@
+/*
+  Registro asincrono dei messaggi dei server: sostituisce le printf() sul percorso delle richieste.
+
+  Chi registra un messaggio (Registra(), di solito tramite le macro REGISTRA e REGISTRA_CAMPIONE) non lo formatta: copia
+  in un record binario il puntatore alla stringa di formato (una costante) e gli argomenti, e lo accoda nell'anello del
+  proprio thread. Ogni thread ha un anello SPSC di REGISTRO_RECORD record, senza lock: un solo thread di scrittura in
+  background svuota tutti gli anelli, formatta i record e li scrive sullo standard output con una sola fwrite() per giro.
+  Se l'anello è pieno il record viene scartato e contato, senza mai bloccare chi serve le richieste.
+
+  Le stringhe passate con %s vengono copiate nel record (al più REGISTRO_DIM_TESTO byte in tutto), quindi possono stare
+  in buffer temporanei. Gli argomenti '*' di larghezza e precisione e %n non sono supportati.
+
+  Livelli: ogni messaggio ha un livello e viene registrato solo se non supera quello impostato con AvviaRegistro().
+  I messaggi di ogni richiesta (REGISTRA_CAMPIONE) si possono inoltre campionare: con campionamento N ogni punto del
+  codice registra un'occorrenza su N per thread.
+
+  Solo Linux: altrove (o prima di AvviaRegistro()) Registra() scrive subito con vprintf(), come le printf() originali.
+*/
+#ifndef REGISTRO_G35_H
+#define REGISTRO_G35_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if defined (__linux__)
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#endif
+
+#define REGISTRO_RECORD 1024            /* record per anello (potenza di 2) */
+#define REGISTRO_MAX_ANELLI 512         /* thread che possono avere un anello; gli altri scrivono in modo sincrono */
+#define REGISTRO_MAX_ARGOMENTI 8
+#define REGISTRO_DIM_TESTO 128          /* byte per le stringhe %s di un record */
+#define REGISTRO_DIM_USCITA 65536       /* buffer del thread di scrittura */
+#define REGISTRO_ATTESA_US 1000         /* pausa del thread di scrittura quando gli anelli sono vuoti */
+
+/* Livelli dei messaggi, dal più al meno importante */
+enum { LIVELLO_ERRORE, LIVELLO_AVVISO, LIVELLO_CONNESSIONE, LIVELLO_RICHIESTA };
+
+/* Parti dell'indirizzo IPv4 (struct in_addr) come quattro argomenti %u, senza formattarlo con inet_ntoa() */
+#define INDIRIZZO_IPV4(indirizzo) \
+    (unsigned)(ntohl((indirizzo).s_addr) >> 24), (unsigned)((ntohl((indirizzo).s_addr) >> 16) & 0xFF), \
+    (unsigned)((ntohl((indirizzo).s_addr) >> 8) & 0xFF), (unsigned)(ntohl((indirizzo).s_addr) & 0xFF)
+
+static int livello_registro = LIVELLO_RICHIESTA;
+static unsigned long campionamento_registro = 1;
+
+#if defined (__linux__)
+#define REGISTRO_LOCALE_THREAD _Thread_local
+#else
+#define REGISTRO_LOCALE_THREAD
+#endif
+
+/* Tipo C di un argomento, ricavato dalla specifica di conversione */
+typedef enum
+{
+    ARGOMENTO_INT, ARGOMENTO_LONG, ARGOMENTO_LLONG, ARGOMENTO_UINT, ARGOMENTO_ULONG, ARGOMENTO_ULLONG,
+    ARGOMENTO_SIZE, ARGOMENTO_DOUBLE, ARGOMENTO_STRINGA, ARGOMENTO_PUNTATORE, ARGOMENTO_NESSUNO
+} TipoArgomento;
+
+typedef union
+{
+    long long i;
+    unsigned long long u;
+    size_t z;
+    double d;
+    const void *p;
+} ArgomentoRegistro;
+
+typedef struct
+{
+    const char *formato;                /* costante: non viene copiata */
+    uint8_t livello;
+    uint8_t num_argomenti;
+    uint16_t testo_len;
+    ArgomentoRegistro argomenti[REGISTRO_MAX_ARGOMENTI];   /* per %s: posizione della stringa in 'testo' */
+    char testo[REGISTRO_DIM_TESTO];
+} RecordRegistro;
+
+/*
+  Analizza la specifica di conversione che inizia in 'specifica' (subito dopo il '%') e restituisce il tipo
+  dell'argomento; *fine punta al carattere dopo la conversione. "%%" restituisce ARGOMENTO_NESSUNO.
+*/
+static inline TipoArgomento LeggiSpecifica(const char *specifica, const char **fine)
+{
+    const char *c = specifica;
+    int lunghezza = 0;      /* 0 nessuna, 1 l, 2 ll, 3 z/j/t */
+
+    while (*c && strchr("-+ #0123456789.", *c)) c++;
+    while (*c && strchr("hlLzjt", *c))
+    {
+        if (*c == 'l') lunghezza = (lunghezza == 1) ? 2 : 1;
+        else if (*c == 'z' || *c == 'j' || *c == 't') lunghezza = 3;
+        c++;
+    }
+    *fine = (*c) ? c + 1 : c;
+    switch (*c)
+    {
+        case 'd': case 'i':
+            return lunghezza == 1 ? ARGOMENTO_LONG : lunghezza == 2 ? ARGOMENTO_LLONG : lunghezza == 3 ? ARGOMENTO_SIZE : ARGOMENTO_INT;
+        case 'c':
+            return ARGOMENTO_INT;
+        case 'u': case 'x': case 'X': case 'o':
+            return lunghezza == 1 ? ARGOMENTO_ULONG : lunghezza == 2 ? ARGOMENTO_ULLONG : lunghezza == 3 ? ARGOMENTO_SIZE : ARGOMENTO_UINT;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            return ARGOMENTO_DOUBLE;
+        case 's':
+            return ARGOMENTO_STRINGA;
+        case 'p':
+            return ARGOMENTO_PUNTATORE;
+        default:
+            return ARGOMENTO_NESSUNO;
+    }
+}
+
+/* Formatta il record in 'uscita' (al più 'spazio' byte) e restituisce i byte scritti */
+static inline size_t FormattaRecord(const RecordRegistro *record, char *uscita, size_t spazio)
+{
+    const char *c = record->formato;
+    size_t scritti = 0;
+    int a = 0;
+
+    while (*c && scritti + 1 < spazio)
+    {
+        if (*c != '%')
+        {
+            uscita[scritti++] = *c++;
+            continue;
+        }
+        if (c[1] == '%')
+        {
+            uscita[scritti++] = '%';
+            c += 2;
+            continue;
+        }
+
+        /* La specifica viene ricopiata e passata a snprintf() con un argomento del tipo giusto */
+        const char *fine;
+        char specifica[32];
+        TipoArgomento tipo = LeggiSpecifica(c + 1, &fine);
+        size_t len = (size_t)(fine - c) < sizeof(specifica) ? (size_t)(fine - c) : sizeof(specifica) - 1;
+        memcpy(specifica, c, len);
+        specifica[len] = '\0';
+        c = fine;
+        if (tipo == ARGOMENTO_NESSUNO || a >= record->num_argomenti) continue;
+
+        const ArgomentoRegistro *arg = &record->argomenti[a++];
+        size_t libero = spazio - scritti;
+        int n;
+        switch (tipo)
+        {
+            case ARGOMENTO_INT:       n = snprintf(uscita + scritti, libero, specifica, (int)arg->i); break;
+            case ARGOMENTO_LONG:      n = snprintf(uscita + scritti, libero, specifica, (long)arg->i); break;
+            case ARGOMENTO_LLONG:     n = snprintf(uscita + scritti, libero, specifica, arg->i); break;
+            case ARGOMENTO_UINT:      n = snprintf(uscita + scritti, libero, specifica, (unsigned)arg->u); break;
+            case ARGOMENTO_ULONG:     n = snprintf(uscita + scritti, libero, specifica, (unsigned long)arg->u); break;
+            case ARGOMENTO_ULLONG:    n = snprintf(uscita + scritti, libero, specifica, arg->u); break;
+            case ARGOMENTO_SIZE:      n = snprintf(uscita + scritti, libero, specifica, arg->z); break;
+            case ARGOMENTO_DOUBLE:    n = snprintf(uscita + scritti, libero, specifica, arg->d); break;
+            case ARGOMENTO_STRINGA:   n = snprintf(uscita + scritti, libero, specifica, record->testo + arg->u); break;
+            default:                  n = snprintf(uscita + scritti, libero, specifica, arg->p); break;
+        }
+        if (n < 0) break;
+        scritti += ((size_t)n < libero) ? (size_t)n : libero - 1;
+    }
+    return scritti;
+}
+
+/* Copia gli argomenti descritti da 'formato' nel record (lato di chi registra: nessuna formattazione) */
+static inline void CompilaRecord(RecordRegistro *record, int livello, const char *formato, va_list argomenti)
+{
+    const char *c = formato;
+    record->formato = formato;
+    record->livello = (uint8_t)livello;
+    record->num_argomenti = 0;
+    record->testo_len = 0;
+
+    while ((c = strchr(c, '%')) != NULL && record->num_argomenti < REGISTRO_MAX_ARGOMENTI)
+    {
+        ArgomentoRegistro *arg = &record->argomenti[record->num_argomenti];
+        switch (LeggiSpecifica(c + 1, &c))
+        {
+            case ARGOMENTO_INT:       arg->i = va_arg(argomenti, int); break;
+            case ARGOMENTO_LONG:      arg->i = va_arg(argomenti, long); break;
+            case ARGOMENTO_LLONG:     arg->i = va_arg(argomenti, long long); break;
+            case ARGOMENTO_UINT:      arg->u = va_arg(argomenti, unsigned); break;
+            case ARGOMENTO_ULONG:     arg->u = va_arg(argomenti, unsigned long); break;
+            case ARGOMENTO_ULLONG:    arg->u = va_arg(argomenti, unsigned long long); break;
+            case ARGOMENTO_SIZE:      arg->z = va_arg(argomenti, size_t); break;
+            case ARGOMENTO_DOUBLE:    arg->d = va_arg(argomenti, double); break;
+            case ARGOMENTO_PUNTATORE: arg->p = va_arg(argomenti, void *); break;
+            case ARGOMENTO_STRINGA:
+            {
+                const char *stringa = va_arg(argomenti, const char *);
+                size_t len, libero;
+                if (stringa == NULL) stringa = "(null)";
+                if (record->testo_len >= REGISTRO_DIM_TESTO)
+                {
+                    /* Testo esaurito: la stringa diventa vuota, cioè il terminatore dell'ultima copiata */
+                    arg->u = REGISTRO_DIM_TESTO - 1;
+                    break;
+                }
+                len = strlen(stringa);
+                libero = REGISTRO_DIM_TESTO - record->testo_len - 1;
+                if (len > libero) len = libero;   /* le stringhe troppo lunghe vengono troncate */
+                memcpy(record->testo + record->testo_len, stringa, len);
+                arg->u = record->testo_len;
+                record->testo_len += (uint16_t)len;
+                record->testo[record->testo_len++] = '\0';
+                break;
+            }
+            default:
+                continue;   /* "%%" */
+        }
+        record->num_argomenti++;
+    }
+}
+
+#if defined (__linux__)
+/* Anello di un thread: 'testa' è scritto solo dal thread che registra, 'coda' solo dal thread di scrittura */
+typedef struct
+{
+    _Alignas(64) atomic_ulong testa;
+    _Alignas(64) atomic_ulong coda;
+    atomic_ulong scartati;
+    RecordRegistro record[REGISTRO_RECORD];
+} AnelloRegistro;
+
+static _Atomic(AnelloRegistro *) anelli_registro[REGISTRO_MAX_ANELLI];
+static atomic_int num_anelli_registro;
+static atomic_int registro_attivo;
+static REGISTRO_LOCALE_THREAD AnelloRegistro *anello_del_thread;
+static REGISTRO_LOCALE_THREAD int senza_anello;        /* allocazione fallita o anelli esauriti: scrittura sincrona */
+static pthread_mutex_t svuotamento_registro = PTHREAD_MUTEX_INITIALIZER;   /* solo fra thread di scrittura e atexit */
+
+/* Anello del thread chiamante, creato e registrato al primo messaggio */
+static inline AnelloRegistro *AnelloRegistroThread(void)
+{
+    if (anello_del_thread != NULL || senza_anello) return anello_del_thread;
+
+    int posto = atomic_fetch_add(&num_anelli_registro, 1);
+    AnelloRegistro *anello = (posto < REGISTRO_MAX_ANELLI) ? calloc(1, sizeof(AnelloRegistro)) : NULL;
+    if (anello == NULL)
+    {
+        senza_anello = 1;
+        return NULL;
+    }
+    atomic_store_explicit(&anelli_registro[posto], anello, memory_order_release);
+    return anello_del_thread = anello;
+}
+
+/* Svuota tutti gli anelli sullo standard output; restituisce il numero di record scritti */
+static inline unsigned long SvuotaRegistro(void)
+{
+    static char uscita[REGISTRO_DIM_USCITA];
+    unsigned long scritti = 0;
+    size_t usati = 0;
+    int n = atomic_load_explicit(&num_anelli_registro, memory_order_acquire);
+
+    if (n > REGISTRO_MAX_ANELLI) n = REGISTRO_MAX_ANELLI;
+    pthread_mutex_lock(&svuotamento_registro);
+    for (int i = 0; i < n; i++)
+    {
+        AnelloRegistro *anello = atomic_load_explicit(&anelli_registro[i], memory_order_acquire);
+        if (anello == NULL) continue;
+
+        unsigned long coda = atomic_load_explicit(&anello->coda, memory_order_relaxed);
+        unsigned long testa = atomic_load_explicit(&anello->testa, memory_order_acquire);
+        for (; coda != testa; coda++, scritti++)
+        {
+            /* Un record formattato occupa al più qualche centinaio di byte: si scarica il buffer prima che si riempia */
+            if (usati > REGISTRO_DIM_USCITA - 1024)
+            {
+                fwrite(uscita, 1, usati, stdout);
+                usati = 0;
+            }
+            usati += FormattaRecord(&anello->record[coda & (REGISTRO_RECORD - 1)], uscita + usati, REGISTRO_DIM_USCITA - usati);
+        }
+        atomic_store_explicit(&anello->coda, coda, memory_order_release);   /* i posti tornano liberi per chi registra */
+    }
+    if (usati > 0) fwrite(uscita, 1, usati, stdout);
+    if (scritti > 0) fflush(stdout);
+    pthread_mutex_unlock(&svuotamento_registro);
+    return scritti;
+}
+
+/* Messaggi scartati dall'avvio perché l'anello del thread era pieno */
+static inline unsigned long MessaggiScartati(void)
+{
+    unsigned long totale = 0;
+    int n = atomic_load_explicit(&num_anelli_registro, memory_order_acquire);
+    if (n > REGISTRO_MAX_ANELLI) n = REGISTRO_MAX_ANELLI;
+    for (int i = 0; i < n; i++)
+    {
+        AnelloRegistro *anello = atomic_load_explicit(&anelli_registro[i], memory_order_acquire);
+        if (anello != NULL) totale += atomic_load_explicit(&anello->scartati, memory_order_relaxed);
+    }
+    return totale;
+}
+
+/* Thread di scrittura: svuota gli anelli; se sono vuoti attende REGISTRO_ATTESA_US. Ogni secondo segnala i nuovi scarti. */
+static void *ThreadRegistro(void *arg)
+{
+    const struct timespec pausa = { 0, REGISTRO_ATTESA_US * 1000L };
+    unsigned long scartati_segnalati = 0;
+    time_t prossimo_controllo = time(NULL) + 1;
+    (void)arg;
+
+    while (1)
+    {
+        if (SvuotaRegistro() == 0) nanosleep(&pausa, NULL);
+
+        time_t ora = time(NULL);
+        if (ora >= prossimo_controllo)
+        {
+            unsigned long scartati = MessaggiScartati();
+            if (scartati != scartati_segnalati)
+            {
+                printf("--- Registro: %lu messaggi scartati (buffer pieno), %lu dall'avvio ---\n",
+                       scartati - scartati_segnalati, scartati);
+                fflush(stdout);
+                scartati_segnalati = scartati;
+            }
+            prossimo_controllo = ora + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Alla chiusura del processo si scrivono i messaggi ancora negli anelli */
+static void ChiudiRegistro(void)
+{
+    SvuotaRegistro();
+}
+#endif
+
+/* Registra un messaggio (formato e argomenti come printf) senza formattarlo. Usare le macro REGISTRA. */
+#if defined (__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+static inline void Registra(int livello, const char *formato, ...)
+{
+    va_list argomenti;
+    va_start(argomenti, formato);
+#if defined (__linux__)
+    AnelloRegistro *anello;
+    if (atomic_load_explicit(&registro_attivo, memory_order_relaxed) && (anello = AnelloRegistroThread()) != NULL)
+    {
+        unsigned long testa = atomic_load_explicit(&anello->testa, memory_order_relaxed);
+        if (testa - atomic_load_explicit(&anello->coda, memory_order_acquire) >= REGISTRO_RECORD)
+        {
+            /* Anello pieno: il messaggio si perde, chi serve la richiesta non aspetta */
+            atomic_store_explicit(&anello->scartati, atomic_load_explicit(&anello->scartati, memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+        else
+        {
+            CompilaRecord(&anello->record[testa & (REGISTRO_RECORD - 1)], livello, formato, argomenti);
+            atomic_store_explicit(&anello->testa, testa + 1, memory_order_release);
+        }
+        va_end(argomenti);
+        return;
+    }
+#endif
+    (void)livello;
+    vprintf(formato, argomenti);
+    va_end(argomenti);
+}
+
+/* Messaggio registrato se il livello è abilitato */
+#define REGISTRA(livello, ...) \
+    do { if ((livello) <= livello_registro) Registra((livello), __VA_ARGS__); } while (0)
+
+/* Messaggio di una singola richiesta: oltre al livello si applica il campionamento (un'occorrenza su N per punto e thread) */
+#define REGISTRA_CAMPIONE(livello, ...) \
+    do { \
+        static REGISTRO_LOCALE_THREAD unsigned long occorrenze_registro; \
+        if ((livello) <= livello_registro && occorrenze_registro++ % campionamento_registro == 0) Registra((livello), __VA_ARGS__); \
+    } while (0)
+
+/*
+  Imposta livello e campionamento e avvia il thread di scrittura. Va chiamata dal thread principale prima di creare
+  gli altri thread (dopo AvviaMetriche(), così anche il thread di scrittura ha SIGUSR1 bloccato).
+*/
+static inline void AvviaRegistro(int livello, unsigned long campionamento)
+{
+    livello_registro = livello;
+    campionamento_registro = campionamento > 0 ? campionamento : 1;
+#if defined (__linux__)
+    pthread_t thread;
+    fflush(stdout);
+    if (pthread_create(&thread, NULL, ThreadRegistro, NULL) != 0)
+    {
+        printf("Impossibile avviare il thread del registro: i messaggi vengono scritti in modo sincrono.\n");
+        return;
+    }
+    pthread_detach(thread);
+    atexit(ChiudiRegistro);
+    atomic_store_explicit(&registro_attivo, 1, memory_order_release);
+#endif
+}
+
+#endif /* REGISTRO_G35_H */
@@ -0,0 +1,196 @@
+/*
+  Ruota gerarchica di temporizzatori (Varghese e Lauck): le scadenze di tutte le connessioni di un worker in una sola
+  struttura, senza un timerfd per socket e senza una coda con priorità.
+
+  Il tempo è diviso in tick di durata fissa. La ruota ha LIVELLI_RUOTA livelli di CASELLE_RUOTA caselle: il livello 0
+  ha una casella per tick, il livello 1 una casella ogni 64 tick, il livello 2 ogni 4096 e così via. Un temporizzatore
+  va nel livello più basso che copre la distanza dalla sua scadenza, in una lista doppiamente collegata: armarlo e
+  annullarlo costano O(1). Quando il livello 0 completa un giro, la casella corrente del livello 1 si "versa" nei livelli
+  inferiori (ogni temporizzatore si reinserisce con la distanza ormai ridotta), e allo stesso modo i livelli superiori.
+
+  Una maschera di bit per livello dice quali caselle sono occupate: trovare il prossimo evento (il primo temporizzatore
+  del livello 0 o il primo versamento di una casella occupata) costa poche istruzioni, così il ciclo del worker può
+  dormire fino a lì invece di svegliarsi a ogni tick, e dopo una lunga attesa salta direttamente al tick successivo utile.
+
+  Il temporizzatore è un campo della struttura che lo usa (la connessione): la ruota non alloca memoria.
+  Lo stato è di un solo thread (un worker del server): nessuna sincronizzazione. Tempi in nanosecondi.
+*/
+#ifndef RUOTA_TEMPORIZZATORI_G35_H
+#define RUOTA_TEMPORIZZATORI_G35_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define BIT_CASELLE_RUOTA 6
+#define CASELLE_RUOTA (1 << BIT_CASELLE_RUOTA)
+#define MASCHERA_RUOTA (CASELLE_RUOTA - 1)
+#define LIVELLI_RUOTA 4                         /* con tick da 10 ms le scadenze arrivano a circa 46 ore */
+#define DISTANZA_MASSIMA_RUOTA ((1ull << (BIT_CASELLE_RUOTA * LIVELLI_RUOTA)) - 1)
+
+typedef struct Temporizzatore
+{
+    struct Temporizzatore *prossimo;
+    struct Temporizzatore **precedente;         /* campo che punta a questo temporizzatore (NULL = non armato) */
+    uint64_t scadenza;                          /* in tick */
+    uint8_t livello, casella;
+} Temporizzatore;
+
+typedef struct
+{
+    Temporizzatore *caselle[LIVELLI_RUOTA][CASELLE_RUOTA];
+    uint64_t occupate[LIVELLI_RUOTA];           /* bit i = casella i non vuota */
+    uint64_t adesso;                            /* tick corrente: i tick precedenti sono già stati elaborati */
+    uint64_t origine, durata_tick;
+    unsigned long armati;
+} RuotaTemporizzatori;
+
+static inline void InizializzaRuota(RuotaTemporizzatori *ruota, uint64_t durata_tick, uint64_t ora)
+{
+    memset(ruota, 0, sizeof(*ruota));
+    ruota->origine = ora;
+    ruota->durata_tick = durata_tick;
+}
+
+static inline int TemporizzatoreArmato(const Temporizzatore *temporizzatore)
+{
+    return temporizzatore->precedente != NULL;
+}
+
+static inline uint64_t TickRuota(const RuotaTemporizzatori *ruota, uint64_t ora)
+{
+    return ora > ruota->origine ? (ora - ruota->origine) / ruota->durata_tick : 0;
+}
+
+/* Mette il temporizzatore nella casella della sua scadenza, rispetto al tick corrente */
+static inline void InserisciRuota(RuotaTemporizzatori *ruota, Temporizzatore *temporizzatore)
+{
+    uint64_t distanza;
+    int livello = 0, casella;
+
+    if (temporizzatore->scadenza < ruota->adesso) temporizzatore->scadenza = ruota->adesso;   /* già scaduto: al prossimo controllo */
+    distanza = temporizzatore->scadenza - ruota->adesso;
+    if (distanza > DISTANZA_MASSIMA_RUOTA)
+    {
+        distanza = DISTANZA_MASSIMA_RUOTA;
+        temporizzatore->scadenza = ruota->adesso + distanza;
+    }
+    while (livello < LIVELLI_RUOTA - 1 && distanza >= (1ull << (BIT_CASELLE_RUOTA * (livello + 1)))) livello++;
+    casella = (int)((temporizzatore->scadenza >> (BIT_CASELLE_RUOTA * livello)) & MASCHERA_RUOTA);
+
+    temporizzatore->livello = (uint8_t)livello;
+    temporizzatore->casella = (uint8_t)casella;
+    temporizzatore->prossimo = ruota->caselle[livello][casella];
+    if (temporizzatore->prossimo != NULL) temporizzatore->prossimo->precedente = &temporizzatore->prossimo;
+    temporizzatore->precedente = &ruota->caselle[livello][casella];
+    ruota->caselle[livello][casella] = temporizzatore;
+    ruota->occupate[livello] |= 1ull << casella;
+}
+
+static inline void AnnullaTemporizzatore(RuotaTemporizzatori *ruota, Temporizzatore *temporizzatore)
+{
+    if (!TemporizzatoreArmato(temporizzatore)) return;
+    *temporizzatore->precedente = temporizzatore->prossimo;
+    if (temporizzatore->prossimo != NULL) temporizzatore->prossimo->precedente = temporizzatore->precedente;
+    if (ruota->caselle[temporizzatore->livello][temporizzatore->casella] == NULL)
+        ruota->occupate[temporizzatore->livello] &= ~(1ull << temporizzatore->casella);
+    temporizzatore->prossimo = NULL;
+    temporizzatore->precedente = NULL;
+    ruota->armati--;
+}
+
+/* Arma (o riarma) il temporizzatore perché scada 'durata' ns dopo 'ora' (arrotondata al tick successivo) */
+static inline void ArmaTemporizzatore(RuotaTemporizzatori *ruota, Temporizzatore *temporizzatore, uint64_t ora, uint64_t durata)
+{
+    AnnullaTemporizzatore(ruota, temporizzatore);
+    temporizzatore->scadenza = TickRuota(ruota, ora) + (durata + ruota->durata_tick - 1) / ruota->durata_tick;
+    InserisciRuota(ruota, temporizzatore);
+    ruota->armati++;
+}
+
+/* Distanza in caselle dalla posizione 'indice' alla prima casella occupata dopo di essa, nel giro (0 = nessuna) */
+static inline int DistanzaOccupata(uint64_t occupate, int indice)
+{
+    uint64_t ruotate;
+    if (occupate == 0) return 0;
+    ruotate = (occupate >> indice) | (indice ? occupate << (CASELLE_RUOTA - indice) : 0);
+    ruotate &= ~1ull;                           /* la casella corrente è trattata a parte */
+    return ruotate ? __builtin_ctzll(ruotate) : CASELLE_RUOTA;
+}
+
+/* Primo tick dopo quello corrente in cui la ruota ha qualcosa da fare (UINT64_MAX se è vuota) */
+static inline uint64_t ProssimoEventoRuota(const RuotaTemporizzatori *ruota)
+{
+    uint64_t prossimo = UINT64_MAX, periodo;
+    int livello, distanza;
+
+    for (livello = 0; livello < LIVELLI_RUOTA; livello++)
+    {
+        distanza = DistanzaOccupata(ruota->occupate[livello], (int)((ruota->adesso >> (BIT_CASELLE_RUOTA * livello)) & MASCHERA_RUOTA));
+        if (distanza == 0) continue;
+        /* Livello > 0: la casella si versa all'inizio del suo periodo; nessuna scadenza arriva prima */
+        periodo = (ruota->adesso >> (BIT_CASELLE_RUOTA * livello)) + (uint64_t)distanza;
+        if (periodo << (BIT_CASELLE_RUOTA * livello) < prossimo) prossimo = periodo << (BIT_CASELLE_RUOTA * livello);
+    }
+    return prossimo;
+}
+
+/* Versa nei livelli inferiori le caselle che iniziano il loro periodo al tick corrente (multiplo di CASELLE_RUOTA) */
+static inline void VersaRuota(RuotaTemporizzatori *ruota)
+{
+    Temporizzatore *lista, *prossimo;
+    int livello, casella;
+
+    for (livello = 1; livello < LIVELLI_RUOTA; livello++)
+    {
+        casella = (int)((ruota->adesso >> (BIT_CASELLE_RUOTA * livello)) & MASCHERA_RUOTA);
+        lista = ruota->caselle[livello][casella];
+        ruota->caselle[livello][casella] = NULL;
+        ruota->occupate[livello] &= ~(1ull << casella);
+        for (; lista != NULL; lista = prossimo)
+        {
+            prossimo = lista->prossimo;
+            InserisciRuota(ruota, lista);
+        }
+        if (casella != 0) break;
+    }
+}
+
+/*
+  Restituisce un temporizzatore scaduto entro 'ora', già staccato dalla ruota, oppure NULL se non ce ne sono altri.
+  Si chiama in un ciclo dopo ogni attesa degli eventi.
+*/
+static inline Temporizzatore *ProssimoScaduto(RuotaTemporizzatori *ruota, uint64_t ora)
+{
+    uint64_t tick = TickRuota(ruota, ora), prossimo;
+    Temporizzatore *scaduto;
+
+    while (1)
+    {
+        scaduto = ruota->caselle[0][ruota->adesso & MASCHERA_RUOTA];
+        if (scaduto != NULL)
+        {
+            AnnullaTemporizzatore(ruota, scaduto);
+            return scaduto;
+        }
+        if (ruota->adesso >= tick) return NULL;
+        prossimo = ProssimoEventoRuota(ruota);
+        ruota->adesso = prossimo < tick ? prossimo : tick;
+        if ((ruota->adesso & MASCHERA_RUOTA) == 0) VersaRuota(ruota);
+    }
+}
+
+/* Millisecondi di attesa fino al prossimo evento della ruota, per epoll_wait() (-1 = nessun temporizzatore) */
+static inline int AttesaRuota(const RuotaTemporizzatori *ruota, uint64_t ora)
+{
+    uint64_t evento, istante;
+
+    if (ruota->armati == 0) return -1;
+    if (ruota->caselle[0][ruota->adesso & MASCHERA_RUOTA] != NULL) return 0;
+    evento = ProssimoEventoRuota(ruota);
+    istante = ruota->origine + evento * ruota->durata_tick;
+    if (istante <= ora) return 0;
+    istante = (istante - ora + 999999) / 1000000;
+    return istante > 3600000 ? 3600000 : (int)istante;
+}
+
+#endif /* RUOTA_TEMPORIZZATORI_G35_H */
@@ -3,12 +3,21 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment (lib, "ws2_32.lib")
+#include <io.h>         // _setmode() per l'ingresso e l'uscita binari del flusso (-S -B)
+#include <fcntl.h>
 
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>        // struct iovec per sendmsg()
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>          // Socket non bloccanti del flusso (-S)
+#include <errno.h>
+#include <time.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>    // TCP_NODELAY
 #define closesocket close   // Mappa closesocket su close per sistemi Unix [cite: 204, 205]
 #endif
 
@@ -16,11 +25,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+
+#include "../comune/protocollo_g35.h"   // Messaggi binari con intestazione fissa (opzione -f)
+#include "../comune/lettore_g35.h"      // Risposte dei messaggi lette sul posto da un buffer di ricezione
 // Costanti
 #define PROTOPORT 48000                           // Porta di default per l'applicazione
 #define ECHOMAX 255                               // Dimensione massima del buffer di echo
 #define EXIT_STRING "TERMINE PROCESSO CLIENT"     // Stringa di terminazione
 #define CONNECT_OK_STRING "connessione avvenuta"  // Stringa di conferma connessione
+#define OVERLOAD_STRING "SERVER SOVRACCARICO"     // Inviata dal server al posto del saluto quando rifiuta la connessione
+#define LIMIT_STRING "LIMITE SUPERATO"            // Inviata al posto del saluto se questo client ha superato il limite del server (-L)
+#define OP_SESSIONE 'P'                           // Carattere che apre una sessione persistente
+#define SESSION_STRING "SESSIONE"                 // Conferma di apertura della sessione
+#define DIM_RICHIESTA_SESSIONE 9                  // Richiesta in sessione: carattere operazione + 2 * sizeof(uint32_t)
+#define FINESTRA_SESSIONE 128                     // Richieste massime in volo in una sessione
+#define OP_BATCH 'B'                              // Carattere che introduce una richiesta batch
+#define BATCH_STRING "BATCH"                      // Conferma della richiesta batch
+#define MAX_BATCH 65536                           // Coppie massime in un batch (limite del server TCP)
+#define MODALITA_BINARIA 'F'                      // Opzione -f: messaggi binari (non è un carattere del protocollo)
+#define DIM_RICHIESTA_BINARIA (DIM_INTESTAZIONE + 2 * sizeof(uint32_t))   // Messaggio con un'operazione singola
+#define MODALITA_GRANDI 'G'                       // Opzione -g: numeri grandi nei messaggi binari
+#define MAX_MESSAGGIO_GRANDI 4096                 // Byte massimi di un messaggio (limite del server TCP)
+#define MAX_RIGA_GRANDI 16384                     // Riga di input con due numeri grandi in decimale
+#define MODALITA_ESPRESSIONI 'X'                  // Opzione -x: espressioni con variabili nei messaggi binari
+#define DIM_BUFFER_FLUSSO (1 << 20)               // Flusso (-S): buffer di lettura dell'ingresso e di scrittura dei risultati
+#define DIM_RICEZIONE_FLUSSO (256 * 1024)         // Flusso: buffer di ricezione di ogni connessione
+#define MAX_CONNESSIONI_FLUSSO 64
+#define MAX_FINESTRA_FLUSSO 65536                 // Richieste massime in volo per connessione
+#define DIM_RISULTATO_BINARIO 5                   // Uscita binaria del flusso: esito e risultato
+#if defined (MSG_NOSIGNAL)
+#define FLAG_INVIO_FLUSSO MSG_NOSIGNAL            // Flusso (-S): una connessione chiusa dal server non termina il client con SIGPIPE
+#else
+#define FLAG_INVIO_FLUSSO 0
+#endif
 
 void ErrorHandler(char *errorMessage) 
 {   // Funzione di gestione errori
@@ -48,7 +85,1077 @@ int RecvExact(int sock, char *buf, int len)
     return total_bytes;   // Restituisce il numero totale di byte ricevuti
 }
 
-int main(void) 
+// Invia due aree di memoria con una sola chiamata (scatter-gather), senza copiarle in un buffer unico
+int InviaParti(int sock, const void *prima, int len_prima, const void *seconda, int len_seconda)
+{
+#if defined (_WIN32)
+    WSABUF parti[2] = { { (ULONG)len_prima, (CHAR *)prima }, { (ULONG)len_seconda, (CHAR *)seconda } };
+    DWORD inviati;
+    if (WSASend(sock, parti, 2, &inviati, 0, NULL, NULL) != 0) return -1;
+    return (int)inviati;
+#else
+    struct iovec parti[2] = { { (void *)prima, (size_t)len_prima }, { (void *)seconda, (size_t)len_seconda } };
+    struct msghdr messaggio;
+    memset(&messaggio, 0, sizeof(messaggio));
+    messaggio.msg_iov = parti;
+    messaggio.msg_iovlen = 2;
+    return (int)sendmsg(sock, &messaggio, 0);
+#endif
+}
+
+/*
+SESSIONE PERSISTENTE (opzione -s): invece di una sola operazione per connessione, il client apre una sessione inviando
+OP_SESSIONE e poi invia le richieste a blocchi, tutte con una sola send() e senza attendere i singoli risultati
+(pipeline). I risultati arrivano nello stesso ordine delle richieste. Vedi la descrizione del formato nel server.
+*/
+int SessioneClient(int Csocket)
+{
+    char richieste[FINESTRA_SESSIONE * DIM_RICHIESTA_SESSIONE];   // Blocco di richieste da inviare
+    char operazioni[FINESTRA_SESSIONE];                            // Per stampare i risultati
+    long operandi[FINESTRA_SESSIONE][2];
+    uint32_t risultati[FINESTRA_SESSIONE];
+    char riga[ECHOMAX];
+    int in_coda, i, fine_input = 0;
+    long totale = 0;
+
+    printf("Sessione aperta. Inserisci un'operazione per riga (es. A 3 4); una riga vuota invia il blocco, EOF chiude la sessione.\n");
+    while (!fine_input)
+    {
+        // Accumula fino a FINESTRA_SESSIONE richieste (o fino a una riga vuota / fine dell'input)
+        in_coda = 0;
+        while (in_coda < FINESTRA_SESSIONE)
+        {
+            char op;
+            long op1, op2;
+            if (fgets(riga, sizeof(riga), stdin) == NULL)
+            {
+                fine_input = 1;
+                break;
+            }
+            if (riga[0] == '\n' || riga[0] == '\r')
+            {
+                if (in_coda > 0) break;
+                continue;
+            }
+            if (sscanf(riga, " %c %ld %ld", &op, &op1, &op2) != 3 || strchr("AaSsMmDd", op) == NULL)
+            {
+                printf("Riga ignorata: %s", riga);
+                continue;
+            }
+
+            char *richiesta = richieste + in_coda * DIM_RICHIESTA_SESSIONE;
+            uint32_t net_op1 = htonl((uint32_t)op1);
+            uint32_t net_op2 = htonl((uint32_t)op2);
+            richiesta[0] = op;
+            memcpy(richiesta + 1, &net_op1, sizeof(uint32_t));
+            memcpy(richiesta + 1 + sizeof(uint32_t), &net_op2, sizeof(uint32_t));
+            operazioni[in_coda] = op;
+            operandi[in_coda][0] = op1;
+            operandi[in_coda][1] = op2;
+            in_coda++;
+        }
+        if (in_coda == 0) continue;
+
+        // Tutte le richieste del blocco partono insieme, poi si ricevono i risultati nello stesso ordine
+        if (send(Csocket, richieste, in_coda * DIM_RICHIESTA_SESSIONE, 0) != in_coda * DIM_RICHIESTA_SESSIONE)
+        {
+            ErrorHandler("send() fallita invio richieste della sessione.\n");
+            return -1;
+        }
+        if (RecvExact(Csocket, (char *)risultati, in_coda * sizeof(uint32_t)) <= 0)
+        {
+            ErrorHandler("recv() fallita o connessione chiusa prematuramente (risultati della sessione).\n");
+            return -1;
+        }
+        for (i = 0; i < in_coda; i++)
+        {
+            printf("%ld %c %ld = %d\n", operandi[i][0], operazioni[i], operandi[i][1], (int32_t)ntohl(risultati[i]));
+        }
+        totale += in_coda;
+    }
+
+    printf("Sessione chiusa dopo %ld operazioni.\n", totale);
+    return 0;
+}
+
+/*
+Operazione singola con il protocollo originale, su una connessione nuova: è il ripiego dei messaggi binari quando il
+server non li conosce. Restituisce 0 e il risultato, 1 se il server rifiuta l'operazione, -1 in caso di errore.
+*/
+int OperazioneClassica(const struct sockaddr_in *sad, char op, long op1, long op2, int32_t *risultato)
+{
+    char risposta[ECHOMAX] = {0};
+    uint32_t operands[2] = { htonl((uint32_t)op1), htonl((uint32_t)op2) }, net_result;
+    int sock, esito = -1;
+
+    if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) return -1;
+    if (connect(sock, (const struct sockaddr *)sad, sizeof(*sad)) == 0
+        && RecvExact(sock, risposta, sizeof(CONNECT_OK_STRING)) > 0
+        && send(sock, &op, 1, 0) == 1
+        && recv(sock, risposta, ECHOMAX - 1, 0) > 0)
+    {
+        if (strcmp(risposta, EXIT_STRING) == 0) esito = 1;
+        else if (send(sock, (char *)operands, sizeof(operands), 0) == sizeof(operands)
+                 && RecvExact(sock, (char *)&net_result, sizeof(net_result)) > 0)
+        {
+            *risultato = (int32_t)ntohl(net_result);
+            esito = 0;
+        }
+    }
+    closesocket(sock);
+    return esito;
+}
+
+/*
+MESSAGGI BINARI (opzione -f): il client invia OP_NEGOZIAZIONE al posto del carattere operazione e, se il server risponde
+con un messaggio, ogni operazione diventa un messaggio di DIM_RICHIESTA_BINARIA byte con intestazione fissa; la risposta
+porta un esito numerico e lo stesso identificativo (formato in comune/protocollo_g35.h). Le richieste partono a blocchi
+come nella sessione. Se il server risponde con una stringa non conosce i messaggi binari: il client usa allora il
+protocollo originale, con una connessione per operazione.
+*/
+int MessaggiClient(int Csocket, const struct sockaddr_in *sad)
+{
+    unsigned char richieste[FINESTRA_SESSIONE * DIM_RICHIESTA_BINARIA];
+    char ingresso[FINESTRA_SESSIONE * DIM_RICHIESTA_BINARIA];   // Le risposte di un blocco non sono più lunghe delle richieste
+    Lettore lettore;
+    const unsigned char *risposta;
+    char operazioni[FINESTRA_SESSIONE];
+    long operandi[FINESTRA_SESSIONE][2];
+    char riga[ECHOMAX];
+    Intestazione intestazione;
+    uint32_t valori[2], id = 0;
+    int in_coda, i, fine_input = 0, binario;
+    long totale = 0;
+    int32_t risultato;
+
+    InizializzaLettore(&lettore, ingresso, sizeof(ingresso));
+    ScriviIntestazione(richieste, OP_NEGOZIAZIONE, 0, 0, id++);
+    if (send(Csocket, (char *)richieste, DIM_INTESTAZIONE, 0) != DIM_INTESTAZIONE)
+    {
+        ErrorHandler("send() fallita (negoziazione).\n");
+        return -1;
+    }
+    // Un server che non conosce i messaggi risponde EXIT_STRING, più lunga di un'intestazione
+    binario = (risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) != NULL
+              && LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione)
+              && intestazione.flag_esito == ESITO_OK && intestazione.lunghezza == 0;
+    if (binario) printf("Messaggi binari attivi (versione %d).\n", intestazione.versione);
+    else printf("Il server non supporta i messaggi binari: ogni operazione usa il protocollo originale.\n");
+
+    printf("Inserisci un'operazione per riga (es. A 3 4); una riga vuota invia il blocco, EOF termina.\n");
+    while (!fine_input)
+    {
+        in_coda = 0;
+        while (in_coda < FINESTRA_SESSIONE)
+        {
+            char op;
+            long op1, op2;
+            if (fgets(riga, sizeof(riga), stdin) == NULL)
+            {
+                fine_input = 1;
+                break;
+            }
+            if (riga[0] == '\n' || riga[0] == '\r')
+            {
+                if (in_coda > 0) break;
+                continue;
+            }
+            if (sscanf(riga, " %c %ld %ld", &op, &op1, &op2) != 3 || strchr("AaSsMmDd", op) == NULL)
+            {
+                printf("Riga ignorata: %s", riga);
+                continue;
+            }
+
+            valori[0] = htonl((uint32_t)op1);
+            valori[1] = htonl((uint32_t)op2);
+            ScriviIntestazione(richieste + in_coda * DIM_RICHIESTA_BINARIA, (uint8_t)op, 0, sizeof(valori), id + in_coda);
+            memcpy(richieste + in_coda * DIM_RICHIESTA_BINARIA + DIM_INTESTAZIONE, valori, sizeof(valori));
+            operazioni[in_coda] = op;
+            operandi[in_coda][0] = op1;
+            operandi[in_coda][1] = op2;
+            in_coda++;
+        }
+        if (in_coda == 0) continue;
+
+        if (!binario)
+        {
+            for (i = 0; i < in_coda; i++)
+            {
+                if (OperazioneClassica(sad, operazioni[i], operandi[i][0], operandi[i][1], &risultato) != 0)
+                {
+                    ErrorHandler("Operazione con il protocollo originale fallita.\n");
+                    return -1;
+                }
+                printf("%ld %c %ld = %d\n", operandi[i][0], operazioni[i], operandi[i][1], risultato);
+            }
+            totale += in_coda;
+            continue;
+        }
+
+        if (send(Csocket, (char *)richieste, in_coda * DIM_RICHIESTA_BINARIA, 0) != (int)(in_coda * DIM_RICHIESTA_BINARIA))
+        {
+            ErrorHandler("send() fallita invio messaggi.\n");
+            return -1;
+        }
+        // Risposte nello stesso ordine: intestazione e, se l'esito lo prevede, il risultato.
+        // Di solito arrivano tutte con una sola recv() e si leggono sul posto dal buffer del lettore.
+        for (i = 0; i < in_coda; i++)
+        {
+            const char *carico = NULL;
+            if ((risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) == NULL
+                || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione)
+                || intestazione.id != id + i || intestazione.lunghezza > sizeof(uint32_t)
+                || (intestazione.lunghezza > 0 && (carico = LeggiLettore(&lettore, Csocket, intestazione.lunghezza)) == NULL))
+            {
+                ErrorHandler("recv() fallita o risposta non valida (messaggi).\n");
+                return -1;
+            }
+            if (intestazione.lunghezza == sizeof(uint32_t))
+            {
+                memcpy(&valori[0], carico, sizeof(uint32_t));
+                printf("%ld %c %ld = %d%s\n", operandi[i][0], operazioni[i], operandi[i][1], (int32_t)ntohl(valori[0]),
+                       intestazione.flag_esito == ESITO_DIVISIONE_PER_ZERO ? " (divisione per zero)" : "");
+            }
+            else if (intestazione.flag_esito == ESITO_SOVRACCARICO)
+                printf("%ld %c %ld: scartata, server sovraccarico\n", operandi[i][0], operazioni[i], operandi[i][1]);
+            else if (intestazione.flag_esito == ESITO_LIMITE_SUPERATO)
+                printf("%ld %c %ld: scartata, limite di frequenza superato\n", operandi[i][0], operazioni[i], operandi[i][1]);
+            else printf("%ld %c %ld: esito %d\n", operandi[i][0], operazioni[i], operandi[i][1], intestazione.flag_esito);
+        }
+        id += in_coda;
+        totale += in_coda;
+    }
+
+    printf("Connessione chiusa dopo %ld operazioni.\n", totale);
+    return 0;
+}
+
+/*
+NUMERI GRANDI (opzione -g): dopo la negoziazione ogni riga "op a b" diventa un messaggio FLAG_GRANDI con i due interi
+di lunghezza arbitraria (in decimale nell'input); il risultato torna nello stesso formato e si stampa in decimale.
+Operazioni: A, S, M, D (quoziente), R (resto), E (potenza). Un messaggio deve stare in MAX_MESSAGGIO_GRANDI byte.
+*/
+int GrandiClient(int Csocket)
+{
+    unsigned char richiesta[MAX_MESSAGGIO_GRANDI];
+    char ingresso[MAX_MESSAGGIO_GRANDI];   // La risposta più lunga (potenza) sta in DIM_INTESTAZIONE + 4 + MAX_BYTE_POTENZA byte
+    static char riga[MAX_RIGA_GRANDI];
+    Lettore lettore;
+    const unsigned char *risposta;
+    const char *carico;
+    Intestazione intestazione;
+    Numero a, b, r;
+    char op, *testo_a, *testo_b, *testo;
+    uint32_t id = 0, lunghezza;
+    int esito = 0;
+
+    InizializzaLettore(&lettore, ingresso, sizeof(ingresso));
+    ScriviIntestazione(richiesta, OP_NEGOZIAZIONE, 0, 0, id++);
+    if (send(Csocket, (char *)richiesta, DIM_INTESTAZIONE, 0) != DIM_INTESTAZIONE
+        || (risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) == NULL
+        || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione)
+        || intestazione.flag_esito != ESITO_OK || intestazione.lunghezza != 0)
+    {
+        printf("Il server non supporta i messaggi binari: i numeri grandi non sono disponibili.\n");
+        return -1;
+    }
+
+    InizializzaNumero(&a);
+    InizializzaNumero(&b);
+    InizializzaNumero(&r);
+    printf("Inserisci un'operazione per riga (A, S, M, D, R=resto, E=potenza, es. M 123456789012345678901 98765); EOF termina.\n");
+    while (fgets(riga, sizeof(riga), stdin) != NULL)
+    {
+        op = 0;
+        testo_a = strtok(riga, " \t\r\n");
+        if (testo_a != NULL && testo_a[1] == '\0') op = testo_a[0];
+        testo_a = strtok(NULL, " \t\r\n");
+        testo_b = strtok(NULL, " \t\r\n");
+        if (op == 0 && testo_a == NULL) continue;   // Riga vuota
+        if (!OperazioneGrandiValida(op) || testo_a == NULL || testo_b == NULL
+            || NumeroDaTesto(&a, testo_a) != 0 || NumeroDaTesto(&b, testo_b) != 0)
+        {
+            printf("Riga ignorata: operazione o numeri non validi.\n");
+            continue;
+        }
+        lunghezza = DimensioneNumero(&a) + DimensioneNumero(&b);
+        if (DIM_INTESTAZIONE + lunghezza > sizeof(richiesta))
+        {
+            printf("Riga ignorata: i due numeri superano %d byte.\n", MAX_MESSAGGIO_GRANDI - DIM_INTESTAZIONE);
+            continue;
+        }
+        ScriviIntestazione(richiesta, (uint8_t)op, FLAG_GRANDI, lunghezza, id);
+        ScriviNumero(richiesta + DIM_INTESTAZIONE + ScriviNumero(richiesta + DIM_INTESTAZIONE, &a), &b);
+        if (send(Csocket, (char *)richiesta, DIM_INTESTAZIONE + lunghezza, 0) != (int)(DIM_INTESTAZIONE + lunghezza))
+        {
+            ErrorHandler("send() fallita invio numeri grandi.\n");
+            esito = -1;
+            break;
+        }
+
+        carico = NULL;
+        if ((risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) == NULL
+            || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione) || intestazione.id != id
+            || intestazione.lunghezza > sizeof(ingresso)
+            || (intestazione.lunghezza > 0 && (carico = LeggiLettore(&lettore, Csocket, intestazione.lunghezza)) == NULL))
+        {
+            ErrorHandler("recv() fallita o risposta non valida (numeri grandi).\n");
+            esito = -1;
+            break;
+        }
+        id++;
+        if (carico == NULL || LeggiNumero(&r, (const unsigned char *)carico, intestazione.lunghezza, (int)(intestazione.lunghezza / 4) + 1)
+                              != (long)intestazione.lunghezza)
+        {
+            printf("%c: esito %d\n", op, intestazione.flag_esito);
+            continue;
+        }
+        if ((testo = TestoDaNumero(&r)) == NULL)
+        {
+            ErrorHandler("Memoria esaurita.\n");
+            esito = -1;
+            break;
+        }
+        printf("%s%s\n", testo, intestazione.flag_esito == ESITO_DIVISIONE_PER_ZERO ? " (divisione per zero)" : "");
+        free(testo);
+    }
+
+    LiberaNumero(&a);
+    LiberaNumero(&b);
+    LiberaNumero(&r);
+    return esito;
+}
+
+/*
+ESPRESSIONI (opzione -x): dopo la negoziazione il client legge un'espressione con variabili di una lettera
+(es. (a+b)*c/d) e poi, una riga per valutazione, i valori delle variabili in ordine alfabetico. Una riga vuota (o EOF)
+invia in un solo messaggio OP_ESPRESSIONE tutte le valutazioni accumulate; una riga che inizia con '=' cambia
+espressione. Il client compila l'espressione solo per sapere quante variabili ha: il calcolo lo fa il server, che
+conserva il programma compilato e non analizza di nuovo lo stesso testo.
+*/
+int EspressioniClient(int Csocket)
+{
+    unsigned char richiesta[MAX_MESSAGGIO_GRANDI];
+    char ingresso[MAX_MESSAGGIO_GRANDI];
+    char riga[ECHOMAX], testo[MAX_TESTO_ESPRESSIONE + 1] = "";
+    static Programma programma;   // ~1 KB: solo il numero di variabili e il testo
+    Lettore lettore;
+    const unsigned char *risposta;
+    const char *carico;
+    Intestazione intestazione;
+    uint32_t id = 0, n = 0, max_n = 0, i, valore;
+    int lunghezza_testo = 0, fine_input = 0, j, letti, pos;
+    char *p;
+
+    InizializzaLettore(&lettore, ingresso, sizeof(ingresso));
+    ScriviIntestazione(richiesta, OP_NEGOZIAZIONE, 0, 0, id++);
+    if (send(Csocket, (char *)richiesta, DIM_INTESTAZIONE, 0) != DIM_INTESTAZIONE
+        || (risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) == NULL
+        || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione)
+        || intestazione.flag_esito != ESITO_OK || intestazione.lunghezza != 0)
+    {
+        printf("Il server non supporta i messaggi binari: le espressioni non sono disponibili.\n");
+        return -1;
+    }
+
+    printf("Inserisci un'espressione (es. (a+b)*c/d), poi una riga di valori per valutazione (variabili in ordine alfabetico).\n");
+    printf("Una riga vuota invia le valutazioni, una riga \"= espressione\" cambia espressione, EOF termina.\n");
+    while (!fine_input)
+    {
+        if (fgets(riga, sizeof(riga), stdin) == NULL) fine_input = 1;
+        else riga[strcspn(riga, "\r\n")] = '\0';
+
+        // Nuova espressione: la prima riga non vuota, o una riga che inizia con '='
+        if (!fine_input && (lunghezza_testo == 0 || riga[0] == '='))
+        {
+            p = riga + (riga[0] == '=');
+            while (*p == ' ') p++;
+            if (*p == '\0') continue;
+            if (n > 0) printf("Valutazioni non inviate scartate.\n");
+            n = 0;
+            if (CompilaEspressione(&programma, p, (int)strlen(p)) != 0)
+            {
+                printf("Espressione non valida: %s\n", p);
+                lunghezza_testo = 0;
+                continue;
+            }
+            lunghezza_testo = (int)strlen(p);
+            memcpy(testo, p, (size_t)lunghezza_testo + 1);
+            // Valutazioni che entrano in un messaggio: intestazione, L, testo, n, n * k valori
+            max_n = programma.variabili == 0 ? 1
+                    : (uint32_t)(MAX_MESSAGGIO_GRANDI - DIM_INTESTAZIONE - 8 - lunghezza_testo) / (4 * (uint32_t)programma.variabili);
+            if (max_n > MAX_BATCH) max_n = MAX_BATCH;
+            printf("Variabili: %d. ", programma.variabili);
+            if (programma.variabili == 0) printf("Una riga vuota calcola l'espressione.\n");
+            else printf("Fino a %u valutazioni per messaggio.\n", max_n);
+            continue;
+        }
+
+        if (!fine_input && riga[0] != '\0' && lunghezza_testo > 0)
+        {
+            // Riga di valori: ne servono esattamente programma.variabili
+            pos = DIM_INTESTAZIONE + 8 + lunghezza_testo + (int)(n * programma.variabili * 4);
+            for (j = 0, p = riga; j < programma.variabili; j++, p += letti)
+            {
+                long v;
+                if (sscanf(p, " %ld%n", &v, &letti) != 1) break;
+                valore = htonl((uint32_t)v);
+                memcpy(richiesta + pos + j * 4, &valore, sizeof(valore));
+            }
+            if (j < programma.variabili || sscanf(p, " %*s") != EOF)
+            {
+                printf("Riga ignorata: servono %d valori.\n", programma.variabili);
+                continue;
+            }
+            if (++n < max_n) continue;   // Il messaggio è pieno: si invia subito
+        }
+        if (lunghezza_testo == 0 || (n == 0 && (programma.variabili > 0 || fine_input))) continue;
+        if (programma.variabili == 0) n = 1;
+
+        // Invio: [L][testo][n][valori], già scritti nel buffer dopo l'intestazione
+        uint32_t lunghezza = 8 + (uint32_t)lunghezza_testo + n * (uint32_t)programma.variabili * 4;
+        valore = htonl((uint32_t)lunghezza_testo);
+        memcpy(richiesta + DIM_INTESTAZIONE, &valore, sizeof(valore));
+        memcpy(richiesta + DIM_INTESTAZIONE + 4, testo, (size_t)lunghezza_testo);
+        valore = htonl(n);
+        memcpy(richiesta + DIM_INTESTAZIONE + 4 + lunghezza_testo, &valore, sizeof(valore));
+        ScriviIntestazione(richiesta, OP_ESPRESSIONE, 0, lunghezza, id);
+        if (send(Csocket, (char *)richiesta, DIM_INTESTAZIONE + lunghezza, 0) != (int)(DIM_INTESTAZIONE + lunghezza))
+        {
+            ErrorHandler("send() fallita invio espressione.\n");
+            return -1;
+        }
+
+        carico = NULL;
+        if ((risposta = (const unsigned char *)LeggiLettore(&lettore, Csocket, DIM_INTESTAZIONE)) == NULL
+            || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione) || intestazione.id != id
+            || intestazione.lunghezza > sizeof(ingresso)
+            || (intestazione.lunghezza > 0 && (carico = LeggiLettore(&lettore, Csocket, intestazione.lunghezza)) == NULL))
+        {
+            ErrorHandler("recv() fallita o risposta non valida (espressioni).\n");
+            return -1;
+        }
+        id++;
+        if (carico == NULL || intestazione.lunghezza != (n + 1) * sizeof(uint32_t)) printf("%s: esito %d\n", testo, intestazione.flag_esito);
+        else
+        {
+            for (i = 0; i < n; i++)
+            {
+                memcpy(&valore, carico + 4 + i * 4, sizeof(valore));
+                printf("%s = %d\n", testo, (int32_t)ntohl(valore));
+            }
+            if (intestazione.flag_esito == ESITO_DIVISIONE_PER_ZERO) printf("(almeno una divisione per zero: risultato 0)\n");
+        }
+        n = 0;
+    }
+    return 0;
+}
+
+/*
+BATCH (opzione -b): una sola richiesta con un'operazione e fino a MAX_BATCH coppie di operandi; il server risponde
+con il numero di risultati seguito da tutti i risultati. Vedi il formato in comune/calcolo_g35.h.
+*/
+int BatchClient(int Csocket)
+{
+    char intestazione[DIM_INTESTAZIONE_BATCH] = {0};
+    char riga[ECHOMAX];
+    char op;
+    long op1, op2;
+    uint32_t n = 0, net_n, i;
+    uint32_t *coppie = malloc(MAX_BATCH * 2 * sizeof(uint32_t));
+    uint32_t *risultati = malloc(MAX_BATCH * sizeof(uint32_t));
+    int esito = -1;
+
+    if (coppie == NULL || risultati == NULL)
+    {
+        ErrorHandler("Memoria insufficiente per il batch.\n");
+        goto fine;
+    }
+
+    printf("Inserisci l'operazione del batch (A=Addizione, S=Sottrazione, M=Moltiplicazione, D=Divisione):\n");
+    if (scanf(" %c", &op) != 1) goto fine;
+    printf("Inserisci le coppie di interi, una per riga; EOF o una riga vuota terminano l'elenco:\n");
+    fgets(riga, sizeof(riga), stdin);   // Resto della riga dell'operazione
+    while (n < MAX_BATCH && fgets(riga, sizeof(riga), stdin) != NULL && riga[0] != '\n' && riga[0] != '\r')
+    {
+        if (sscanf(riga, "%ld %ld", &op1, &op2) != 2)
+        {
+            printf("Riga ignorata: %s", riga);
+            continue;
+        }
+        coppie[2 * n] = htonl((uint32_t)op1);
+        coppie[2 * n + 1] = htonl((uint32_t)op2);
+        n++;
+    }
+
+    // Intestazione (operazione, 3 byte riservati, numero di coppie) e coppie, con una sola chiamata
+    intestazione[0] = op;
+    net_n = htonl(n);
+    memcpy(intestazione + 4, &net_n, sizeof(net_n));
+    if (InviaParti(Csocket, intestazione, sizeof(intestazione), coppie, n * 2 * sizeof(uint32_t))
+        != (int)(sizeof(intestazione) + n * 2 * sizeof(uint32_t)))
+    {
+        ErrorHandler("send() fallita invio batch.\n");
+        goto fine;
+    }
+
+    // Risposta: numero di risultati (0 = richiesta rifiutata) seguito dai risultati
+    if (RecvExact(Csocket, (char *)&net_n, sizeof(net_n)) <= 0)
+    {
+        ErrorHandler("recv() fallita o connessione chiusa prematuramente (risposta batch).\n");
+        goto fine;
+    }
+    if (ntohl(net_n) != n || n == 0)
+    {
+        printf("Il server ha rifiutato il batch.\n");
+        goto fine;
+    }
+    if (RecvExact(Csocket, (char *)risultati, n * sizeof(uint32_t)) <= 0)
+    {
+        ErrorHandler("recv() fallita o connessione chiusa prematuramente (risultati batch).\n");
+        goto fine;
+    }
+    for (i = 0; i < n; i++)
+    {
+        printf("%d %c %d = %d\n", (int32_t)ntohl(coppie[2 * i]), op, (int32_t)ntohl(coppie[2 * i + 1]), (int32_t)ntohl(risultati[i]));
+    }
+    esito = 0;
+
+fine:
+    free(coppie);
+    free(risultati);
+    return esito;
+}
+
+/*
+FLUSSO (opzione -S): modalità non interattiva per grandi volumi. Le operazioni arrivano da un file o dallo standard
+input, in CSV (una riga "op,a,b" per operazione; valgono anche spazi, tabulazioni e ';' come separatori) oppure in
+binario con -B (record di DIM_RICHIESTA_SESSIONE byte: carattere operazione e due interi a 32 bit in network order).
+Ogni operazione diventa un messaggio binario su una delle -c connessioni persistenti, con al più -n richieste in volo
+per connessione. I risultati si scrivono nell'ordine dell'ingresso, uno per operazione: in CSV "risultato,esito"
+(risultato vuoto se la risposta non ne porta uno), in binario un byte di esito e il risultato in network order.
+Le righe non valide producono l'esito ESITO_RICHIESTA_MALFORMATA, le operazioni sconosciute ESITO_OPERAZIONE_NON_VALIDA,
+senza passare dal server.
+
+Ingresso e uscita passano da buffer di DIM_BUFFER_FLUSSO byte (una fread() e una fwrite() ogni tanti record); le
+socket sono non bloccanti e una sola select() attende tutte le connessioni. Le richieste accodate partono con una
+send() per connessione e le risposte si leggono con una recv() di tutto lo spazio libero: il costo per operazione è
+il parsing, non le chiamate di sistema. I risultati stanno in un anello di connessioni * finestra posizioni indicizzato
+con l'identificativo del messaggio: arrivano anche fuori ordine (fra connessioni diverse) e si scrivono appena è
+pronto il primo non ancora scritto.
+*/
+typedef struct
+{
+    int sock;
+    unsigned char *uscita;      // Messaggi accodati: uscita[inviati .. accodati) non ancora inviati
+    int accodati, inviati;
+    char *ingresso;
+    Lettore lettore;
+    int in_volo;
+} ConnessioneFlusso;
+
+typedef struct
+{
+    int32_t risultato;
+    uint8_t esito;
+    uint8_t con_risultato;      // La risposta conteneva un risultato
+    uint8_t pronto;             // Risposta arrivata e non ancora scritta
+} RisultatoFlusso;
+
+typedef struct
+{
+    FILE *file;
+    char *dati;
+    size_t inizio, fine;
+    int finito;                 // fread() ha raggiunto la fine del file
+    int binario;
+} IngressoFlusso;
+
+double OraFlusso()
+{
+#if defined (_WIN32)
+    return GetTickCount64() / 1000.0;
+#else
+    struct timespec ora;
+    clock_gettime(CLOCK_MONOTONIC, &ora);
+    return ora.tv_sec + ora.tv_nsec / 1e9;
+#endif
+}
+
+// 1 se l'ultima operazione della socket non bloccante è fallita solo perché andava ripetuta più tardi
+int DaRipetere()
+{
+#if defined (_WIN32)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+int ImpostaNonBloccante(int sock)
+{
+#if defined (_WIN32)
+    u_long uno = 1;
+    return ioctlsocket(sock, FIONBIO, &uno) == 0 ? 0 : -1;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+#endif
+}
+
+// Sposta all'inizio i byte non consumati e rilegge dal file fino a riempire il buffer
+void RiempiIngresso(IngressoFlusso *ingresso)
+{
+    size_t letti;
+    if (ingresso->inizio > 0)
+    {
+        memmove(ingresso->dati, ingresso->dati + ingresso->inizio, ingresso->fine - ingresso->inizio);
+        ingresso->fine -= ingresso->inizio;
+        ingresso->inizio = 0;
+    }
+    while (!ingresso->finito && ingresso->fine < DIM_BUFFER_FLUSSO)
+    {
+        letti = fread(ingresso->dati + ingresso->fine, 1, DIM_BUFFER_FLUSSO - ingresso->fine, ingresso->file);
+        ingresso->fine += letti;
+        if (letti == 0) ingresso->finito = 1;
+        else break;
+    }
+}
+
+// Intero decimale con segno in [p, fine); avanza *p oltre le cifre. 0 se non ci sono cifre o se il valore non sta in
+// un int32_t: gli operandi non vengono mai troncati in silenzio.
+int LeggiIntero(const char **p, const char *fine, int32_t *valore)
+{
+    const char *q = *p;
+    int negativo = 0, cifre = 0;
+    long long v = 0;
+    if (q < fine && (*q == '-' || *q == '+')) negativo = (*q++ == '-');
+    while (q < fine && *q >= '0' && *q <= '9')
+    {
+        v = v * 10 + (*q++ - '0');
+        if (v > (long long)INT32_MAX + 1) return 0;
+        cifre++;
+    }
+    if (negativo) v = -v;
+    if (cifre == 0 || v > INT32_MAX) return 0;
+    *valore = (int32_t)v;
+    *p = q;
+    return 1;
+}
+
+int Separatore(char c)
+{
+    return c == ',' || c == ';' || c == ' ' || c == '\t';
+}
+
+/*
+Prossima operazione dell'ingresso: 1 se letta, 0 a fine ingresso, -1 per una riga (o un record finale incompleto)
+non valida. Le righe vuote e quelle che iniziano con '#' si saltano.
+*/
+int ProssimaOperazione(IngressoFlusso *ingresso, char *op, uint32_t operandi[2])
+{
+    const char *p, *fine_riga;
+    int32_t valori[2];
+
+    if (ingresso->binario)
+    {
+        if (ingresso->fine - ingresso->inizio < DIM_RICHIESTA_SESSIONE) RiempiIngresso(ingresso);
+        if (ingresso->fine == ingresso->inizio) return 0;
+        if (ingresso->fine - ingresso->inizio < DIM_RICHIESTA_SESSIONE)
+        {
+            ingresso->inizio = ingresso->fine;
+            return -1;
+        }
+        p = ingresso->dati + ingresso->inizio;
+        *op = p[0];
+        memcpy(operandi, p + 1, 2 * sizeof(uint32_t));
+        operandi[0] = ntohl(operandi[0]);
+        operandi[1] = ntohl(operandi[1]);
+        ingresso->inizio += DIM_RICHIESTA_SESSIONE;
+        return 1;
+    }
+
+    for (;;)
+    {
+        fine_riga = memchr(ingresso->dati + ingresso->inizio, '\n', ingresso->fine - ingresso->inizio);
+        if (fine_riga == NULL && !ingresso->finito)
+        {
+            RiempiIngresso(ingresso);
+            fine_riga = memchr(ingresso->dati + ingresso->inizio, '\n', ingresso->fine - ingresso->inizio);
+        }
+        if (fine_riga == NULL)
+        {
+            // Ultima riga senza a capo, oppure una riga più lunga dell'intero buffer
+            if (ingresso->fine == ingresso->inizio) return 0;
+            fine_riga = ingresso->dati + ingresso->fine;
+        }
+        p = ingresso->dati + ingresso->inizio;
+        ingresso->inizio = (size_t)(fine_riga - ingresso->dati) + (fine_riga < ingresso->dati + ingresso->fine);
+
+        while (p < fine_riga && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == fine_riga || *p == '#') continue;
+        *op = *p++;
+        if (p == fine_riga || !Separatore(*p)) return -1;
+        while (p < fine_riga && Separatore(*p)) p++;
+        if (!LeggiIntero(&p, fine_riga, &valori[0])) return -1;
+        if (p == fine_riga || !Separatore(*p)) return -1;
+        while (p < fine_riga && Separatore(*p)) p++;
+        if (!LeggiIntero(&p, fine_riga, &valori[1])) return -1;
+        while (p < fine_riga && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p != fine_riga) return -1;
+        operandi[0] = (uint32_t)valori[0];
+        operandi[1] = (uint32_t)valori[1];
+        return 1;
+    }
+}
+
+// Accoda il risultato all'uscita, svuotando il buffer con una fwrite() quando è pieno
+int ScriviRisultato(FILE *file, char *buffer, size_t *usati, const RisultatoFlusso *r, int binario)
+{
+    if (*usati > DIM_BUFFER_FLUSSO - 32)
+    {
+        if (fwrite(buffer, 1, *usati, file) != *usati) return -1;
+        *usati = 0;
+    }
+    if (binario)
+    {
+        uint32_t net_result = htonl((uint32_t)r->risultato);
+        buffer[(*usati)++] = (char)r->esito;
+        memcpy(buffer + *usati, &net_result, sizeof(net_result));
+        *usati += sizeof(net_result);
+    }
+    else
+    {
+        char cifre[16];
+        int n = 0;
+        uint32_t v = r->risultato < 0 ? 0u - (uint32_t)r->risultato : (uint32_t)r->risultato;
+        if (r->con_risultato)
+        {
+            if (r->risultato < 0) buffer[(*usati)++] = '-';
+            do cifre[n++] = (char)('0' + v % 10); while ((v /= 10) != 0);
+            while (n > 0) buffer[(*usati)++] = cifre[--n];
+        }
+        *usati += sprintf(buffer + *usati, ",%d\n", r->esito);
+    }
+    return 0;
+}
+
+// Connessione, saluto e negoziazione dei messaggi binari, ancora con la socket bloccante
+int ApriConnessioneFlusso(ConnessioneFlusso *c, const struct sockaddr_in *sad)
+{
+    char saluto[ECHOMAX] = {0};
+    unsigned char negoziazione[DIM_INTESTAZIONE];
+    const unsigned char *risposta;
+    Intestazione intestazione;
+    int uno = 1;
+
+    if ((c->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) return -1;
+    if (connect(c->sock, (const struct sockaddr *)sad, sizeof(*sad)) < 0)
+    {
+        ErrorHandler("Connessione fallita.\n");
+        return -1;
+    }
+    if (recv(c->sock, saluto, ECHOMAX - 1, 0) <= 0 || strcmp(saluto, CONNECT_OK_STRING) != 0)
+    {
+        fprintf(stderr, "Il server non ha accettato la connessione (%s).\n", saluto[0] ? saluto : "chiusa");
+        return -1;
+    }
+    ScriviIntestazione(negoziazione, OP_NEGOZIAZIONE, 0, 0, 0);
+    if (send(c->sock, (char *)negoziazione, DIM_INTESTAZIONE, 0) != DIM_INTESTAZIONE
+        || (risposta = (const unsigned char *)LeggiLettore(&c->lettore, c->sock, DIM_INTESTAZIONE)) == NULL
+        || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione)
+        || intestazione.flag_esito != ESITO_OK || intestazione.lunghezza != 0)
+    {
+        ErrorHandler("Il server non supporta i messaggi binari.\n");
+        return -1;
+    }
+    setsockopt(c->sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&uno, sizeof(uno));
+    return ImpostaNonBloccante(c->sock);
+}
+
+int FlussoClient(int argc, char *argv[])
+{
+    const char *nome_server = "localhost", *percorso_ingresso = NULL, *percorso_uscita = NULL;
+    int porta = PROTOPORT, num_connessioni = 1, finestra = 1024, binario = 0, uso = 0, i, esito = -1;
+    IngressoFlusso ingresso;
+    FILE *uscita = stdout;
+    char *buffer_uscita = NULL;
+    size_t usati_uscita = 0;
+    ConnessioneFlusso connessioni[MAX_CONNESSIONI_FLUSSO];
+    RisultatoFlusso *risultati = NULL;
+    uint64_t letti = 0, scritti = 0, capacita;
+    unsigned long non_valide = 0, rifiutate = 0, divisioni_per_zero = 0;
+    int prossima = 0, fine_ingresso = 0;
+    struct hostent *host;
+    struct sockaddr_in sad;
+    double inizio;
+
+    for (i = 0; i < argc; i++)
+    {
+        int ha_valore = (i + 1 < argc);
+        if (strcmp(argv[i], "-h") == 0 && ha_valore) nome_server = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0 && ha_valore) porta = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && ha_valore) num_connessioni = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && ha_valore) finestra = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && ha_valore) percorso_uscita = argv[++i];
+        else if (strcmp(argv[i], "-B") == 0) binario = 1;
+        else if ((argv[i][0] != '-' || strcmp(argv[i], "-") == 0) && percorso_ingresso == NULL) percorso_ingresso = argv[i];
+        else uso = 1;
+    }
+    if (uso || num_connessioni < 1 || num_connessioni > MAX_CONNESSIONI_FLUSSO || finestra < 1 || finestra > MAX_FINESTRA_FLUSSO
+        || porta <= 0 || porta > 65535)
+    {
+        printf("Uso: client -S [-h server] [-P porta] [-c connessioni] [-n finestra] [-B] [-o uscita] [ingresso]\n");
+        printf("  ingresso  file delle operazioni (default: standard input), in CSV \"op,a,b\" o binario con -B\n");
+        printf("  -c N      connessioni persistenti (default 1, massimo %d)\n", MAX_CONNESSIONI_FLUSSO);
+        printf("  -n N      richieste in volo per connessione (default 1024, massimo %d)\n", MAX_FINESTRA_FLUSSO);
+        printf("  -B        ingresso e uscita binari (record di %d e di %d byte)\n", DIM_RICHIESTA_SESSIONE, DIM_RISULTATO_BINARIO);
+        printf("  -o FILE   risultati in FILE invece che sullo standard output\n");
+        return -1;
+    }
+
+    memset(&ingresso, 0, sizeof(ingresso));
+    memset(connessioni, 0, sizeof(connessioni));
+    for (i = 0; i < num_connessioni; i++) connessioni[i].sock = -1;
+    ingresso.binario = binario;
+    ingresso.file = stdin;
+    if (percorso_ingresso != NULL && strcmp(percorso_ingresso, "-") != 0
+        && (ingresso.file = fopen(percorso_ingresso, binario ? "rb" : "r")) == NULL)
+    {
+        fprintf(stderr, "Impossibile aprire %s.\n", percorso_ingresso);
+        return -1;
+    }
+    if (percorso_uscita != NULL && (uscita = fopen(percorso_uscita, binario ? "wb" : "w")) == NULL)
+    {
+        fprintf(stderr, "Impossibile creare %s.\n", percorso_uscita);
+        goto fine;
+    }
+#if defined (_WIN32)
+    if (binario)
+    {
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    capacita = (uint64_t)num_connessioni * finestra;
+    ingresso.dati = malloc(DIM_BUFFER_FLUSSO);
+    buffer_uscita = malloc(DIM_BUFFER_FLUSSO);
+    risultati = calloc(capacita, sizeof(RisultatoFlusso));
+    if (ingresso.dati == NULL || buffer_uscita == NULL || risultati == NULL)
+    {
+        ErrorHandler("Memoria insufficiente per il flusso.\n");
+        goto fine;
+    }
+
+    if ((host = gethostbyname(nome_server)) == NULL)
+    {
+        fprintf(stderr, "Risoluzione del nome fallita per %s.\n", nome_server);
+        goto fine;
+    }
+    memset(&sad, 0, sizeof(sad));
+    sad.sin_family = AF_INET;
+    sad.sin_port = htons((uint16_t)porta);
+    sad.sin_addr = *(struct in_addr *)host->h_addr_list[0];
+    for (i = 0; i < num_connessioni; i++)
+    {
+        ConnessioneFlusso *c = &connessioni[i];
+        c->uscita = malloc((size_t)finestra * DIM_RICHIESTA_BINARIA);
+        c->ingresso = malloc(DIM_RICEZIONE_FLUSSO);
+        if (c->uscita == NULL || c->ingresso == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per il flusso.\n");
+            goto fine;
+        }
+        InizializzaLettore(&c->lettore, c->ingresso, DIM_RICEZIONE_FLUSSO);
+        if (ApriConnessioneFlusso(c, &sad) < 0) goto fine;
+    }
+
+    inizio = OraFlusso();
+    while (!fine_ingresso || scritti < letti)
+    {
+        fd_set lettura, scrittura;
+        int max_sock = -1, attese = 0;
+
+        // 1. Risultati pronti, nell'ordine dell'ingresso: liberano le loro posizioni dell'anello per le nuove richieste
+        while (scritti < letti && risultati[scritti % capacita].pronto)
+        {
+            RisultatoFlusso *r = &risultati[scritti % capacita];
+            if (ScriviRisultato(uscita, buffer_uscita, &usati_uscita, r, binario) < 0)
+            {
+                ErrorHandler("Scrittura dei risultati fallita.\n");
+                goto fine;
+            }
+            r->pronto = 0;
+            scritti++;
+        }
+
+        // 2. Nuove richieste finché c'è posto nell'anello dei risultati e nella finestra di qualche connessione
+        while (!fine_ingresso && letti - scritti < capacita)
+        {
+            ConnessioneFlusso *c = NULL;
+            RisultatoFlusso *r = &risultati[letti % capacita];
+            uint32_t operandi[2];
+            char op;
+            int letta, j;
+
+            for (j = 0; j < num_connessioni && c == NULL; j++)
+            {
+                if (connessioni[(prossima + j) % num_connessioni].in_volo < finestra)
+                {
+                    c = &connessioni[(prossima + j) % num_connessioni];
+                    prossima = (prossima + j + 1) % num_connessioni;
+                }
+            }
+            if (c == NULL) break;
+            if ((letta = ProssimaOperazione(&ingresso, &op, operandi)) == 0)
+            {
+                fine_ingresso = 1;
+                break;
+            }
+            if (letta < 0 || strchr("AaSsMmDd", op) == NULL || op == '\0')
+            {
+                // Risposta locale: occupa comunque la sua posizione nell'ordine dell'uscita
+                r->esito = letta < 0 ? ESITO_RICHIESTA_MALFORMATA : ESITO_OPERAZIONE_NON_VALIDA;
+                r->risultato = 0;
+                r->con_risultato = 0;
+                r->pronto = 1;
+                non_valide++;
+                letti++;
+                continue;
+            }
+            if (c->inviati == c->accodati) c->inviati = c->accodati = 0;
+            else if (c->accodati + (int)DIM_RICHIESTA_BINARIA > finestra * (int)DIM_RICHIESTA_BINARIA)
+            {
+                memmove(c->uscita, c->uscita + c->inviati, c->accodati - c->inviati);
+                c->accodati -= c->inviati;
+                c->inviati = 0;
+            }
+            operandi[0] = htonl(operandi[0]);
+            operandi[1] = htonl(operandi[1]);
+            ScriviIntestazione(c->uscita + c->accodati, (uint8_t)op, 0, sizeof(operandi), (uint32_t)letti);
+            memcpy(c->uscita + c->accodati + DIM_INTESTAZIONE, operandi, sizeof(operandi));
+            c->accodati += DIM_RICHIESTA_BINARIA;
+            c->in_volo++;
+            letti++;
+        }
+
+        // 3. Invii e ricezioni su tutte le connessioni con una sola select()
+        FD_ZERO(&lettura);
+        FD_ZERO(&scrittura);
+        for (i = 0; i < num_connessioni; i++)
+        {
+            ConnessioneFlusso *c = &connessioni[i];
+            if (c->in_volo > 0) FD_SET(c->sock, &lettura);
+            if (c->inviati < c->accodati) FD_SET(c->sock, &scrittura);
+            if (c->in_volo > 0 || c->inviati < c->accodati)
+            {
+                attese++;
+                if (c->sock > max_sock) max_sock = c->sock;
+            }
+        }
+        if (attese == 0) continue;   // Solo risposte locali: nessuna attesa sulla rete
+        if (select(max_sock + 1, &lettura, &scrittura, NULL, NULL) < 0)
+        {
+            if (DaRipetere()) continue;
+            ErrorHandler("select() fallita.\n");
+            goto fine;
+        }
+        for (i = 0; i < num_connessioni; i++)
+        {
+            ConnessioneFlusso *c = &connessioni[i];
+            int n, lunghezza;
+
+            if (FD_ISSET(c->sock, &scrittura))
+            {
+                n = send(c->sock, (char *)c->uscita + c->inviati, c->accodati - c->inviati, FLAG_INVIO_FLUSSO);
+                if (n > 0) c->inviati += n;
+                else if (n < 0 && !DaRipetere())
+                {
+                    ErrorHandler("send() fallita (flusso).\n");
+                    goto fine;
+                }
+            }
+            if (!FD_ISSET(c->sock, &lettura)) continue;
+            n = RiempiLettore(&c->lettore, c->sock);
+            if (n == 0 || (n < 0 && !DaRipetere()))
+            {
+                fprintf(stderr, "Connessione chiusa dal server con %d richieste in volo.\n", c->in_volo);
+                goto fine;
+            }
+            // Risposte complete: intestazione ed eventuale risultato, letti sul posto dal buffer di ricezione
+            while ((lunghezza = LunghezzaMessaggio((const unsigned char *)DatiLettore(&c->lettore), DisponibiliLettore(&c->lettore),
+                                                   DIM_RICHIESTA_BINARIA)) != 0)
+            {
+                const unsigned char *risposta = (const unsigned char *)DatiLettore(&c->lettore);
+                Intestazione intestazione;
+                uint64_t indice;
+                RisultatoFlusso *r;
+
+                if (lunghezza < 0 || !LeggiIntestazione(risposta, lunghezza, &intestazione)
+                    || (indice = scritti + (uint32_t)(intestazione.id - (uint32_t)scritti)) >= letti
+                    || (r = &risultati[indice % capacita])->pronto || intestazione.lunghezza > sizeof(uint32_t))
+                {
+                    ErrorHandler("Risposta non valida dal server (flusso).\n");
+                    goto fine;
+                }
+                r->esito = intestazione.flag_esito;
+                r->con_risultato = (intestazione.lunghezza == sizeof(uint32_t));
+                r->risultato = 0;
+                if (r->con_risultato)
+                {
+                    uint32_t net_result;
+                    memcpy(&net_result, risposta + DIM_INTESTAZIONE, sizeof(net_result));
+                    r->risultato = (int32_t)ntohl(net_result);
+                }
+                if (r->esito == ESITO_SOVRACCARICO || r->esito == ESITO_LIMITE_SUPERATO) rifiutate++;
+                else if (r->esito == ESITO_DIVISIONE_PER_ZERO) divisioni_per_zero++;
+                r->pronto = 1;
+                c->in_volo--;
+                ConsumaLettore(&c->lettore, lunghezza);
+            }
+        }
+    }
+
+    if (usati_uscita > 0 && fwrite(buffer_uscita, 1, usati_uscita, uscita) != usati_uscita)
+    {
+        ErrorHandler("Scrittura dei risultati fallita.\n");
+        goto fine;
+    }
+    usati_uscita = 0;
+    if (fflush(uscita) != 0)
+    {
+        ErrorHandler("Scrittura dei risultati fallita.\n");
+        goto fine;
+    }
+    {
+        double durata = OraFlusso() - inizio;
+        fprintf(stderr, "%llu operazioni in %.3f s (%.0f al secondo) su %d connessioni con finestra %d.\n",
+                (unsigned long long)scritti, durata, durata > 0 ? scritti / durata : 0.0, num_connessioni, finestra);
+        fprintf(stderr, "Righe non valide: %lu, rifiutate dal server: %lu, divisioni per zero: %lu.\n",
+                non_valide, rifiutate, divisioni_per_zero);
+    }
+    esito = 0;
+
+fine:
+    // In caso di errore si scrivono comunque i risultati già pronti
+    if (usati_uscita > 0 && buffer_uscita != NULL) fwrite(buffer_uscita, 1, usati_uscita, uscita);
+    if (uscita != stdout && uscita != NULL) fclose(uscita);
+    else fflush(stdout);
+    if (ingresso.file != stdin && ingresso.file != NULL) fclose(ingresso.file);
+    for (i = 0; i < num_connessioni; i++)
+    {
+        if (connessioni[i].sock >= 0) closesocket(connessioni[i].sock);
+        free(connessioni[i].uscita);
+        free(connessioni[i].ingresso);
+    }
+    free(ingresso.dati);
+    free(buffer_uscita);
+    free(risultati);
+    return esito;
+}
+
+int main(int argc, char *argv[]) 
 {
     // 1. Inizializzazione Winsock (solo per Windows)
     #if defined (_WIN32)
@@ -60,6 +1167,36 @@ int main(void)
         }
     #endif
 
+    // -S: flusso non interattivo, con le proprie opzioni; il nome del server non si chiede perché lo standard input
+    // può essere l'ingresso delle operazioni
+    if (argc > 1 && strcmp(argv[1], "-S") == 0)
+    {
+        int esito = FlussoClient(argc - 2, argv + 2);
+        ClearWinSock();
+        return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Opzioni: -s sessione persistente con più operazioni sulla stessa connessione, -b batch di coppie, -f messaggi binari,
+    // -g numeri grandi, -x espressioni
+    char modalita = 0;   // OP_SESSIONE, OP_BATCH, MODALITA_BINARIA, MODALITA_GRANDI, MODALITA_ESPRESSIONI oppure 0
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) modalita = OP_SESSIONE;
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) modalita = OP_BATCH;
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) modalita = MODALITA_BINARIA;
+    if (argc > 1 && strcmp(argv[1], "-g") == 0) modalita = MODALITA_GRANDI;
+    if (argc > 1 && strcmp(argv[1], "-x") == 0) modalita = MODALITA_ESPRESSIONI;
+    if (argc > 2 || (argc > 1 && modalita == 0))
+    {
+        printf("Uso: %s [-s | -b | -f | -g | -x | -S ...]\n", argv[0]);
+        printf("  -s  sessione persistente: più operazioni in pipeline sulla stessa connessione\n");
+        printf("  -b  batch: una sola operazione applicata a molte coppie di operandi\n");
+        printf("  -f  messaggi binari con esito numerico, con ripiego sul protocollo originale\n");
+        printf("  -g  numeri grandi: interi di lunghezza arbitraria nei messaggi binari\n");
+        printf("  -x  espressioni con variabili, compilate e conservate in cache dal server\n");
+        printf("  -S  flusso: operazioni da un file o dallo standard input, risultati in ordine (%s -S -? per le opzioni)\n", argv[0]);
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
+
     int Csocket;                     // Definire una variabile (int) che conterrà il descrittore della socket:
     struct sockaddr_in sad;          //Creare un elemento di tipo sockaddr_in
     char serverName[ECHOMAX];        // Nome del server
@@ -125,6 +1262,51 @@ int main(void)
         return EXIT_FAILURE;                                                        // Restituisce EXIT_FAILURE in caso di errore
     }
     printf("Server dice: %s\n", response_string);
+    if (strcmp(response_string, OVERLOAD_STRING) == 0 || strcmp(response_string, LIMIT_STRING) == 0)
+    {
+        printf(strcmp(response_string, LIMIT_STRING) == 0 ? "Troppe richieste da questo indirizzo: riprovare più tardi.\n"
+                                                          : "Il server è sovraccarico: riprovare più tardi.\n");
+        closesocket(Csocket);
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
+
+    if (modalita == MODALITA_BINARIA || modalita == MODALITA_GRANDI || modalita == MODALITA_ESPRESSIONI)
+    {
+        int esito;
+        if (modalita == MODALITA_BINARIA) esito = MessaggiClient(Csocket, &sad);
+        else esito = (modalita == MODALITA_GRANDI) ? GrandiClient(Csocket) : EspressioniClient(Csocket);
+        closesocket(Csocket);
+        ClearWinSock();
+        return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (modalita != 0)
+    {
+        // Apertura della sessione o del batch: un server che non li supporta risponde con EXIT_STRING
+        const char *attesa = (modalita == OP_SESSIONE) ? SESSION_STRING : BATCH_STRING;
+        operation_char = modalita;
+        memset(response_string, 0, ECHOMAX);
+        if (send(Csocket, &operation_char, 1, 0) != 1 || recv(Csocket, response_string, ECHOMAX - 1, 0) <= 0)
+        {
+            ErrorHandler("send() o recv() fallita (apertura sessione/batch).\n");
+            closesocket(Csocket);
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        if (strcmp(response_string, attesa) != 0)
+        {
+            printf("Il server non supporta la modalità richiesta (risposta: %s).\n", response_string);
+            closesocket(Csocket);
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+
+        int esito = (modalita == OP_SESSIONE) ? SessioneClient(Csocket) : BatchClient(Csocket);
+        closesocket(Csocket);
+        ClearWinSock();
+        return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     // 6. CLIENT: legge una lettera e la invia al server
     printf("Inserisci l'operazione (A=Addizione, S=Sottrazione, M=Moltiplicazione, D=Divisione):\n");
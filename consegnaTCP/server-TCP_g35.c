@@ -1,58 +1,2308 @@
 // Inclusioni specifiche per Sockets (come da slide)
+#if defined (__linux__)
+#define _GNU_SOURCE         // Necessario per accept4() e pthread_setaffinity_np()
+#endif
 #if defined (_WIN32)
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment (lib, "ws2_32.lib")
 
-#else
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#define closesocket close   // Mappa closesocket su close per sistemi Unix
-#endif
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>        // struct iovec per sendmsg()
+#include <sys/un.h>         // Socket locale AF_UNIX (-U, -M)
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define closesocket close   // Mappa closesocket su close per sistemi Unix
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "../comune/calcolo_g35.h"   // Calcolo delle operazioni (singole e batch SIMD), condiviso con il server UDP
+#include "../comune/protocollo_g35.h" // Messaggi binari con intestazione fissa, condivisi con il protocollo UDP senza stato
+#include "../comune/metriche_g35.h"  // Durata delle fasi e contatori, esportati su socket di amministrazione e SIGUSR1
+#include "../comune/registro_g35.h"  // Messaggi scritti da un thread in background invece che con printf()
+#include "../comune/lettore_g35.h"   // Buffer di ricezione per connessione: una recv() per tutto ciò che è arrivato
+#include "../comune/ammissione_g35.h" // Scarto del lavoro in base al ritardo di coda (CoDel)
+#include "../comune/pool_g35.h"    // Slab delle connessioni e buffer riusati: a regime nessuna malloc() per richiesta
+#include "../comune/cattura_g35.h"  // Cattura delle richieste in un file mappato in memoria, per riprodurle (-R)
+
+#if defined (__linux__)
+#include <sys/epoll.h>      // Ciclo ad eventi (solo Linux)
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>        // Worker multi-core
+#include <sched.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "../comune/anello_condiviso_g35.h"   // Anelli in memoria condivisa con i client locali (-M)
+#include "../comune/ruota_temporizzatori_g35.h" // Scadenze delle connessioni nelle modalità ad eventi
+#include "../comune/limitatore_g35.h"   // Limite di richieste e byte al secondo per indirizzo del client (-L)
+#include "../comune/pipeline_g35.h"     // Thread di calcolo per i messaggi pesanti (-C)
+#endif
+
+// io_uring (solo Linux): servono gli header del kernel con multishot e anelli di buffer (Linux >= 6.0); non serve liburing
+#if defined (__linux__) && defined (__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined (IORING_SETUP_SINGLE_ISSUER) && defined (IORING_RECV_MULTISHOT)
+#define SERVER_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+// Costanti
+
+#define PROTOPORT 48000  // Porta di default per l'applicazione
+#define QLEN 5           // Dimensione della coda di richieste (ad es. 5), massimo numero di connessioni accettate
+#define BUFFER_SIZE 512   // Dimensione del buffer
+#define EXIT_STRING "TERMINE PROCESSO CLIENT"   // Stringa di terminazione
+#define CONNECT_OK_STRING "connessione avvenuta"   // Stringa di conferma connessione
+#define OVERLOAD_STRING "SERVER SOVRACCARICO"      // Inviata al posto del saluto a una connessione rifiutata
+#define LIMIT_STRING "LIMITE SUPERATO"             // Inviata al posto del saluto se l'indirizzo del client ha superato il limite (-L)
+#define MAX_EVENTI 256    // Numero massimo di eventi restituiti da una singola epoll_wait()
+#define MAX_WORKER 256    // Numero massimo di worker (thread con socket di ascolto propria)
+#define INTERVALLO_STATISTICHE 10   // Secondi fra due stampe dei contatori dei worker
+#define OP_SESSIONE 'P'               // Carattere operazione che apre una sessione persistente
+#define SESSION_STRING "SESSIONE"     // Risposta del server all'apertura di una sessione
+#define DIM_RICHIESTA_SESSIONE 9      // Richiesta in sessione: carattere operazione + 2 * sizeof(uint32_t)
+#define DIM_BUFFER_SESSIONE 4096      // Buffer di ricezione/invio di una sessione
+#define MAX_BATCH_TCP 65536           // Numero massimo di coppie in una richiesta batch
+#define MAX_COPPIE_MESSAGGIO ((DIM_BUFFER_SESSIONE - DIM_INTESTAZIONE - 4) / 8)   // Coppie massime in un batch a messaggi binari
+#define VOCI_URING 256                // io_uring: voci della submission queue
+#define VOCI_CQ_URING 4096            // io_uring: voci della completion queue
+#define NUM_BUFFER_URING 512          // io_uring: buffer di ricezione registrati (potenza di 2)
+#define DIM_BUFFER_URING 4096         // io_uring: dimensione di ogni buffer di ricezione
+#define GRUPPO_BUFFER_URING 0         // io_uring: identificativo del gruppo di buffer
+#define URING_NON_DISPONIBILE 2       // Esito di ServerUring() se il kernel non supporta io_uring
+#define PORTA_METRICHE 48001          // Porta di default dell'endpoint delle metriche (-a)
+#define MAX_ANELLI 64                 // Anelli in memoria condivisa serviti contemporaneamente (-M), un thread ciascuno
+#define SCADENZA_ATTESA_S 300         // Default di -t: secondi di inattività fra due richieste di una sessione
+#define SCADENZA_INTESTAZIONE_S 60    // Default di -t: secondi per ricevere l'operazione o l'intestazione di un messaggio
+#define SCADENZA_RICHIESTA_S 60       // Default di -t: secondi per ricevere il resto della richiesta e inviare la risposta
+#define DURATA_TICK_MS 10             // Risoluzione delle scadenze nelle modalità ad eventi
+
+// Fasi di una richiesta misurate dalle metriche. Le fasi di ricezione comprendono l'attesa dei dati del client;
+// l'accettazione va dal ritorno di accept() alla connessione pronta (registrazione e stampa), esclusa l'attesa.
+typedef enum
+{
+    FASE_ACCETTAZIONE,
+    FASE_INVIO_SALUTO,
+    FASE_RICEZIONE_OPERAZIONE,
+    FASE_INVIO_OPERAZIONE,        // Stringa di risposta all'operazione (o SESSIONE, BATCH, EXIT_STRING)
+    FASE_RICEZIONE_OPERANDI,      // Anche le richieste di una sessione, i messaggi binari e l'intestazione e le coppie di un batch
+    FASE_CALCOLO,
+    FASE_INVIO_RISULTATO,
+    NUM_FASI
+} FaseRichiesta;
+
+static const char *const nomi_fasi[NUM_FASI] =
+{
+    "accettazione", "invio_saluto", "ricezione_operazione", "invio_operazione", "ricezione_operandi", "calcolo", "invio_risultato"
+};
+
+// Controllo di ammissione, impostato dalla riga di comando (-q, -l, -d)
+static int coda_ascolto = QLEN;         // Backlog delle socket di ascolto
+static long limite_connessioni = 0;     // Connessioni aperte al massimo nelle modalità ad eventi (0 = nessun limite)
+static uint64_t obiettivo_codel = 0;    // Ritardo di coda accettabile in ns prima di scartare lavoro (0 = CoDel disattivato)
+#if defined (__linux__)
+static Limitatore *limitatore = NULL;   // Richieste e byte al secondo per indirizzo, impostati con -L (NULL = nessun limite)
+static PipelineCalcolo *pipeline = NULL; // Thread di calcolo per i messaggi pesanti, avviati con -C (NULL = calcolo sul posto)
+#endif
+
+// Scadenze delle connessioni in ns per fase (SCADENZA_*, metriche_g35.h), impostate con -t; 0 = nessuna scadenza
+static uint64_t scadenze[NUM_SCADENZE] = { SCADENZA_ATTESA_S * 1000000000ull, SCADENZA_INTESTAZIONE_S * 1000000000ull,
+                                           SCADENZA_RICHIESTA_S * 1000000000ull };
+static const char *const nomi_scadenze[NUM_SCADENZE] = { "inattività", "intestazione", "richiesta" };
+
+void ErrorHandler(char *errorMessage) 
+{// Funzione di gestione errori
+    REGISTRA(LIVELLO_ERRORE, "%s", errorMessage);
+}
+
+void ClearWinSock() 
+{// Funzione di pulizia Winsock
+#if defined (_WIN32)
+    WSACleanup();
+#endif
+}
+
+// Conta una chiamata di sistema del percorso delle richieste: ricezione, invio e attesa degli eventi
+#define CONTA_CHIAMATA(metriche) AggiornaMetrica(&(metriche)->chiamate_sistema, 1)
+
+// Registra l'arrivo di un client: indirizzo IPv4, oppure client locale se è arrivato dalla socket AF_UNIX (-U)
+void RegistraClient(const struct sockaddr_in *cad)
+{
+    if (cad->sin_family == AF_INET)
+        REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "\nGestione client %u.%u.%u.%u\n", INDIRIZZO_IPV4(cad->sin_addr));
+    else
+        REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "\nGestione client locale\n");
+}
+
+// Indirizzo IPv4 del client per il limite di -L; 0 per un client locale (AF_UNIX), che non ha limite
+uint32_t IndirizzoClient(const struct sockaddr_in *cad)
+{
+    return cad->sin_family == AF_INET ? cad->sin_addr.s_addr : 0;
+}
+
+// Porta del client per la cattura di -R; per un client locale il descrittore della connessione, che distingue fra loro
+// i client locali contemporanei
+uint16_t PortaClient(const struct sockaddr_in *cad, int sock)
+{
+    return cad->sin_family == AF_INET ? cad->sin_port : htons((uint16_t)sock);
+}
+
+// Origine delle prossime richieste catturate dal thread (-R): il client di 'indirizzo' (0 = locale) e 'porta'
+void OrigineClient(uint32_t indirizzo, uint16_t porta)
+{
+    OrigineCattura(indirizzo != 0 ? TRASPORTO_TCP : TRASPORTO_LOCALE, indirizzo, porta);
+}
+
+// 1 se il client ha superato il limite di -L con una richiesta di 'byte' byte, che altrimenti gli viene addebitata.
+// Solo Linux: altrove -L non è disponibile e il limite non scatta mai.
+int LimiteSuperato(uint32_t indirizzo, uint64_t byte)
+{
+#if defined (__linux__)
+    return limitatore != NULL && !AmmessoDalLimitatore(limitatore, indirizzo, byte, OraMetriche());
+#else
+    (void)indirizzo; (void)byte;
+    return 0;
+#endif
+}
+
+#if !defined (_WIN32)
+// Crea una socket di ascolto AF_UNIX su 'percorso' (-U e -M). Un file rimasto da un'esecuzione precedente viene
+// rimosso solo se è una socket. Sulla connessione accettata il server usa le stesse recv()/send() della socket TCP.
+int CreaSocketLocale(const char *percorso)
+{
+    struct sockaddr_un sad;
+    struct stat stato;
+    int sock;
+
+    memset(&sad, 0, sizeof(sad));
+    sad.sun_family = AF_UNIX;
+    if (strlen(percorso) >= sizeof(sad.sun_path))
+    {
+        ErrorHandler("Percorso della socket locale troppo lungo.\n");
+        return -1;
+    }
+    strcpy(sad.sun_path, percorso);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        ErrorHandler("Creazione della socket locale fallita.\n");
+        return -1;
+    }
+    if (lstat(percorso, &stato) == 0 && S_ISSOCK(stato.st_mode)) unlink(percorso);
+    if (bind(sock, (struct sockaddr *)&sad, sizeof(sad)) < 0)
+    {
+        ErrorHandler("bind() fallito sulla socket locale.\n");
+        closesocket(sock);
+        return -1;
+    }
+    if (listen(sock, coda_ascolto) < 0)
+    {
+        ErrorHandler("listen() fallito sulla socket locale.\n");
+        closesocket(sock);
+        return -1;
+    }
+    return sock;
+}
+#endif
+
+// Nel ciclo iterativo ogni connessione riceve attraverso un Lettore (comune/lettore_g35.h): i campi arrivati con una
+// sola recv() si leggono sul posto. Alla chiusura le recv() fatte e le letture corte passano alle metriche.
+void ChiudiLettore(int clientSocket, Metriche *metriche, Lettore *lettore)
+{
+    AggiornaMetrica(&metriche->chiamate_sistema, lettore->chiamate);
+    AggiornaMetrica(&metriche->letture_corte, lettore->parziali);
+    closesocket(clientSocket);
+}
+
+// Nel ciclo iterativo le scadenze (-t) sono limiti del kernel su ogni recv()/send() bloccante della fase: il client è
+// uno solo alla volta, quindi non serve la ruota delle modalità ad eventi. Il limite riparte a ogni recv() riuscita.
+void ImpostaScadenzaSocket(int clientSocket, Metriche *metriche, int opzione, int fase)
+{
+    if (scadenze[fase] == 0) return;
+    CONTA_CHIAMATA(metriche);
+#if defined (_WIN32)
+    DWORD millisecondi = (DWORD)(scadenze[fase] / 1000000);
+    setsockopt(clientSocket, SOL_SOCKET, opzione, (const char *)&millisecondi, sizeof(millisecondi));
+#else
+    struct timeval limite = { (time_t)(scadenze[fase] / 1000000000ull), (suseconds_t)(scadenze[fase] % 1000000000ull / 1000) };
+    setsockopt(clientSocket, SOL_SOCKET, opzione, &limite, sizeof(limite));
+#endif
+}
+
+// Dopo una ricezione fallita nel ciclo iterativo: conta la scadenza se la recv() è terminata per il limite di tempo
+void ContaScadenzaSocket(Metriche *metriche, int fase)
+{
+#if defined (_WIN32)
+    if (WSAGetLastError() == WSAETIMEDOUT) AggiornaMetrica(&metriche->scadenze[fase], 1);
+#else
+    if (errno == EAGAIN || errno == EWOULDBLOCK) AggiornaMetrica(&metriche->scadenze[fase], 1);
+#endif
+}
+
+// Invia due aree di memoria con una sola chiamata (scatter-gather), senza copiarle in un buffer unico.
+// Restituisce i byte inviati oppure -1.
+int InviaParti(int sock, const void *prima, int len_prima, const void *seconda, int len_seconda)
+{
+#if defined (_WIN32)
+    WSABUF parti[2] = { { (ULONG)len_prima, (CHAR *)prima }, { (ULONG)len_seconda, (CHAR *)seconda } };
+    DWORD inviati;
+    if (WSASend(sock, parti, 2, &inviati, 0, NULL, NULL) != 0) return -1;
+    return (int)inviati;
+#else
+    struct iovec parti[2] = { { (void *)prima, (size_t)len_prima }, { (void *)seconda, (size_t)len_seconda } };
+    struct msghdr messaggio;
+    memset(&messaggio, 0, sizeof(messaggio));
+    messaggio.msg_iov = parti;
+    messaggio.msg_iovlen = 2;
+    return (int)sendmsg(sock, &messaggio, 0);
+#endif
+}
+
+// Restituisce la stringa di risposta associata al carattere operazione,
+// oppure NULL se il carattere non corrisponde ad alcuna operazione
+const char *RispostaOperazione(char operation_char)
+{
+    switch (operation_char)
+    {
+        case 'A': case 'a': return "ADDIZIONE";
+        case 'S': case 's': return "SOTTRAZIONE";
+        case 'M': case 'm': return "MOLTIPLICAZIONE";
+        case 'D': case 'd': return "DIVISIONE";
+        default:            return NULL;
+    }
+}
+
+// Esegue l'operazione richiesta su operandi già convertiti in host order (semantica in calcolo_g35.h)
+int32_t CalcolaRisultato(Metriche *metriche, char operation_char, int32_t op1, int32_t op2)
+{
+    if ((operation_char == 'D' || operation_char == 'd') && op2 == 0)
+    {
+        AggiornaMetrica(&metriche->divisioni_per_zero, 1);
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Errore: divisione per zero.\n");   // Il risultato è 0
+    }
+    return CalcolaScalare(operation_char, op1, op2);
+}
+
+/*
+SESSIONE PERSISTENTE: se il client invia OP_SESSIONE al posto dell'operazione, il server risponde SESSION_STRING e la
+connessione resta aperta. Da quel momento il client può inviare richieste una dietro l'altra senza attendere i risultati,
+ognuna di DIM_RICHIESTA_SESSIONE byte (carattere operazione, op1, op2 in network order); il server risponde con un
+risultato di sizeof(uint32_t) byte per richiesta, nello stesso ordine. La sessione termina quando il client chiude la
+connessione oppure, dopo le risposte alle richieste precedenti, quando arriva un'operazione non riconosciuta.
+*/
+
+// Elabora tutte le richieste complete presenti in 'in' e accoda i risultati in 'out' a partire da *out_len.
+// Si ferma quando 'out' è pieno o dopo un'operazione non valida (in tal caso *fine = 1). Anche una richiesta oltre il
+// limite di -L per 'indirizzo' chiude la sessione: il formato non ha un esito con cui rifiutarla.
+// Restituisce il numero di byte di 'in' consumati.
+int ElaboraSessione(Metriche *metriche, const char *in, int in_len, char *out, int *out_len, int out_cap, int *fine, uint32_t indirizzo)
+{
+    int consumati = 0;
+    uint32_t operands[2];
+
+    while (in_len - consumati >= DIM_RICHIESTA_SESSIONE && *out_len + (int)sizeof(uint32_t) <= out_cap)
+    {
+        char operation_char = in[consumati];
+        ContaOperazione(metriche, operation_char);
+        if (RispostaOperazione(operation_char) == NULL)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Operazione non valida nella sessione: '%c', chiusura della sessione.\n", operation_char);
+            *fine = 1;
+            break;
+        }
+        CatturaOperazione(FORMATO_SESSIONE, operation_char, in + consumati + 1);
+        if (LimiteSuperato(indirizzo, DIM_RICHIESTA_SESSIONE))
+        {
+            AggiornaMetrica(&metriche->scarti[SCARTO_LIMITE_INDIRIZZO], 1);
+            REGISTRA_CAMPIONE(LIVELLO_AVVISO, "Limite di frequenza superato nella sessione: chiusura della sessione.\n");
+            *fine = 1;
+            break;
+        }
+
+        memcpy(operands, in + consumati + 1, sizeof(operands));   // Le richieste non sono allineate nel buffer
+        int32_t op1 = (int32_t)ntohl(operands[0]);
+        int32_t op2 = (int32_t)ntohl(operands[1]);
+        int32_t result = CalcolaRisultato(metriche, operation_char, op1, op2);
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Calcolo: %d %c %d = %d\n", op1, operation_char, op2, result);
+
+        uint32_t net_result = htonl((uint32_t)result);
+        memcpy(out + *out_len, &net_result, sizeof(uint32_t));
+        *out_len += sizeof(uint32_t);
+        consumati += DIM_RICHIESTA_SESSIONE;
+    }
+    return consumati;
+}
+
+/*
+MESSAGGI BINARI: se al posto del carattere operazione arriva MAGIC_PROTOCOLLO, il client parla il protocollo a messaggi di
+protocollo_g35.h (lo stesso del server UDP senza stato) e quel byte è l'inizio del primo messaggio. Il server non invia
+stringhe: ogni messaggio riceve un messaggio di risposta con esito numerico e lo stesso identificativo, nello stesso ordine.
+Come nella sessione, la connessione resta aperta finché il client non la chiude. Ogni messaggio deve stare nel buffer
+di ricezione (batch fino a MAX_COPPIE_MESSAGGIO coppie) e viene letto sul posto, senza copiarlo: un messaggio più lungo
+o un byte diverso da MAGIC_PROTOCOLLO all'inizio di un messaggio chiudono la connessione.
+*/
+
+// Calcoli eseguiti per la risposta a un messaggio: le coppie di un batch, 1 per gli altri, 0 se è stato rifiutato
+uint32_t OperazioniEseguite(const Intestazione *richiesta, int lunghezza, const unsigned char *risposta)
+{
+    if (risposta[3] != ESITO_OK && risposta[3] != ESITO_DIVISIONE_PER_ZERO) return 0;
+    if (richiesta->flag_esito & FLAG_BATCH) return (uint32_t)(lunghezza - DIM_INTESTAZIONE) / 8;
+    return richiesta->operazione != OP_NEGOZIAZIONE;
+}
+
+// Elabora tutti i messaggi completi presenti in 'in' e accoda le risposte in 'out' a partire da *out_len, come
+// ElaboraSessione(). *operazioni riceve il numero di calcoli eseguiti (le coppie, per un batch).
+// Con 'codel' (modalità ad eventi con -d) i messaggi in attesa da 'inizio_coda' possono essere scartati: la risposta
+// è ESITO_SOVRACCARICO, senza calcolo. Un messaggio oltre il limite di -L per 'indirizzo' riceve ESITO_LIMITE_SUPERATO.
+// Con 'da_delegare' (modalità epoll con -C) ci si ferma prima di un messaggio pesante (RichiestaPesante()): se 'out'
+// è vuoto *da_delegare = 1 e il messaggio, già contato e non consumato, resta all'inizio di 'in' per i thread di
+// calcolo; altrimenti le risposte già pronte partono prima e il messaggio si riprende alla chiamata successiva.
+int ElaboraMessaggi(Metriche *metriche, const char *in, int in_len, char *out, int *out_len, int out_cap, int *fine, uint32_t *operazioni,
+                    ControlloCoDel *codel, uint64_t inizio_coda, uint32_t indirizzo, int *da_delegare)
+{
+    const unsigned char *messaggio;
+    Intestazione richiesta;
+    int consumati = 0, lunghezza;
+    uint64_t ora;
+
+    *operazioni = 0;
+    while ((lunghezza = LunghezzaMessaggio((const unsigned char *)in + consumati, in_len - consumati, DIM_BUFFER_SESSIONE)) != 0)
+    {
+        if (lunghezza < 0)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Messaggio binario non valido o troppo lungo: chiusura della connessione.\n");
+            *fine = 1;
+            break;
+        }
+        messaggio = (const unsigned char *)in + consumati;
+        if (*out_len + LunghezzaMassimaRisposta(messaggio, lunghezza) > out_cap) break;
+
+        LeggiIntestazione(messaggio, lunghezza, &richiesta);
+        if (da_delegare != NULL && *out_len > 0 && RichiestaPesante(&richiesta)) break;
+        if (richiesta.operazione != OP_NEGOZIAZIONE) CatturaMessaggio(FORMATO_BINARIO, messaggio, (uint32_t)lunghezza);
+        unsigned char *risposta = (unsigned char *)out + *out_len;
+        ora = codel != NULL && richiesta.operazione != OP_NEGOZIAZIONE ? OraMetriche() : 0;
+        if (ora != 0 && CoDelScarta(codel, ora - inizio_coda, ora))
+        {
+            ScriviIntestazione(risposta, richiesta.operazione, ESITO_SOVRACCARICO, 0, richiesta.id);
+            *out_len += DIM_INTESTAZIONE;
+            AggiornaMetrica(&metriche->scarti[SCARTO_CODEL_MESSAGGIO], 1);
+            REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Messaggio %u scartato: server sovraccarico\n", richiesta.id);
+            consumati += lunghezza;
+            continue;
+        }
+        if (richiesta.operazione != OP_NEGOZIAZIONE && LimiteSuperato(indirizzo, (uint64_t)lunghezza))
+        {
+            ScriviIntestazione(risposta, richiesta.operazione, ESITO_LIMITE_SUPERATO, 0, richiesta.id);
+            *out_len += DIM_INTESTAZIONE;
+            AggiornaMetrica(&metriche->scarti[SCARTO_LIMITE_INDIRIZZO], 1);
+            REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Messaggio %u scartato: limite di frequenza del client superato\n", richiesta.id);
+            consumati += lunghezza;
+            continue;
+        }
+        if (richiesta.operazione != OP_NEGOZIAZIONE)
+            ContaOperazione(metriche, OperazioneMetrica(&richiesta));
+        if (da_delegare != NULL && RichiestaPesante(&richiesta))
+        {
+            *da_delegare = 1;
+            break;
+        }
+
+        *out_len += RispondiRichiesta(&richiesta, messaggio + DIM_INTESTAZIONE, risposta, MAX_COPPIE_MESSAGGIO);
+        AggiornaMetrica(&metriche->divisioni_per_zero, DivisioniPerZero(&richiesta, messaggio + DIM_INTESTAZIONE, risposta));
+        *operazioni += OperazioniEseguite(&richiesta, lunghezza, risposta);
+
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Messaggio %u: op '%c'%s, esito %d\n", richiesta.id, richiesta.operazione,
+                          (richiesta.flag_esito & FLAG_BATCH) ? " (batch)" : "", risposta[3]);
+        consumati += lunghezza;
+    }
+    return consumati;
+}
+
+// 1 se 'in' contiene almeno una richiesta completa (o, per i messaggi binari, dei byte da rifiutare)
+int RichiestaCompleta(const char *in, int in_len, int binario)
+{
+    if (binario) return LunghezzaMessaggio((const unsigned char *)in, in_len, DIM_BUFFER_SESSIONE) != 0;
+    return in_len >= DIM_RICHIESTA_SESSIONE;
+}
+
+// Sessione nel ciclo iterativo: una recv() per tutto ciò che è arrivato e una sola send() per tutte le risposte.
+// Le richieste si elaborano sul posto nel buffer del lettore, che può contenerne già alcune arrivate insieme
+// all'apertura. Con 'binario' la connessione usa i messaggi binari e il primo messaggio inizia nel lettore.
+void SessioneIterativa(int clientSocket, Metriche *metriche, Lettore *lettore, int binario, uint32_t indirizzo)
+{
+    char uscita[DIM_BUFFER_SESSIONE];
+    int uscita_len, consumati, fine = 0, n;
+    uint32_t operazioni;
+    uint64_t inizio_fase = OraMetriche();
+
+    while (!fine)
+    {
+        if (!RichiestaCompleta(DatiLettore(lettore), DisponibiliLettore(lettore), binario))
+        {
+            n = RiempiLettore(lettore, clientSocket);
+            if (n <= 0)
+            {
+                if (n < 0 || DisponibiliLettore(lettore) > 0) ErrorHandler("recv() fallita o connessione chiusa a metà di una richiesta.\n");
+                if (n < 0) ContaScadenzaSocket(metriche, DisponibiliLettore(lettore) > 0 ? SCADENZA_RICHIESTA : SCADENZA_ATTESA);
+                break;   // n == 0 a fine richiesta: il client ha chiuso la sessione
+            }
+            inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, inizio_fase);
+            continue;
+        }
+
+        uscita_len = 0;
+        if (binario) consumati = ElaboraMessaggi(metriche, DatiLettore(lettore), DisponibiliLettore(lettore), uscita, &uscita_len,
+                                                 sizeof(uscita), &fine, &operazioni, NULL, 0, indirizzo, NULL);
+        else consumati = ElaboraSessione(metriche, DatiLettore(lettore), DisponibiliLettore(lettore), uscita, &uscita_len,
+                                         sizeof(uscita), &fine, indirizzo);
+        ConsumaLettore(lettore, consumati);   // Una richiesta incompleta resta nel buffer fino alla prossima lettura
+        if (uscita_len == 0) continue;
+        inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, inizio_fase);
+
+        CONTA_CHIAMATA(metriche);
+        if (send(clientSocket, uscita, uscita_len, 0) != uscita_len)
+        {
+            AggiornaMetrica(&metriche->invii_falliti, 1);
+            ErrorHandler("send() fallita invio risultati della sessione.\n");
+            break;
+        }
+        inizio_fase = ChiudiFase(metriche, FASE_INVIO_RISULTATO, inizio_fase);
+    }
+}
+
+/*
+BATCH: se il client invia OP_BATCH al posto dell'operazione, il server risponde BATCH_STRING e riceve un'intestazione
+(operazione e numero n di coppie) seguita da n coppie di operandi; calcola tutto con il kernel SIMD di calcolo_g35.h
+e restituisce n seguito dagli n risultati con una sola sendmsg(): n e i risultati sono due parti distinte (scatter-gather).
+Il formato è descritto in calcolo_g35.h.
+*/
+
+// Controlla l'intestazione di una richiesta batch: restituisce il numero di coppie, 0 se la richiesta non è valida
+// o se i suoi operandi superano il limite di -L per 'indirizzo'
+uint32_t ValidaIntestazioneBatch(Metriche *metriche, const char *intestazione, char *op, uint32_t indirizzo)
+{
+    uint32_t n;
+    memcpy(&n, intestazione + 4, sizeof(n));
+    n = ntohl(n);
+    *op = intestazione[0];
+    if (!OperazioneValida(*op) || n == 0 || n > MAX_BATCH_TCP)
+    {
+        REGISTRA(LIVELLO_AVVISO, "Richiesta batch non valida (operazione '%c', %u coppie).\n", *op, n);
+        return 0;
+    }
+    if (LimiteSuperato(indirizzo, 2 * (uint64_t)n * sizeof(uint32_t)))
+    {
+        AggiornaMetrica(&metriche->scarti[SCARTO_LIMITE_INDIRIZZO], 1);
+        REGISTRA_CAMPIONE(LIVELLO_AVVISO, "Batch di %u coppie rifiutato: limite di frequenza del client superato.\n", n);
+        return 0;
+    }
+    return n;
+}
+
+// Dimensione in byte del buffer di un batch di n coppie: 2n operandi seguiti dallo spazio per gli n risultati
+size_t DimensioneBatch(uint32_t n)
+{
+    return 3 * (size_t)n * sizeof(uint32_t);
+}
+
+// Prende dal pool il buffer di un batch di n coppie (da restituire con RendiBufferPool() e DimensioneBatch(n))
+uint32_t *AllocaBatch(PoolBuffer *pool, uint32_t n)
+{
+    return PrendiBufferPool(pool, DimensioneBatch(n));
+}
+
+// Esegue il batch ricevuto in 'buffer' e scrive i risultati subito dopo gli operandi.
+// Restituisce il puntatore ai risultati, lunghi n * sizeof(uint32_t) byte (n si invia a parte).
+uint32_t *EseguiBatch(Metriche *metriche, uint32_t *buffer, char op, uint32_t n)
+{
+    uint32_t *risultati = buffer + 2 * (size_t)n;
+    uint32_t zeri = CalcolaBatch(op, buffer, risultati, n);
+    AggiornaMetrica(&metriche->divisioni_per_zero, zeri);
+
+    if (zeri > 0) REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Batch: %u operazioni '%c' (%u divisioni per zero, risultato 0)\n", n, op, zeri);
+    else REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Batch: %u operazioni '%c'\n", n, op);
+    return risultati;
+}
+
+// Batch nel ciclo iterativo: l'intestazione si legge sul posto, le coppie si ricevono direttamente nel buffer del batch
+void BatchIterativo(int clientSocket, Metriche *metriche, PoolBuffer *pool, Lettore *lettore, uint32_t indirizzo)
+{
+    const char *intestazione;
+    uint32_t n, nessun_risultato = 0, *buffer;
+    uint64_t inizio_fase = OraMetriche();
+    char op;
+
+    if ((intestazione = LeggiLettore(lettore, clientSocket, DIM_INTESTAZIONE_BATCH)) == NULL)
+    {
+        ErrorHandler("recv() fallita o connessione chiusa prematuramente (intestazione batch).\n");
+        ContaScadenzaSocket(metriche, SCADENZA_INTESTAZIONE);
+        return;
+    }
+    if ((n = ValidaIntestazioneBatch(metriche, intestazione, &op, indirizzo)) == 0 || (buffer = AllocaBatch(pool, n)) == NULL)
+    {
+        CONTA_CHIAMATA(metriche);
+        if (send(clientSocket, (char *)&nessun_risultato, sizeof(uint32_t), 0) != sizeof(uint32_t)) AggiornaMetrica(&metriche->invii_falliti, 1);
+        return;
+    }
+
+    ImpostaScadenzaSocket(clientSocket, metriche, SO_RCVTIMEO, SCADENZA_RICHIESTA);
+    if (CopiaDaLettore(lettore, clientSocket, (char *)buffer, 2 * n * sizeof(uint32_t)) <= 0)
+    {
+        ErrorHandler("recv() fallita o connessione chiusa prematuramente (operandi batch).\n");
+        ContaScadenzaSocket(metriche, SCADENZA_RICHIESTA);
+    }
+    else
+    {
+        inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, inizio_fase);
+        CatturaBatch(op, n, buffer);
+        uint32_t *risultati = EseguiBatch(metriche, buffer, op, n);
+        uint32_t net_n = htonl(n);
+        inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, inizio_fase);
+        CONTA_CHIAMATA(metriche);
+        if (InviaParti(clientSocket, &net_n, sizeof(net_n), risultati, n * sizeof(uint32_t)) != (int)((n + 1) * sizeof(uint32_t)))
+        {
+            AggiornaMetrica(&metriche->invii_falliti, 1);
+            ErrorHandler("send() fallita invio risultati batch.\n");
+        }
+        else ChiudiFase(metriche, FASE_INVIO_RISULTATO, inizio_fase);
+    }
+    RendiBufferPool(pool, buffer, DimensioneBatch(n));
+}
+
+#if defined (__linux__)
+/*
+MODALITÀ AD EVENTI (epoll): invece di servire un client alla volta, tutte le socket sono non bloccanti e un unico thread
+attende con epoll_wait() che una qualsiasi di esse sia pronta. Ogni connessione ripercorre lo stesso scambio del ciclo
+iterativo (saluto -> carattere operazione -> stringa di risposta -> operandi -> risultato), ma come macchina a stati
+esplicita: quando recv() o send() restituirebbero EAGAIN si salva il punto raggiunto e si passa alla connessione successiva.
+*/
+
+typedef enum
+{
+    STATO_INVIO_SALUTO,           // Invio di CONNECT_OK_STRING in corso
+    STATO_RICEZIONE_OPERAZIONE,   // Attesa del carattere operazione (1 byte)
+    STATO_INVIO_RISPOSTA,         // Invio della stringa di operazione/terminazione in corso
+    STATO_RICEZIONE_OPERANDI,     // Attesa dei due interi (2 * sizeof(uint32_t) bytes)
+    STATO_INVIO_RISULTATO,        // Invio del risultato in corso
+    STATO_SESSIONE,               // Sessione persistente o messaggi binari: richieste e risposte in pipeline
+    STATO_RICEZIONE_INTESTAZIONE_BATCH,   // Attesa dell'intestazione di un batch
+    STATO_RICEZIONE_BATCH         // Attesa delle coppie di operandi di un batch
+} StatoConnessione;
+
+typedef enum
+{
+    ATTESA_LETTURA,     // La connessione attende dati dal client (EPOLLIN)
+    ATTESA_SCRITTURA,   // La connessione attende spazio nel buffer di invio (EPOLLOUT)
+    DA_CHIUDERE,        // Scambio terminato o errore: la connessione va chiusa
+    IN_CALCOLO          // Un messaggio è nella pipeline (-C): nessun evento finché non torna dai thread di calcolo
+} EsitoAvanzamento;
+
+// Stato di un worker: ogni worker ha la propria socket di ascolto e il proprio ciclo epoll.
+// I contatori sono scritti solo dal thread del worker e letti dal thread principale per le statistiche.
+typedef struct
+{
+    int id;                             // Indice del worker
+    int sock;                           // Socket di ascolto del worker
+    int cpu;                            // Core su cui è fissato il thread (-1 = nessuno)
+    pthread_t thread;
+    atomic_ulong connessioni_accettate; // Connessioni ricevute dal kernel su questa socket
+    atomic_ulong richieste_servite;     // Risultati inviati
+    atomic_long connessioni_attive;     // Connessioni attualmente aperte
+    atomic_ulong chiamate_sistema;      // io_uring: chiamate io_uring_enter()
+    int usa_uring;                      // 1 se il worker usa io_uring invece di epoll
+    Metriche *metriche;                 // Fasi e contatori delle richieste servite dal worker
+    ControlloCoDel codel;               // -d: scarto in base al ritardo di coda del ciclo del worker
+    uint64_t inizio_coda;               // -d: istante da cui attendono gli eventi del giro corrente
+    uint64_t giro_precedente;           // -d: istante di inizio del giro precedente
+    RuotaTemporizzatori ruota;          // Scadenze delle connessioni del worker
+    Slab connessioni;                   // Memoria delle Connessione del worker, riusata dopo la chiusura
+    PoolBuffer buffer;                  // Buffer dei batch, riusati fra le connessioni
+    CompletamentiPipeline *completamenti;   // -C: messaggi di ritorno dai thread di calcolo (solo epoll)
+} Worker;
+
+// Connessioni aperte da tutti i worker, per il limite di -l
+static atomic_long connessioni_aperte;
+
+// Incrementa (o decrementa) un contatore del worker: c'è un solo scrittore, quindi basta load + store senza lock
+#define AGGIORNA_CONTATORE(contatore, delta) \
+    atomic_store_explicit(&(contatore), atomic_load_explicit(&(contatore), memory_order_relaxed) + (delta), memory_order_relaxed)
+
+typedef struct Connessione
+{
+    Worker *worker;                 // Worker che gestisce la connessione
+    int sock;                       // Socket connessa al client
+    StatoConnessione stato;         // Passo corrente dello scambio
+    uint32_t eventi;                // Eventi attualmente registrati su epoll
+    char operation_char;            // Operazione richiesta
+    uint64_t inizio_fase;           // Metriche: istante di inizio della fase corrente
+    int valid_operation;            // 1 se l'operazione è riconosciuta
+    int sessione;                   // 1 se il client ha chiesto una sessione persistente
+    int binario;                    // 1 se il client usa i messaggi binari (anche in STATO_SESSIONE)
+    int batch;                      // 1 se il client ha chiesto un batch
+    char uscita[DIM_BUFFER_SESSIONE];   // Dati da inviare al client
+    int uscita_len;                 // Lunghezza dei dati in 'uscita'
+    const char *coda;               // Seconda parte da inviare dopo 'uscita' con la stessa sendmsg(): i risultati di un batch
+    int coda_len;                   // Lunghezza di 'coda' (0 = nessuna)
+    int uscita_inviati;             // Byte già inviati, contando entrambe le parti
+    char ingresso[DIM_BUFFER_SESSIONE]; // Byte ricevuti, letti sul posto attraverso 'lettore'
+    Lettore lettore;
+    int fine_sessione;              // Sessione: chiudere appena inviate le risposte in sospeso
+    uint32_t indirizzo;             // Indirizzo IPv4 del client per il limite di -L (0 = client locale, nessun limite)
+    uint16_t porta;                 // Porta del client per la cattura di -R (vedi PortaClient())
+    LavoroPipeline lavoro;          // -C: messaggio pesante all'inizio del lettore, in calcolo su un altro thread
+    Intestazione richiesta_lavoro;  // -C: intestazione di quel messaggio
+    int lunghezza_lavoro;           // -C: e sua lunghezza
+    Temporizzatore scadenza;        // Scadenza della fase corrente, nella ruota del worker
+    int fase_scadenza;              // Fase della scadenza armata (SCADENZA_*, -1 = da riarmare)
+    uint32_t *buffer_batch;         // Batch: operandi e risposta, dal pool del worker (vedi AllocaBatch)
+    uint32_t batch_n;               // Batch: numero di coppie
+    size_t batch_ricevuti;          // Batch: byte di operandi già ricevuti
+    char batch_op;                  // Batch: operazione
+    struct AnelloUring *uring;      // io_uring: anello del worker (NULL in modalità epoll)
+    int buffer_testa, buffer_coda;  // io_uring: buffer ricevuti e non ancora consumati, in ordine (-1 = nessuno)
+    int buffer_consumati;           // io_uring: byte già consumati del primo buffer
+    int in_volo;                    // io_uring: operazioni accodate e non ancora completate
+    int invio_in_corso;             // io_uring: una send è in corso
+    int fine_ricezione;             // io_uring: 1 il client ha chiuso, -1 errore di ricezione
+    int chiusura_avviata;           // io_uring: shutdown già accodato
+    struct Connessione *prossimo_riarmo;   // io_uring: lista delle recv da riaccodare
+    struct msghdr messaggio_uring;  // io_uring: sendmsg in corso (deve restare valida fino al completamento)
+    struct iovec parti_uring[2];
+} Connessione;
+
+// Imposta la socket in modalità non bloccante
+int ImpostaNonBloccante(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Byte ancora da inviare fra 'uscita' e 'coda'
+int ByteDaInviare(Connessione *conn)
+{
+    return conn->uscita_len + conn->coda_len - conn->uscita_inviati;
+}
+
+// Descrive con 'parti' (almeno 2) ciò che resta da inviare; restituisce il numero di parti usate
+int PartiUscita(Connessione *conn, struct iovec *parti)
+{
+    int inviati = conn->uscita_inviati, n = 0;
+    if (inviati < conn->uscita_len)
+    {
+        parti[n].iov_base = conn->uscita + inviati;
+        parti[n++].iov_len = conn->uscita_len - inviati;
+        inviati = 0;
+    }
+    else inviati -= conn->uscita_len;
+    if (inviati < conn->coda_len)
+    {
+        parti[n].iov_base = (void *)(conn->coda + inviati);
+        parti[n++].iov_len = conn->coda_len - inviati;
+    }
+    return n;
+}
+
+#if defined (SERVER_URING)
+/*
+MODALITÀ IO_URING: al posto di epoll + recv()/send() le operazioni vengono accodate in un anello condiviso con il kernel
+(submission queue) e i loro esiti letti da un secondo anello (completion queue). Una sola io_uring_enter() per giro del
+ciclo invia tutte le operazioni accodate e attende i completamenti:
+- una accept multishot resta attiva e produce un completamento per ogni nuova connessione;
+- per ogni connessione una recv multishot resta attiva e sceglie da sé un buffer libero da un anello di buffer registrato
+  (provided buffer ring): i byte ricevuti restano in quel buffer finché la macchina a stati non li consuma;
+- l'ultimo invio di uno scambio è collegato (IOSQE_IO_LINK) allo shutdown della connessione, che parte solo a invio completato.
+La macchina a stati è la stessa della modalità epoll: cambiano solo RiceviConnessione() e InviaUscita().
+*/
+
+// Ogni user_data porta il puntatore alla connessione e, nei 3 bit bassi (gli oggetti dello slab sono allineati a 16), il tipo di operazione
+typedef enum
+{
+    URING_ACCETTA,
+    URING_RICEVI,
+    URING_INVIA,
+    URING_SHUTDOWN,
+    URING_CHIUDI,
+    URING_RIARMO        // Non è un'operazione del kernel: recv in attesa di buffer liberi
+} OperazioneUring;
+#define TIPO_URING_MASCHERA 7
+
+typedef struct AnelloUring
+{
+    int fd;
+    Worker *worker;
+    // Submission queue
+    unsigned *sq_coda;                  // Condivisa col kernel
+    unsigned *sq_testa;                 // Condivisa col kernel
+    unsigned sq_maschera;
+    unsigned sq_voci;
+    unsigned sq_coda_locale;            // Voci preparate (anche non ancora pubblicate)
+    unsigned sq_inviate;                // Voci già passate al kernel
+    struct io_uring_sqe *sqe;
+    // Completion queue
+    unsigned *cq_testa;
+    unsigned *cq_coda;
+    unsigned cq_maschera;
+    struct io_uring_cqe *cqe;
+    void *mappa_sq, *mappa_cq;
+    size_t dim_mappa_sq, dim_mappa_cq;
+    // Anello dei buffer di ricezione
+    struct io_uring_buf_ring *anello_buffer;
+    unsigned short buffer_coda;
+    char *buffer;                       // NUM_BUFFER_URING buffer da DIM_BUFFER_URING byte
+    int lunghezza[NUM_BUFFER_URING];    // Byte ricevuti in ogni buffer
+    int prossimo[NUM_BUFFER_URING];     // Buffer successivo della stessa connessione (-1 = ultimo)
+    struct Connessione *da_riarmare;    // Connessioni la cui recv multishot si è fermata per mancanza di buffer
+} AnelloUring;
+
+// Prepara una voce della submission queue (azzerata); se l'anello è pieno passa prima al kernel le voci accumulate
+struct io_uring_sqe *PrendiSqe(AnelloUring *anello)
+{
+    while (anello->sq_coda_locale - __atomic_load_n(anello->sq_testa, __ATOMIC_ACQUIRE) >= anello->sq_voci)
+    {
+        __atomic_store_n(anello->sq_coda, anello->sq_coda_locale, __ATOMIC_RELEASE);
+        int n = (int)syscall(__NR_io_uring_enter, anello->fd, anello->sq_coda_locale - anello->sq_inviate, 0, 0, NULL, 0);
+        AGGIORNA_CONTATORE(anello->worker->chiamate_sistema, 1);
+        CONTA_CHIAMATA(anello->worker->metriche);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) return NULL;
+        if (n > 0) anello->sq_inviate += n;
+    }
+    struct io_uring_sqe *sqe = &anello->sqe[anello->sq_coda_locale & anello->sq_maschera];
+    memset(sqe, 0, sizeof(*sqe));
+    anello->sq_coda_locale++;
+    return sqe;
+}
+
+// Rimette un buffer nell'anello dei buffer disponibili per le recv
+void RestituisciBuffer(AnelloUring *anello, int bid)
+{
+    struct io_uring_buf *buf = &anello->anello_buffer->bufs[anello->buffer_coda & (NUM_BUFFER_URING - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(anello->buffer + (size_t)bid * DIM_BUFFER_URING);
+    buf->len = DIM_BUFFER_URING;
+    buf->bid = (uint16_t)bid;
+    anello->buffer_coda++;
+    __atomic_store_n(&anello->anello_buffer->tail, anello->buffer_coda, __ATOMIC_RELEASE);
+}
+
+// Copia in 'buf' fino a 'len' byte dai buffer ricevuti dalla connessione, restituendo al kernel quelli svuotati.
+// Ha la stessa semantica di recv() su socket non bloccante: -1 con errno EAGAIN se non c'è ancora niente, 0 a fine flusso.
+int RiceviUring(Connessione *conn, char *buf, int len)
+{
+    AnelloUring *anello = conn->uring;
+    int copiati = 0;
+
+    while (copiati < len && conn->buffer_testa >= 0)
+    {
+        int bid = conn->buffer_testa;
+        int n = anello->lunghezza[bid] - conn->buffer_consumati;
+        if (n > len - copiati) n = len - copiati;
+        memcpy(buf + copiati, anello->buffer + (size_t)bid * DIM_BUFFER_URING + conn->buffer_consumati, n);
+        copiati += n;
+        conn->buffer_consumati += n;
+        if (conn->buffer_consumati == anello->lunghezza[bid])
+        {
+            conn->buffer_testa = anello->prossimo[bid];
+            if (conn->buffer_testa < 0) conn->buffer_coda = -1;
+            conn->buffer_consumati = 0;
+            RestituisciBuffer(anello, bid);
+        }
+    }
+    if (copiati > 0) return copiati;
+    if (conn->fine_ricezione == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (conn->fine_ricezione < 0)
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    return 0;
+}
+
+// 1 se, inviata l'uscita corrente, la macchina a stati chiuderà la connessione (stesse condizioni di AvanzaConnessione)
+int UltimoInvio(Connessione *conn)
+{
+    return conn->stato == STATO_INVIO_RISULTATO
+        || (conn->stato == STATO_INVIO_RISPOSTA && !conn->sessione && !conn->batch && !conn->valid_operation)
+        || (conn->stato == STATO_SESSIONE && conn->fine_sessione);
+}
+
+// Accoda lo shutdown della connessione: fa terminare la recv multishot, poi la connessione viene chiusa
+void AvviaChiusuraUring(Connessione *conn)
+{
+    struct io_uring_sqe *sqe = PrendiSqe(conn->uring);
+    conn->chiusura_avviata = 1;
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = conn->sock;
+    sqe->len = SHUT_RDWR;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_SHUTDOWN;
+    conn->in_volo++;
+}
+
+// Equivalente di InviaUscita(): accoda un'unica send (sendmsg se c'è anche la coda) per tutta l'uscita
+// e restituisce 0 finché non è completata
+int InviaUscitaUring(Connessione *conn)
+{
+    if (ByteDaInviare(conn) <= 0) return 1;
+    if (conn->invio_in_corso) return 0;
+
+    struct io_uring_sqe *sqe = PrendiSqe(conn->uring);
+    if (sqe == NULL) return -1;
+    sqe->fd = conn->sock;
+    if (conn->coda_len > 0)
+    {
+        conn->messaggio_uring.msg_iov = conn->parti_uring;
+        conn->messaggio_uring.msg_iovlen = PartiUscita(conn, conn->parti_uring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = (uint64_t)(uintptr_t)&conn->messaggio_uring;
+        sqe->len = 1;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = (uint64_t)(uintptr_t)(conn->uscita + conn->uscita_inviati);
+        sqe->len = conn->uscita_len - conn->uscita_inviati;
+    }
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;   // Il kernel ripete l'invio finché non è completo
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_INVIA;
+    conn->in_volo++;
+    conn->invio_in_corso = 1;
+
+    // Ultimo invio dello scambio: lo shutdown è collegato e parte solo se l'invio va a buon fine
+    if (UltimoInvio(conn))
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+        AvviaChiusuraUring(conn);
+    }
+    return 0;
+}
+#endif
+
+// Lettura non bloccante dalla connessione: recv() in modalità epoll, buffer già ricevuti in modalità io_uring
+int RiceviConnessione(Connessione *conn, void *buf, int len)
+{
+#if defined (SERVER_URING)
+    if (conn->uring != NULL) return RiceviUring(conn, buf, len);
+#endif
+    CONTA_CHIAMATA(conn->worker->metriche);
+    return recv(conn->sock, buf, len, 0);
+}
+
+// Una lettura di tutto lo spazio libero del lettore della connessione, con la semantica di RiceviConnessione().
+// In modalità epoll, se l'ultima recv() ha svuotato la socket, si attende il prossimo EPOLLIN senza una recv() a vuoto.
+int RiempiConnessione(Connessione *conn)
+{
+    int spazio, n;
+    char *libero = SpazioLettore(&conn->lettore, &spazio);
+    if (spazio == 0)
+    {
+        errno = ENOBUFS;   // Richiesta più grande del buffer
+        return -1;
+    }
+    if (conn->lettore.esaurito && conn->uring == NULL)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    n = RiceviConnessione(conn, libero, spazio);
+    AggiungiLettore(&conn->lettore, n, spazio);
+    return n;
+}
+
+// Prepara i dati da inviare e porta la connessione nello stato di invio indicato
+void AccodaUscita(Connessione *conn, const void *dati, int len, StatoConnessione stato)
+{
+    memcpy(conn->uscita, dati, len);
+    conn->uscita_len = len;
+    conn->coda_len = 0;
+    conn->uscita_inviati = 0;
+    conn->stato = stato;
+}
+
+// Svuota il buffer di uscita (e la coda, con la stessa sendmsg()): restituisce 1 se è stato inviato tutto, 0 se il buffer
+// di invio della socket è pieno (il resto partirà al prossimo EPOLLOUT), -1 in caso di errore
+int InviaUscita(Connessione *conn)
+{
+    struct iovec parti[2];
+    struct msghdr messaggio;
+    int n;
+#if defined (SERVER_URING)
+    if (conn->uring != NULL) return InviaUscitaUring(conn);
+#endif
+    memset(&messaggio, 0, sizeof(messaggio));
+    messaggio.msg_iov = parti;
+    while (ByteDaInviare(conn) > 0)
+    {
+        messaggio.msg_iovlen = PartiUscita(conn, parti);
+        n = sendmsg(conn->sock, &messaggio, MSG_NOSIGNAL);
+        CONTA_CHIAMATA(conn->worker->metriche);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            AggiornaMetrica(&conn->worker->metriche->invii_falliti, 1);
+            ErrorHandler("send() fallita.\n");
+            return -1;
+        }
+        conn->uscita_inviati += n;
+    }
+    return 1;
+}
+
+// -C, su un thread di calcolo: risposta al messaggio pesante lasciato all'inizio del lettore. La connessione è fuori
+// da epoll e dalla ruota delle scadenze finché il thread del worker non raccoglie il lavoro: nessun altro la tocca.
+void CalcolaMessaggio(LavoroPipeline *lavoro, Metriche *metriche)
+{
+    Connessione *conn = (Connessione *)((char *)lavoro - offsetof(Connessione, lavoro));
+    const unsigned char *carico = (const unsigned char *)DatiLettore(&conn->lettore) + DIM_INTESTAZIONE;
+
+    conn->uscita_len = RispondiRichiesta(&conn->richiesta_lavoro, carico, (unsigned char *)conn->uscita, MAX_COPPIE_MESSAGGIO);
+    AggiornaMetrica(&metriche->divisioni_per_zero, DivisioniPerZero(&conn->richiesta_lavoro, carico, (unsigned char *)conn->uscita));
+}
+
+// -C, sul thread del worker: il messaggio calcolato esce dal lettore e la sessione riprende dall'invio della risposta
+void ConcludiMessaggio(Connessione *conn)
+{
+    const Intestazione *richiesta = &conn->richiesta_lavoro;
+
+    AGGIORNA_CONTATORE(conn->worker->richieste_servite, OperazioniEseguite(richiesta, conn->lunghezza_lavoro, (unsigned char *)conn->uscita));
+    REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Messaggio %u: op '%c'%s, esito %d (thread di calcolo)\n", richiesta->id, richiesta->operazione,
+                      (richiesta->flag_esito & FLAG_BATCH) ? " (batch)" : "", (unsigned char)conn->uscita[3]);
+    ConsumaLettore(&conn->lettore, conn->lunghezza_lavoro);
+    conn->inizio_fase = ChiudiFase(conn->worker->metriche, FASE_CALCOLO, conn->inizio_fase);
+    conn->fase_scadenza = -1;
+}
+
+// Fa avanzare la macchina a stati della connessione finché è possibile farlo senza bloccare
+EsitoAvanzamento AvanzaConnessione(Connessione *conn)
+{
+    Metriche *metriche = conn->worker->metriche;
+    int n, inviato;
+    OrigineClient(conn->indirizzo, conn->porta);   // Il thread serve più connessioni: l'origine cambia a ogni avanzamento
+    while (1)
+    {
+        switch (conn->stato)
+        {
+            case STATO_INVIO_SALUTO:
+            case STATO_INVIO_RISPOSTA:
+            case STATO_INVIO_RISULTATO:
+                inviato = InviaUscita(conn);
+                if (inviato == 0) return ATTESA_SCRITTURA;
+                if (inviato < 0) return DA_CHIUDERE;
+
+                // Invio completato: si passa al passo successivo dello scambio
+                conn->inizio_fase = ChiudiFase(metriche, conn->stato == STATO_INVIO_SALUTO ? FASE_INVIO_SALUTO :
+                                               conn->stato == STATO_INVIO_RISPOSTA ? FASE_INVIO_OPERAZIONE : FASE_INVIO_RISULTATO,
+                                               conn->inizio_fase);
+                if (conn->stato == STATO_INVIO_SALUTO)
+                {
+                    conn->stato = STATO_RICEZIONE_OPERAZIONE;
+                }
+                else if (conn->stato == STATO_INVIO_RISPOSTA && conn->sessione)
+                {
+                    conn->uscita_len = conn->uscita_inviati = 0;
+                    conn->stato = STATO_SESSIONE;
+                }
+                else if (conn->stato == STATO_INVIO_RISPOSTA && conn->batch)
+                {
+                    conn->stato = STATO_RICEZIONE_INTESTAZIONE_BATCH;
+                }
+                else if (conn->stato == STATO_INVIO_RISPOSTA && conn->valid_operation)
+                {
+                    conn->stato = STATO_RICEZIONE_OPERANDI;
+                }
+                else
+                {
+                    if (conn->stato == STATO_INVIO_RISULTATO) AGGIORNA_CONTATORE(conn->worker->richieste_servite, conn->batch ? conn->batch_n : 1);
+                    return DA_CHIUDERE;   // Risultato inviato oppure EXIT_STRING inviata
+                }
+                break;
+
+            case STATO_RICEZIONE_OPERAZIONE:
+            {
+                if (DisponibiliLettore(&conn->lettore) == 0)
+                {
+                    n = RiempiConnessione(conn);
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ATTESA_LETTURA;
+                    if (n <= 0)
+                    {
+                        ErrorHandler("recv() fallita o connessione chiusa prematuramente (carattere operazione).\n");
+                        return DA_CHIUDERE;
+                    }
+                }
+                conn->operation_char = *DatiLettore(&conn->lettore);
+                conn->inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERAZIONE, conn->inizio_fase);
+
+                // Messaggi binari: niente stringa di risposta, il byte resta nel lettore come inizio del primo messaggio
+                if ((unsigned char)conn->operation_char == MAGIC_PROTOCOLLO)
+                {
+                    conn->binario = 1;
+                    conn->uscita_len = conn->uscita_inviati = 0;
+                    conn->stato = STATO_SESSIONE;
+                    break;
+                }
+                ConsumaLettore(&conn->lettore, 1);
+                ContaOperazione(metriche, conn->operation_char);
+
+                const char *risposta = RispostaOperazione(conn->operation_char);
+                conn->valid_operation = (risposta != NULL);
+                conn->sessione = (toupper((unsigned char)conn->operation_char) == OP_SESSIONE);
+                conn->batch = (toupper((unsigned char)conn->operation_char) == OP_BATCH);
+                if (conn->sessione) risposta = SESSION_STRING;
+                else if (conn->batch) risposta = BATCH_STRING;
+                else if (!conn->valid_operation) risposta = EXIT_STRING;
+                REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Ricevuta op: '%c', Invio indietro: '%s'\n", conn->operation_char, risposta);
+                AccodaUscita(conn, risposta, strlen(risposta) + 1, STATO_INVIO_RISPOSTA);
+                break;
+            }
+
+            case STATO_RICEZIONE_OPERANDI:
+            {
+                // I byte si accumulano nel lettore fra più risvegli; gli operandi si leggono sul posto
+                uint32_t operands[2];
+                if (DisponibiliLettore(&conn->lettore) < (int)sizeof(operands))
+                {
+                    n = RiempiConnessione(conn);
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ATTESA_LETTURA;
+                    if (n <= 0)
+                    {
+                        ErrorHandler("recv() fallita o connessione chiusa prematuramente (operandi).\n");
+                        return DA_CHIUDERE;
+                    }
+                    if (DisponibiliLettore(&conn->lettore) < (int)sizeof(operands))
+                    {
+                        AggiornaMetrica(&metriche->letture_corte, 1);
+                        break;
+                    }
+                }
+                memcpy(operands, DatiLettore(&conn->lettore), sizeof(operands));   // Non allineati nel buffer
+                CatturaOperazione(FORMATO_SINGOLA, conn->operation_char, operands);
+                ConsumaLettore(&conn->lettore, sizeof(operands));
+                conn->inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, conn->inizio_fase);
+
+                int32_t op1 = (int32_t)ntohl(operands[0]);
+                int32_t op2 = (int32_t)ntohl(operands[1]);
+                int32_t result = CalcolaRisultato(metriche, conn->operation_char, op1, op2);
+                REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Calcolo: %d %c %d = %d\n", op1, conn->operation_char, op2, result);
+                conn->inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, conn->inizio_fase);
+
+                uint32_t net_result = htonl((uint32_t)result);
+                AccodaUscita(conn, &net_result, sizeof(uint32_t), STATO_INVIO_RISULTATO);
+                break;
+            }
+
+            case STATO_SESSIONE:
+            {
+                // 1. Le risposte prodotte dall'ultima lettura partono tutte insieme
+                inviato = InviaUscita(conn);
+                if (inviato == 0) return ATTESA_SCRITTURA;
+                if (inviato < 0) return DA_CHIUDERE;
+                if (conn->uscita_len > 0) conn->inizio_fase = ChiudiFase(metriche, FASE_INVIO_RISULTATO, conn->inizio_fase);
+                conn->uscita_len = conn->uscita_inviati = 0;
+                if (conn->fine_sessione) return DA_CHIUDERE;
+
+                // 2. Se nel buffer ci sono ancora richieste complete si elaborano prima di leggere altro
+                if (!RichiestaCompleta(DatiLettore(&conn->lettore), DisponibiliLettore(&conn->lettore), conn->binario))
+                {
+                    n = RiempiConnessione(conn);
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ATTESA_LETTURA;
+                    if (n <= 0)
+                    {
+                        if (n < 0 || DisponibiliLettore(&conn->lettore) > 0) ErrorHandler("recv() fallita o connessione chiusa a metà di una richiesta.\n");
+                        return DA_CHIUDERE;   // n == 0 a fine richiesta: il client ha chiuso la sessione
+                    }
+                    if (!RichiestaCompleta(DatiLettore(&conn->lettore), DisponibiliLettore(&conn->lettore), conn->binario)) break;   // Si torna a leggere
+                    conn->inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, conn->inizio_fase);
+                }
+
+                // 3. Tutte le richieste complete ricevute con questa lettura vengono elaborate in un colpo solo, sul posto;
+                //    con -C un messaggio pesante va invece ai thread di calcolo, uno per volta, così l'ordine delle risposte resta quello
+                int consumati, da_delegare = 0;
+                uint32_t operazioni;
+                if (conn->binario)
+                {
+                    consumati = ElaboraMessaggi(metriche, DatiLettore(&conn->lettore), DisponibiliLettore(&conn->lettore), conn->uscita,
+                                                &conn->uscita_len, sizeof(conn->uscita), &conn->fine_sessione, &operazioni,
+                                                obiettivo_codel ? &conn->worker->codel : NULL, conn->worker->inizio_coda, conn->indirizzo,
+                                                conn->worker->completamenti != NULL ? &da_delegare : NULL);
+                }
+                else
+                {
+                    consumati = ElaboraSessione(metriche, DatiLettore(&conn->lettore), DisponibiliLettore(&conn->lettore), conn->uscita,
+                                                &conn->uscita_len, sizeof(conn->uscita), &conn->fine_sessione, conn->indirizzo);
+                    operazioni = consumati / DIM_RICHIESTA_SESSIONE;
+                }
+                ConsumaLettore(&conn->lettore, consumati);
+                AGGIORNA_CONTATORE(conn->worker->richieste_servite, operazioni);
+                if (consumati > 0)
+                {
+                    conn->inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, conn->inizio_fase);
+                    conn->fase_scadenza = -1;   // Richieste complete: le scadenze ripartono per le successive
+                }
+                if (da_delegare)
+                {
+                    const unsigned char *messaggio = (const unsigned char *)DatiLettore(&conn->lettore);
+                    conn->lunghezza_lavoro = LunghezzaMessaggio(messaggio, DisponibiliLettore(&conn->lettore), DIM_BUFFER_SESSIONE);
+                    LeggiIntestazione(messaggio, conn->lunghezza_lavoro, &conn->richiesta_lavoro);
+                    if (InviaLavoro(conn->worker->completamenti, &conn->lavoro)) return IN_CALCOLO;
+                    CalcolaMessaggio(&conn->lavoro, metriche);   // Pipeline piena: calcolo sul posto, come senza -C
+                    ConcludiMessaggio(conn);
+                }
+                break;
+            }
+
+            case STATO_RICEZIONE_INTESTAZIONE_BATCH:
+            {
+                if (DisponibiliLettore(&conn->lettore) < DIM_INTESTAZIONE_BATCH)
+                {
+                    n = RiempiConnessione(conn);
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ATTESA_LETTURA;
+                    if (n <= 0)
+                    {
+                        ErrorHandler("recv() fallita o connessione chiusa prematuramente (intestazione batch).\n");
+                        return DA_CHIUDERE;
+                    }
+                    if (DisponibiliLettore(&conn->lettore) < DIM_INTESTAZIONE_BATCH)
+                    {
+                        AggiornaMetrica(&metriche->letture_corte, 1);
+                        break;
+                    }
+                }
+
+                conn->batch_n = ValidaIntestazioneBatch(metriche, DatiLettore(&conn->lettore), &conn->batch_op, conn->indirizzo);
+                ConsumaLettore(&conn->lettore, DIM_INTESTAZIONE_BATCH);
+                if (conn->batch_n == 0 || (conn->buffer_batch = AllocaBatch(&conn->worker->buffer, conn->batch_n)) == NULL)
+                {
+                    uint32_t nessun_risultato = 0;
+                    conn->batch_n = 0;
+                    AccodaUscita(conn, &nessun_risultato, sizeof(uint32_t), STATO_INVIO_RISULTATO);
+                    break;
+                }
+
+                // Le coppie arrivate insieme all'intestazione si copiano una volta; il resto si riceve direttamente nel batch
+                size_t presenti = DisponibiliLettore(&conn->lettore);
+                if (presenti > 2 * (size_t)conn->batch_n * sizeof(uint32_t)) presenti = 2 * (size_t)conn->batch_n * sizeof(uint32_t);
+                memcpy(conn->buffer_batch, DatiLettore(&conn->lettore), presenti);
+                ConsumaLettore(&conn->lettore, presenti);
+                conn->batch_ricevuti = presenti;
+                conn->stato = STATO_RICEZIONE_BATCH;
+                break;
+            }
+
+            case STATO_RICEZIONE_BATCH:
+            {
+                size_t attesi = 2 * (size_t)conn->batch_n * sizeof(uint32_t);
+                if (conn->batch_ricevuti < attesi)
+                {
+                    if (conn->lettore.esaurito && conn->uring == NULL) return ATTESA_LETTURA;   // Come in RiempiConnessione()
+                    n = RiceviConnessione(conn, (char *)conn->buffer_batch + conn->batch_ricevuti, attesi - conn->batch_ricevuti);
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return ATTESA_LETTURA;
+                    conn->lettore.esaurito = (n >= 0 && (size_t)n < attesi - conn->batch_ricevuti);
+                    if (conn->lettore.esaurito) AggiornaMetrica(&metriche->letture_corte, 1);
+                    if (n <= 0)
+                    {
+                        ErrorHandler("recv() fallita o connessione chiusa prematuramente (operandi batch).\n");
+                        return DA_CHIUDERE;
+                    }
+                    conn->batch_ricevuti += n;
+                    if (conn->batch_ricevuti < attesi) break;
+                }
+                conn->inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, conn->inizio_fase);
+
+                // I risultati partono direttamente dal buffer del batch, dopo n, con la stessa sendmsg(): nessuna copia in 'uscita'
+                CatturaBatch(conn->batch_op, conn->batch_n, conn->buffer_batch);
+                const uint32_t *risultati = EseguiBatch(metriche, conn->buffer_batch, conn->batch_op, conn->batch_n);
+                uint32_t net_n = htonl(conn->batch_n);
+                conn->inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, conn->inizio_fase);
+                AccodaUscita(conn, &net_n, sizeof(net_n), STATO_INVIO_RISULTATO);
+                conn->coda = (const char *)risultati;
+                conn->coda_len = conn->batch_n * sizeof(uint32_t);
+                break;
+            }
+        }
+    }
+}
+
+/*
+SCADENZE: ogni connessione ha un temporizzatore nella ruota del worker (comune/ruota_temporizzatori_g35.h), armato per
+la fase in cui si trova dopo ogni avanzamento:
+- inattività: sessione senza richieste incomplete, il client può inviare la prossima quando vuole;
+- intestazione: il carattere operazione dopo il saluto, l'intestazione di un batch o di un messaggio binario;
+- richiesta: il resto della richiesta (operandi, coppie del batch, carico del messaggio) e l'invio della risposta.
+Il temporizzatore si riarma solo quando cambia la fase o quando una sessione completa delle richieste: un client che
+invia un byte alla volta (slowloris) non sposta la scadenza e viene chiuso quando la fase dura troppo.
+*/
+
+// Fase di scadenza della connessione, dallo stato della macchina a stati e dai byte in attesa
+int FaseScadenza(Connessione *conn)
+{
+    if (ByteDaInviare(conn) > 0) return SCADENZA_RICHIESTA;
+    switch (conn->stato)
+    {
+        case STATO_RICEZIONE_OPERAZIONE:
+        case STATO_RICEZIONE_INTESTAZIONE_BATCH:
+            return SCADENZA_INTESTAZIONE;
+        case STATO_SESSIONE:
+            if (DisponibiliLettore(&conn->lettore) == 0) return SCADENZA_ATTESA;
+            if (conn->binario && DisponibiliLettore(&conn->lettore) < DIM_INTESTAZIONE) return SCADENZA_INTESTAZIONE;
+            return SCADENZA_RICHIESTA;
+        default:
+            return SCADENZA_RICHIESTA;
+    }
+}
+
+// Riarma la scadenza se la connessione è passata a un'altra fase: O(1), nessuna chiamata di sistema
+void AggiornaScadenza(Connessione *conn)
+{
+    int fase = FaseScadenza(conn);
+    if (fase == conn->fase_scadenza) return;
+    conn->fase_scadenza = fase;
+    if (scadenze[fase] > 0) ArmaTemporizzatore(&conn->worker->ruota, &conn->scadenza, OraMetriche(), scadenze[fase]);
+    else AnnullaTemporizzatore(&conn->worker->ruota, &conn->scadenza);
+}
+
+// Chiude la connessione e libera lo stato associato (close() la rimuove anche da epoll)
+void ChiudiConnessione(Connessione *conn)
+{
+    REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Chiusura della connessione con il client.\n");
+    AnnullaTemporizzatore(&conn->worker->ruota, &conn->scadenza);
+    AGGIORNA_CONTATORE(conn->worker->connessioni_attive, -1);
+    atomic_fetch_sub_explicit(&connessioni_aperte, 1, memory_order_relaxed);
+    if (conn->sock >= 0) closesocket(conn->sock);
+    RendiBufferPool(&conn->worker->buffer, conn->buffer_batch, DimensioneBatch(conn->batch_n));
+    LiberaSlab(&conn->worker->connessioni, conn);
+}
+
+// Applica l'esito dell'avanzamento: chiude la connessione o aggiorna gli eventi attesi
+void GestisciEsito(int epfd, Connessione *conn, EsitoAvanzamento esito)
+{
+    if (esito == DA_CHIUDERE)
+    {
+        ChiudiConnessione(conn);
+        return;
+    }
+    if (esito == IN_CALCOLO)
+    {
+        // Fuori da epoll e senza scadenza finché il messaggio non torna: nessun evento può chiuderla a metà calcolo
+        AnnullaTemporizzatore(&conn->worker->ruota, &conn->scadenza);
+        conn->fase_scadenza = -1;
+        if (conn->eventi == 0) return;   // Già fuori: il messaggio precedente è appena tornato dal calcolo
+        CONTA_CHIAMATA(conn->worker->metriche);
+        if (epoll_ctl(epfd, EPOLL_CTL_DEL, conn->sock, NULL) < 0) ErrorHandler("epoll_ctl() fallita.\n");
+        conn->eventi = 0;
+        return;
+    }
+    AggiornaScadenza(conn);
+
+    uint32_t eventi = (esito == ATTESA_LETTURA) ? EPOLLIN : EPOLLOUT;
+    if (eventi != conn->eventi)
+    {
+        struct epoll_event ev;
+        ev.events = eventi;
+        ev.data.ptr = conn;
+        CONTA_CHIAMATA(conn->worker->metriche);
+        if (epoll_ctl(epfd, conn->eventi == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn->sock, &ev) < 0)
+        {
+            ErrorHandler("epoll_ctl() fallita.\n");
+            ChiudiConnessione(conn);
+            return;
+        }
+        conn->eventi = eventi;
+    }
+}
+
+/*
+CONTROLLO DI AMMISSIONE (modalità ad eventi): una connessione appena accettata viene rifiutata se le connessioni aperte
+hanno raggiunto il limite di -l, oppure se con -d il ciclo del worker ha una coda fissa (CoDel, comune/ammissione_g35.h).
+Il rifiuto è immediato: il client riceve OVERLOAD_STRING al posto del saluto e la connessione si chiude, invece di
+restare in coda fino al timeout del client. Con -d anche i messaggi binari possono essere scartati (ESITO_SOVRACCARICO).
+
+Con -L ogni indirizzo ha anche un limite di richieste e byte al secondo (comune/limitatore_g35.h), in tutte le modalità:
+l'apertura di una connessione conta come una richiesta e il client oltre il limite riceve LIMIT_STRING al posto del
+saluto; poi si addebitano i messaggi binari (ESITO_LIMITE_SUPERATO), le richieste di una sessione (che si chiude) e
+gli operandi di un batch (risposta con 0 coppie). Il controllo costa una ricerca nella tabella e una CAS per secchio.
+
+Il ritardo di coda di un evento si misura dall'inizio della sua attesa: se la epoll_wait() (o io_uring_enter()) ha
+dovuto attendere, gli eventi sono arrivati durante l'attesa e il ritardo parte dal suo ritorno; se invece c'erano già
+eventi pronti, sono arrivati mentre il worker elaborava il giro precedente e il ritardo parte dall'inizio di quel giro.
+È una stima per eccesso del ritardo del primo evento del giro, esatta a meno di un giro.
+*/
+
+// -1 se la connessione da 'indirizzo' è ammessa, altrimenti il motivo del rifiuto (SCARTO_*). Una connessione ammessa
+// conta fra le aperte fino a ChiudiConnessione().
+int AmmettiConnessione(Worker *worker, uint32_t indirizzo)
+{
+    uint64_t ora;
+
+    if (LimiteSuperato(indirizzo, 0)) return SCARTO_LIMITE_INDIRIZZO;
+
+    if (obiettivo_codel > 0)
+    {
+        ora = OraMetriche();
+        if (CoDelScarta(&worker->codel, ora - worker->inizio_coda, ora)) return SCARTO_CODEL_CONNESSIONE;
+    }
+    if (atomic_fetch_add_explicit(&connessioni_aperte, 1, memory_order_relaxed) >= limite_connessioni && limite_connessioni > 0)
+    {
+        atomic_fetch_sub_explicit(&connessioni_aperte, 1, memory_order_relaxed);
+        return SCARTO_LIMITE_CONNESSIONI;
+    }
+    return -1;
+}
+
+// Rifiuto rapido: OVERLOAD_STRING (o LIMIT_STRING) al posto del saluto, senza bloccare (se non entra nel buffer il
+// client vede solo la chiusura)
+void RifiutaConnessione(int clientSocket, Metriche *metriche, int motivo)
+{
+    const char *rifiuto = motivo == SCARTO_LIMITE_INDIRIZZO ? LIMIT_STRING : OVERLOAD_STRING;
+
+    CONTA_CHIAMATA(metriche);
+    send(clientSocket, rifiuto, strlen(rifiuto) + 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    AggiornaMetrica(&metriche->scarti[motivo], 1);
+    REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Connessione rifiutata: %s.\n",
+                      motivo == SCARTO_LIMITE_INDIRIZZO ? "limite di frequenza del client" :
+                      motivo == SCARTO_LIMITE_CONNESSIONI ? "limite di connessioni" : "ritardo di coda");
+    closesocket(clientSocket);
+}
+
+// Inizio dell'attesa degli eventi restituiti ora dal ciclo del worker: 'ha_atteso' se la chiamata si è bloccata
+void InizioCodaWorker(Worker *worker, int ha_atteso)
+{
+    uint64_t ora = OraMetriche();
+    worker->inizio_coda = ha_atteso ? ora : worker->giro_precedente;
+    worker->giro_precedente = ora;
+}
+
+// Accetta tutte le connessioni in attesa sulla socket di ascolto (non bloccante)
+void AccettaConnessioni(int epfd, Worker *worker)
+{
+    struct sockaddr_in cad;
+    socklen_t clientLen;
+    int clientSocket;
+
+    while (1)
+    {
+        clientLen = sizeof(cad);
+        clientSocket = accept4(worker->sock, (struct sockaddr *)&cad, &clientLen, SOCK_NONBLOCK);
+        if (clientSocket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) ErrorHandler("accept() fallito.\n");
+            return;
+        }
+        uint64_t accettata = OraMetriche();
+        RegistraClient(&cad);
+        int motivo = AmmettiConnessione(worker, IndirizzoClient(&cad));
+        if (motivo >= 0)
+        {
+            RifiutaConnessione(clientSocket, worker->metriche, motivo);
+            continue;
+        }
+
+        Connessione *conn = AllocaSlab(&worker->connessioni);
+        if (conn == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per la connessione.\n");
+            atomic_fetch_sub_explicit(&connessioni_aperte, 1, memory_order_relaxed);
+            closesocket(clientSocket);
+            continue;
+        }
+        memset(conn, 0, sizeof(Connessione));
+        conn->worker = worker;
+        conn->sock = clientSocket;
+        conn->indirizzo = IndirizzoClient(&cad);
+        conn->porta = PortaClient(&cad, clientSocket);
+        conn->eventi = EPOLLIN;
+        conn->fase_scadenza = -1;
+        InizializzaLettore(&conn->lettore, conn->ingresso, sizeof(conn->ingresso));
+        conn->lettore.esaurito = 1;   // Il client invierà l'operazione solo dopo il saluto: si attende EPOLLIN
+        AccodaUscita(conn, CONNECT_OK_STRING, strlen(CONNECT_OK_STRING) + 1, STATO_INVIO_SALUTO);
+
+        struct epoll_event ev;
+        ev.events = conn->eventi;
+        ev.data.ptr = conn;
+        CONTA_CHIAMATA(worker->metriche);
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, clientSocket, &ev) < 0)
+        {
+            ErrorHandler("epoll_ctl() fallita.\n");
+            atomic_fetch_sub_explicit(&connessioni_aperte, 1, memory_order_relaxed);
+            closesocket(clientSocket);
+            LiberaSlab(&worker->connessioni, conn);
+            continue;
+        }
+        AGGIORNA_CONTATORE(worker->connessioni_accettate, 1);
+        AGGIORNA_CONTATORE(worker->connessioni_attive, 1);
+        conn->inizio_fase = ChiudiFase(worker->metriche, FASE_ACCETTAZIONE, accettata);
+
+        // Il saluto di norma entra subito nel buffer di invio: si prova senza attendere EPOLLOUT
+        GestisciEsito(epfd, conn, AvanzaConnessione(conn));
+    }
+}
+
+#if defined (SERVER_URING)
+void GestisciEsitoUring(Connessione *conn, EsitoAvanzamento esito);
+#endif
+
+// Chiude le connessioni la cui fase è scaduta. Con io_uring la shutdown() sincrona fa terminare anche un invio bloccato
+// da un client che non legge; la chiusura prosegue poi come le altre.
+void ScadiConnessioni(Worker *worker)
+{
+    Temporizzatore *scaduto;
+    uint64_t ora = OraMetriche();
+
+    while ((scaduto = ProssimoScaduto(&worker->ruota, ora)) != NULL)
+    {
+        Connessione *conn = (Connessione *)((char *)scaduto - offsetof(Connessione, scadenza));
+        AggiornaMetrica(&worker->metriche->scadenze[conn->fase_scadenza], 1);
+        REGISTRA(LIVELLO_AVVISO, "Connessione chiusa: scadenza di %s superata.\n", nomi_scadenze[conn->fase_scadenza]);
+#if defined (SERVER_URING)
+        if (conn->uring != NULL)
+        {
+            CONTA_CHIAMATA(worker->metriche);
+            shutdown(conn->sock, SHUT_RDWR);
+            if (!conn->chiusura_avviata) GestisciEsitoUring(conn, DA_CHIUDERE);
+            continue;
+        }
+#endif
+        ChiudiConnessione(conn);
+    }
+}
+
+// -C: riprende le connessioni i cui messaggi sono tornati dai thread di calcolo (eventfd del worker leggibile)
+void RaccogliCalcoli(int epfd, Worker *worker)
+{
+    LavoroPipeline *lavoro;
+
+    RiarmaCompletamenti(worker->completamenti);
+    while ((lavoro = ProssimoCompletamento(worker->completamenti)) != NULL)
+    {
+        Connessione *conn = (Connessione *)((char *)lavoro - offsetof(Connessione, lavoro));
+        ConcludiMessaggio(conn);
+        GestisciEsito(epfd, conn, AvanzaConnessione(conn));
+    }
+}
+
+// Ciclo principale della modalità ad eventi: un solo thread serve tutte le connessioni della socket del worker
+int ServerEpoll(Worker *worker)
+{
+    struct epoll_event eventi[MAX_EVENTI];
+    struct epoll_event ev;
+    int epfd, n, i;
+
+    if (ImpostaNonBloccante(worker->sock) < 0)
+    {
+        ErrorHandler("fcntl() fallita sulla socket di ascolto.\n");
+        return EXIT_FAILURE;
+    }
+    if ((epfd = epoll_create1(0)) < 0)
+    {
+        ErrorHandler("epoll_create1() fallita.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Con -U e -w tutti i worker ascoltano sulla stessa socket AF_UNIX: EPOLLEXCLUSIVE ne sveglia uno solo per connessione
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL;   // data.ptr == NULL identifica la socket di ascolto
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, worker->sock, &ev) < 0)
+    {
+        ErrorHandler("epoll_ctl() fallita sulla socket di ascolto.\n");
+        closesocket(epfd);
+        return EXIT_FAILURE;
+    }
+
+    // Con -C l'eventfd dei completamenti è nello stesso ciclo: data.ptr punta allo stato della pipeline del worker
+    if (pipeline != NULL)
+    {
+        if ((worker->completamenti = CreaCompletamenti(pipeline, worker->metriche)) == NULL)
+        {
+            ErrorHandler("Creazione dei completamenti della pipeline fallita.\n");
+            closesocket(epfd);
+            return EXIT_FAILURE;
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = worker->completamenti;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, worker->completamenti->eventfd, &ev) < 0)
+        {
+            ErrorHandler("epoll_ctl() fallita sull'eventfd della pipeline.\n");
+            closesocket(epfd);
+            return EXIT_FAILURE;
+        }
+    }
+
+    while (1)
+    {
+        // Con -d una prima epoll_wait() senza attesa dice se gli eventi erano già pronti (vedi InizioCodaWorker())
+        n = 0;
+        if (obiettivo_codel > 0)
+        {
+            n = epoll_wait(epfd, eventi, MAX_EVENTI, 0);
+            CONTA_CHIAMATA(worker->metriche);
+            if (n > 0) InizioCodaWorker(worker, 0);
+        }
+        if (n <= 0)
+        {
+            // Si attende al più fino al prossimo evento della ruota delle scadenze
+            n = epoll_wait(epfd, eventi, MAX_EVENTI, AttesaRuota(&worker->ruota, OraMetriche()));
+            CONTA_CHIAMATA(worker->metriche);
+            if (obiettivo_codel > 0) InizioCodaWorker(worker, 1);
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            ErrorHandler("epoll_wait() fallita.\n");
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            Connessione *conn = eventi[i].data.ptr;
+            if (conn == NULL)
+            {
+                AccettaConnessioni(epfd, worker);
+            }
+            else if ((void *)conn == (void *)worker->completamenti)
+            {
+                RaccogliCalcoli(epfd, worker);
+            }
+            else
+            {
+                // Anche su EPOLLERR/EPOLLHUP si passa dalla macchina a stati: la recv()/send() riporta l'errore
+                if (eventi[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) conn->lettore.esaurito = 0;
+                GestisciEsito(epfd, conn, AvanzaConnessione(conn));
+            }
+        }
+        ScadiConnessioni(worker);
+    }
+
+    closesocket(epfd);
+    return EXIT_FAILURE;
+}
+
+#if defined (SERVER_URING)
+// Accoda (o riaccoda) la recv multishot della connessione, con scelta automatica del buffer dal gruppo registrato
+void ArmaRicezioneUring(Connessione *conn)
+{
+    struct io_uring_sqe *sqe = PrendiSqe(conn->uring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = GRUPPO_BUFFER_URING;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_RICEVI;
+    conn->in_volo++;
+}
+
+// Accoda la accept multishot sulla socket di ascolto (user_data senza connessione)
+void ArmaAccettazioneUring(AnelloUring *anello)
+{
+    struct io_uring_sqe *sqe = PrendiSqe(anello);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = anello->worker->sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_ACCETTA;
+}
+
+// Applica l'esito della macchina a stati; a chiusura avviata e senza operazioni in corso accoda la close()
+void GestisciEsitoUring(Connessione *conn, EsitoAvanzamento esito)
+{
+    if (esito == DA_CHIUDERE && !conn->chiusura_avviata) AvviaChiusuraUring(conn);
+    if (!conn->chiusura_avviata)
+    {
+        AggiornaScadenza(conn);
+        return;
+    }
+
+    // I byte non ancora consumati non servono più: i buffer tornano subito disponibili
+    while (conn->buffer_testa >= 0)
+    {
+        int bid = conn->buffer_testa;
+        conn->buffer_testa = conn->uring->prossimo[bid];
+        RestituisciBuffer(conn->uring, bid);
+    }
+    conn->buffer_coda = -1;
+
+    if (conn->in_volo == 0)
+    {
+        struct io_uring_sqe *sqe = PrendiSqe(conn->uring);
+        if (sqe == NULL) return;
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = conn->sock;
+        sqe->user_data = (uint64_t)(uintptr_t)conn | URING_CHIUDI;
+        conn->in_volo++;
+    }
+}
+
+// Nuova connessione accettata dal kernel: si accodano il saluto e la recv multishot
+void NuovaConnessioneUring(AnelloUring *anello, int clientSocket)
+{
+    uint64_t accettata = OraMetriche();
+    struct sockaddr_in cad;
+    socklen_t clientLen = sizeof(cad);
+
+    // La accept multishot non riporta l'indirizzo: serve solo al limite di -L e alla cattura di -R, e solo allora lo si chiede
+    cad.sin_family = AF_UNSPEC;
+    if ((limitatore != NULL || CatturaAttiva()) && getpeername(clientSocket, (struct sockaddr *)&cad, &clientLen) < 0) cad.sin_family = AF_UNSPEC;
+    int motivo = AmmettiConnessione(anello->worker, IndirizzoClient(&cad));
+    if (motivo >= 0)
+    {
+        RifiutaConnessione(clientSocket, anello->worker->metriche, motivo);   // Fuori dall'anello: è un percorso raro
+        return;
+    }
+    Connessione *conn = AllocaSlab(&anello->worker->connessioni);
+    if (conn == NULL)
+    {
+        ErrorHandler("Memoria insufficiente per la connessione.\n");
+        atomic_fetch_sub_explicit(&connessioni_aperte, 1, memory_order_relaxed);
+        closesocket(clientSocket);
+        return;
+    }
+    memset(conn, 0, sizeof(Connessione));
+    conn->worker = anello->worker;
+    conn->sock = clientSocket;
+    conn->uring = anello;
+    conn->indirizzo = IndirizzoClient(&cad);
+    conn->porta = PortaClient(&cad, clientSocket);
+    conn->buffer_testa = conn->buffer_coda = -1;
+    conn->fase_scadenza = -1;
+    InizializzaLettore(&conn->lettore, conn->ingresso, sizeof(conn->ingresso));
+    REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "\nGestione nuovo client\n");   // La accept multishot non riporta l'indirizzo di ogni client
+    AGGIORNA_CONTATORE(anello->worker->connessioni_accettate, 1);
+    AGGIORNA_CONTATORE(anello->worker->connessioni_attive, 1);
+    conn->inizio_fase = ChiudiFase(anello->worker->metriche, FASE_ACCETTAZIONE, accettata);
+
+    AccodaUscita(conn, CONNECT_OK_STRING, strlen(CONNECT_OK_STRING) + 1, STATO_INVIO_SALUTO);
+    ArmaRicezioneUring(conn);
+    GestisciEsitoUring(conn, AvanzaConnessione(conn));
+}
+
+// Elabora un completamento relativo a una connessione
+void CompletamentoUring(AnelloUring *anello, Connessione *conn, OperazioneUring tipo, int res, unsigned flags)
+{
+    switch (tipo)
+    {
+        case URING_RICEVI:
+            if (!(flags & IORING_CQE_F_MORE)) conn->in_volo--;   // La recv multishot è terminata
+            if (res > 0)
+            {
+                // Il buffer scelto dal kernel si accoda a quelli della connessione, in ordine di arrivo
+                int bid = (int)(flags >> IORING_CQE_BUFFER_SHIFT);
+                anello->lunghezza[bid] = res;
+                anello->prossimo[bid] = -1;
+                if (conn->buffer_coda >= 0) anello->prossimo[conn->buffer_coda] = bid;
+                else conn->buffer_testa = bid;
+                conn->buffer_coda = bid;
+            }
+            else if (res == 0) conn->fine_ricezione = 1;
+            else if (res != -ENOBUFS) conn->fine_ricezione = -1;
+
+            // Recv terminata senza fine del flusso (es. buffer esauriti): si riaccoda dopo questo giro di completamenti
+            if (!(flags & IORING_CQE_F_MORE) && conn->fine_ricezione == 0 && !conn->chiusura_avviata)
+            {
+                conn->prossimo_riarmo = anello->da_riarmare;
+                anello->da_riarmare = conn;
+                conn->in_volo++;
+            }
+            if (!conn->chiusura_avviata && !conn->invio_in_corso) GestisciEsitoUring(conn, AvanzaConnessione(conn));
+            else GestisciEsitoUring(conn, ATTESA_LETTURA);
+            break;
+
+        case URING_INVIA:
+            conn->in_volo--;
+            conn->invio_in_corso = 0;
+            if (res < 0 || res != ByteDaInviare(conn))
+            {
+                AggiornaMetrica(&conn->worker->metriche->invii_falliti, 1);
+                ErrorHandler("send() fallita.\n");
+                GestisciEsitoUring(conn, DA_CHIUDERE);
+                break;
+            }
+            conn->uscita_inviati += res;
+            GestisciEsitoUring(conn, AvanzaConnessione(conn));
+            break;
+
+        case URING_SHUTDOWN:
+            conn->in_volo--;
+            // Shutdown annullato perché l'invio collegato è fallito: la recv va comunque fatta terminare
+            if (res == -ECANCELED) AvviaChiusuraUring(conn);
+            GestisciEsitoUring(conn, DA_CHIUDERE);
+            break;
+
+        case URING_CHIUDI:
+            conn->sock = -1;   // Già chiusa dal kernel
+            ChiudiConnessione(conn);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Libera l'anello (solo in caso di errore durante l'avvio)
+void DistruggiAnelloUring(AnelloUring *anello)
+{
+    if (anello->anello_buffer != NULL) munmap(anello->anello_buffer, NUM_BUFFER_URING * sizeof(struct io_uring_buf));
+    if (anello->mappa_cq != NULL && anello->mappa_cq != anello->mappa_sq) munmap(anello->mappa_cq, anello->dim_mappa_cq);
+    if (anello->mappa_sq != NULL) munmap(anello->mappa_sq, anello->dim_mappa_sq);
+    if (anello->sqe != NULL) munmap(anello->sqe, anello->sq_voci * sizeof(struct io_uring_sqe));
+    if (anello->fd >= 0) closesocket(anello->fd);
+    free(anello->buffer);
+    free(anello);
+}
+
+// Crea l'anello e registra i buffer di ricezione; NULL se il kernel non supporta le funzioni richieste
+AnelloUring *CreaAnelloUring(Worker *worker)
+{
+    struct io_uring_params parametri;
+    struct io_uring_buf_reg registrazione;
+    AnelloUring *anello = calloc(1, sizeof(AnelloUring));
+    unsigned i;
+
+    if (anello == NULL) return NULL;
+    anello->fd = -1;
+    anello->worker = worker;
+
+    // SINGLE_ISSUER (un solo thread accoda operazioni) esiste dal kernel 6.0, come la recv multishot:
+    // un kernel più vecchio rifiuta il flag e si ripiega su epoll
+    memset(&parametri, 0, sizeof(parametri));
+    parametri.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_CQSIZE;
+    parametri.cq_entries = VOCI_CQ_URING;
+    anello->fd = (int)syscall(__NR_io_uring_setup, VOCI_URING, &parametri);
+    if (anello->fd < 0 || !(parametri.features & IORING_FEAT_SINGLE_MMAP) || !(parametri.features & IORING_FEAT_NODROP))
+    {
+        DistruggiAnelloUring(anello);
+        return NULL;
+    }
+
+    // Con FEAT_SINGLE_MMAP submission e completion queue condividono la stessa mappatura
+    anello->dim_mappa_sq = parametri.sq_off.array + parametri.sq_entries * sizeof(unsigned);
+    anello->dim_mappa_cq = parametri.cq_off.cqes + parametri.cq_entries * sizeof(struct io_uring_cqe);
+    if (anello->dim_mappa_cq > anello->dim_mappa_sq) anello->dim_mappa_sq = anello->dim_mappa_cq;
+    anello->mappa_sq = mmap(NULL, anello->dim_mappa_sq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, anello->fd, IORING_OFF_SQ_RING);
+    anello->sq_voci = parametri.sq_entries;
+    anello->sqe = mmap(NULL, parametri.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       anello->fd, IORING_OFF_SQES);
+    if (anello->mappa_sq == MAP_FAILED || anello->sqe == MAP_FAILED)
+    {
+        if (anello->mappa_sq == MAP_FAILED) anello->mappa_sq = NULL;
+        if (anello->sqe == MAP_FAILED) anello->sqe = NULL;
+        DistruggiAnelloUring(anello);
+        return NULL;
+    }
+    anello->mappa_cq = anello->mappa_sq;
+
+    char *sq = anello->mappa_sq;
+    anello->sq_testa = (unsigned *)(sq + parametri.sq_off.head);
+    anello->sq_coda = (unsigned *)(sq + parametri.sq_off.tail);
+    anello->sq_maschera = *(unsigned *)(sq + parametri.sq_off.ring_mask);
+    unsigned *indici = (unsigned *)(sq + parametri.sq_off.array);
+    for (i = 0; i < parametri.sq_entries; i++) indici[i] = i;   // La voce i dell'anello usa sempre la sqe i
+    anello->sq_coda_locale = anello->sq_inviate = *anello->sq_coda;
+    anello->cq_testa = (unsigned *)(sq + parametri.cq_off.head);
+    anello->cq_coda = (unsigned *)(sq + parametri.cq_off.tail);
+    anello->cq_maschera = *(unsigned *)(sq + parametri.cq_off.ring_mask);
+    anello->cqe = (struct io_uring_cqe *)(sq + parametri.cq_off.cqes);
+
+    // Anello dei buffer: memoria allineata alla pagina condivisa col kernel, più l'area dei buffer veri e propri
+    anello->anello_buffer = mmap(NULL, NUM_BUFFER_URING * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    anello->buffer = malloc((size_t)NUM_BUFFER_URING * DIM_BUFFER_URING);
+    if (anello->anello_buffer == MAP_FAILED || anello->buffer == NULL)
+    {
+        if (anello->anello_buffer == MAP_FAILED) anello->anello_buffer = NULL;
+        DistruggiAnelloUring(anello);
+        return NULL;
+    }
+    memset(&registrazione, 0, sizeof(registrazione));
+    registrazione.ring_addr = (uint64_t)(uintptr_t)anello->anello_buffer;
+    registrazione.ring_entries = NUM_BUFFER_URING;
+    registrazione.bgid = GRUPPO_BUFFER_URING;
+    if (syscall(__NR_io_uring_register, anello->fd, IORING_REGISTER_PBUF_RING, &registrazione, 1) < 0)
+    {
+        DistruggiAnelloUring(anello);
+        return NULL;
+    }
+    for (i = 0; i < NUM_BUFFER_URING; i++) RestituisciBuffer(anello, (int)i);
+    return anello;
+}
+
+// Ciclo principale della modalità io_uring. Restituisce URING_NON_DISPONIBILE se il kernel non la supporta.
+int ServerUring(Worker *worker)
+{
+    AnelloUring *anello = CreaAnelloUring(worker);
+    if (anello == NULL) return URING_NON_DISPONIBILE;
+
+    ArmaAccettazioneUring(anello);
+    while (1)
+    {
+        // Una sola chiamata di sistema: invia le operazioni accodate e attende almeno un completamento.
+        // Con -d, i completamenti già presenti prima della chiamata sono arrivati durante il giro precedente.
+        // Se ci sono scadenze armate l'attesa termina al più al prossimo evento della ruota (-ETIME)
+        int pronti = *anello->cq_testa != __atomic_load_n(anello->cq_coda, __ATOMIC_ACQUIRE);
+        int attesa = AttesaRuota(&worker->ruota, OraMetriche());
+        struct __kernel_timespec limite = { attesa / 1000, (attesa % 1000) * 1000000ll };
+        struct io_uring_getevents_arg argomento = { 0, 0, 0, (uint64_t)(uintptr_t)&limite };
+        __atomic_store_n(anello->sq_coda, anello->sq_coda_locale, __ATOMIC_RELEASE);
+        int n = (int)syscall(__NR_io_uring_enter, anello->fd, anello->sq_coda_locale - anello->sq_inviate, 1,
+                             IORING_ENTER_GETEVENTS | (attesa >= 0 ? IORING_ENTER_EXT_ARG : 0),
+                             attesa >= 0 ? (void *)&argomento : NULL, attesa >= 0 ? sizeof(argomento) : 0);
+        CONTA_CHIAMATA(worker->metriche);
+        if (obiettivo_codel > 0) InizioCodaWorker(worker, !pronti);
+        AGGIORNA_CONTATORE(worker->chiamate_sistema, 1);
+        if (n < 0 && errno == ETIME) n = 0;
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            ErrorHandler("io_uring_enter() fallita.\n");
+            break;
+        }
+        anello->sq_inviate += n;
+
+        unsigned testa = *anello->cq_testa;
+        unsigned coda = __atomic_load_n(anello->cq_coda, __ATOMIC_ACQUIRE);
+        for (; testa != coda; testa++)
+        {
+            struct io_uring_cqe *cqe = &anello->cqe[testa & anello->cq_maschera];
+            OperazioneUring tipo = (OperazioneUring)(cqe->user_data & TIPO_URING_MASCHERA);
+            Connessione *conn = (Connessione *)(uintptr_t)(cqe->user_data & ~(uint64_t)TIPO_URING_MASCHERA);
+
+            if (tipo == URING_ACCETTA)
+            {
+                if (cqe->res >= 0) NuovaConnessioneUring(anello, cqe->res);
+                else if (cqe->res != -EINTR && cqe->res != -ECONNABORTED) ErrorHandler("accept() fallito.\n");
+                if (!(cqe->flags & IORING_CQE_F_MORE)) ArmaAccettazioneUring(anello);
+            }
+            else CompletamentoUring(anello, conn, tipo, cqe->res, cqe->flags);
+        }
+        __atomic_store_n(anello->cq_testa, testa, __ATOMIC_RELEASE);
+
+        // Le recv fermate per mancanza di buffer ripartono ora che questo giro ne ha restituiti
+        while (anello->da_riarmare != NULL)
+        {
+            Connessione *conn = anello->da_riarmare;
+            anello->da_riarmare = conn->prossimo_riarmo;
+            conn->in_volo--;
+            if (!conn->chiusura_avviata) ArmaRicezioneUring(conn);
+            else GestisciEsitoUring(conn, DA_CHIUDERE);
+        }
+        ScadiConnessioni(worker);
+    }
+    return EXIT_FAILURE;
+}
+#endif
+
+/*
+MODALITÀ MULTI-CORE: si avviano N worker, ciascuno in un proprio thread con una propria socket di ascolto sulla stessa
+porta (opzione SO_REUSEPORT) e un proprio ciclo epoll. È il kernel a distribuire le nuove connessioni fra le socket,
+quindi i worker non condividono alcuno stato e il servizio scala con il numero di core.
+*/
+
+// Crea una socket di ascolto su PROTOPORT condivisibile con gli altri worker (passi 2-4 del main, più SO_REUSEPORT)
+int CreaSocketCondivisa(void)
+{
+    struct sockaddr_in sad;
+    int sock, attiva = 1;
+
+    if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+    {
+        ErrorHandler("Creazione della socket fallita.\n");
+        return -1;
+    }
+
+    // SO_REUSEPORT va impostata su tutte le socket prima del bind, altrimenti il secondo bind sulla stessa porta fallisce
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &attiva, sizeof(attiva)) < 0)
+    {
+        ErrorHandler("setsockopt(SO_REUSEPORT) fallita.\n");
+        closesocket(sock);
+        return -1;
+    }
+
+    memset(&sad, 0, sizeof(sad));
+    sad.sin_family = AF_INET;
+    sad.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sad.sin_port = htons(PROTOPORT);
+    if (bind(sock, (struct sockaddr *)&sad, sizeof(sad)) < 0)
+    {
+        ErrorHandler("bind() fallito.\n");
+        closesocket(sock);
+        return -1;
+    }
+    if (listen(sock, coda_ascolto) < 0)
+    {
+        ErrorHandler("listen() fallito.\n");
+        closesocket(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Esegue il ciclo del worker: io_uring se richiesto e supportato dal kernel, altrimenti epoll
+int AvviaCicloWorker(Worker *worker)
+{
+    InizializzaCoDel(&worker->codel, obiettivo_codel, INTERVALLO_CODEL_MS * 1000000ull);
+    InizializzaRuota(&worker->ruota, DURATA_TICK_MS * 1000000ull, OraMetriche());
+    InizializzaSlab(&worker->connessioni, sizeof(Connessione), POOL_CONNESSIONI);
+    InizializzaPoolBuffer(&worker->buffer);
+    worker->giro_precedente = OraMetriche();
+#if defined (SERVER_URING)
+    if (worker->usa_uring)
+    {
+        int esito = ServerUring(worker);
+        if (esito != URING_NON_DISPONIBILE) return esito;
+    }
+#endif
+    if (worker->usa_uring)
+    {
+        printf("io_uring non disponibile: il worker %d usa epoll.\n", worker->id);
+        worker->usa_uring = 0;
+    }
+    return ServerEpoll(worker);
+}
+
+// Corpo del thread di un worker: eventuale affinità al core, poi il ciclo ad eventi
+void *ThreadWorker(void *arg)
+{
+    Worker *worker = arg;
+
+    if (worker->cpu >= 0)
+    {
+        cpu_set_t insieme;
+        CPU_ZERO(&insieme);
+        CPU_SET(worker->cpu, &insieme);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(insieme), &insieme) != 0)
+        {
+            printf("Worker %d: impossibile fissare il thread sul core %d.\n", worker->id, worker->cpu);
+        }
+    }
+
+    AvviaCicloWorker(worker);
+    printf("Worker %d terminato.\n", worker->id);
+    return NULL;
+}
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdint.h>
-// Costanti
+// Stampa i contatori di ogni worker e la quota di connessioni ricevute, per verificare la distribuzione del kernel
+void StampaStatisticheWorker(Worker *workers, int num_worker)
+{
+    unsigned long totale = 0;
+    int i;
 
-#define PROTOPORT 48000  // Porta di default per l'applicazione
-#define QLEN 5           // Dimensione della coda di richieste (ad es. 5), massimo numero di connessioni accettate
-#define BUFFER_SIZE 512   // Dimensione del buffer
-#define EXIT_STRING "TERMINE PROCESSO CLIENT"   // Stringa di terminazione
-#define CONNECT_OK_STRING "connessione avvenuta"   // Stringa di conferma connessione
+    for (i = 0; i < num_worker; i++)
+    {
+        totale += atomic_load_explicit(&workers[i].connessioni_accettate, memory_order_relaxed);
+    }
 
-void ErrorHandler(char *errorMessage) 
-{// Funzione di gestione errori
-    printf("%s", errorMessage);
+    printf("\n--- Statistiche worker (%lu connessioni totali) ---\n", totale);
+    for (i = 0; i < num_worker; i++)
+    {
+        unsigned long accettate = atomic_load_explicit(&workers[i].connessioni_accettate, memory_order_relaxed);
+        unsigned long servite = atomic_load_explicit(&workers[i].richieste_servite, memory_order_relaxed);
+        long attive = atomic_load_explicit(&workers[i].connessioni_attive, memory_order_relaxed);
+        printf("Worker %d (core %d): accettate %lu (%.1f%%), richieste servite %lu, connessioni attive %ld",
+               workers[i].id, workers[i].cpu, accettate, totale ? 100.0 * accettate / totale : 0.0, servite, attive);
+        if (workers[i].usa_uring)
+        {
+            unsigned long chiamate = atomic_load_explicit(&workers[i].chiamate_sistema, memory_order_relaxed);
+            printf(", io_uring_enter %lu (%.2f per connessione)", chiamate, accettate ? (double)chiamate / accettate : 0.0);
+        }
+        printf("\n");
+    }
 }
 
-void ClearWinSock() 
-{// Funzione di pulizia Winsock
-#if defined (_WIN32)
-    WSACleanup();
-#endif
+// Avvia num_worker worker (0 = uno per ogni CPU online) e stampa periodicamente le loro statistiche.
+// Con 'percorso_locale' (-U) i worker ascoltano tutti sulla stessa socket AF_UNIX, che non ammette SO_REUSEPORT.
+int ServerMultiCore(int num_worker, int fissa_core, int usa_uring, const char *percorso_locale)
+{
+    static Worker workers[MAX_WORKER];
+    long num_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long ultimo_totale = 0;
+    int i, sock_locale = -1;
+
+    if (num_cpu < 1) num_cpu = 1;
+    if (num_worker <= 0) num_worker = (int)num_cpu;
+    if (num_worker > MAX_WORKER) num_worker = MAX_WORKER;
+    if (percorso_locale != NULL && (sock_locale = CreaSocketLocale(percorso_locale)) < 0) return EXIT_FAILURE;
+
+    // Le socket si creano tutte prima di avviare i thread, così un errore di bind viene segnalato subito
+    for (i = 0; i < num_worker; i++)
+    {
+        workers[i].id = i;
+        workers[i].cpu = fissa_core ? (int)(i % num_cpu) : -1;
+        workers[i].usa_uring = usa_uring;
+        if ((workers[i].metriche = NuoveMetriche()) == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per le metriche dei worker.\n");
+            while (--i >= 0 && sock_locale < 0) closesocket(workers[i].sock);
+            return EXIT_FAILURE;
+        }
+        if ((workers[i].sock = sock_locale >= 0 ? sock_locale : CreaSocketCondivisa()) < 0)
+        {
+            while (--i >= 0) closesocket(workers[i].sock);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < num_worker; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, ThreadWorker, &workers[i]) != 0)
+        {
+            printf("Impossibile avviare il worker %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    if (sock_locale >= 0) printf("Server in ascolto su %s con %d worker%s%s.\n", percorso_locale, num_worker,
+                                 fissa_core ? " fissati ai core" : "", usa_uring ? " (io_uring)" : "");
+    else printf("Server in ascolto sulla porta %d con %d worker%s%s.\n", PROTOPORT, num_worker,
+                fissa_core ? " fissati ai core" : "", usa_uring ? " (io_uring)" : "");
+
+    // Il thread principale non serve client: stampa le statistiche solo se nel frattempo è arrivato qualcosa
+    while (1)
+    {
+        unsigned long totale = 0;
+        sleep(INTERVALLO_STATISTICHE);
+        for (i = 0; i < num_worker; i++)
+        {
+            totale += atomic_load_explicit(&workers[i].connessioni_accettate, memory_order_relaxed)
+                    + atomic_load_explicit(&workers[i].richieste_servite, memory_order_relaxed);
+        }
+        if (totale != ultimo_totale)
+        {
+            StampaStatisticheWorker(workers, num_worker);
+            ultimo_totale = totale;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ANELLI IN MEMORIA CONDIVISA (-M PERCORSO): i client sulla stessa macchina possono scambiare le richieste senza passare
+dal kernel. Un thread accetta sulla socket AF_UNIX PERCORSO le regioni create dai client (comune/anello_condiviso_g35.h)
+e affida ognuna a un thread di servizio, che legge i messaggi binari dalla coda delle richieste e scrive le risposte
+nella coda delle risposte. Quando il client chiude, il thread di servizio non termina: attende il prossimo anello con
+le proprie metriche e il proprio anello del registro, così i client che vanno e vengono non consumano memoria.
+*/
+
+typedef struct
+{
+    pthread_t thread;
+    int avviato;                    // Thread già creato (scritto solo dal thread di accettazione)
+    atomic_int occupato;            // 1 dall'assegnazione di un anello alla sua chiusura
+    sem_t assegnato;                // Segnalato dal thread di accettazione quando 'anello' e 'sock' sono pronti
+    AnelloCondiviso *anello;
+    int sock;                       // Connessione AF_UNIX del client: la sua chiusura libera l'anello
+    Metriche *metriche;             // Fasi e contatori delle richieste servite da questo thread
+} ServizioAnello;
+
+static ServizioAnello servizi_anello[MAX_ANELLI];
+static int socket_anelli = -1;      // Socket di ascolto di -M
+static int giri_anello;             // -b: controlli attivi della coda prima di dormire sul futex
+
+// Serve un anello finché il client non chiude la connessione o scrive dati non validi
+void ServiAnello(ServizioAnello *servizio)
+{
+    AnelloCondiviso *anello = servizio->anello;
+    Metriche *metriche = servizio->metriche;
+    unsigned char richiesta[MAX_MESSAGGIO_ANELLO];
+    const unsigned char *messaggio;
+    unsigned char *risposta;
+    Intestazione intestazione;
+    uint32_t lunghezza;
+    uint64_t chiamate, inizio;
+    int presente, n;
+
+    OrigineClient(0, htons((uint16_t)servizio->sock));
+    while (1)
+    {
+        if ((messaggio = ProssimoMessaggio(&anello->richieste, &lunghezza)) == NULL)
+        {
+            chiamate = 0;
+            presente = AttendiMessaggio(&anello->richieste, giri_anello, &chiamate);
+            AggiornaMetrica(&metriche->chiamate_sistema, chiamate);
+            if (!presente && AltroLatoChiuso(servizio->sock)) return;
+            continue;
+        }
+        inizio = OraMetriche();
+
+        // La richiesta si copia prima di leggerla: il client potrebbe modificarla mentre il server la elabora
+        if (lunghezza > MAX_MESSAGGIO_ANELLO)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Anello: indici o lunghezza non validi, chiusura.\n");
+            return;
+        }
+        memcpy(richiesta, messaggio, lunghezza);
+        ConsumaMessaggio(&anello->richieste);
+        if (LunghezzaMessaggio(richiesta, (int)lunghezza, MAX_MESSAGGIO_ANELLO) != (int)lunghezza
+            || (risposta = SpazioMessaggio(&anello->risposte)) == NULL)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Anello: messaggio non valido o coda delle risposte piena, chiusura.\n");
+            return;
+        }
+
+        LeggiIntestazione(richiesta, (int)lunghezza, &intestazione);
+        if (intestazione.operazione != OP_NEGOZIAZIONE)
+        {
+            CatturaMessaggio(FORMATO_BINARIO, richiesta, lunghezza);
+            ContaOperazione(metriche, OperazioneMetrica(&intestazione));
+        }
+        n = RispondiRichiesta(&intestazione, richiesta + DIM_INTESTAZIONE, risposta, MAX_COPPIE_ANELLO);
+        AggiornaMetrica(&metriche->divisioni_per_zero, DivisioniPerZero(&intestazione, richiesta + DIM_INTESTAZIONE, risposta));
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Anello, messaggio %u: op '%c'%s, esito %d\n", intestazione.id, intestazione.operazione,
+                          (intestazione.flag_esito & FLAG_BATCH) ? " (batch)" : "", risposta[3]);
+        ChiudiFase(metriche, FASE_CALCOLO, inizio);
+        AggiornaMetrica(&metriche->chiamate_sistema, PubblicaMessaggio(&anello->risposte, (uint32_t)n));
+    }
+}
+
+// Corpo di un thread di servizio: attende un anello, lo serve, lo libera e torna in attesa
+void *ThreadServizioAnello(void *arg)
+{
+    ServizioAnello *servizio = arg;
+
+    while (1)
+    {
+        while (sem_wait(&servizio->assegnato) < 0 && errno == EINTR);
+        REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "\nGestione client locale su anello condiviso\n");
+        ServiAnello(servizio);
+        REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Chiusura dell'anello del client.\n");
+        munmap(servizio->anello, sizeof(AnelloCondiviso));
+        closesocket(servizio->sock);
+        atomic_store_explicit(&servizio->occupato, 0, memory_order_release);
+    }
+    return NULL;
+}
+
+// Riceve dal client il descrittore della regione e la mappa. NULL se il messaggio o la regione non sono validi:
+// senza i sigilli il client potrebbe accorciare la regione e il server riceverebbe SIGBUS leggendola.
+AnelloCondiviso *RiceviAnello(int sock)
+{
+    char controllo[CMSG_SPACE(sizeof(int))], byte;
+    struct iovec parte = { &byte, 1 };
+    struct msghdr messaggio;
+    struct cmsghdr *descrittore;
+    struct stat stato;
+    AnelloCondiviso *anello = NULL;
+    int regione, sigilli;
+
+    memset(&messaggio, 0, sizeof(messaggio));
+    messaggio.msg_iov = &parte;
+    messaggio.msg_iovlen = 1;
+    messaggio.msg_control = controllo;
+    messaggio.msg_controllen = sizeof(controllo);
+    if (recvmsg(sock, &messaggio, MSG_CMSG_CLOEXEC) != 1) return NULL;
+    descrittore = CMSG_FIRSTHDR(&messaggio);
+    if (descrittore == NULL || descrittore->cmsg_level != SOL_SOCKET || descrittore->cmsg_type != SCM_RIGHTS
+        || descrittore->cmsg_len != CMSG_LEN(sizeof(int))) return NULL;
+    memcpy(&regione, CMSG_DATA(descrittore), sizeof(int));
+
+    sigilli = fcntl(regione, F_GET_SEALS);
+    if (sigilli >= 0 && (sigilli & (F_SEAL_SHRINK | F_SEAL_GROW)) == (F_SEAL_SHRINK | F_SEAL_GROW)
+        && fstat(regione, &stato) == 0 && stato.st_size == (off_t)sizeof(AnelloCondiviso))
+    {
+        anello = mmap(NULL, sizeof(AnelloCondiviso), PROT_READ | PROT_WRITE, MAP_SHARED, regione, 0);
+        if (anello == MAP_FAILED) anello = NULL;
+        else if (anello->magic != MAGIC_ANELLO || anello->dimensione != sizeof(AnelloCondiviso))
+        {
+            munmap(anello, sizeof(AnelloCondiviso));
+            anello = NULL;
+        }
+    }
+    closesocket(regione);
+    return anello;
+}
+
+// Thread di accettazione degli anelli: riceve la regione, la affida a un thread di servizio libero (creato al primo
+// uso) e conferma al client con un byte ESITO_OK; un anello non valido o senza thread liberi viene rifiutato.
+void *ThreadAccettaAnelli(void *arg)
+{
+    struct timeval timeout = { 1, 0 };  // Un client che si connette e non invia la regione non blocca gli altri
+    ServizioAnello *servizio;
+    AnelloCondiviso *anello;
+    char conferma;
+    int sock, i;
+
+    (void)arg;
+    while (1)
+    {
+        if ((sock = accept4(socket_anelli, NULL, NULL, SOCK_CLOEXEC)) < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED) ErrorHandler("accept() fallito sulla socket degli anelli.\n");
+            continue;
+        }
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if ((anello = RiceviAnello(sock)) == NULL)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Anello rifiutato: regione non valida.\n");
+            conferma = ESITO_RICHIESTA_MALFORMATA;
+            send(sock, &conferma, 1, MSG_NOSIGNAL);
+            closesocket(sock);
+            continue;
+        }
+
+        for (i = 0; i < MAX_ANELLI && atomic_load_explicit(&servizi_anello[i].occupato, memory_order_acquire); i++);
+        servizio = (i < MAX_ANELLI) ? &servizi_anello[i] : NULL;
+        if (servizio != NULL && !servizio->avviato)
+        {
+            // NuoveMetriche() si può chiamare mentre worker e thread di calcolo registrano le loro metriche. Un insieme
+            // già registrato in un tentativo fallito si riusa invece di occupare un altro posto.
+            if (servizio->metriche == NULL) servizio->metriche = NuoveMetriche();
+            if (servizio->metriche == NULL || sem_init(&servizio->assegnato, 0, 0) < 0
+                || pthread_create(&servizio->thread, NULL, ThreadServizioAnello, servizio) != 0) servizio = NULL;
+            else
+            {
+                pthread_detach(servizio->thread);
+                servizio->avviato = 1;
+            }
+        }
+        if (servizio == NULL)
+        {
+            REGISTRA(LIVELLO_AVVISO, "Anello rifiutato: nessun thread di servizio disponibile.\n");
+            munmap(anello, sizeof(AnelloCondiviso));
+            conferma = ESITO_OPERAZIONE_NON_VALIDA;
+            send(sock, &conferma, 1, MSG_NOSIGNAL);
+            closesocket(sock);
+            continue;
+        }
+
+        servizio->anello = anello;
+        servizio->sock = sock;
+        atomic_store_explicit(&servizio->occupato, 1, memory_order_relaxed);
+        conferma = ESITO_OK;
+        send(sock, &conferma, 1, MSG_NOSIGNAL);   // Se il client è già terminato lo scopre il thread di servizio
+        sem_post(&servizio->assegnato);
+    }
+    return NULL;
 }
 
-// Funzione di utilità per ricevere esattamente la dimensione richiesta
-// Necessaria per la comunicazione TCP (stream) per assicurare la ricezione completa dei dati
-int RecvExact(int sock, char *buf, int len) 
-{                                                                                                   
-    // Riceve esattamente 'len' byte dalla socket 'sock' e li memorizza in 'buf'
-    // Conteggio totale dei byte ricevuti
-    // Numero di byte ricevuti in una singola chiamata a recv()
+// Crea la socket di -M e avvia il thread di accettazione degli anelli
+int AvviaAnelli(const char *percorso, int giri)
+{
+    pthread_t thread;
 
-    int total_bytes = 0;                                                                            
-    int bytes_rcvd;                                                                                 
-    while (total_bytes < len) // Continua fino a quando non sono stati ricevuti 'len' byte
+    giri_anello = giri;
+    if ((socket_anelli = CreaSocketLocale(percorso)) < 0) return -1;
+    if (pthread_create(&thread, NULL, ThreadAccettaAnelli, NULL) != 0)
     {
-        bytes_rcvd = recv(sock, buf + total_bytes, len - total_bytes, 0);  // Riceve dati dalla socket                         
-    if (bytes_rcvd <= 0) return bytes_rcvd;                                // Errore o connessione chiusa
-        total_bytes += bytes_rcvd;                                         // Aggiorna il conteggio dei byte totali ricevuti
+        ErrorHandler("Impossibile avviare il thread degli anelli.\n");
+        closesocket(socket_anelli);
+        return -1;
     }
-    return total_bytes;
+    pthread_detach(thread);
+    return 0;
 }
+#endif
 
 int main(int argc, char *argv[]) 
 {
@@ -66,69 +2316,337 @@ int main(int argc, char *argv[])
     }
     #endif
 
+    // Opzioni da riga di comando: senza opzioni si usa il ciclo iterativo
+    int modalita_epoll = 0;     // -e: un solo thread con ciclo ad eventi
+    int usa_uring = 0;          // -u: ciclo io_uring al posto di epoll (da solo o con -w)
+    int modalita_worker = 0;    // -w [N]: N worker con socket e ciclo ad eventi propri
+    int num_worker = 0;         // 0 = un worker per ogni CPU online
+    int fissa_core = 0;         // -p: ogni worker viene fissato a un core
+    int porta_metriche = 0;     // -a [PORTA]: endpoint delle metriche (0 = solo SIGUSR1)
+    int livello = LIVELLO_RICHIESTA;        // -v LIVELLO: messaggi registrati (default tutti)
+    unsigned long campionamento = 1;        // -c N: un messaggio per richiesta ogni N
+    const char *percorso_locale = NULL;     // -U PERCORSO: socket AF_UNIX al posto della porta TCP
+    const char *percorso_anelli = NULL;     // -M PERCORSO: anelli in memoria condivisa
+    int giri = 0;                           // -b GIRI: attesa attiva sugli anelli prima di dormire
+    uint64_t richieste_limite = 0, byte_limite = 0;   // -L RICHIESTE[,BYTE]: limite per indirizzo del client
+    int thread_calcolo = 0;                 // -C N: thread di calcolo per i messaggi pesanti (0 = calcolo sul posto)
+    const char *percorso_cattura = NULL;    // -R FILE: cattura delle richieste ricevute
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0)
+        {
+            modalita_epoll = 1;
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            modalita_worker = 1;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') num_worker = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            fissa_core = 1;
+        }
+        else if (strcmp(argv[i], "-u") == 0)
+        {
+            usa_uring = 1;
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            porta_metriche = PORTA_METRICHE;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') porta_metriche = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '3')
+        {
+            livello = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0)
+        {
+            campionamento = (unsigned long)atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc)
+        {
+            percorso_locale = argv[++i];
+        }
+        else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+        {
+            percorso_anelli = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+        {
+            giri = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            coda_ascolto = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+        {
+            limite_connessioni = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-d") == 0)
+        {
+            uint64_t obiettivo_ms = OBIETTIVO_CODEL_MS;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') obiettivo_ms = (uint64_t)atol(argv[++i]);
+            obiettivo_codel = obiettivo_ms * 1000000ull;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+        {
+            // Secondi (anche decimali) per inattività, intestazione e richiesta; i valori omessi restano quelli di default
+            char *resto = argv[++i];
+            for (int fase = 0; fase < NUM_SCADENZE && *resto != '\0'; fase++)
+            {
+                double secondi = strtod(resto, &resto);
+                if (secondi >= 0) scadenze[fase] = (uint64_t)(secondi * 1e9);
+                if (*resto == ',') resto++;
+            }
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+        {
+            // Richieste al secondo e, facoltativi, byte al secondo per indirizzo del client
+            char *resto = argv[++i];
+            richieste_limite = strtoull(resto, &resto, 10);
+            if (*resto == ',') byte_limite = strtoull(resto + 1, NULL, 10);
+        }
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            thread_calcolo = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc)
+        {
+            percorso_cattura = argv[++i];
+        }
+        else
+        {
+            printf("Uso: %s [-e | -u] [-w [N]] [-p] [-a [PORTA]] [-v LIVELLO] [-c N] [-U PERCORSO] [-M PERCORSO [-b GIRI]]\n"
+                   "       [-q N] [-l N] [-d [MS]] [-t ATTESA[,INTESTAZIONE[,RICHIESTA]]] [-L RICHIESTE[,BYTE]]\n"
+                   "       [-C N] [-R FILE]\n", argv[0]);
+            printf("  -e      modalità ad eventi (epoll, solo Linux)\n");
+            printf("  -w [N]  N worker con SO_REUSEPORT, ognuno col proprio ciclo ad eventi (default: una per CPU)\n");
+            printf("  -p      con -w, fissa ogni worker a un core\n");
+            printf("  -u      modalità io_uring (solo Linux >= 6.0, altrimenti epoll); con -w vale per ogni worker\n");
+            printf("  -a [PORTA]  metriche in formato Prometheus su http://127.0.0.1:PORTA/metrics (default %d, solo Linux)\n", PORTA_METRICHE);
+            printf("  -v LIVELLO  messaggi registrati: 0 errori, 1 avvisi, 2 connessioni, 3 richieste (default 3)\n");
+            printf("  -c N    registra un messaggio per richiesta ogni N (default 1: tutti)\n");
+            printf("  -U PERCORSO  ascolta sulla socket locale AF_UNIX PERCORSO invece che sulla porta TCP (non Windows)\n");
+            printf("  -M PERCORSO  accetta su PERCORSO gli anelli in memoria condivisa dei client locali (solo Linux)\n");
+            printf("  -b GIRI      con -M, controlli attivi della coda prima di dormire sul futex (default 0)\n");
+            printf("  -q N    backlog delle socket di ascolto (default %d)\n", QLEN);
+            printf("  -l N    con -e/-w/-u, rifiuta subito le connessioni oltre N aperte (default 0: nessun limite)\n");
+            printf("  -d [MS] con -e/-w/-u, scarta connessioni e messaggi se il ritardo di coda resta sopra MS ms (CoDel, default %d)\n", OBIETTIVO_CODEL_MS);
+            printf("  -t A[,I[,R]]  secondi di inattività, per l'intestazione e per la richiesta prima di chiudere una connessione\n"
+                   "               (default %d,%d,%d; 0 = nessuna scadenza)\n", SCADENZA_ATTESA_S, SCADENZA_INTESTAZIONE_S, SCADENZA_RICHIESTA_S);
+            printf("  -L R[,B]  limite di R richieste e B byte al secondo per indirizzo del client (0 = nessun limite, solo Linux)\n");
+            printf("  -C N    con -e/-w, N thread di calcolo per batch, numeri grandi ed espressioni dei messaggi binari (max %d, solo Linux)\n",
+                   MAX_THREAD_CALCOLO);
+            printf("  -R FILE  cattura ogni richiesta ricevuta in FILE, da riprodurre con strumenti/riproduci_g35 (solo Linux)\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Metriche: va fatto prima di avviare i worker, che ereditano SIGUSR1 bloccato
+    if (AvviaMetriche("tcp", nomi_fasi, NUM_FASI, porta_metriche) < 0)
+    {
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
+    AvviaRegistro(livello, campionamento);   // Da qui i messaggi delle richieste passano dal thread di scrittura
+
+    #if defined (_WIN32)
+    if (percorso_locale != NULL)
+    {
+        printf("Socket locale non disponibile su questo sistema: uso la porta TCP.\n");
+        percorso_locale = NULL;
+    }
+    #endif
+
+    // Cattura: attivata prima di creare i thread, ognuno dei quali scriverà nei propri blocchi del file
+    if (percorso_cattura != NULL)
+    {
+    #if defined (__linux__)
+        if (AvviaCattura(percorso_cattura) < 0)
+        {
+            ErrorHandler("Impossibile creare il file di cattura.\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Cattura delle richieste in %s.\n", percorso_cattura);
+    #else
+        printf("Cattura delle richieste non disponibile su questo sistema.\n");
+    #endif
+    }
+
+    // Limite per indirizzo: una sola tabella condivisa da tutti i worker
+    if (richieste_limite > 0 || byte_limite > 0)
+    {
+    #if defined (__linux__)
+        if ((limitatore = CreaLimitatore(richieste_limite, byte_limite)) == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per il limite per indirizzo.\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Limite per indirizzo: %llu richieste/s, %llu byte/s (0 = nessun limite).\n",
+               (unsigned long long)richieste_limite, (unsigned long long)byte_limite);
+    #else
+        printf("Limite per indirizzo non disponibile su questo sistema.\n");
+    #endif
+    }
+
+    // Thread di calcolo: una sola pipeline condivisa dai worker epoll, ognuno col proprio eventfd di ritorno
+    if (thread_calcolo > 0)
+    {
+    #if defined (__linux__)
+        if (thread_calcolo > MAX_THREAD_CALCOLO) thread_calcolo = MAX_THREAD_CALCOLO;
+        if ((pipeline = AvviaPipeline(thread_calcolo, CalcolaMessaggio)) == NULL)
+        {
+            ErrorHandler("Avvio dei thread di calcolo fallito.\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Pipeline di calcolo: %d thread.\n", thread_calcolo);
+    #else
+        printf("Thread di calcolo non disponibili su questo sistema: calcolo sul posto.\n");
+    #endif
+    }
+
+    // Gli anelli hanno un proprio thread di accettazione, qualunque sia la modalità delle connessioni
+    if (percorso_anelli != NULL)
+    {
+    #if defined (__linux__)
+        if (AvviaAnelli(percorso_anelli, giri) < 0)
+        {
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Anelli in memoria condivisa su %s (attesa attiva: %d giri).\n", percorso_anelli, giri);
+    #else
+        printf("Anelli in memoria condivisa non disponibili su questo sistema.\n");
+    #endif
+    }
+
+    if (modalita_worker)
+    {
+    #if defined (__linux__)
+        int esito = ServerMultiCore(num_worker, fissa_core, usa_uring, percorso_locale);
+        ClearWinSock();
+        return esito;
+    #else
+        printf("Modalità multi-core non disponibile su questo sistema: uso il ciclo iterativo.\n");
+    #endif
+    }
+
     int MySocket, clientSocket;     // Descrittore della socket principale e della socket client
     struct sockaddr_in sad, cad;    // sad: Server Address, cad: Client Address
     unsigned int clientLen;         // Lunghezza dell'indirizzo client
     char operation_char;
     char response_string[BUFFER_SIZE];   // Buffer di risposta
-    uint32_t operands[2];                // [0] = op1, [1] = op2 (network order uint32_t)
+    char ingresso[DIM_BUFFER_SESSIONE];  // Buffer di ricezione della connessione corrente
+    Lettore lettore;                     // Legge sul posto da 'ingresso' i campi della richiesta
+    const char *operands;                // op1 e op2 (network order), dentro 'ingresso'
     int32_t result;                      // result in 32-bit
+    Metriche *metriche;                  // Fasi e contatori delle richieste del ciclo iterativo (o del worker ad eventi)
+    PoolBuffer buffer_batch;             // Buffer dei batch, riusati fra le connessioni
+    uint64_t inizio_fase;
 
-    // 2. CREAZIONE DELLA SOCKET (Listening Socket)
-
-    /*
-    Per creare la socket esiste la funzione socket ( ). Esistono due tipi di socket, cioè STREAM e DGRAM, ma la funzione socket 
-    passa tre parametri (int pf, int type, int protocol), che denotano rispettivamente la famiglia di protocolli (se ipv4 o ipv6), 
-    il tipo di socket (se STREAM o DGRAM) e il protocollo da utilizzare (coppia ip + tipo di socket). Restituisce un intero che rappresenta 
-    il descrittore della socket creata, o -1 in caso di errore.
-    */
-
-    if ((MySocket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) 
-    {// SOCK_STREAM per TCP
-        ErrorHandler("Creazione della socket fallita.\n");                                         
+    if ((metriche = NuoveMetriche()) == NULL)
+    {
+        ErrorHandler("Memoria insufficiente per le metriche.\n");
         ClearWinSock();
-        return EXIT_FAILURE;                                                                            
+        return EXIT_FAILURE;
     }
 
-
-    // 3. COSTRUZIONE E BIND DELL'INDIRIZZO (Solo lato SERVER)
-    memset(&sad, 0, sizeof(sad));
-    sad.sin_family = AF_INET;        // Famiglia di protocolli IPv4
-    sad.sin_addr.s_addr = inet_addr("127.0.0.1");    // Ascolto su localhost (la stessa macchina)
-    sad.sin_port = htons (PROTOPORT);                // Porta in formato Big-Endian (Network Byte Order)
-
-    /*
-    La funzione bind ( ) associa un indirizzo locale (IP e porta) alla socket creata in precedenza. Essa prende tre parametri:
-    il descrittore della socket, un puntatore alla struttura che contiene l'indirizzo e la dimensione di tale struttura. Restituisce 0 in caso 
-    di successo, altrimenti -1.
-    */
-
-    if (bind (MySocket, (struct sockaddr*) &sad, sizeof(sad)) < 0) 
-    {// Assegna porta e IP alla socket 
-        ErrorHandler("bind() fallito.\n");   // Se il bind fallisce, termina il server
-        closesocket (MySocket);
-        ClearWinSock();
-        return EXIT_FAILURE;
+    // Con -U la socket di ascolto è locale (AF_UNIX) e i passi 2-4 si fanno in CreaSocketLocale()
+    #if !defined (_WIN32)
+    if (percorso_locale != NULL)
+    {
+        if ((MySocket = CreaSocketLocale(percorso_locale)) < 0)
+        {
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Server in ascolto su %s...\n", percorso_locale);
     }
+    else
+    #endif
+    {
+        // 2. CREAZIONE DELLA SOCKET (Listening Socket)
 
-    // 4. SETTAGGIO DELLA SOCKET ALL'ASCOLTO
+        /*
+        Per creare la socket esiste la funzione socket ( ). Esistono due tipi di socket, cioè STREAM e DGRAM, ma la funzione socket 
+        passa tre parametri (int pf, int type, int protocol), che denotano rispettivamente la famiglia di protocolli (se ipv4 o ipv6), 
+        il tipo di socket (se STREAM o DGRAM) e il protocollo da utilizzare (coppia ip + tipo di socket). Restituisce un intero che rappresenta 
+        il descrittore della socket creata, o -1 in caso di errore.
+        */
+
+        if ((MySocket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) 
+        {// SOCK_STREAM per TCP
+            ErrorHandler("Creazione della socket fallita.\n");                                         
+            ClearWinSock();
+            return EXIT_FAILURE;                                                                            
+        }
+
+
+        // 3. COSTRUZIONE E BIND DELL'INDIRIZZO (Solo lato SERVER)
+        memset(&sad, 0, sizeof(sad));
+        sad.sin_family = AF_INET;        // Famiglia di protocolli IPv4
+        sad.sin_addr.s_addr = inet_addr("127.0.0.1");    // Ascolto su localhost (la stessa macchina)
+        sad.sin_port = htons (PROTOPORT);                // Porta in formato Big-Endian (Network Byte Order)
+
+        /*
+        La funzione bind ( ) associa un indirizzo locale (IP e porta) alla socket creata in precedenza. Essa prende tre parametri:
+        il descrittore della socket, un puntatore alla struttura che contiene l'indirizzo e la dimensione di tale struttura. Restituisce 0 in caso 
+        di successo, altrimenti -1.
+        */
+
+        if (bind (MySocket, (struct sockaddr*) &sad, sizeof(sad)) < 0) 
+        {// Assegna porta e IP alla socket 
+            ErrorHandler("bind() fallito.\n");   // Se il bind fallisce, termina il server
+            closesocket (MySocket);
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+
+        // 4. SETTAGGIO DELLA SOCKET ALL'ASCOLTO
 
-    /*
-    La funzione listen ( ) setta la socket in uno stato in cui rimane in attesa di richiesta di connessioni. 
-    La funzione restituisce 0 in caso di successo, altrimenti -1, prendendo come parametri il descrittore della socket e la 
-    dimensione della coda di richieste in attesa (QLEN). 
-    */
+        /*
+        La funzione listen ( ) setta la socket in uno stato in cui rimane in attesa di richiesta di connessioni. 
+        La funzione restituisce 0 in caso di successo, altrimenti -1, prendendo come parametri il descrittore della socket e la 
+        dimensione della coda di richieste in attesa (QLEN, o il valore di -q). 
+        */
+
+        if (listen (MySocket, coda_ascolto) < 0) 
+        {// Mette la socket in attesa di richieste di connessione
+            ErrorHandler("listen() fallito.\n");  // Se il listen fallisce, termina il server
+            closesocket (MySocket);
+            ClearWinSock();
+            return EXIT_FAILURE;                                                                                
+        }
+        printf("Server in ascolto sulla porta %d...\n", PROTOPORT);  // Notifica che il server è in ascolto
+    }
 
-    if (listen (MySocket, QLEN) < 0) 
-    {// Mette la socket in attesa di richieste di connessione
-        ErrorHandler("listen() fallito.\n");  // Se il listen fallisce, termina il server
-        closesocket (MySocket);
+    if (modalita_epoll || usa_uring)
+    {
+    #if defined (__linux__)
+        Worker worker;      // Un solo worker, eseguito nel thread principale sulla socket appena creata
+        memset(&worker, 0, sizeof(worker));
+        worker.sock = MySocket;
+        worker.cpu = -1;
+        worker.usa_uring = usa_uring;
+        worker.metriche = metriche;
+        printf("Modalità ad eventi (%s) attiva.\n", usa_uring ? "io_uring" : "epoll");
+        int esito = AvviaCicloWorker(&worker);
+        closesocket(MySocket);
         ClearWinSock();
-        return EXIT_FAILURE;                                                                                
+        return esito;
+    #else
+        printf("Modalità ad eventi non disponibile su questo sistema: uso il ciclo iterativo.\n");
+    #endif
     }
-    printf("Server in ascolto sulla porta %d...\n", PROTOPORT);  // Notifica che il server è in ascolto
     
     
+    InizializzaPoolBuffer(&buffer_batch);
+
     // 5. CICLO DI ACCETTAZIONE (Il server rimane in ascolto iterativamente)
     while (1) 
     {
@@ -147,105 +2665,138 @@ int main(int argc, char *argv[])
             // Non chiudo MySocket, continua il ciclo.
             continue;
         }
-        printf("\nGestione client %s\n", inet_ntoa (cad.sin_addr)); // Notifica connessione client
+        inizio_fase = OraMetriche();
+        InizializzaLettore(&lettore, ingresso, sizeof(ingresso));
+        RegistraClient(&cad);   // Notifica connessione client
+        ImpostaScadenzaSocket(clientSocket, metriche, SO_SNDTIMEO, SCADENZA_RICHIESTA);
+        ImpostaScadenzaSocket(clientSocket, metriche, SO_RCVTIMEO, SCADENZA_INTESTAZIONE);
+        inizio_fase = ChiudiFase(metriche, FASE_ACCETTAZIONE, inizio_fase);
+
+        // Limite di frequenza dell'indirizzo (-L): LIMIT_STRING al posto del saluto e chiusura, senza altro lavoro
+        uint32_t indirizzo = IndirizzoClient(&cad);
+        OrigineClient(indirizzo, PortaClient(&cad, clientSocket));
+        if (LimiteSuperato(indirizzo, 0))
+        {
+            CONTA_CHIAMATA(metriche);
+            send(clientSocket, LIMIT_STRING, strlen(LIMIT_STRING) + 1, 0);
+            AggiornaMetrica(&metriche->scarti[SCARTO_LIMITE_INDIRIZZO], 1);
+            REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Connessione rifiutata: limite di frequenza del client.\n");
+            closesocket(clientSocket);
+            continue;
+        }
 
         // 4. SERVER: invia la stringa "connessione avvenuta" 
         /*
         FUNZIONE SEND (): Vedi funzionamento nella parte client (rigo 134)
         */
+        CONTA_CHIAMATA(metriche);
         if (send(clientSocket, CONNECT_OK_STRING, strlen(CONNECT_OK_STRING) + 1, 0) != strlen(CONNECT_OK_STRING) + 1) 
         {
+            AggiornaMetrica(&metriche->invii_falliti, 1);
             ErrorHandler("send() fallita invio messaggio connessione.\n"); // Se l'invio fallisce, termina il server
         }
+        inizio_fase = ChiudiFase(metriche, FASE_INVIO_SALUTO, inizio_fase);
 
         // 7. SERVER: riceve la lettera (1 byte)
         /*
         La funzione recv ( ) riceve dati da una socket connessa. Restituisce il numero di byte ricevuti in caso di successo,
         altrimenti un valore <= 0. La funzione prende come parametri il descrittore della socket, il buffer in cui memorizzare i dati ricevuti,
         la dimensione del buffer e il flag solitamente posto a 0. In questo caso, il server si aspetta di ricevere un solo carattere (1 byte).
+        Qui la recv() chiede tutto lo spazio del lettore: se il client ha già inviato altro, arriva con la stessa chiamata.
         */
-        if (recv(clientSocket, &operation_char, 1, 0) <= 0) 
+        if (DisponibiliLettore(&lettore) == 0 && RiempiLettore(&lettore, clientSocket) <= 0) 
         {
             ErrorHandler("recv() fallita o connessione chiusa prematuramente (carattere operazione).\n");
-            closesocket(clientSocket);
+            ContaScadenzaSocket(metriche, SCADENZA_INTESTAZIONE);
+            ChiudiLettore(clientSocket, metriche, &lettore);
             continue;
         }
+        operation_char = *DatiLettore(&lettore);
+        inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERAZIONE, inizio_fase);
 
-        // Logica condizionale: imposta la stringa di risposta
-        int valid_operation = 1;
-        switch (operation_char) 
+        // Messaggi binari: nessuna stringa di risposta, la connessione prosegue come una sessione.
+        // Il byte MAGIC_PROTOCOLLO resta nel lettore: è l'inizio del primo messaggio.
+        if ((unsigned char)operation_char == MAGIC_PROTOCOLLO)
         {
-            case 'A': case 'a':
-                strcpy(response_string, "ADDIZIONE");
-                break;
-            case 'S': case 's':
-                strcpy(response_string, "SOTTRAZIONE");
-                break;
-            case 'M': case 'm':
-                strcpy(response_string, "MOLTIPLICAZIONE");
-                break;
-            case 'D': case 'd':
-                strcpy(response_string, "DIVISIONE");
-                break;
-            default: // Carattere non riconosciuto
-                strcpy(response_string, EXIT_STRING);
-                valid_operation = 0;
-                break;
+            ImpostaScadenzaSocket(clientSocket, metriche, SO_RCVTIMEO, SCADENZA_ATTESA);
+            SessioneIterativa(clientSocket, metriche, &lettore, 1, indirizzo);
+            REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Chiusura della connessione con il client.\n");
+            ChiudiLettore(clientSocket, metriche, &lettore);
+            continue;
         }
-        printf("Ricevuta op: '%c', Invio indietro: '%s'\n", operation_char, response_string);
+        ConsumaLettore(&lettore, 1);
+        ContaOperazione(metriche, operation_char);
+
+        // Logica condizionale: imposta la stringa di risposta
+        const char *risposta = RispostaOperazione(operation_char);
+        int valid_operation = (risposta != NULL);
+        int sessione = (toupper((unsigned char)operation_char) == OP_SESSIONE);   // Sessione persistente
+        int batch = (toupper((unsigned char)operation_char) == OP_BATCH);         // Batch di coppie
+        if (sessione) strcpy(response_string, SESSION_STRING);
+        else if (batch) strcpy(response_string, BATCH_STRING);
+        else strcpy(response_string, valid_operation ? risposta : EXIT_STRING);   // Carattere non riconosciuto: EXIT_STRING
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Ricevuta op: '%c', Invio indietro: '%s'\n", operation_char, response_string);
 
         // SERVER: invia la stringa di operazione/terminazione
+        CONTA_CHIAMATA(metriche);
         if (send(clientSocket, response_string, strlen(response_string) + 1, 0) != strlen(response_string) + 1) 
         {
+            AggiornaMetrica(&metriche->invii_falliti, 1);
             ErrorHandler("send() fallita invio stringa operazione.\n");
         }
+        inizio_fase = ChiudiFase(metriche, FASE_INVIO_OPERAZIONE, inizio_fase);
         
+        // Sessione: le richieste si susseguono sulla stessa connessione finché il client non la chiude
+        if (sessione)
+        {
+            ImpostaScadenzaSocket(clientSocket, metriche, SO_RCVTIMEO, SCADENZA_ATTESA);
+            SessioneIterativa(clientSocket, metriche, &lettore, 0, indirizzo);
+        }
+
+        else if (batch)
+        {
+            BatchIterativo(clientSocket, metriche, &buffer_batch, &lettore, indirizzo);
+        }
+
         // Se l'operazione è valida:
-        if (valid_operation) 
+        else if (valid_operation) 
         { 
             // 9. SERVER: riceve i due interi (2 * sizeof(uint32_t) bytes)
-            if (RecvExact(clientSocket, (char *)operands, sizeof(uint32_t) * 2) <= 0) 
+            ImpostaScadenzaSocket(clientSocket, metriche, SO_RCVTIMEO, SCADENZA_RICHIESTA);
+            if ((operands = LeggiLettore(&lettore, clientSocket, sizeof(uint32_t) * 2)) == NULL) 
             {
                 ErrorHandler("recv() fallita o connessione chiusa prematuramente (operandi).\n");
-                closesocket(clientSocket);
+                ContaScadenzaSocket(metriche, SCADENZA_RICHIESTA);
+                ChiudiLettore(clientSocket, metriche, &lettore);
                 continue;
             }
+            inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE_OPERANDI, inizio_fase);
 
             // Esegue l'operazione: converti in host order (32-bit)
-            int32_t op1 = (int32_t)ntohl(operands[0]); // Conversione Network to Host (32-bit)
-            int32_t op2 = (int32_t)ntohl(operands[1]);
-
-            switch (operation_char) 
-            {
-                case 'A': case 'a': result = (int32_t)(op1 + op2); break;
-                case 'S': case 's': result = (int32_t)(op1 - op2); break;
-                case 'M': case 'm': result = (int32_t)(op1 * op2); break;
-                case 'D': case 'd': 
-                    if (op2 != 0) 
-                    {
-                        result = (int32_t)(op1 / op2);
-                    } 
+            uint32_t operandi[2];
+            memcpy(operandi, operands, sizeof(operandi));   // Gli operandi nel lettore non sono allineati
+            CatturaOperazione(FORMATO_SINGOLA, operation_char, operandi);
+            int32_t op1 = (int32_t)ntohl(operandi[0]); // Conversione Network to Host (32-bit)
+            int32_t op2 = (int32_t)ntohl(operandi[1]);
 
-                    else 
-                    {
-                        result = 0; // Gestione semplice della divisione per zero
-                        printf("Errore: divisione per zero.\n");
-                    }
-                    break;
-            }
-            printf("Calcolo: %d %c %d = %d\n", op1, operation_char, op2, result);
+            result = CalcolaRisultato(metriche, operation_char, op1, op2);
+            REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Calcolo: %d %c %d = %d\n", op1, operation_char, op2, result);
+            inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, inizio_fase);
 
             // 9. SERVER: invia il risultato (1 * sizeof(uint32_t) bytes)
             uint32_t net_result = htonl((uint32_t)result); // Conversione Host to Network (32-bit)
+            CONTA_CHIAMATA(metriche);
             if (send(clientSocket, (char *)&net_result, sizeof(uint32_t), 0) != sizeof(uint32_t)) 
             {
+                AggiornaMetrica(&metriche->invii_falliti, 1);
                 ErrorHandler("send() fallita invio risultato.\n");
             }
+            else ChiudiFase(metriche, FASE_INVIO_RISULTATO, inizio_fase);
         }
 
         // 9. Chiude la connessione corrente (la socket temporanea clientSocket) [cite: 29]
-        printf("Chiusura della connessione con il client.\n");
-        closesocket(clientSocket); // Chiude la socket temporanea
+        REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "Chiusura della connessione con il client.\n");
+        ChiudiLettore(clientSocket, metriche, &lettore); // Chiude la socket temporanea
     }
 
     // Qui non si arriva mai nel server che non termina
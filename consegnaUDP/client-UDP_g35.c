@@ -13,6 +13,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <netdb.h> /* per gethostbyname */
+#include <sys/select.h> /* select() per attendere una risposta con un limite di tempo */
 #define closesocket close
 #endif
 
@@ -27,12 +28,48 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
+#include "../comune/protocollo_g35.h"   /* protocollo senza stato e formato del batch, gli stessi del server */
 
 /* Costanti usate dall'applicazione */
 #define PORT 48000          /* porta del server UDP */
 #define ECHOMAX 255         /* dimensione massima dei messaggi di testo */
 #define EXIT_STRING "TERMINE PROCESSO CLIENT" /* stringa di terminazione */
+#define LIMIT_STRING "LIMITE SUPERATO" /* risposta del server oltre il limite per indirizzo (-L del server) */
+#define BATCH_STRING "BATCH" /* conferma della richiesta batch */
+#define MAX_DATAGRAMMA 65507      /* massimo carico utile di un datagram UDP su IPv4 */
+#define MAX_BATCH_UDP ((MAX_DATAGRAMMA - DIM_INTESTAZIONE_BATCH) / 8)  /* coppie che entrano in un datagram */
+
+/* Ritrasmissione delle richieste del protocollo senza stato (tempi in millisecondi) */
+#define RTO_INIZIALE 300.0        /* attesa della risposta prima del primo campione di RTT */
+#define RTO_MINIMO 50.0
+#define RTO_MASSIMO 4000.0
+#define MAX_TENTATIVI 6           /* invii di una richiesta prima di considerarla persa */
+#define MAX_IN_VOLO 32            /* richieste inviate e ancora senza risposta sulla socket */
+#define FINESTRA_FLUSSO 1024      /* richieste di un blocco nella modalita' -f */
+
+/* Stima del tempo di andata e ritorno (RTT) secondo Jacobson/Karels, come in TCP (RFC 6298) */
+typedef struct
+{
+    double srtt;                  /* RTT medio smussato */
+    double rttvar;                /* variazione media dell'RTT */
+    double rto;                   /* attesa prima di ritrasmettere */
+    bool stimato;                 /* false fino al primo campione */
+    unsigned long ritrasmissioni;
+} StimaRTT;
+
+/* Una richiesta con un'operazione: datagram da (ri)trasmettere e risposta ricevuta */
+typedef struct
+{
+    unsigned char datagramma[DIM_INTESTAZIONE + 8];
+    unsigned char risposta[DIM_INTESTAZIONE + 4];
+    int lunghezza_risposta;       /* -1 finche' la risposta non arriva */
+    uint32_t id;
+    int tentativi;                /* invii fatti */
+    double invio;                 /* ora dell'ultimo invio */
+    double scadenza;              /* ora della prossima ritrasmissione */
+} Richiesta;
 
 /* Stampa un messaggio di errore passato come stringa */
 void ErrorHandler(char *errorMessage) 
@@ -48,7 +85,349 @@ void ClearWinSock()
 #endif
 }
 
-int main(void) 
+/* Orologio monotono in millisecondi */
+double OraMillisecondi(void)
+{
+#if defined (_WIN32)
+    return (double)GetTickCount64();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+#endif
+}
+
+void InizializzaStimaRTT(StimaRTT *stima)
+{
+    memset(stima, 0, sizeof(*stima));
+    stima->rto = RTO_INIZIALE;
+}
+
+/* Nuovo campione di RTT: RTTVAR e SRTT si aggiornano con pesi 1/4 e 1/8, poi RTO = SRTT + 4 * RTTVAR */
+void AggiornaStimaRTT(StimaRTT *stima, double campione)
+{
+    if (!stima->stimato)
+    {
+        stima->srtt = campione;
+        stima->rttvar = campione / 2;
+        stima->stimato = true;
+    }
+    else
+    {
+        double scarto = stima->srtt - campione;
+        stima->rttvar = 0.75 * stima->rttvar + 0.25 * (scarto < 0 ? -scarto : scarto);
+        stima->srtt = 0.875 * stima->srtt + 0.125 * campione;
+    }
+    stima->rto = stima->srtt + 4 * stima->rttvar;
+    if (stima->rto < RTO_MINIMO) stima->rto = RTO_MINIMO;
+    if (stima->rto > RTO_MASSIMO) stima->rto = RTO_MASSIMO;
+}
+
+/* Intestazione (magic, versione, operazione, flag, lunghezza del carico utile, id) e i due operandi */
+void PreparaRichiesta(Richiesta *richiesta, char op, long op1, long op2, uint32_t id)
+{
+    uint32_t campi[2];
+
+    ScriviIntestazione(richiesta->datagramma, (uint8_t)toupper((unsigned char)op), 0, sizeof(campi), id);
+    campi[0] = htonl((uint32_t)op1);
+    campi[1] = htonl((uint32_t)op2);
+    memcpy(richiesta->datagramma + DIM_INTESTAZIONE, campi, sizeof(campi));
+    richiesta->id = id;
+}
+
+/* (Ri)trasmette la richiesta: la ritrasmissione usa lo stesso id, cosi' il server la riconosce e ripete la risposta.
+   L'attesa della risposta raddoppia a ogni invio della stessa richiesta (backoff esponenziale), fino a RTO_MASSIMO. */
+int InviaRichiesta(int sock, const struct sockaddr_in *server, Richiesta *richiesta, const StimaRTT *stima, double ora)
+{
+    double attesa = stima->rto;
+    int i;
+
+    if (sendto(sock, (char *)richiesta->datagramma, sizeof(richiesta->datagramma), 0,
+               (const struct sockaddr *)server, sizeof(*server)) != (int)sizeof(richiesta->datagramma))
+    {
+        ErrorHandler("sendto() fallita invio richiesta\n");
+        return -1;
+    }
+    for (i = 0; i < richiesta->tentativi && attesa < RTO_MASSIMO; i++) attesa *= 2;
+    richiesta->tentativi++;
+    richiesta->invio = ora;
+    richiesta->scadenza = ora + (attesa < RTO_MASSIMO ? attesa : RTO_MASSIMO);
+    return 0;
+}
+
+/*
+  Invia le n richieste e ne attende le risposte, con al massimo MAX_IN_VOLO richieste senza risposta alla volta.
+  Una richiesta senza risposta entro la sua attesa viene ritrasmessa con l'attesa raddoppiata, e dopo MAX_TENTATIVI
+  invii si considera persa (lunghezza_risposta resta -1). L'RTO di partenza e' comune a tutte le richieste della socket.
+  L'RTT si misura solo sulle richieste inviate una volta (algoritmo di Karn): la risposta a una richiesta ritrasmessa
+  non dice a quale invio corrisponde.
+  Restituisce il numero di richieste perse, -1 in caso di errore, -2 se il server conosce solo il vecchio protocollo.
+*/
+int ScambiaRichieste(int sock, const struct sockaddr_in *server, StimaRTT *stima, Richiesta *richieste, int n)
+{
+    int in_volo[MAX_IN_VOLO];     /* indici delle richieste inviate e ancora senza risposta */
+    int num_in_volo = 0, prossima = 0, perse = 0, i, len;
+    unsigned char risposta[ECHOMAX];
+    struct sockaddr_in fromAddr;
+    unsigned int fromSize;
+    uint32_t id;
+
+    while (prossima < n || num_in_volo > 0)
+    {
+        double ora = OraMillisecondi(), attesa = RTO_MASSIMO;
+
+        /* Nuove richieste finche' la finestra lo consente */
+        while (prossima < n && num_in_volo < MAX_IN_VOLO)
+        {
+            richieste[prossima].tentativi = 0;
+            richieste[prossima].lunghezza_risposta = -1;
+            if (InviaRichiesta(sock, server, &richieste[prossima], stima, ora) != 0) return -1;
+            in_volo[num_in_volo++] = prossima++;
+        }
+
+        /* Richieste scadute: ritrasmissione o, dopo MAX_TENTATIVI invii, rinuncia */
+        for (i = 0; i < num_in_volo; )
+        {
+            Richiesta *richiesta = &richieste[in_volo[i]];
+            if (richiesta->scadenza <= ora)
+            {
+                if (richiesta->tentativi >= MAX_TENTATIVI)
+                {
+                    perse++;
+                    in_volo[i] = in_volo[--num_in_volo];
+                    continue;
+                }
+                if (InviaRichiesta(sock, server, richiesta, stima, ora) != 0) return -1;
+                stima->ritrasmissioni++;
+            }
+            if (richiesta->scadenza - ora < attesa) attesa = richiesta->scadenza - ora;
+            i++;
+        }
+        if (num_in_volo == 0) continue;
+
+        /* Attesa di una risposta fino alla prima scadenza */
+        fd_set leggibili;
+        struct timeval limite;
+        FD_ZERO(&leggibili);
+        FD_SET(sock, &leggibili);
+        limite.tv_sec = (long)(attesa / 1000);
+        limite.tv_usec = (long)((attesa - limite.tv_sec * 1000.0) * 1000);
+        int pronti = select(sock + 1, &leggibili, NULL, NULL, &limite);
+        if (pronti < 0)
+        {
+            ErrorHandler("select() fallita attesa risposta\n");
+            return -1;
+        }
+        if (pronti == 0) continue;
+
+        fromSize = sizeof(fromAddr);
+        len = recvfrom(sock, (char *)risposta, sizeof(risposta) - 1, 0, (struct sockaddr *)&fromAddr, &fromSize);
+        if (len < 0)
+        {
+            ErrorHandler("recvfrom() fallita ricezione risposta\n");
+            return -1;
+        }
+        if (server->sin_addr.s_addr != fromAddr.sin_addr.s_addr) continue;   /* sorgente non riconosciuta: si ignora */
+
+        /* Un server che conosce solo il vecchio protocollo legge il primo byte come operazione e risponde EXIT_STRING */
+        if (risposta[0] != MAGIC_PROTOCOLLO)
+        {
+            risposta[len] = '\0';
+            if (strcmp((char *)risposta, EXIT_STRING) == 0) return -2;
+            continue;
+        }
+        if (len < DIM_INTESTAZIONE) continue;
+        memcpy(&id, risposta + 8, sizeof(id));
+        id = ntohl(id);
+
+        /* Le risposte a richieste gia' risposte o perse (ritrasmissioni doppie) non trovano posto e si scartano */
+        for (i = 0; i < num_in_volo && richieste[in_volo[i]].id != id; i++);
+        if (i == num_in_volo) continue;
+        Richiesta *richiesta = &richieste[in_volo[i]];
+        if (richiesta->tentativi == 1) AggiornaStimaRTT(stima, OraMillisecondi() - richiesta->invio);
+        richiesta->lunghezza_risposta = len;
+        memcpy(richiesta->risposta, risposta, len < (int)sizeof(richiesta->risposta) ? (size_t)len : sizeof(richiesta->risposta));
+        in_volo[i] = in_volo[--num_in_volo];
+    }
+    return perse;
+}
+
+/* Batch (opzione -b): un datagram con operazione, numero di coppie e coppie; la risposta e' un solo datagram
+   con il numero di risultati e i risultati (formato descritto in comune/calcolo_g35.h) */
+int BatchClient(int sock, struct sockaddr_in *echoServAddr)
+{
+    static char datagramma[MAX_DATAGRAMMA];   /* richiesta: intestazione + coppie */
+    static char risposta[MAX_DATAGRAMMA];     /* risposta: n + risultati */
+    struct sockaddr_in fromAddr;
+    unsigned int fromSize = sizeof(fromAddr);
+    char riga[ECHOMAX];
+    char op;
+    long op1, op2;
+    uint32_t n = 0, net_n, valori[2], i;
+    int len;
+
+    printf("Inserisci l'operazione del batch (A=Addizione, S=Sottrazione, M=Moltiplicazione, D=Divisione):\n");
+    if (scanf(" %c", &op) != 1) return -1;
+    printf("Inserisci le coppie di interi, una per riga (massimo %d); EOF o una riga vuota terminano l'elenco:\n", MAX_BATCH_UDP);
+    fgets(riga, sizeof(riga), stdin);   /* resto della riga dell'operazione */
+    while (n < MAX_BATCH_UDP && fgets(riga, sizeof(riga), stdin) != NULL && riga[0] != '\n' && riga[0] != '\r')
+    {
+        if (sscanf(riga, "%ld %ld", &op1, &op2) != 2)
+        {
+            printf("Riga ignorata: %s", riga);
+            continue;
+        }
+        valori[0] = htonl((uint32_t)op1);
+        valori[1] = htonl((uint32_t)op2);
+        memcpy(datagramma + DIM_INTESTAZIONE_BATCH + n * 8, valori, sizeof(valori));
+        n++;
+    }
+
+    /* Intestazione: operazione, 3 byte riservati, numero di coppie */
+    memset(datagramma, 0, DIM_INTESTAZIONE_BATCH);
+    datagramma[0] = op;
+    net_n = htonl(n);
+    memcpy(datagramma + 4, &net_n, sizeof(net_n));
+    len = DIM_INTESTAZIONE_BATCH + n * 8;
+    if (sendto(sock, datagramma, len, 0, (struct sockaddr *)echoServAddr, sizeof(*echoServAddr)) != len)
+    {
+        ErrorHandler("sendto() fallita invio batch\n");
+        return -1;
+    }
+
+    len = recvfrom(sock, risposta, sizeof(risposta), 0, (struct sockaddr *)&fromAddr, &fromSize);
+    if (len < (int)sizeof(uint32_t) || echoServAddr->sin_addr.s_addr != fromAddr.sin_addr.s_addr)
+    {
+        ErrorHandler("recvfrom() fallita o risposta batch non valida\n");
+        return -1;
+    }
+    memcpy(&net_n, risposta, sizeof(net_n));
+    if (n == 0 || ntohl(net_n) != n || len != (int)((n + 1) * sizeof(uint32_t)))
+    {
+        printf("Il server ha rifiutato il batch.\n");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        uint32_t r;
+        memcpy(valori, datagramma + DIM_INTESTAZIONE_BATCH + i * 8, sizeof(valori));
+        memcpy(&r, risposta + (i + 1) * sizeof(uint32_t), sizeof(r));
+        printf("%d %c %d = %d\n", (int32_t)ntohl(valori[0]), op, (int32_t)ntohl(valori[1]), (int32_t)ntohl(r));
+    }
+    return 0;
+}
+
+/* Protocollo senza stato: operazione e operandi in un solo datagram, risultato in un solo datagram con lo stesso id;
+   la richiesta viene ritrasmessa se la risposta non arriva.
+   Restituisce 0 se il risultato e' stato ricevuto, 1 se il server usa il vecchio protocollo, -1 in caso di errore. */
+int RichiestaSenzaStato(int sock, struct sockaddr_in *echoServAddr, char op, long op1, long op2)
+{
+    Richiesta richiesta;
+    StimaRTT stima;
+    uint32_t risultato;
+    uint32_t id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);   /* distingue la risposta da quelle di richieste precedenti */
+
+    InizializzaStimaRTT(&stima);
+    PreparaRichiesta(&richiesta, op, op1, op2, id);
+    int esito = ScambiaRichieste(sock, echoServAddr, &stima, &richiesta, 1);
+    if (esito == -2) return 1;
+    if (esito < 0) return -1;
+    if (esito > 0)
+    {
+        printf("Nessuna risposta dal server dopo %d tentativi.\n", MAX_TENTATIVI);
+        return -1;
+    }
+    if (stima.ritrasmissioni > 0) printf("Risposta ricevuta dopo %lu ritrasmissioni.\n", stima.ritrasmissioni);
+
+    if ((richiesta.risposta[3] != ESITO_OK && richiesta.risposta[3] != ESITO_DIVISIONE_PER_ZERO)
+        || richiesta.lunghezza_risposta != DIM_INTESTAZIONE + 4)
+    {
+        if (richiesta.risposta[3] == ESITO_LIMITE_SUPERATO) printf("Troppe richieste da questo indirizzo: riprovare piu' tardi.\n");
+        else printf("Richiesta rifiutata dal server (esito %d).\n", richiesta.risposta[3]);
+        return -1;
+    }
+    if (richiesta.risposta[3] == ESITO_DIVISIONE_PER_ZERO) printf("Divisione per zero: il server restituisce 0.\n");
+    memcpy(&risultato, richiesta.risposta + DIM_INTESTAZIONE, sizeof(risultato));
+    printf("Risultato ricevuto dal server: %d\n", (int32_t)ntohl(risultato));
+    return 0;
+}
+
+/* Flusso (opzione -f): una riga "op a b" per operazione. Una riga vuota (o EOF, o FINESTRA_FLUSSO righe) invia il
+   blocco letto con il protocollo senza stato, fino a MAX_IN_VOLO richieste alla volta con ritrasmissione di quelle
+   perse, e stampa i risultati nell'ordine dell'input. Alla fine riporta RTT stimato e ritrasmissioni. */
+int FlussoClient(int sock, struct sockaddr_in *echoServAddr)
+{
+    static Richiesta richieste[FINESTRA_FLUSSO];
+    static long operandi[FINESTRA_FLUSSO][2];
+    StimaRTT stima;
+    char riga[ECHOMAX];
+    char op;
+    long op1, op2, totale = 0, senza_risposta = 0;
+    uint32_t id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16), risultato;
+    int in_coda, i, fine_input = 0;
+
+    InizializzaStimaRTT(&stima);
+    printf("Inserisci un'operazione per riga (es. A 3 4); una riga vuota invia il blocco, EOF termina.\n");
+    while (!fine_input)
+    {
+        in_coda = 0;
+        while (in_coda < FINESTRA_FLUSSO)
+        {
+            if (fgets(riga, sizeof(riga), stdin) == NULL)
+            {
+                fine_input = 1;
+                break;
+            }
+            if (riga[0] == '\n' || riga[0] == '\r')
+            {
+                if (in_coda > 0) break;
+                continue;
+            }
+            if (sscanf(riga, " %c %ld %ld", &op, &op1, &op2) != 3 || strchr("AaSsMmDd", op) == NULL)
+            {
+                printf("Riga ignorata: %s", riga);
+                continue;
+            }
+            PreparaRichiesta(&richieste[in_coda], op, op1, op2, id++);
+            operandi[in_coda][0] = op1;
+            operandi[in_coda][1] = op2;
+            in_coda++;
+        }
+        if (in_coda == 0) continue;
+
+        int esito = ScambiaRichieste(sock, echoServAddr, &stima, richieste, in_coda);
+        if (esito == -2) printf("Il server non supporta il protocollo senza stato.\n");
+        if (esito < 0) return -1;
+
+        for (i = 0; i < in_coda; i++)
+        {
+            Richiesta *richiesta = &richieste[i];
+            op = (char)richiesta->datagramma[2];
+            if (richiesta->lunghezza_risposta < 0)
+            {
+                printf("%ld %c %ld: nessuna risposta dopo %d tentativi\n", operandi[i][0], op, operandi[i][1], MAX_TENTATIVI);
+                senza_risposta++;
+            }
+            else if (richiesta->lunghezza_risposta == DIM_INTESTAZIONE + 4)
+            {
+                memcpy(&risultato, richiesta->risposta + DIM_INTESTAZIONE, sizeof(risultato));
+                printf("%ld %c %ld = %d%s\n", operandi[i][0], op, operandi[i][1], (int32_t)ntohl(risultato),
+                       richiesta->risposta[3] == ESITO_DIVISIONE_PER_ZERO ? " (divisione per zero)" : "");
+            }
+            else if (richiesta->risposta[3] == ESITO_LIMITE_SUPERATO)
+                printf("%ld %c %ld: scartata, limite di frequenza superato\n", operandi[i][0], op, operandi[i][1]);
+            else printf("%ld %c %ld: esito %d\n", operandi[i][0], op, operandi[i][1], richiesta->risposta[3]);
+        }
+        totale += in_coda;
+    }
+
+    printf("%ld operazioni, %ld senza risposta, %lu ritrasmissioni. RTT stimato %.3f ms (variazione %.3f ms), RTO %.0f ms.\n",
+           totale, senza_risposta, stima.ritrasmissioni, stima.srtt, stima.rttvar, stima.rto);
+    return senza_risposta == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) 
 {
     /* Inizializzazione Winsock (solo Windows): WSAStartup deve essere chiamato prima
        di usare le socket su Windows. Su Unix questa sezione viene ignorata. */
@@ -61,6 +440,21 @@ int main(void)
     }
 #endif
 
+    /* Opzioni: -b batch di coppie con una sola operazione, -l vecchio protocollo in due scambi,
+       -f flusso di operazioni con piu' richieste in volo */
+    bool batch = (argc > 1 && strcmp(argv[1], "-b") == 0);
+    bool vecchio_protocollo = (argc > 1 && strcmp(argv[1], "-l") == 0);
+    bool flusso = (argc > 1 && strcmp(argv[1], "-f") == 0);
+    if (argc > 2 || (argc > 1 && !batch && !vecchio_protocollo && !flusso))
+    {
+        printf("Uso: %s [-b | -l | -f]\n"
+               "  -b  batch: una sola operazione applicata a molte coppie di operandi\n"
+               "  -l  vecchio protocollo: operazione e operandi in due datagram separati\n"
+               "  -f  flusso: un'operazione per riga, fino a %d richieste in volo con ritrasmissione\n", argv[0], MAX_IN_VOLO);
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
+
     /* Variabili principali del client */
     int sock;                           /* descrittore della socket UDP */
     struct sockaddr_in echoServAddr;    /* indirizzo del server (IP + porta) */
@@ -102,10 +496,67 @@ int main(void)
     /* Messaggio informativo all'utente su dove verra' inviato il pacchetto */
     printf("Invio al server IP: %s sulla porta %d...\n", inet_ntoa(echoServAddr.sin_addr), PORT);
 
+    if (flusso)
+    {
+        int esito = FlussoClient(sock, &echoServAddr);
+        closesocket(sock);
+        ClearWinSock();
+        return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (batch)
+    {
+        /* Il server conferma con BATCH_STRING; un server che non supporta il batch risponde EXIT_STRING */
+        operation_char = OP_BATCH;
+        fromSize = sizeof(fromAddr);
+        if (sendto(sock, &operation_char, 1, 0, (struct sockaddr *)&echoServAddr, sizeof(echoServAddr)) != 1
+            || (respStringLen = recvfrom(sock, response_string, ECHOMAX - 1, 0, (struct sockaddr *)&fromAddr, &fromSize)) < 0)
+        {
+            ErrorHandler("sendto() o recvfrom() fallita (apertura batch)\n");
+            closesocket(sock);
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        response_string[respStringLen] = '\0';
+        int esito = -1;
+        if (strcmp(response_string, BATCH_STRING) == 0) esito = BatchClient(sock, &echoServAddr);
+        else printf("Il server non supporta il batch (risposta: %s).\n", response_string);
+
+        closesocket(sock);
+        ClearWinSock();
+        return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     /* Lettura dell'operazione da inviare: A,S,M,D */
     printf("Inserisci l'operazione (A=Addizione, S=Sottrazione, M=Moltiplicazione, D=Divisione):\n");
     scanf(" %c", &operation_char); /* spazio prima di %c per saltare whitespace */
 
+    /* Protocollo senza stato: gli operandi si chiedono subito, la richiesta parte in un solo datagram.
+       Se il server conosce solo il vecchio protocollo si prosegue con quello, riusando gli operandi gia' letti. */
+    long op1, op2;
+    bool operandi_letti = false;
+    if (!vecchio_protocollo)
+    {
+        printf("Inserisci due interi (separati da spazio): ");
+        if (scanf("%ld %ld", &op1, &op2) != 2) 
+        {
+             ErrorHandler("Input non valido, terminazione.\n");
+             closesocket(sock);
+             ClearWinSock();
+             return EXIT_FAILURE;
+        }
+        operandi_letti = true;
+
+        int esito = RichiestaSenzaStato(sock, &echoServAddr, operation_char, op1, op2);
+        if (esito != 1)
+        {
+            closesocket(sock);
+            ClearWinSock();
+            return esito == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        printf("Il server non supporta il protocollo senza stato: uso il vecchio protocollo.\n");
+    }
+
     /* Invio del singolo carattere che indica l'operazione al server con sendto() */
 
     /* FUNZIONE SENDTO:
@@ -162,13 +613,16 @@ int main(void)
     {
         printf("Ricevuta indicazione di terminazione dal server. Chiusura del client.\n");
     } 
+    else if (strcmp(response_string, LIMIT_STRING) == 0)
+    {
+        printf("Troppe richieste da questo indirizzo: riprovare piu' tardi.\n");
+    }
     
     else 
     {
-        /* Altrimenti la procedura continua: il client chiede due interi e li invia al server */
-        long op1, op2;
-        printf("Inserisci due interi (separati da spazio): ");
-        if (scanf("%ld %ld", &op1, &op2) != 2) 
+        /* Altrimenti la procedura continua: il client chiede due interi (se non gia' letti) e li invia al server */
+        if (!operandi_letti) printf("Inserisci due interi (separati da spazio): ");
+        if (!operandi_letti && scanf("%ld %ld", &op1, &op2) != 2) 
         {
              ErrorHandler("Input non valido, terminazione.\n");
              closesocket(sock);
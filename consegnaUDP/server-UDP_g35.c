@@ -1,3 +1,7 @@
+#if defined (__linux__)
+#define _GNU_SOURCE                /* necessario per recvmmsg(), sendmmsg() e pthread_setaffinity_np() */
+#endif
+
 #if defined (_WIN32)
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -10,10 +14,20 @@
 #define closesocket close
 #endif
 
+#if defined (__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
 /*
   Server UDP per la calcolatrice: riceve l'operazione richiesta dal client,
   invia una conferma (o la stringa di terminazione), riceve gli operandi,
   calcola il risultato e lo invia indietro.
+  Con il protocollo senza stato (comune/protocollo_g35.h) richiesta e risposta stanno ciascuna
+  in un solo datagram; il vecchio protocollo in due scambi resta supportato.
 */
 
 /*
@@ -29,6 +43,18 @@ sta nell'uso delle funzioni di invio e ricezione dei dati.
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
+
+#include "../comune/calcolo_g35.h"   /* calcolo delle operazioni (singole e batch SIMD), condiviso con il server TCP */
+#include "../comune/protocollo_g35.h" /* messaggi binari del protocollo senza stato */
+#include "../comune/metriche_g35.h"   /* durata delle fasi e contatori, esportati su socket di amministrazione e SIGUSR1 */
+#include "../comune/registro_g35.h"   /* messaggi scritti da un thread in background invece che con printf() */
+#if defined (__linux__)
+#include "../comune/limitatore_g35.h" /* limite di richieste e byte al secondo per indirizzo del client (-L) */
+#include "../comune/pipeline_g35.h"   /* thread di calcolo per le richieste pesanti (-C) */
+#include "../comune/pool_g35.h"       /* buffer dei lavori della pipeline, riusati invece di chiederli all'heap */
+#include "../comune/cattura_g35.h"    /* cattura delle richieste in un file mappato in memoria, per riprodurle (-R) */
+#endif
 
 
 /* Inclusioni specifiche per sockets:
@@ -42,11 +68,90 @@ sta nell'uso delle funzioni di invio e ricezione dei dati.
 #define PORT 48000                 /* porta su cui il server UDP ascolta */
 #define ECHOMAX 255                /* dimensione massima dei messaggi di testo */
 #define EXIT_STRING "TERMINE PROCESSO CLIENT" /* stringa che indica terminazione dal client */
+#define LIMIT_STRING "LIMITE SUPERATO" /* risposta all'operazione del vecchio protocollo oltre il limite per indirizzo (-L) */
+#define MAX_DATAGRAMMA 65507       /* massimo carico utile di un datagram UDP su IPv4 */
+#define MAX_BATCH_UDP ((MAX_DATAGRAMMA - DIM_INTESTAZIONE_BATCH) / 8)  /* coppie che entrano in un datagram */
+#define MAX_COPPIE_PROTOCOLLO ((MAX_DATAGRAMMA - DIM_INTESTAZIONE - 4) / 8) /* coppie di un batch nel protocollo senza stato */
+#define INTERVALLO_STATISTICHE 10  /* secondi fra due stampe delle statistiche */
+#define DIM_LOTTO_DEFAULT 32       /* datagram per recvmmsg()/sendmmsg() se -m non indica un numero */
+#define MAX_LOTTO 1024             /* limite della dimensione del lotto */
+#define MAX_WORKER 256             /* limite dei worker della modalita' multi-core */
+#define DIM_CONTROLLO 64           /* spazio per i messaggi di controllo di un datagram */
+#define MAX_ATTESE 256             /* client del vecchio protocollo che attendono di inviare gli operandi */
+#define PORTA_METRICHE 48002       /* porta di default dell'endpoint delle metriche (-a) */
+#define MAX_DUPLICATI 256          /* risposte conservate per le ritrasmissioni dei client */
+#define MAX_RISPOSTA_DUPLICATO 256 /* byte massimi di una risposta conservata */
+#define DURATA_DUPLICATO 30        /* secondi per cui una risposta resta valida (oltre i tentativi del client) */
+
+/* Fasi misurate dalle metriche. La ricezione comprende l'attesa del datagram; nel ciclo a lotti ricezione e invio
+   si misurano per chiamata (un lotto), il calcolo per datagram. */
+enum { FASE_RICEZIONE, FASE_CALCOLO, FASE_INVIO, NUM_FASI };
+static const char *const nomi_fasi[NUM_FASI] = { "ricezione", "calcolo", "invio" };
+
+#if defined (__linux__)
+/* Limite per indirizzo impostato con -L, una sola tabella per tutti i worker (NULL = nessun limite) */
+static Limitatore *limitatore = NULL;
+/* Thread di calcolo avviati con -C, condivisi da tutti i cicli a lotti (NULL = calcolo sul posto) */
+static PipelineCalcolo *pipeline = NULL;
+#endif
+
+/* Vecchio protocollo (operazione e operandi in due datagram): operazione in sospeso di un client.
+   Le attese stanno in una tabella di MAX_ATTESE posti ad accesso diretto, indicizzata da indirizzo e porta:
+   in caso di collisione il client piu' recente prende il posto del precedente, i cui operandi verranno scartati. */
+typedef struct
+{
+    struct sockaddr_in client;
+    char operation_char;
+    bool attiva;
+} Attesa;
+
+/* Protocollo senza stato: risposta gia' inviata a una richiesta, per servire le ritrasmissioni del client senza
+   ricalcolarla. Le risposte stanno in una tabella di MAX_DUPLICATI posti ad accesso diretto, indicizzata da indirizzo,
+   porta e id della richiesta: in caso di collisione la risposta piu' recente prende il posto della precedente.
+   Le risposte piu' lunghe di MAX_RISPOSTA_DUPLICATO byte (batch, numeri grandi) non si conservano: una ritrasmissione
+   le ricalcola, con lo stesso risultato perche' la risposta dipende solo dal datagram. */
+typedef struct
+{
+    struct sockaddr_in client;
+    uint32_t id;
+    uint32_t lunghezza_richiesta;  /* con l'operazione, distingue un id riusato da una ritrasmissione */
+    uint8_t operazione;
+    time_t scadenza;
+    int lunghezza;                 /* lunghezza della risposta, 0 se il posto e' libero */
+    char risposta[MAX_RISPOSTA_DUPLICATO];
+} Duplicato;
+
+/* I contatori sono scritti solo dal thread che serve la socket; nella modalita' multi-core li legge anche
+   il thread principale, quindi su Linux sono atomici (accessi relaxed, nessun lock) */
+#if defined (__linux__)
+typedef atomic_ulong Contatore;
+#define LEGGI_CONTATORE(contatore) atomic_load_explicit(&(contatore), memory_order_relaxed)
+#define AGGIORNA_CONTATORE(contatore, delta) \
+    atomic_store_explicit(&(contatore), LEGGI_CONTATORE(contatore) + (delta), memory_order_relaxed)
+#define IMPOSTA_CONTATORE(contatore, valore) atomic_store_explicit(&(contatore), (valore), memory_order_relaxed)
+#else
+typedef unsigned long Contatore;
+#define LEGGI_CONTATORE(contatore) (contatore)
+#define AGGIORNA_CONTATORE(contatore, delta) ((contatore) += (delta))
+#define IMPOSTA_CONTATORE(contatore, valore) ((contatore) = (valore))
+#endif
+
+/* Contatori del server, stampati ogni INTERVALLO_STATISTICHE secondi */
+typedef struct
+{
+    Contatore datagrammi;          /* datagram ricevuti */
+    Contatore risposte;            /* datagram di risposta inviati */
+    Contatore chiamate;            /* chiamate di sistema di ricezione e di invio */
+    Contatore scartati;            /* datagram scartati dal kernel per buffer di ricezione pieno (SO_RXQ_OVFL) */
+    unsigned long ultima_stampa;   /* datagrammi alla stampa precedente */
+    time_t prossima_stampa;
+    Metriche *metriche;            /* fasi e contatori per operazione, esportati da comune/metriche_g35.h */
+} Statistiche;
 
 /* Stampa messaggi di errore ricevuti come stringa */
 void ErrorHandler(char *errorMessage) 
 {
-    printf("%s", errorMessage);
+    REGISTRA(LIVELLO_ERRORE, "%s", errorMessage);
 }
 
 /* Pulisce le risorse di Winsock su Windows; no-op su Unix */
@@ -57,6 +162,721 @@ void ClearWinSock()
 #endif
 }
 
+/* Batch: il datagram contiene intestazione e coppie (formato in calcolo_g35.h), la risposta n e gli n risultati.
+   Restituisce la lunghezza della risposta preparata in 'risposta'. */
+int EseguiBatchUDP(Metriche *metriche, const char *datagramma, int len, char *risposta)
+{
+    uint32_t n = 0, net_n;
+    char op = datagramma[0];
+
+    if (len >= DIM_INTESTAZIONE_BATCH)
+    {
+        memcpy(&net_n, datagramma + 4, sizeof(net_n));
+        n = ntohl(net_n);
+    }
+    if (len < DIM_INTESTAZIONE_BATCH || !OperazioneValida(op) || n == 0 || n > MAX_BATCH_UDP
+        || len != (int)(DIM_INTESTAZIONE_BATCH + n * 8))
+    {
+        REGISTRA(LIVELLO_AVVISO, "Richiesta batch non valida (%d byte)\n", len);
+        memset(risposta, 0, sizeof(uint32_t));
+        return sizeof(uint32_t);
+    }
+
+    CatturaBatch(op, n, datagramma + DIM_INTESTAZIONE_BATCH);
+    uint32_t zeri = CalcolaBatch(op, datagramma + DIM_INTESTAZIONE_BATCH, risposta + sizeof(uint32_t), n);
+    AggiornaMetrica(&metriche->divisioni_per_zero, zeri);
+    net_n = htonl(n);
+    memcpy(risposta, &net_n, sizeof(net_n));
+
+    if (zeri > 0) REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Batch: %u operazioni '%c' (%u divisioni per zero, risultato 0)\n", n, op, zeri);
+    else REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Batch: %u operazioni '%c'\n", n, op);
+    return (int)((n + 1) * sizeof(uint32_t));
+}
+
+/* Posto della tabella delle attese associato al client */
+Attesa *CercaAttesa(Attesa *attese, const struct sockaddr_in *client)
+{
+    uint32_t chiave = client->sin_addr.s_addr * 2654435761u ^ client->sin_port;
+    return &attese[chiave % MAX_ATTESE];
+}
+
+/* Posto della tabella delle risposte associato alla richiesta 'id' del client */
+Duplicato *CercaDuplicato(Duplicato *duplicati, const struct sockaddr_in *client, uint32_t id)
+{
+    uint32_t chiave = (client->sin_addr.s_addr * 2654435761u ^ client->sin_port) + id * 0x9E3779B9u;
+    return &duplicati[(chiave ^ (chiave >> 16)) % MAX_DUPLICATI];
+}
+
+/* 1 se 'duplicato' contiene la risposta, ancora valida, proprio a questa richiesta del client */
+int RispostaConservata(const Duplicato *duplicato, const struct sockaddr_in *client, const Intestazione *richiesta, time_t ora)
+{
+    return duplicato->lunghezza > 0 && duplicato->id == richiesta->id && ora < duplicato->scadenza
+           && duplicato->client.sin_addr.s_addr == client->sin_addr.s_addr && duplicato->client.sin_port == client->sin_port
+           && duplicato->operazione == richiesta->operazione && duplicato->lunghezza_richiesta == richiesta->lunghezza;
+}
+
+/* Conserva nel posto 'duplicato' la risposta alla richiesta del client, se e' abbastanza corta */
+void ConservaRisposta(Duplicato *duplicato, const struct sockaddr_in *client, const Intestazione *richiesta, time_t ora,
+                      const char *risposta, int lunghezza)
+{
+    if (lunghezza > MAX_RISPOSTA_DUPLICATO) return;
+    duplicato->client = *client;
+    duplicato->id = richiesta->id;
+    duplicato->lunghezza_richiesta = richiesta->lunghezza;
+    duplicato->operazione = richiesta->operazione;
+    duplicato->scadenza = ora + DURATA_DUPLICATO;
+    duplicato->lunghezza = lunghezza;
+    memcpy(duplicato->risposta, risposta, (size_t)lunghezza);
+}
+
+/* 1 se 'attesa' contiene un'operazione in sospeso proprio di questo client */
+int AttesaDelClient(const Attesa *attesa, const struct sockaddr_in *client)
+{
+    return attesa->attiva && attesa->client.sin_addr.s_addr == client->sin_addr.s_addr
+           && attesa->client.sin_port == client->sin_port;
+}
+
+/* Protocollo senza stato: la risposta dipende solo dal datagram ricevuto. Restituisce la lunghezza della risposta. */
+int RispondiDatagramma(Metriche *metriche, const Intestazione *richiesta, const char *datagramma, int len, char *risposta)
+{
+    int lunghezza;
+
+    if (richiesta->operazione != OP_NEGOZIAZIONE)
+        ContaOperazione(metriche, OperazioneMetrica(richiesta));
+
+    /* Il carico utile deve occupare esattamente il resto del datagram */
+    if (richiesta->lunghezza != (uint32_t)(len - DIM_INTESTAZIONE))
+    {
+        AggiornaMetrica(&metriche->letture_corte, 1);
+        ScriviIntestazione((unsigned char *)risposta, richiesta->operazione, ESITO_RICHIESTA_MALFORMATA, 0, richiesta->id);
+        lunghezza = DIM_INTESTAZIONE;
+    }
+    else lunghezza = RispondiRichiesta(richiesta, (const unsigned char *)datagramma + DIM_INTESTAZIONE,
+                                       (unsigned char *)risposta, MAX_COPPIE_PROTOCOLLO);
+
+    AggiornaMetrica(&metriche->divisioni_per_zero,
+                    DivisioniPerZero(richiesta, (const unsigned char *)datagramma + DIM_INTESTAZIONE, (const unsigned char *)risposta));
+
+    REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Richiesta %u: op '%c'%s, esito %d\n", richiesta->id, richiesta->operazione,
+           (richiesta->flag_esito & FLAG_BATCH) ? " (batch)" : "", risposta[3]);
+    return lunghezza;
+}
+
+/* 1 se il client ha superato il limite di -L con un datagram di 'byte' byte, che altrimenti gli viene addebitato.
+   Solo Linux: altrove -L non e' disponibile e il limite non scatta mai. */
+int LimiteSuperato(const struct sockaddr_in *client, int byte)
+{
+#if defined (__linux__)
+    return limitatore != NULL && !AmmessoDalLimitatore(limitatore, client->sin_addr.s_addr, (uint64_t)byte, OraMetriche());
+#else
+    (void)client; (void)byte;
+    return 0;
+#endif
+}
+
+/*
+  Gestisce un datagram ricevuto da 'client' e prepara in 'risposta' (almeno MAX_DATAGRAMMA byte) il datagram da inviare.
+  'attese' e' la tabella delle operazioni in sospeso del vecchio protocollo, 'duplicati' quella delle risposte gia'
+  inviate con il protocollo senza stato.
+  Con -L ogni datagram (anche una ritrasmissione) costa una richiesta e la sua lunghezza in byte: oltre il limite si
+  risponde con la sola intestazione ESITO_LIMITE_SUPERATO, o con LIMIT_STRING all'operazione del vecchio protocollo, di
+  cui si scartano invece gli operandi (il client li ritrasmette o rinuncia). Nessun calcolo e nessuna risposta conservata.
+  Con -R le richieste del protocollo senza stato si catturano tutte, anche quelle oltre il limite e le ritrasmissioni;
+  quelle del vecchio protocollo quando arrivano operandi validi.
+  Con 'da_delegare' (ciclo a lotti con -C) una richiesta pesante del protocollo senza stato che non e' una ritrasmissione
+  gia' servita non viene calcolata: *da_delegare diventa 1 e si restituisce 0.
+  Restituisce la lunghezza della risposta, 0 se non c'e' niente da inviare.
+*/
+int ElaboraDatagramma(Metriche *metriche, Attesa *attese, Duplicato *duplicati, const char *datagramma, int len,
+                      const struct sockaddr_in *client, char *risposta, int *da_delegare)
+{
+    Intestazione intestazione;           /* protocollo senza stato: intestazione della richiesta */
+    char operation_char;                 /* operazione richiesta (carattere) */
+    int operands[2];                     /* operandi inviati dal client */
+    long result = 0;                     /* risultato dell'operazione */
+    int senza_stato = LeggiIntestazione((const unsigned char *)datagramma, len, &intestazione);
+
+    /* Informazione su quale client abbiamo appena ricevuto */
+    REGISTRA_CAMPIONE(LIVELLO_CONNESSIONE, "\nGestione client %u.%u.%u.%u\n", INDIRIZZO_IPV4(client->sin_addr));
+    OrigineCattura(TRASPORTO_UDP, client->sin_addr.s_addr, client->sin_port);
+    if (senza_stato && intestazione.operazione != OP_NEGOZIAZIONE) CatturaMessaggio(FORMATO_BINARIO, datagramma, (uint32_t)len);
+
+    if (LimiteSuperato(client, len))
+    {
+        AggiornaMetrica(&metriche->scarti[SCARTO_LIMITE_INDIRIZZO], 1);
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Datagram scartato: limite di frequenza del client superato\n");
+        if (senza_stato)
+        {
+            ScriviIntestazione((unsigned char *)risposta, intestazione.operazione, ESITO_LIMITE_SUPERATO, 0, intestazione.id);
+            return DIM_INTESTAZIONE;
+        }
+        if (len == 1)
+        {
+            strcpy(risposta, LIMIT_STRING);
+            return (int)strlen(risposta) + 1;
+        }
+        Attesa *attesa = CercaAttesa(attese, client);
+        if (AttesaDelClient(attesa, client)) attesa->attiva = false;
+        return 0;
+    }
+
+    /* Protocollo senza stato: richiesta completa (intestazione + operandi) in un solo datagram, risposta in un solo datagram */
+    if (senza_stato)
+    {
+        if (intestazione.operazione == OP_NEGOZIAZIONE) return RispondiDatagramma(metriche, &intestazione, datagramma, len, risposta);
+
+        /* Una ritrasmissione del client (stesso indirizzo, porta e id) riceve la risposta gia' calcolata */
+        Duplicato *duplicato = CercaDuplicato(duplicati, client, intestazione.id);
+        time_t ora = time(NULL);
+        if (RispostaConservata(duplicato, client, &intestazione, ora))
+        {
+            AggiornaMetrica(&metriche->richieste_duplicate, 1);
+            REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Richiesta %u ripetuta: risposta gia' calcolata\n", intestazione.id);
+            memcpy(risposta, duplicato->risposta, (size_t)duplicato->lunghezza);
+            return duplicato->lunghezza;
+        }
+
+        /* Con -C una richiesta pesante non si calcola qui: il chiamante la passa ai thread di calcolo */
+        if (da_delegare != NULL && RichiestaPesante(&intestazione))
+        {
+            *da_delegare = 1;
+            return 0;
+        }
+
+        int lunghezza = RispondiDatagramma(metriche, &intestazione, datagramma, len, risposta);
+        ConservaRisposta(duplicato, client, &intestazione, ora, risposta, lunghezza);
+        return lunghezza;
+    }
+
+    /* Vecchio protocollo: il primo datagram (1 byte) contiene l'operazione, il successivo gli operandi */
+    Attesa *attesa = CercaAttesa(attese, client);
+
+    if (len != 1)
+    {
+        if (!AttesaDelClient(attesa, client))
+        {
+            ErrorHandler("Datagram inatteso: nessuna operazione in sospeso per il client\n");
+            return 0;
+        }
+        operation_char = attesa->operation_char;
+        attesa->attiva = false;
+
+        /* Batch: il datagram contiene operazione, numero di coppie e coppie; la risposta e' un solo datagram */
+        if (operation_char == 'B' || operation_char == 'b')
+        {
+            return EseguiBatchUDP(metriche, datagramma, len, risposta);
+        }
+
+        /* Controllo che la dimensione ricevuta sia corretta (due int) */
+        if (len != (int)(sizeof(int) * 2)) 
+        {
+            AggiornaMetrica(&metriche->letture_corte, 1);
+            ErrorHandler("Dimensione operandi errata\n");
+            return 0; /* si torna a ricevere una nuova richiesta */
+        }
+        memcpy(operands, datagramma, sizeof(int) * 2);
+        CatturaOperazione(FORMATO_SINGOLA, operation_char, operands);
+
+        /* Convertiamo gli operandi da network byte order a host order prima dell'operazione */
+        long op1 = ntohl(operands[0]);
+        long op2 = ntohl(operands[1]);
+
+        /* Calcolo dell'operazione richiesta */
+        switch (operation_char) 
+        {
+            case 'A': case 'a': result = op1 + op2; break;
+            case 'S': case 's': result = op1 - op2; break;
+            case 'M': case 'm': result = op1 * op2; break;
+            case 'D': case 'd':
+                if (op2 != 0)
+                    result = op1 / op2;
+                else {
+                    AggiornaMetrica(&metriche->divisioni_per_zero, 1);
+                    result = 0; /* gestione semplice divisione per zero */
+                    REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Errore: divisione per zero.\n");
+                }
+                break;
+        }
+
+        /* Stampa diagnostica del calcolo effettuato */
+        REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Calcolo: %ld %c %ld = %ld\n", op1, operation_char, op2, result);
+
+        /* Risultato in network byte order */
+        long net_result = htonl(result);
+        memcpy(risposta, &net_result, sizeof(long));
+        return (int)sizeof(long);
+    }
+
+    /* Determina quale operazione e prepara la stringa di risposta */
+    operation_char = datagramma[0];
+    ContaOperazione(metriche, operation_char);
+    bool valid_operation = true;
+    switch (operation_char) 
+    {
+        case 'A': case 'a':
+            strcpy(risposta, "ADDIZIONE");
+            break;
+        case 'S': case 's':
+            strcpy(risposta, "SOTTRAZIONE");
+            break;
+        case 'M': case 'm':
+            strcpy(risposta, "MOLTIPLICAZIONE");
+            break;
+        case 'D': case 'd':
+            strcpy(risposta, "DIVISIONE");
+            break;
+        case 'B': case 'b':   /* OP_BATCH */
+            strcpy(risposta, BATCH_STRING);
+            break;
+        default:
+            /* Carattere non riconosciuto: chiediamo al client di terminare */
+            strcpy(risposta, EXIT_STRING);
+            valid_operation = false;
+            break;
+    }
+
+    /* Se l'operazione e' valida, il client inviera' gli operandi (o il batch) in un datagram successivo:
+       memorizziamo l'operazione e torniamo subito a servire gli altri datagram. Un'operazione non valida annulla solo
+       quella in sospeso dello stesso client: se il posto e' di un altro client che ha lo stesso hash, resta sua */
+    if (valid_operation)
+    {
+        attesa->attiva = true;
+        attesa->client = *client;
+        attesa->operation_char = operation_char;
+    }
+    else if (AttesaDelClient(attesa, client)) attesa->attiva = false;
+
+    /* Stampa diagnostica della stringa di conferma/terminazione da inviare al client */
+    REGISTRA_CAMPIONE(LIVELLO_RICHIESTA, "Ricevuta op: '%c', Invio indietro: '%s'\n", operation_char, risposta);
+    return (int)strlen(risposta) + 1;
+}
+
+/* Ogni INTERVALLO_STATISTICHE secondi, se nel frattempo sono arrivati datagram, stampa i contatori */
+void StampaStatistiche(Statistiche *statistiche)
+{
+    time_t ora = time(NULL);
+
+    unsigned long datagrammi = LEGGI_CONTATORE(statistiche->datagrammi);
+
+    if (ora < statistiche->prossima_stampa) return;
+    statistiche->prossima_stampa = ora + INTERVALLO_STATISTICHE;
+    if (datagrammi == statistiche->ultima_stampa) return;
+    statistiche->ultima_stampa = datagrammi;
+
+    printf("\n--- Statistiche: %lu datagram ricevuti, %lu risposte, %lu chiamate di sistema (%.3f per richiesta), %lu scartati dal kernel ---\n",
+           datagrammi, LEGGI_CONTATORE(statistiche->risposte), LEGGI_CONTATORE(statistiche->chiamate),
+           (double)LEGGI_CONTATORE(statistiche->chiamate) / datagrammi, LEGGI_CONTATORE(statistiche->scartati));
+}
+
+/* Dimensiona il buffer di ricezione della socket (0 = default del sistema) e, su Linux, chiede al kernel
+   di allegare ai datagram ricevuti il numero di datagram scartati dalla socket (SO_RXQ_OVFL) */
+void ConfiguraRicezione(int sock, int dim_buffer)
+{
+    int valore;
+    socklen_t lunghezza = sizeof(valore);
+
+    if (dim_buffer > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&dim_buffer, sizeof(dim_buffer)) < 0)
+    {
+        ErrorHandler("setsockopt(SO_RCVBUF) fallita\n");
+    }
+#if defined (__linux__)
+    valore = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &valore, sizeof(valore)) < 0)
+    {
+        ErrorHandler("setsockopt(SO_RXQ_OVFL) fallita\n");
+    }
+#endif
+    /* Il kernel puo' arrotondare o limitare la dimensione richiesta (su Linux la raddoppia, entro net.core.rmem_max) */
+    if (dim_buffer > 0 && getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char *)&valore, &lunghezza) == 0)
+    {
+        printf("Buffer di ricezione della socket: %d byte.\n", valore);
+    }
+}
+
+#if defined (__linux__)
+/* Worker della modalita' multi-core: una socket SO_REUSEPORT servita da un thread */
+typedef struct
+{
+    int id;
+    int sock;
+    int cpu;                           /* core su cui e' fissato il thread, -1 se non fissato */
+    int dim_lotto;
+    pthread_t thread;
+    Attesa attese[MAX_ATTESE];         /* il kernel manda i datagram di un client sempre alla stessa socket */
+    Duplicato duplicati[MAX_DUPLICATI];
+    Statistiche statistiche;
+} Worker;
+
+/* Il messaggio di controllo SO_RXQ_OVFL contiene il totale dei datagram scartati dalla socket fino a quel momento */
+void LeggiScartati(struct msghdr *messaggio, Statistiche *statistiche)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(messaggio); cmsg != NULL; cmsg = CMSG_NXTHDR(messaggio, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            uint32_t scartati;
+            memcpy(&scartati, CMSG_DATA(cmsg), sizeof(scartati));
+            IMPOSTA_CONTATORE(statistiche->scartati, scartati);
+        }
+    }
+}
+
+/* -C: richiesta pesante in calcolo su un thread della pipeline. Il datagram e' copiato (il buffer del lotto si riusa
+   alla recvmmsg() successiva) e la risposta, fino a MAX_DATAGRAMMA byte, si scrive dopo di esso. */
+typedef struct
+{
+    LavoroPipeline lavoro;
+    struct sockaddr_in client;
+    Intestazione intestazione;
+    int len;                           /* lunghezza del datagram */
+    int lunghezza;                     /* lunghezza della risposta, scritta dal thread di calcolo */
+    char datagramma[];                 /* datagram, poi risposta */
+} LavoroUDP;
+
+/* Byte del lavoro per un datagram di 'len' byte, da PrendiBufferPool() e RendiBufferPool() */
+size_t DimensioneLavoroUDP(int len)
+{
+    return sizeof(LavoroUDP) + (size_t)len + MAX_DATAGRAMMA;
+}
+
+/* Eseguita da un thread di calcolo: 'metriche' e' l'insieme del thread, che conta anche l'operazione */
+void CalcolaDatagramma(LavoroPipeline *lavoro, Metriche *metriche)
+{
+    LavoroUDP *udp = (LavoroUDP *)lavoro;
+    udp->lunghezza = RispondiDatagramma(metriche, &udp->intestazione, udp->datagramma, udp->len, udp->datagramma + udp->len);
+}
+
+/* Passa ai thread di calcolo la richiesta pesante 'datagramma' del client. Restituisce 0 se e' partita; se la pipeline
+   e' piena (o manca la memoria) la calcola sul posto in 'risposta' e ne restituisce la lunghezza, come senza -C. */
+int DelegaDatagramma(CompletamentiPipeline *completamenti, PoolBuffer *lavori, Duplicato *duplicati, const char *datagramma, int len,
+                     const struct sockaddr_in *client, char *risposta)
+{
+    LavoroUDP *udp = PrendiBufferPool(lavori, DimensioneLavoroUDP(len));
+    Intestazione intestazione = { 0 };   /* gia' validata da ElaboraDatagramma() */
+    int lunghezza;
+
+    LeggiIntestazione((const unsigned char *)datagramma, len, &intestazione);
+    if (udp != NULL)
+    {
+        udp->client = *client;
+        udp->intestazione = intestazione;
+        udp->len = len;
+        memcpy(udp->datagramma, datagramma, (size_t)len);
+        if (InviaLavoro(completamenti, &udp->lavoro)) return 0;
+        RendiBufferPool(lavori, udp, DimensioneLavoroUDP(len));
+    }
+    lunghezza = RispondiDatagramma(completamenti->metriche, &intestazione, datagramma, len, risposta);
+    ConservaRisposta(CercaDuplicato(duplicati, client, intestazione.id), client, &intestazione, time(NULL), risposta, lunghezza);
+    return lunghezza;
+}
+
+/* -C, eventfd dei completamenti leggibile: invia le risposte calcolate dai thread della pipeline e le conserva per le
+   ritrasmissioni. Una ritrasmissione arrivata mentre l'originale era in calcolo e' stata calcolata di nuovo: il client
+   riceve due risposte uguali e tiene la prima. */
+void InviaCalcolati(int sock, CompletamentiPipeline *completamenti, PoolBuffer *lavori, Duplicato *duplicati, Statistiche *statistiche)
+{
+    LavoroPipeline *lavoro;
+    time_t ora = time(NULL);
+
+    RiarmaCompletamenti(completamenti);
+    AGGIORNA_CONTATORE(statistiche->chiamate, 1);
+    while ((lavoro = ProssimoCompletamento(completamenti)) != NULL)
+    {
+        LavoroUDP *udp = (LavoroUDP *)lavoro;
+        const char *risposta = udp->datagramma + udp->len;
+
+        ConservaRisposta(CercaDuplicato(duplicati, &udp->client, udp->intestazione.id), &udp->client, &udp->intestazione, ora,
+                         risposta, udp->lunghezza);
+        if (sendto(sock, risposta, (size_t)udp->lunghezza, 0, (struct sockaddr *)&udp->client, sizeof(udp->client)) != udp->lunghezza)
+        {
+            AggiornaMetrica(&statistiche->metriche->invii_falliti, 1);
+            ErrorHandler("sendto() fallita invio risposta calcolata\n");
+        }
+        else AGGIORNA_CONTATORE(statistiche->risposte, 1);
+        AGGIORNA_CONTATORE(statistiche->chiamate, 1);
+        AggiornaMetrica(&statistiche->metriche->chiamate_sistema, 1);
+        RendiBufferPool(lavori, udp, DimensioneLavoroUDP(udp->len));
+    }
+}
+
+/*
+  Ciclo con I/O a lotti: una recvmmsg() preleva fino a 'dim_lotto' datagram gia' arrivati (MSG_WAITFORONE: attende
+  solo il primo), i datagram vengono elaborati in ordine e tutte le risposte partono con una sola sendmmsg().
+  Con molti client il numero di chiamate di sistema per richiesta scende da 2 verso 2 / dim_lotto.
+  Con 'stampa' falso le statistiche vengono stampate da un altro thread (modalita' multi-core).
+  Con -C le richieste pesanti passano ai thread di calcolo e le loro risposte partono quando tornano: il ciclo attende
+  con poll() sia la socket sia l'eventfd dei completamenti.
+*/
+int ServerLotti(int sock, int dim_lotto, Attesa *attese, Duplicato *duplicati, Statistiche *statistiche, bool stampa)
+{
+    Metriche *metriche = statistiche->metriche;
+    struct mmsghdr *ricevuti = calloc(dim_lotto, sizeof(struct mmsghdr));
+    struct mmsghdr *risposte = calloc(dim_lotto, sizeof(struct mmsghdr));
+    struct iovec *iov_ricevuti = calloc(dim_lotto, sizeof(struct iovec));
+    struct iovec *iov_risposte = calloc(dim_lotto, sizeof(struct iovec));
+    struct sockaddr_in *mittenti = calloc(dim_lotto, sizeof(struct sockaddr_in));
+    char *controllo = calloc(dim_lotto, DIM_CONTROLLO);   /* messaggi di controllo: contatore SO_RXQ_OVFL */
+    /* Un posto da MAX_DATAGRAMMA per datagram: le pagine vengono occupate solo quando un datagram grande le usa */
+    char *buffer_ricevuti = malloc((size_t)dim_lotto * MAX_DATAGRAMMA);
+    char *buffer_risposte = malloc((size_t)dim_lotto * MAX_DATAGRAMMA);
+    CompletamentiPipeline *completamenti = pipeline != NULL ? CreaCompletamenti(pipeline, metriche) : NULL;
+    PoolBuffer lavori;                 /* -C: lavori in volo verso i thread di calcolo, presi e resi da questo thread */
+    int i;
+
+    if ((pipeline != NULL && completamenti == NULL) || !ricevuti || !risposte || !iov_ricevuti || !iov_risposte || !mittenti || !controllo || !buffer_ricevuti || !buffer_risposte)
+    {
+        ErrorHandler("Memoria insufficiente per il ciclo a lotti\n");
+        free(ricevuti); free(risposte); free(iov_ricevuti); free(iov_risposte);
+        free(mittenti); free(controllo); free(buffer_ricevuti); free(buffer_risposte);
+        return EXIT_FAILURE;
+    }
+
+    if (completamenti != NULL) InizializzaPoolBuffer(&lavori);
+    for (i = 0; i < dim_lotto; i++)
+    {
+        iov_ricevuti[i].iov_base = buffer_ricevuti + (size_t)i * MAX_DATAGRAMMA;
+        iov_ricevuti[i].iov_len = MAX_DATAGRAMMA;
+        ricevuti[i].msg_hdr.msg_iov = &iov_ricevuti[i];
+        ricevuti[i].msg_hdr.msg_iovlen = 1;
+        ricevuti[i].msg_hdr.msg_name = &mittenti[i];
+        ricevuti[i].msg_hdr.msg_control = controllo + (size_t)i * DIM_CONTROLLO;
+    }
+
+    if (stampa) printf("I/O a lotti attivo: fino a %d datagram per recvmmsg()/sendmmsg().\n", dim_lotto);
+
+    while (1)
+    {
+        /* La recvmmsg() sovrascrive le lunghezze di indirizzo e messaggi di controllo: vanno ripristinate a ogni giro */
+        for (i = 0; i < dim_lotto; i++)
+        {
+            ricevuti[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            ricevuti[i].msg_hdr.msg_controllen = DIM_CONTROLLO;
+        }
+
+        uint64_t inizio_fase = OraMetriche();
+        if (completamenti != NULL)
+        {
+            struct pollfd sorgenti[2] = { { sock, POLLIN, 0 }, { completamenti->eventfd, POLLIN, 0 } };
+            int pronte = poll(sorgenti, 2, -1);
+            AGGIORNA_CONTATORE(statistiche->chiamate, 1);
+            AggiornaMetrica(&metriche->chiamate_sistema, 1);
+            if (pronte < 0)
+            {
+                if (errno != EINTR) ErrorHandler("poll() fallita\n");
+                continue;
+            }
+            if (sorgenti[1].revents & POLLIN) InviaCalcolati(sock, completamenti, &lavori, duplicati, statistiche);
+            if (!(sorgenti[0].revents & POLLIN)) continue;
+        }
+        int n = recvmmsg(sock, ricevuti, dim_lotto, MSG_WAITFORONE, NULL);
+        AGGIORNA_CONTATORE(statistiche->chiamate, 1);
+        AggiornaMetrica(&metriche->chiamate_sistema, 1);
+        if (n < 0)
+        {
+            if (errno != EINTR) ErrorHandler("recvmmsg() fallita\n");
+            continue;
+        }
+        inizio_fase = ChiudiFase(metriche, FASE_RICEZIONE, inizio_fase);
+        AGGIORNA_CONTATORE(statistiche->datagrammi, n);
+        LeggiScartati(&ricevuti[n - 1].msg_hdr, statistiche);
+
+        /* Elaborazione in ordine di arrivo (il vecchio protocollo dipende dall'ordine dei datagram di ogni client) */
+        int da_inviare = 0;
+        for (i = 0; i < n; i++)
+        {
+            char *risposta = buffer_risposte + (size_t)da_inviare * MAX_DATAGRAMMA;
+            int da_delegare = 0;
+            int lunghezza = ElaboraDatagramma(metriche, attese, duplicati, iov_ricevuti[i].iov_base, (int)ricevuti[i].msg_len, &mittenti[i], risposta,
+                                              completamenti != NULL ? &da_delegare : NULL);
+            if (da_delegare)
+                lunghezza = DelegaDatagramma(completamenti, &lavori, duplicati, iov_ricevuti[i].iov_base, (int)ricevuti[i].msg_len, &mittenti[i], risposta);
+            inizio_fase = ChiudiFase(metriche, FASE_CALCOLO, inizio_fase);
+            if (lunghezza <= 0) continue;
+
+            iov_risposte[da_inviare].iov_base = risposta;
+            iov_risposte[da_inviare].iov_len = lunghezza;
+            risposte[da_inviare].msg_hdr.msg_iov = &iov_risposte[da_inviare];
+            risposte[da_inviare].msg_hdr.msg_iovlen = 1;
+            risposte[da_inviare].msg_hdr.msg_name = &mittenti[i];
+            risposte[da_inviare].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            da_inviare++;
+        }
+
+        /* La sendmmsg() puo' inviare meno messaggi di quelli richiesti: si riprova con i rimanenti */
+        int inviati = 0;
+        while (inviati < da_inviare)
+        {
+            int esito = sendmmsg(sock, risposte + inviati, da_inviare - inviati, 0);
+            AGGIORNA_CONTATORE(statistiche->chiamate, 1);
+            AggiornaMetrica(&metriche->chiamate_sistema, 1);
+            if (esito < 0)
+            {
+                if (errno == EINTR) continue;
+                AggiornaMetrica(&metriche->invii_falliti, da_inviare - inviati);
+                ErrorHandler("sendmmsg() fallita invio risposte\n");
+                break;
+            }
+            inviati += esito;
+        }
+        AGGIORNA_CONTATORE(statistiche->risposte, inviati);
+        if (inviati > 0) ChiudiFase(metriche, FASE_INVIO, inizio_fase);
+
+        if (stampa) StampaStatistiche(statistiche);
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Corpo del thread di un worker: eventuale affinita' al core, poi il ciclo a lotti sulla propria socket */
+void *ThreadWorker(void *arg)
+{
+    Worker *worker = arg;
+
+    if (worker->cpu >= 0)
+    {
+        cpu_set_t insieme;
+        CPU_ZERO(&insieme);
+        CPU_SET(worker->cpu, &insieme);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(insieme), &insieme) != 0)
+        {
+            printf("Worker %d: impossibile fissare il thread sul core %d.\n", worker->id, worker->cpu);
+        }
+    }
+
+    ServerLotti(worker->sock, worker->dim_lotto, worker->attese, worker->duplicati, &worker->statistiche, false);
+    printf("Worker %d terminato.\n", worker->id);
+    return NULL;
+}
+
+/* Stampa per ogni worker il ritmo di datagram nell'ultimo intervallo e i datagram scartati dal kernel */
+void StampaStatisticheWorker(Worker *workers, int num_worker, unsigned long *precedenti, double secondi)
+{
+    unsigned long totale = 0, scartati = 0;
+    int i;
+
+    for (i = 0; i < num_worker; i++)
+    {
+        totale += LEGGI_CONTATORE(workers[i].statistiche.datagrammi);
+        scartati += LEGGI_CONTATORE(workers[i].statistiche.scartati);
+    }
+
+    printf("\n--- Statistiche worker (%lu datagram totali, %lu scartati dal kernel) ---\n", totale, scartati);
+    for (i = 0; i < num_worker; i++)
+    {
+        Statistiche *statistiche = &workers[i].statistiche;
+        unsigned long datagrammi = LEGGI_CONTATORE(statistiche->datagrammi);
+        unsigned long chiamate = LEGGI_CONTATORE(statistiche->chiamate);
+        printf("Worker %d (core %d): %.0f datagram/s, ricevuti %lu (%.1f%%), risposte %lu, %.3f chiamate per richiesta, scartati %lu\n",
+               workers[i].id, workers[i].cpu, (datagrammi - precedenti[i]) / secondi, datagrammi,
+               totale ? 100.0 * datagrammi / totale : 0.0, LEGGI_CONTATORE(statistiche->risposte),
+               datagrammi ? (double)chiamate / datagrammi : 0.0, LEGGI_CONTATORE(statistiche->scartati));
+        precedenti[i] = datagrammi;
+    }
+}
+
+/* Socket UDP sulla porta del server con SO_REUSEPORT: il kernel distribuisce i datagram fra le socket in base a indirizzo e porta del mittente */
+int CreaSocketCondivisa(int dim_buffer)
+{
+    struct sockaddr_in indirizzo;
+    int attiva = 1;
+    int sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (sock < 0)
+    {
+        ErrorHandler("socket() fallita\n");
+        return -1;
+    }
+
+    /* SO_REUSEPORT va impostata su tutte le socket prima del bind, altrimenti il secondo bind sulla stessa porta fallisce */
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &attiva, sizeof(attiva)) < 0)
+    {
+        ErrorHandler("setsockopt(SO_REUSEPORT) fallita\n");
+        closesocket(sock);
+        return -1;
+    }
+    ConfiguraRicezione(sock, dim_buffer);
+
+    memset(&indirizzo, 0, sizeof(indirizzo));
+    indirizzo.sin_family = AF_INET;
+    indirizzo.sin_port = htons(PORT);
+    indirizzo.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (bind(sock, (struct sockaddr *)&indirizzo, sizeof(indirizzo)) < 0)
+    {
+        ErrorHandler("bind() fallito\n");
+        closesocket(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Avvia num_worker worker (0 = uno per ogni CPU online), ognuno con socket, tabelle delle attese e delle risposte
+   e contatori propri */
+int ServerMultiCore(int num_worker, int fissa_core, int dim_lotto, int dim_buffer)
+{
+    static Worker workers[MAX_WORKER];
+    static unsigned long precedenti[MAX_WORKER];
+    long num_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long ultimo_totale = 0;
+    time_t ultima_stampa = time(NULL);
+    int i;
+
+    if (num_cpu < 1) num_cpu = 1;
+    if (num_worker <= 0) num_worker = (int)num_cpu;
+    if (num_worker > MAX_WORKER) num_worker = MAX_WORKER;
+
+    /* Le socket si creano tutte prima di avviare i thread, cosi' un errore di bind viene segnalato subito */
+    for (i = 0; i < num_worker; i++)
+    {
+        workers[i].id = i;
+        workers[i].cpu = fissa_core ? (int)(i % num_cpu) : -1;
+        workers[i].dim_lotto = dim_lotto;
+        if ((workers[i].statistiche.metriche = NuoveMetriche()) == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per le metriche dei worker\n");
+            while (--i >= 0) closesocket(workers[i].sock);
+            return EXIT_FAILURE;
+        }
+        if ((workers[i].sock = CreaSocketCondivisa(dim_buffer)) < 0)
+        {
+            while (--i >= 0) closesocket(workers[i].sock);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < num_worker; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, ThreadWorker, &workers[i]) != 0)
+        {
+            printf("Impossibile avviare il worker %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("Server UDP in ascolto sulla porta %d con %d worker%s, fino a %d datagram per chiamata.\n",
+           PORT, num_worker, fissa_core ? " fissati ai core" : "", dim_lotto);
+
+    /* Il thread principale non serve client: stampa le statistiche solo se nel frattempo e' arrivato qualcosa */
+    while (1)
+    {
+        unsigned long totale = 0;
+        sleep(INTERVALLO_STATISTICHE);
+        for (i = 0; i < num_worker; i++)
+        {
+            totale += LEGGI_CONTATORE(workers[i].statistiche.datagrammi) + LEGGI_CONTATORE(workers[i].statistiche.scartati);
+        }
+        if (totale != ultimo_totale)
+        {
+            time_t ora = time(NULL);
+            StampaStatisticheWorker(workers, num_worker, precedenti, ora > ultima_stampa ? (double)(ora - ultima_stampa) : 1.0);
+            ultimo_totale = totale;
+            ultima_stampa = ora;
+        }
+        else ultima_stampa = time(NULL);
+    }
+    return EXIT_SUCCESS;
+}
+#endif
+
 int main(int argc, char *argv[]) 
 {
     /* Inizializzazione Winsock (solo Windows): chiamare WSAStartup prima di usare le socket */
@@ -69,16 +889,184 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    /* Opzioni da riga di comando: senza opzioni si usa il ciclo con un datagram per chiamata */
+    int dim_lotto = 0;                   /* -m [N]: datagram per recvmmsg()/sendmmsg(), 0 = ciclo classico */
+    int modalita_worker = 0;             /* -w [N]: N worker con socket e ciclo propri */
+    int num_worker = 0;                  /* 0 = un worker per ogni CPU online */
+    int fissa_core = 0;                  /* -p: ogni worker viene fissato a un core */
+    int dim_buffer = 0;                  /* -r BYTE: buffer di ricezione di ogni socket, 0 = default del sistema */
+    int porta_metriche = 0;              /* -a [PORTA]: endpoint delle metriche, 0 = solo SIGUSR1 */
+    int livello = LIVELLO_RICHIESTA;     /* -v LIVELLO: messaggi registrati (default tutti) */
+    unsigned long campionamento = 1;     /* -c N: un messaggio per richiesta ogni N */
+    uint64_t richieste_limite = 0, byte_limite = 0;   /* -L RICHIESTE[,BYTE]: limite per indirizzo del client */
+    int thread_calcolo = 0;              /* -C N: thread di calcolo per le richieste pesanti, 0 = calcolo sul posto */
+    const char *percorso_cattura = NULL; /* -R FILE: cattura delle richieste ricevute */
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0)
+        {
+            dim_lotto = DIM_LOTTO_DEFAULT;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') dim_lotto = atoi(argv[++i]);
+            if (dim_lotto < 1 || dim_lotto > MAX_LOTTO)
+            {
+                printf("Dimensione del lotto non valida: deve essere fra 1 e %d.\n", MAX_LOTTO);
+                ClearWinSock();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            modalita_worker = 1;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') num_worker = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            fissa_core = 1;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            dim_buffer = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            porta_metriche = PORTA_METRICHE;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') porta_metriche = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '3')
+        {
+            livello = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0)
+        {
+            campionamento = (unsigned long)atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+        {
+            char *resto = argv[++i];
+            richieste_limite = strtoull(resto, &resto, 10);
+            if (*resto == ',') byte_limite = strtoull(resto + 1, NULL, 10);
+        }
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            thread_calcolo = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc)
+        {
+            percorso_cattura = argv[++i];
+        }
+        else
+        {
+            printf("Uso: %s [-m [N]] [-w [N]] [-p] [-r BYTE] [-a [PORTA]] [-v LIVELLO] [-c N] [-L RICHIESTE[,BYTE]] [-C N]\n"
+                   "       [-R FILE]\n", argv[0]);
+            printf("  -m [N]   I/O a lotti: fino a N datagram per recvmmsg()/sendmmsg() (default %d, solo Linux)\n", DIM_LOTTO_DEFAULT);
+            printf("  -w [N]   N worker con SO_REUSEPORT, ognuno con socket e ciclo propri (default: uno per CPU, solo Linux)\n");
+            printf("  -p       con -w, fissa ogni worker a un core\n");
+            printf("  -r BYTE  dimensione del buffer di ricezione (SO_RCVBUF) di ogni socket\n");
+            printf("  -a [PORTA]  metriche in formato Prometheus su http://127.0.0.1:PORTA/metrics (default %d, solo Linux)\n", PORTA_METRICHE);
+            printf("  -v LIVELLO  messaggi registrati: 0 errori, 1 avvisi, 2 client, 3 richieste (default 3)\n");
+            printf("  -c N     registra un messaggio per richiesta ogni N (default 1: tutti)\n");
+            printf("  -L R[,B] limite di R datagram e B byte al secondo per indirizzo del client (0 = nessun limite, solo Linux)\n");
+            printf("  -C N     con -m/-w, N thread di calcolo per batch, numeri grandi ed espressioni (max %d, solo Linux)\n", MAX_THREAD_CALCOLO);
+            printf("  -R FILE  cattura ogni richiesta ricevuta in FILE, da riprodurre con strumenti/riproduci_g35 (solo Linux)\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Metriche: prima di avviare i worker, che ereditano SIGUSR1 bloccato */
+    if (AvviaMetriche("udp", nomi_fasi, NUM_FASI, porta_metriche) < 0)
+    {
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
+    AvviaRegistro(livello, campionamento);   /* da qui i messaggi dei datagram passano dal thread di scrittura */
+
+    /* Cattura: attivata prima di creare i thread, ognuno dei quali scrivera' nei propri blocchi del file */
+    if (percorso_cattura != NULL)
+    {
+#if defined (__linux__)
+        if (AvviaCattura(percorso_cattura) < 0)
+        {
+            ErrorHandler("Impossibile creare il file di cattura\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Cattura delle richieste in %s.\n", percorso_cattura);
+#else
+        printf("Cattura delle richieste non disponibile su questo sistema.\n");
+#endif
+    }
+
+    if (richieste_limite > 0 || byte_limite > 0)
+    {
+#if defined (__linux__)
+        if ((limitatore = CreaLimitatore(richieste_limite, byte_limite)) == NULL)
+        {
+            ErrorHandler("Memoria insufficiente per il limite per indirizzo\n");
+            ClearWinSock();
+            return EXIT_FAILURE;
+        }
+        printf("Limite per indirizzo: %llu datagram/s, %llu byte/s (0 = nessun limite).\n",
+               (unsigned long long)richieste_limite, (unsigned long long)byte_limite);
+#else
+        printf("Limite per indirizzo non disponibile su questo sistema.\n");
+#endif
+    }
+
+    /* Thread di calcolo: servono solo al ciclo a lotti, che attende anche i loro completamenti */
+    if (thread_calcolo > 0)
+    {
+#if defined (__linux__)
+        if (dim_lotto == 0 && !modalita_worker)
+        {
+            printf("I thread di calcolo richiedono -m o -w: calcolo sul posto.\n");
+        }
+        else
+        {
+            if (thread_calcolo > MAX_THREAD_CALCOLO) thread_calcolo = MAX_THREAD_CALCOLO;
+            if ((pipeline = AvviaPipeline(thread_calcolo, CalcolaDatagramma)) == NULL)
+            {
+                ErrorHandler("Avvio dei thread di calcolo fallito\n");
+                ClearWinSock();
+                return EXIT_FAILURE;
+            }
+            printf("Pipeline di calcolo: %d thread.\n", thread_calcolo);
+        }
+#else
+        printf("Thread di calcolo non disponibili su questo sistema: calcolo sul posto.\n");
+#endif
+    }
+
+    if (modalita_worker)
+    {
+#if defined (__linux__)
+        int esito = ServerMultiCore(num_worker, fissa_core, dim_lotto > 0 ? dim_lotto : 1, dim_buffer);
+        ClearWinSock();
+        return esito;
+#else
+        printf("Modalita' multi-core non disponibile su questo sistema: uso il ciclo classico.\n");
+#endif
+    }
+
     /* Variabili principali */
     int sock;                            /* descrittore della socket UDP */
     struct sockaddr_in echoServAddr;     /* indirizzo del server (local bind) */
     struct sockaddr_in echoClntAddr;     /* indirizzo del client che invia pacchetti */
     unsigned int cliAddrLen;             /* dimensione della struttura client */
-    char operation_char;                 /* operazione richiesta (carattere) */
-    char response_string[ECHOMAX];       /* buffer per le stringhe di risposta */
-    int operands[2];                     /* buffer per gli operandi inviati dal client */
     int recvMsgSize;                     /* numero di byte ricevuti da recvfrom */
-    long result;                         /* risultato dell'operazione */
+    static char datagramma[MAX_DATAGRAMMA];           /* datagram ricevuto */
+    static char risposta[MAX_DATAGRAMMA];             /* datagram di risposta */
+    static Attesa attese[MAX_ATTESE];                 /* vecchio protocollo: operazioni in sospeso */
+    static Duplicato duplicati[MAX_DUPLICATI];        /* protocollo senza stato: risposte per le ritrasmissioni */
+    Statistiche statistiche = { 0 };                  /* contatori stampati periodicamente */
+    uint64_t inizio_fase;
+
+    if ((statistiche.metriche = NuoveMetriche()) == NULL)
+    {
+        ErrorHandler("Memoria insufficiente per le metriche\n");
+        ClearWinSock();
+        return EXIT_FAILURE;
+    }
 
     /* Creazione della socket UDP: PF_INET, SOCK_DGRAM, IPPROTO_UDP */
     if ((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) 
@@ -88,6 +1076,8 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    ConfiguraRicezione(sock, dim_buffer);
+
     /* Costruzione della struttura indirizzo su cui fare bind (localhost:PORT) */
     memset(&echoServAddr, 0, sizeof(echoServAddr));
     echoServAddr.sin_family = AF_INET;                /* IPv4 */
@@ -105,21 +1095,39 @@ int main(int argc, char *argv[])
 
     /* Notifica che il server e' pronto */
     printf("Server UDP in ascolto sulla porta %d...\n", PORT);
+    statistiche.prossima_stampa = time(NULL) + INTERVALLO_STATISTICHE;
 
-    /* Ciclo infinito di ricezione datagram: il server rimane attivo */
+    if (dim_lotto > 0)
+    {
+#if defined (__linux__)
+        int esito = ServerLotti(sock, dim_lotto, attese, duplicati, &statistiche, true);
+        closesocket(sock);
+        ClearWinSock();
+        return esito;
+#else
+        printf("I/O a lotti non disponibile su questo sistema: uso il ciclo classico.\n");
+#endif
+    }
+
+    /* Ciclo infinito di ricezione datagram: il server rimane attivo.
+       Ogni datagram viene gestito appena arriva, senza attendere il successivo dello stesso client:
+       un client lento o perso non blocca gli altri. */
     while (1) 
     {
         cliAddrLen = sizeof(echoClntAddr);
+        inizio_fase = OraMetriche();
 
-        /* Prima ricezione: attendiamo il singolo byte che indica l'operazione richiesta
+        /* Ricezione di un datagram qualsiasi (fino al massimo consentito da UDP).
            Questa chiamata e' bloccante fino a che non arriva un datagram. */
-        recvMsgSize = recvfrom(sock, &operation_char, 1, 0,
+        recvMsgSize = recvfrom(sock, datagramma, sizeof(datagramma), 0,
                                (struct sockaddr *)&echoClntAddr, &cliAddrLen);
+        AGGIORNA_CONTATORE(statistiche.chiamate, 1);
+        AggiornaMetrica(&statistiche.metriche->chiamate_sistema, 1);
 
         /* FUNZIONE RECVFROM:
         La funzione serve a scrivere mediante la propria socket in quanto interfaccia software su un buffer un messaggio ricevuto 
-        (in questo caso un carattere) da un indirizzo mittente di dimensione sizeof(echoClntAddr). Di conseguenza gli argomenti che passa sono:
-        la socket di riferimento, il buffer dove scrivere il messaggio ricevuto, la dimensione del messaggio (1 byte),
+        da un indirizzo mittente di dimensione sizeof(echoClntAddr). Di conseguenza gli argomenti che passa sono:
+        la socket di riferimento, il buffer dove scrivere il messaggio ricevuto, la dimensione massima del messaggio,
         le opzioni (0 in questo caso), l'indirizzo del mittente e la dimensione di tale indirizzo.
         */
 
@@ -129,89 +1137,31 @@ int main(int argc, char *argv[])
             ErrorHandler("recvfrom() fallita\n");
             continue;
         }
+        AGGIORNA_CONTATORE(statistiche.datagrammi, 1);
+        inizio_fase = ChiudiFase(statistiche.metriche, FASE_RICEZIONE, inizio_fase);
 
-        /* Informazione su quale client abbiamo appena ricevuto */
-        printf("\nGestione client %s\n", inet_ntoa(echoClntAddr.sin_addr));
-
-        /* Determina quale operazione e prepara la stringa di risposta */
-        bool valid_operation = true;
-        switch (operation_char) 
-        {
-            case 'A': case 'a':
-                strcpy(response_string, "ADDIZIONE");
-                break;
-            case 'S': case 's':
-                strcpy(response_string, "SOTTRAZIONE");
-                break;
-            case 'M': case 'm':
-                strcpy(response_string, "MOLTIPLICAZIONE");
-                break;
-            case 'D': case 'd':
-                strcpy(response_string, "DIVISIONE");
-                break;
-            default:
-                /* Carattere non riconosciuto: chiediamo al client di terminare */
-                strcpy(response_string, EXIT_STRING);
-                valid_operation = false;
-                break;
-        }
-
-        /* Stampa diagnostica e invio della stringa di conferma/terminazione al client */
-        printf("Ricevuta op: '%c', Invio indietro: '%s'\n", operation_char, response_string);
-
-        //FUNZIONE SENDTO: vedi parte client rigo 111
-        if (sendto(sock, response_string, strlen(response_string) + 1, 0,
-                   (struct sockaddr *)&echoClntAddr, cliAddrLen) != (int)(strlen(response_string) + 1)) 
-        {
-            ErrorHandler("sendto() fallita invio stringa operazione\n");
-            /* Non usciamo; possiamo continuare a servire altri client */
-        }
-
-        /* Se l'operazione e' valida, attendiamo il pacchetto successivo contenente gli operandi */
-        if (valid_operation) 
+        int lunghezza = ElaboraDatagramma(statistiche.metriche, attese, duplicati, datagramma, recvMsgSize, &echoClntAddr, risposta, NULL);
+        inizio_fase = ChiudiFase(statistiche.metriche, FASE_CALCOLO, inizio_fase);
+        if (lunghezza > 0)
         {
-            recvMsgSize = recvfrom(sock, (char *)operands, sizeof(int) * 2, 0,
-                                   (struct sockaddr *)&echoClntAddr, &cliAddrLen);
-            //FUNZIONE RECVFROM: come sopra
-
-            /* Controllo che la dimensione ricevuta sia corretta (due int) */
-            if (recvMsgSize != (int)(sizeof(int) * 2)) 
+            //FUNZIONE SENDTO: vedi parte client rigo 111
+            AGGIORNA_CONTATORE(statistiche.chiamate, 1);
+            AggiornaMetrica(&statistiche.metriche->chiamate_sistema, 1);
+            if (sendto(sock, risposta, lunghezza, 0,
+                       (struct sockaddr *)&echoClntAddr, cliAddrLen) != lunghezza) 
             {
-                ErrorHandler("recvfrom() fallita o dimensione operandi errata\n");
-                continue; /* torna a ricevere una nuova richiesta */
+                AggiornaMetrica(&statistiche.metriche->invii_falliti, 1);
+                ErrorHandler("sendto() fallita invio risposta\n");
+                /* Non usciamo; possiamo continuare a servire altri client */
             }
-
-            /* Convertiamo gli operandi da network byte order a host order prima dell'operazione */
-            long op1 = ntohl(operands[0]);
-            long op2 = ntohl(operands[1]);
-
-            /* Calcolo dell'operazione richiesta */
-            switch (operation_char) 
+            else
             {
-                case 'A': case 'a': result = op1 + op2; break;
-                case 'S': case 's': result = op1 - op2; break;
-                case 'M': case 'm': result = op1 * op2; break;
-                case 'D': case 'd':
-                    if (op2 != 0)
-                        result = op1 / op2;
-                    else {
-                        result = 0; /* gestione semplice divisione per zero */
-                        printf("Errore: divisione per zero.\n");
-                    }
-                    break;
-            }
-
-            /* Stampa diagnostica del calcolo effettuato */
-            printf("Calcolo: %ld %c %ld = %ld\n", op1, operation_char, op2, result);
-
-            /* Invia il risultato al client in network byte order */
-            long net_result = htonl(result);
-            if (sendto(sock, (char *)&net_result, sizeof(long), 0,
-                       (struct sockaddr *)&echoClntAddr, cliAddrLen) != (int)sizeof(long)) 
-            {
-                ErrorHandler("sendto() fallita invio risultato\n");
+                AGGIORNA_CONTATORE(statistiche.risposte, 1);
+                ChiudiFase(statistiche.metriche, FASE_INVIO, inizio_fase);
             }
         }
+
+        StampaStatistiche(&statistiche);
     }
 
     /* Non si arriva mai qui in un server che gira indefinitamente, ma chiudiamo per correttezza */
@@ -219,4 +1169,4 @@ int main(int argc, char *argv[])
     ClearWinSock();
     system ("pause");
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
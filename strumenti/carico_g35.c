@@ -0,0 +1,670 @@
+/*
+  Generatore di carico per i server TCP e UDP della calcolatrice.
+
+  Usa lo stesso protocollo dei client (consegnaTCP/client-TCP_g35.c e consegnaUDP/client-UDP_g35.c), ma senza input da
+  tastiera: N thread inviano richieste con operazioni e operandi casuali per una durata fissata, verificano ogni
+  risultato e registrano la latenza in un istogramma HDR (comune/istogramma_g35.h). Alla fine stampa throughput,
+  errori e percentili p50/p99/p99.9/max.
+
+  Arrivi:
+  - ciclo chiuso (default): ogni thread invia la richiesta successiva appena riceve la risposta;
+  - ciclo aperto (-R richieste/s): ogni thread ha un calendario di invio a ritmo fisso. Se il server rallenta, le richieste
+    successive partono in ritardo: la latenza "corretta" si misura dall'istante previsto dal calendario e non da quello
+    di invio effettivo, così il ritardo accumulato non sparisce dalla misura (correzione della coordinated omission).
+
+  Con -A CONNESSIONI i thread non aprono connessioni proprie: usano tutti la libreria client (comune/client_g35.h) con
+  un solo gruppo di CONNESSIONI connessioni persistenti, su cui le richieste dei thread viaggiano in pipeline.
+
+  Con -U PERCORSO le connessioni TCP passano dalla socket locale AF_UNIX del server (-U del server), con lo stesso
+  protocollo. Con -M PERCORSO ogni thread apre un anello in memoria condivisa (comune/anello_condiviso_g35.h, -M del
+  server, solo Linux) e invia le richieste senza passare dal kernel; -b GIRI è l'attesa attiva prima di dormire.
+
+  Con -a PORTA il generatore legge dall'endpoint delle metriche del server le chiamate di sistema fatte dal server prima e
+  dopo la misura, e riporta quante ne è costata ogni richiesta: serve a confrontare fra loro modalità e versioni del server.
+
+  Solo sistemi POSIX (thread POSIX e clock_gettime). Compilazione: gcc carico_g35.c -o carico -O2 -pthread
+*/
+
+#if defined (__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#if defined (__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include "../comune/calcolo_g35.h"      /* risultato atteso di ogni richiesta */
+#include "../comune/protocollo_g35.h"   /* richieste UDP senza stato e messaggi binari TCP */
+#include "../comune/istogramma_g35.h"
+#include "../comune/client_g35.h"       /* -A: connessioni condivise dalla libreria client */
+#if defined (__linux__)
+#include "../comune/anello_condiviso_g35.h"   /* -M: anelli in memoria condivisa */
+#endif
+
+#define PORTA_DEFAULT 48000
+#define MAX_THREAD 1024
+#define DIM_BUFFER 256
+#define EXIT_STRING "TERMINE PROCESSO CLIENT"
+#define CONNECT_OK_STRING "connessione avvenuta"
+#define OVERLOAD_STRING "SERVER SOVRACCARICO"     /* saluto di una connessione rifiutata dal controllo di ammissione */
+#define LIMIT_STRING "LIMITE SUPERATO"            /* saluto (o risposta UDP) oltre il limite per indirizzo del server (-L) */
+#define RIFIUTATA -2                    /* esito di una richiesta rifiutata dal server sovraccarico o per il limite di frequenza */
+#define OP_SESSIONE 'P'
+#define SESSION_STRING "SESSIONE"
+#define DIM_RICHIESTA_SESSIONE 9
+#define TIMEOUT_UDP_MS 1000             /* oltre questo tempo una richiesta UDP è considerata persa */
+#define MAX_OPERANDO 100000             /* gli operandi sono casuali in [-MAX_OPERANDO, MAX_OPERANDO] */
+
+/* Configurazione letta dalla riga di comando, in sola lettura per i thread */
+typedef struct
+{
+    struct sockaddr_in server;
+    int udp;                    /* -u: server UDP */
+    int vecchio_protocollo;     /* -l: UDP in due scambi invece del protocollo senza stato */
+    int riuso;                  /* -k: TCP su connessione persistente (sessione) invece di una connessione per richiesta */
+    int binario;                /* -f: TCP su connessione persistente con messaggi binari */
+    int libreria;               /* -A: connessioni del gruppo condiviso della libreria client, 0 = non usata */
+    const char *locale;         /* -U: socket AF_UNIX del server al posto di host e porta, NULL = TCP */
+    const char *anelli;         /* -M: socket su cui aprire gli anelli in memoria condivisa, NULL = non usati */
+    int giri;                   /* -b: con -M, controlli attivi prima di dormire sul futex */
+    int thread;                 /* -c */
+    double durata;              /* -d, secondi */
+    double ritmo;               /* -R, richieste/s totali; 0 = ciclo chiuso */
+    int porta_metriche;         /* -a: endpoint delle metriche del server, 0 = non usato */
+    char operazioni[64];        /* -o: ogni carattere è un'operazione, ripeterlo ne aumenta il peso */
+} Configurazione;
+
+/* Stato e risultati di un thread: nessuna condivisione durante la misura */
+typedef struct
+{
+    int id;
+    pthread_t thread;
+    int sock;                   /* connessione o socket UDP, -1 se chiusa */
+    uint32_t seme;              /* generatore casuale xorshift */
+    uint32_t prossimo_id;       /* UDP e messaggi binari: identificativo della prossima richiesta */
+#if defined (__linux__)
+    AnelloClient *anello;       /* -M: anello del thread, NULL se chiuso */
+#endif
+    uint64_t completate;
+    uint64_t errori;            /* connessione fallita, risposta mancante o risultato errato */
+    uint64_t rifiutate;         /* server sovraccarico o limite per indirizzo: connessione o messaggio rifiutati subito */
+    Istogramma misurata;        /* latenza dall'invio effettivo */
+    Istogramma corretta;        /* ciclo aperto: latenza dall'istante previsto */
+} Generatore;
+
+static Configurazione configurazione;
+static ClientCalcolatrice *client_condiviso;   /* -A */
+
+static uint64_t Adesso(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static uint32_t Casuale(Generatore *generatore)
+{
+    uint32_t x = generatore->seme;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return generatore->seme = x;
+}
+
+static int32_t OperandoCasuale(Generatore *generatore)
+{
+    /* Il vecchio protocollo UDP converte gli operandi come unsigned: con valori negativi la divisione differisce */
+    if (configurazione.udp && configurazione.vecchio_protocollo) return (int32_t)(Casuale(generatore) % (MAX_OPERANDO + 1));
+    return (int32_t)(Casuale(generatore) % (2 * MAX_OPERANDO + 1)) - MAX_OPERANDO;
+}
+
+static void Chiudi(Generatore *generatore)
+{
+    if (generatore->sock >= 0) close(generatore->sock);
+    generatore->sock = -1;
+}
+
+/* Come RecvExact del client TCP: riceve esattamente 'len' byte */
+static int RiceviEsatti(int sock, void *buf, int len)
+{
+    int ricevuti = 0, n;
+    while (ricevuti < len)
+    {
+        n = recv(sock, (char *)buf + ricevuti, len - ricevuti, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ricevuti += n;
+    }
+    return 0;
+}
+
+static int InviaTutto(int sock, const void *buf, int len)
+{
+    int inviati = 0, n;
+    while (inviati < len)
+    {
+        n = send(sock, (const char *)buf + inviati, len - inviati, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        inviati += n;
+    }
+    return 0;
+}
+
+/* Riceve una stringa terminata da '\0' (saluto o risposta all'operazione) e la confronta con quella attesa:
+   RIFIUTATA se il server ha inviato OVERLOAD_STRING o LIMIT_STRING */
+static int RiceviStringa(int sock, const char *attesa)
+{
+    char buf[DIM_BUFFER];
+    int len = 0, n;
+    while (len == 0 || buf[len - 1] != '\0')
+    {
+        if (len == (int)sizeof(buf)) return -1;
+        n = recv(sock, buf + len, sizeof(buf) - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len += n;
+    }
+    if (strcmp(buf, attesa) == 0) return 0;
+    return strcmp(buf, OVERLOAD_STRING) == 0 || strcmp(buf, LIMIT_STRING) == 0 ? RIFIUTATA : -1;
+}
+
+/* Apre la connessione TCP (o AF_UNIX con -U) e attende il saluto del server */
+static int ConnettiTCP(Generatore *generatore)
+{
+    struct sockaddr_un locale;
+    int attiva = 1, esito;
+    if (configurazione.locale != NULL)
+    {
+        memset(&locale, 0, sizeof(locale));
+        locale.sun_family = AF_UNIX;
+        snprintf(locale.sun_path, sizeof(locale.sun_path), "%s", configurazione.locale);
+        if ((generatore->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+        esito = connect(generatore->sock, (struct sockaddr *)&locale, sizeof(locale));
+    }
+    else
+    {
+        if ((generatore->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) return -1;
+        setsockopt(generatore->sock, IPPROTO_TCP, TCP_NODELAY, &attiva, sizeof(attiva));
+        esito = connect(generatore->sock, (struct sockaddr *)&configurazione.server, sizeof(configurazione.server));
+    }
+    if (esito == 0) esito = RiceviStringa(generatore->sock, CONNECT_OK_STRING);
+    if (esito < 0) Chiudi(generatore);
+    return esito < 0 ? esito : 0;
+}
+
+static const char *StringaOperazione(char op)
+{
+    switch (op)
+    {
+        case 'A': return "ADDIZIONE";
+        case 'S': return "SOTTRAZIONE";
+        case 'M': return "MOLTIPLICAZIONE";
+        default:  return "DIVISIONE";
+    }
+}
+
+/* TCP, protocollo del client originale: una connessione per richiesta */
+static int RichiestaTCP(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    uint32_t operandi[2] = { htonl((uint32_t)a), htonl((uint32_t)b) };
+    uint32_t net_result;
+    int esito = -1;
+
+    if ((esito = ConnettiTCP(generatore)) < 0) return esito;
+    esito = -1;
+    if (InviaTutto(generatore->sock, &op, 1) == 0
+        && RiceviStringa(generatore->sock, StringaOperazione(op)) == 0
+        && InviaTutto(generatore->sock, operandi, sizeof(operandi)) == 0
+        && RiceviEsatti(generatore->sock, &net_result, sizeof(net_result)) == 0)
+    {
+        *risultato = (int32_t)ntohl(net_result);
+        esito = 0;
+    }
+    Chiudi(generatore);
+    return esito;
+}
+
+/* TCP con riuso della connessione: sessione persistente, una richiesta da 9 byte e un risultato da 4 byte per volta */
+static int RichiestaSessione(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    unsigned char richiesta[DIM_RICHIESTA_SESSIONE];
+    uint32_t valori[2] = { htonl((uint32_t)a), htonl((uint32_t)b) };
+    uint32_t net_result;
+    char apertura = OP_SESSIONE;
+    int esito;
+
+    if (generatore->sock < 0)
+    {
+        if ((esito = ConnettiTCP(generatore)) < 0) return esito;
+        if (InviaTutto(generatore->sock, &apertura, 1) < 0 || RiceviStringa(generatore->sock, SESSION_STRING) < 0)
+        {
+            Chiudi(generatore);
+            return -1;
+        }
+    }
+    richiesta[0] = (unsigned char)op;
+    memcpy(richiesta + 1, valori, sizeof(valori));
+    if (InviaTutto(generatore->sock, richiesta, sizeof(richiesta)) < 0
+        || RiceviEsatti(generatore->sock, &net_result, sizeof(net_result)) < 0)
+    {
+        Chiudi(generatore);   /* la connessione si riapre alla richiesta successiva */
+        return -1;
+    }
+    *risultato = (int32_t)ntohl(net_result);
+    return 0;
+}
+
+/* Controlla l'intestazione della risposta a un messaggio e ne restituisce il risultato (sempre un solo intero) */
+static int RisultatoMessaggio(const unsigned char *risposta, int n, uint32_t id, int32_t *risultato)
+{
+    Intestazione intestazione;
+    uint32_t net_result;
+    if (!LeggiIntestazione(risposta, n, &intestazione) || intestazione.id != id
+        || (intestazione.flag_esito != ESITO_OK && intestazione.flag_esito != ESITO_DIVISIONE_PER_ZERO)
+        || n != DIM_INTESTAZIONE + 4 || intestazione.lunghezza != 4) return -1;
+    memcpy(&net_result, risposta + DIM_INTESTAZIONE, sizeof(net_result));
+    *risultato = (int32_t)ntohl(net_result);
+    return 0;
+}
+
+/* TCP a messaggi binari: negoziazione all'apertura, poi un messaggio di richiesta e uno di risposta per volta */
+static int RichiestaMessaggio(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    unsigned char richiesta[DIM_INTESTAZIONE + 8], risposta[DIM_INTESTAZIONE + 4];
+    uint32_t valori[2] = { htonl((uint32_t)a), htonl((uint32_t)b) };
+    uint32_t id;
+    Intestazione intestazione;
+    int esito;
+
+    if (generatore->sock < 0)
+    {
+        if ((esito = ConnettiTCP(generatore)) < 0) return esito;
+        id = generatore->prossimo_id++;
+        ScriviIntestazione(richiesta, OP_NEGOZIAZIONE, 0, 0, id);
+        if (InviaTutto(generatore->sock, richiesta, DIM_INTESTAZIONE) < 0 || RiceviEsatti(generatore->sock, risposta, DIM_INTESTAZIONE) < 0
+            || !LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione) || intestazione.id != id || intestazione.flag_esito != ESITO_OK)
+        {
+            Chiudi(generatore);
+            return -1;
+        }
+    }
+    id = generatore->prossimo_id++;
+    ScriviIntestazione(richiesta, (uint8_t)op, 0, sizeof(valori), id);
+    memcpy(richiesta + DIM_INTESTAZIONE, valori, sizeof(valori));
+    if (InviaTutto(generatore->sock, richiesta, sizeof(richiesta)) < 0
+        || RiceviEsatti(generatore->sock, risposta, DIM_INTESTAZIONE) < 0)
+    {
+        Chiudi(generatore);   /* la connessione si riapre alla richiesta successiva */
+        return -1;
+    }
+    /* Un messaggio scartato dal server sovraccarico o oltre il limite ha solo l'intestazione; la connessione resta valida */
+    if (LeggiIntestazione(risposta, DIM_INTESTAZIONE, &intestazione) && intestazione.id == id && intestazione.lunghezza == 0
+        && (intestazione.flag_esito == ESITO_SOVRACCARICO || intestazione.flag_esito == ESITO_LIMITE_SUPERATO)) return RIFIUTATA;
+    if (RiceviEsatti(generatore->sock, risposta + DIM_INTESTAZIONE, sizeof(risposta) - DIM_INTESTAZIONE) < 0
+        || RisultatoMessaggio(risposta, sizeof(risposta), id, risultato) < 0)
+    {
+        Chiudi(generatore);
+        return -1;
+    }
+    return 0;
+}
+
+/* Libreria client: la richiesta passa dal gruppo di connessioni condiviso da tutti i thread */
+static int RichiestaLibreria(char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    int esito = CalcolaSincrono(client_condiviso, op, a, b, risultato);
+    return (esito == ESITO_OK || esito == ESITO_DIVISIONE_PER_ZERO) ? 0 : -1;
+}
+
+#if defined (__linux__)
+/* Anello in memoria condivisa: aperto alla prima richiesta del thread, riaperto dopo un errore */
+static int RichiestaAnello(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    int esito;
+    if (generatore->anello == NULL && (generatore->anello = ApriAnelloClient(configurazione.anelli, configurazione.giri)) == NULL) return -1;
+    esito = CalcolaAnello(generatore->anello, op, a, b, risultato);
+    if (esito == ESITO_ANELLO_CHIUSO)
+    {
+        ChiudiAnelloClient(generatore->anello);
+        generatore->anello = NULL;
+    }
+    return (esito == ESITO_OK || esito == ESITO_DIVISIONE_PER_ZERO) ? 0 : -1;
+}
+#endif
+
+/* Socket UDP "connessa" al server: send()/recv() senza indirizzo e solo datagram del server, con timeout */
+static int ApriUDP(Generatore *generatore)
+{
+    struct timeval timeout = { TIMEOUT_UDP_MS / 1000, (TIMEOUT_UDP_MS % 1000) * 1000 };
+    generatore->sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (generatore->sock < 0) return -1;
+    setsockopt(generatore->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(generatore->sock, (struct sockaddr *)&configurazione.server, sizeof(configurazione.server)) < 0)
+    {
+        Chiudi(generatore);
+        return -1;
+    }
+    return 0;
+}
+
+/* UDP senza stato: un datagram di richiesta, un datagram di risposta con lo stesso id */
+static int RichiestaUDP(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    unsigned char richiesta[DIM_INTESTAZIONE + 8], risposta[DIM_BUFFER];
+    uint32_t valori[2] = { htonl((uint32_t)a), htonl((uint32_t)b) };
+    uint32_t id = generatore->prossimo_id++;
+    Intestazione intestazione;
+    int n;
+
+    if (generatore->sock < 0 && ApriUDP(generatore) < 0) return -1;
+    ScriviIntestazione(richiesta, (uint8_t)op, 0, sizeof(valori), id);
+    memcpy(richiesta + DIM_INTESTAZIONE, valori, sizeof(valori));
+    if (send(generatore->sock, richiesta, sizeof(richiesta), 0) != (int)sizeof(richiesta)) return -1;
+
+    /* Le risposte con un altro id arrivano in ritardo da richieste già date per perse */
+    do
+    {
+        n = recv(generatore->sock, risposta, sizeof(risposta), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+    } while (!LeggiIntestazione(risposta, n, &intestazione) || intestazione.id != id);
+
+    if (intestazione.flag_esito == ESITO_LIMITE_SUPERATO && intestazione.lunghezza == 0) return RIFIUTATA;
+    return RisultatoMessaggio(risposta, n, id, risultato);
+}
+
+/* UDP, protocollo del client originale: operazione, stringa di conferma, operandi, risultato */
+static int RichiestaUDPVecchia(Generatore *generatore, char op, int32_t a, int32_t b, int32_t *risultato)
+{
+    char risposta[DIM_BUFFER];
+    uint32_t valori[2] = { htonl((uint32_t)a), htonl((uint32_t)b) };
+    int n;
+
+    if (generatore->sock < 0 && ApriUDP(generatore) < 0) return -1;
+    if (send(generatore->sock, &op, 1, 0) != 1) return -1;
+    n = recv(generatore->sock, risposta, sizeof(risposta) - 1, 0);
+    if (n <= 0) goto persa;
+    risposta[n] = '\0';
+    if (strcmp(risposta, LIMIT_STRING) == 0) return RIFIUTATA;   /* nessuno scambio aperto: la socket resta valida */
+    if (strcmp(risposta, StringaOperazione(op)) != 0) goto persa;
+    if (send(generatore->sock, valori, sizeof(valori), 0) != (int)sizeof(valori)) return -1;
+    /* Il server invia un long: i primi 4 byte sono il risultato in network order */
+    n = recv(generatore->sock, risposta, sizeof(risposta), 0);
+    if (n < (int)sizeof(uint32_t)) goto persa;
+    memcpy(&valori[0], risposta, sizeof(uint32_t));
+    *risultato = (int32_t)ntohl(valori[0]);
+    return 0;
+
+persa:
+    /* Uno scambio a metà lascerebbe il server in attesa degli operandi: si riparte con una socket (porta) nuova */
+    Chiudi(generatore);
+    return -1;
+}
+
+static void *ThreadGeneratore(void *arg)
+{
+    Generatore *generatore = arg;
+    int n_operazioni = (int)strlen(configurazione.operazioni);
+    uint64_t inizio = Adesso();
+    uint64_t fine = inizio + (uint64_t)(configurazione.durata * 1e9);
+    /* Ciclo aperto: ogni thread ha 1/N del ritmo totale; i calendari dei thread sono sfasati fra loro */
+    uint64_t intervallo = configurazione.ritmo > 0 ? (uint64_t)(1e9 * configurazione.thread / configurazione.ritmo) : 0;
+    uint64_t previsto = inizio + (intervallo * generatore->id) / configurazione.thread;
+
+#if defined (__linux__)
+    /* Il margine di default dei timer (50 us) ritarderebbe ogni risveglio e finirebbe nella latenza corretta */
+    if (intervallo > 0) prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+
+    while (1)
+    {
+        if (intervallo > 0)
+        {
+            uint64_t ora = Adesso();
+            if (previsto >= fine || ora >= fine) break;   /* le richieste in ritardo oltre la fine non si inviano */
+            if (ora < previsto)
+            {
+                struct timespec attesa = { (time_t)(previsto / 1000000000u), (long)(previsto % 1000000000u) };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &attesa, NULL);
+            }
+        }
+
+        char op = configurazione.operazioni[Casuale(generatore) % n_operazioni];
+        int32_t a = OperandoCasuale(generatore), b = OperandoCasuale(generatore), risultato = 0;
+        uint64_t invio = Adesso();
+        if (intervallo == 0 && invio >= fine) break;
+
+        int esito;
+        if (configurazione.udp) esito = configurazione.vecchio_protocollo ? RichiestaUDPVecchia(generatore, op, a, b, &risultato)
+                                                                          : RichiestaUDP(generatore, op, a, b, &risultato);
+        else if (configurazione.libreria) esito = RichiestaLibreria(op, a, b, &risultato);
+#if defined (__linux__)
+        else if (configurazione.anelli != NULL) esito = RichiestaAnello(generatore, op, a, b, &risultato);
+#endif
+        else if (configurazione.binario) esito = RichiestaMessaggio(generatore, op, a, b, &risultato);
+        else esito = configurazione.riuso ? RichiestaSessione(generatore, op, a, b, &risultato)
+                                          : RichiestaTCP(generatore, op, a, b, &risultato);
+        uint64_t ricezione = Adesso();
+
+        if (esito == RIFIUTATA) generatore->rifiutate++;
+        else if (esito < 0 || risultato != CalcolaScalare(op, a, b)) generatore->errori++;
+        else
+        {
+            generatore->completate++;
+            RegistraValore(&generatore->misurata, ricezione - invio);
+            if (intervallo > 0) RegistraValore(&generatore->corretta, ricezione - previsto);
+        }
+        previsto += intervallo;
+    }
+    Chiudi(generatore);
+#if defined (__linux__)
+    ChiudiAnelloClient(generatore->anello);
+#endif
+    return NULL;
+}
+
+/* Chiamate di sistema contate dal server (calcolatrice_chiamate_sistema_totali), -1 se l'endpoint non risponde */
+static long long ChiamateServer(void)
+{
+    static const char richiesta[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    static const char nome[] = "calcolatrice_chiamate_sistema_totali{";
+    struct sockaddr_in indirizzo = configurazione.server;
+    char *testo = malloc(1 << 16), *riga;
+    long long chiamate = -1;
+    int sock, len = 0, n;
+
+    if (testo == NULL) return -1;
+    indirizzo.sin_port = htons((uint16_t)configurazione.porta_metriche);
+    if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) >= 0)
+    {
+        if (connect(sock, (struct sockaddr *)&indirizzo, sizeof(indirizzo)) == 0 && InviaTutto(sock, richiesta, sizeof(richiesta) - 1) == 0)
+        {
+            while (len < (1 << 16) - 1 && (n = recv(sock, testo + len, (1 << 16) - 1 - len, 0)) > 0) len += n;
+        }
+        close(sock);
+    }
+    testo[len] = '\0';
+    if ((riga = strstr(testo, nome)) != NULL && (riga = strchr(riga, '}')) != NULL) chiamate = atoll(riga + 1);
+    free(testo);
+    return chiamate;
+}
+
+static void StampaLatenze(const char *nome, const Istogramma *istogramma)
+{
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f\n", nome,
+           istogramma->totale ? istogramma->somma / istogramma->totale / 1000.0 : 0.0,
+           PercentileIstogramma(istogramma, 50.0) / 1000.0, PercentileIstogramma(istogramma, 99.0) / 1000.0,
+           PercentileIstogramma(istogramma, 99.9) / 1000.0, PercentileIstogramma(istogramma, 100.0) / 1000.0);
+}
+
+static void Uso(const char *programma)
+{
+    printf("Uso: %s [-u [-l]] [-k | -f | -A connessioni | -M percorso [-b giri]] [-h host | -U percorso] [-P porta] [-c thread] [-d secondi] [-R richieste/s] [-o operazioni] [-a porta]\n", programma);
+    printf("  -u          server UDP (default TCP)\n");
+    printf("  -l          con -u, protocollo in due scambi del client originale (default: datagram singolo con id)\n");
+    printf("  -k          TCP: riusa la connessione (sessione persistente); default: una connessione per richiesta\n");
+    printf("  -f          TCP: riusa la connessione con i messaggi binari (intestazione fissa ed esito numerico)\n");
+    printf("  -A N        TCP: i thread condividono N connessioni persistenti della libreria client (messaggi binari)\n");
+    printf("  -M percorso anelli in memoria condivisa sulla socket -M del server, uno per thread (solo Linux)\n");
+    printf("  -b giri     con -M, controlli attivi della risposta prima di dormire sul futex (default 0)\n");
+    printf("  -h host     server (default 127.0.0.1)\n");
+    printf("  -U percorso TCP: connessioni sulla socket locale AF_UNIX del server (-U del server) invece che su host e porta\n");
+    printf("  -P porta    porta del server (default %d)\n", PORTA_DEFAULT);
+    printf("  -c thread   richieste concorrenti, un thread e una connessione/socket ciascuna (default 1)\n");
+    printf("  -d secondi  durata della misura (default 10)\n");
+    printf("  -R ritmo    ciclo aperto a ritmo fisso, richieste/s in totale (default: ciclo chiuso)\n");
+    printf("  -o ASMD     operazioni estratte a caso; ripetere una lettera ne aumenta il peso (default ASMD)\n");
+    printf("  -a porta    endpoint delle metriche del server (-a del server): riporta le sue chiamate di sistema per richiesta\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static Generatore generatori[MAX_THREAD];
+    Istogramma misurata, corretta;
+    const char *host = "127.0.0.1";
+    int porta = PORTA_DEFAULT;
+    struct hostent *risolto;
+    uint64_t completate = 0, errori = 0, rifiutate = 0;
+    int i;
+
+    configurazione.thread = 1;
+    configurazione.durata = 10;
+    strcpy(configurazione.operazioni, "ASMD");
+    for (i = 1; i < argc; i++)
+    {
+        int ha_valore = (i + 1 < argc);
+        if (strcmp(argv[i], "-u") == 0) configurazione.udp = 1;
+        else if (strcmp(argv[i], "-l") == 0) configurazione.vecchio_protocollo = 1;
+        else if (strcmp(argv[i], "-k") == 0) configurazione.riuso = 1;
+        else if (strcmp(argv[i], "-f") == 0) configurazione.binario = 1;
+        else if (strcmp(argv[i], "-h") == 0 && ha_valore) host = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0 && ha_valore) porta = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && ha_valore) configurazione.thread = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && ha_valore) configurazione.durata = atof(argv[++i]);
+        else if (strcmp(argv[i], "-R") == 0 && ha_valore) configurazione.ritmo = atof(argv[++i]);
+        else if (strcmp(argv[i], "-a") == 0 && ha_valore) configurazione.porta_metriche = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-A") == 0 && ha_valore) configurazione.libreria = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-U") == 0 && ha_valore) configurazione.locale = argv[++i];
+        else if (strcmp(argv[i], "-M") == 0 && ha_valore) configurazione.anelli = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0 && ha_valore) configurazione.giri = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && ha_valore)
+        {
+            snprintf(configurazione.operazioni, sizeof(configurazione.operazioni), "%s", argv[++i]);
+        }
+        else
+        {
+            Uso(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; configurazione.operazioni[i] != '\0'; i++)
+    {
+        if (!OperazioneValida(configurazione.operazioni[i])) break;
+        configurazione.operazioni[i] = (char)(configurazione.operazioni[i] & ~0x20);   /* maiuscola */
+    }
+    if (configurazione.operazioni[i] != '\0' || i == 0 || configurazione.thread < 1 || configurazione.thread > MAX_THREAD
+        || configurazione.durata <= 0 || configurazione.ritmo < 0 || porta <= 0 || porta > 65535
+        || configurazione.porta_metriche < 0 || configurazione.porta_metriche > 65535
+        || configurazione.libreria < 0 || configurazione.libreria > MAX_CONNESSIONI_CLIENT || (configurazione.libreria && configurazione.udp)
+        || configurazione.giri < 0 || (configurazione.anelli != NULL && (configurazione.udp || configurazione.libreria))
+        || (configurazione.locale != NULL && (configurazione.udp || configurazione.libreria)))
+    {
+        Uso(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#if !defined (__linux__)
+    if (configurazione.anelli != NULL)
+    {
+        fprintf(stderr, "Gli anelli in memoria condivisa sono disponibili solo su Linux.\n");
+        return EXIT_FAILURE;
+    }
+#endif
+    if ((risolto = gethostbyname(host)) == NULL)
+    {
+        fprintf(stderr, "Risoluzione del nome fallita per %s.\n", host);
+        return EXIT_FAILURE;
+    }
+    configurazione.server.sin_family = AF_INET;
+    configurazione.server.sin_port = htons((uint16_t)porta);
+    configurazione.server.sin_addr = *(struct in_addr *)risolto->h_addr_list[0];
+
+    printf("Carico %s verso %s:%d: %d thread, %.1f s, operazioni %s, ", configurazione.udp ? "UDP" : "TCP",
+           inet_ntoa(configurazione.server.sin_addr), porta, configurazione.thread, configurazione.durata, configurazione.operazioni);
+    if (configurazione.anelli != NULL) printf("anelli su %s, ", configurazione.anelli);
+    else if (configurazione.locale != NULL) printf("socket locale %s, ", configurazione.locale);
+    if (configurazione.ritmo > 0) printf("ciclo aperto a %.0f richieste/s\n", configurazione.ritmo);
+    else printf("ciclo chiuso\n");
+
+    if (configurazione.libreria)
+    {
+        if ((client_condiviso = ApriClient(host, (uint16_t)porta, configurazione.libreria)) == NULL)
+        {
+            fprintf(stderr, "Impossibile aprire le connessioni della libreria client verso %s:%d.\n", host, porta);
+            return EXIT_FAILURE;
+        }
+        printf("Libreria client: %d connessioni condivise dai thread.\n", configurazione.libreria);
+    }
+
+    long long chiamate_prima = configurazione.porta_metriche ? ChiamateServer() : -1;
+    uint64_t inizio = Adesso();
+    for (i = 0; i < configurazione.thread; i++)
+    {
+        generatori[i].id = i;
+        generatori[i].sock = -1;
+        generatori[i].seme = 2463534242u ^ (uint32_t)(i * 2654435761u) ^ (uint32_t)inizio;
+        if (generatori[i].seme == 0) generatori[i].seme = 1;
+        generatori[i].prossimo_id = (uint32_t)i << 24;
+        AzzeraIstogramma(&generatori[i].misurata);
+        AzzeraIstogramma(&generatori[i].corretta);
+        if (pthread_create(&generatori[i].thread, NULL, ThreadGeneratore, &generatori[i]) != 0)
+        {
+            fprintf(stderr, "Impossibile avviare il thread %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    AzzeraIstogramma(&misurata);
+    AzzeraIstogramma(&corretta);
+    for (i = 0; i < configurazione.thread; i++)
+    {
+        pthread_join(generatori[i].thread, NULL);
+        completate += generatori[i].completate;
+        errori += generatori[i].errori;
+        rifiutate += generatori[i].rifiutate;
+        UnisciIstogrammi(&misurata, &generatori[i].misurata);
+        UnisciIstogrammi(&corretta, &generatori[i].corretta);
+    }
+    double secondi = (Adesso() - inizio) / 1e9;
+    if (client_condiviso != NULL) ChiudiClient(client_condiviso);
+    long long chiamate_dopo = configurazione.porta_metriche ? ChiamateServer() : -1;
+
+    printf("\nRichieste completate: %llu, errori: %llu, in %.2f s -> %.1f richieste/s\n",
+           (unsigned long long)completate, (unsigned long long)errori, secondi, completate / secondi);
+    if (rifiutate > 0) printf("Rifiutate dal server (sovraccarico o limite per indirizzo): %llu\n", (unsigned long long)rifiutate);
+    if (configurazione.porta_metriche && (chiamate_prima < 0 || chiamate_dopo < 0))
+        printf("Endpoint delle metriche non raggiungibile sulla porta %d.\n", configurazione.porta_metriche);
+    else if (configurazione.porta_metriche)
+        printf("Chiamate di sistema del server: %lld (%.2f per richiesta)\n", chiamate_dopo - chiamate_prima,
+               completate ? (double)(chiamate_dopo - chiamate_prima) / completate : 0.0);
+    printf("\nLatenza (us)     media        p50        p99      p99.9        max\n");
+    StampaLatenze("misurata", &misurata);
+    if (configurazione.ritmo > 0) StampaLatenze("corretta", &corretta);
+    return errori == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
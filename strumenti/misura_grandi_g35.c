@@ -0,0 +1,148 @@
+/*
+  Misura i punti di incrocio fra gli algoritmi dei numeri grandi (comune/grandi_g35.h), per scegliere le soglie.
+
+  Per ogni lunghezza n (in cifre da 32 bit) esegue al primo livello ciascun algoritmo su operandi casuali e riporta il
+  tempo medio di una chiamata: prodotto n * n scolastico, Karatsuba e Toom-3, divisione 2n / n con l'algoritmo D e con
+  Burnikel-Ziegler. Le ricorsioni interne usano le soglie con cui il programma è compilato, come nel server. Alla fine
+  stampa la prima lunghezza da cui ogni algoritmo resta più veloce del precedente: è il valore da dare alla soglia.
+
+  Le soglie si possono cambiare in compilazione per verificare una scelta, per esempio:
+    gcc misura_grandi_g35.c -o misura_grandi -O2 -DSOGLIA_KARATSUBA=32 -DFOGLIA_BURNIKEL_ZIEGLER=80
+
+  Solo sistemi POSIX (clock_gettime). Compilazione: gcc misura_grandi_g35.c -o misura_grandi -O2
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../comune/grandi_g35.h"
+
+#define TEMPO_MINIMO 0.01               /* secondi di un giro di misura */
+#define GIRI_MISURA 7
+#define MAX_LUNGHEZZA 2048
+
+enum { PRODOTTO_SCOLASTICO, PRODOTTO_KARATSUBA, PRODOTTO_TOOM3, DIVISIONE_D, DIVISIONE_BZ, NUM_ALGORITMI };
+
+static const char *const nomi_algoritmi[NUM_ALGORITMI] = { "scolastico", "Karatsuba", "Toom-3", "algoritmo D", "Burnikel-Ziegler" };
+
+static const int lunghezze[] = { 8, 12, 16, 20, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+                                 320, 384, 512, 768, 1024, 1536, 2048 };
+#define NUM_LUNGHEZZE ((int)(sizeof(lunghezze) / sizeof(lunghezze[0])))
+
+static uint32_t seme = 2463534242u;
+
+static Cifra Casuale(void)
+{
+    seme ^= seme << 13;
+    seme ^= seme >> 17;
+    seme ^= seme << 5;
+    return seme;
+}
+
+static double Adesso(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Una chiamata dell'algoritmo su operandi di n cifre (dividendo di 2n per la divisione) */
+static int Esegui(int algoritmo, Cifra *r, Cifra *q, const Cifra *a, const Cifra *b, int n)
+{
+    switch (algoritmo)
+    {
+        case PRODOTTO_SCOLASTICO: ProdottoScolastico(r, a, n, b, n); return GRANDI_OK;
+        case PRODOTTO_KARATSUBA:  return ProdottoKaratsuba(r, a, n, b, n);
+        case PRODOTTO_TOOM3:      return ProdottoToom3(r, a, n, b, n);
+        case DIVISIONE_D:         return DivisioneScolastica(q, r, a, 2 * n, b, n);
+        default:                  return DivisioneBurnikelZiegler(q, r, a, 2 * n, b, n);
+    }
+}
+
+/*
+  Microsecondi per chiamata: si raddoppiano le ripetizioni finché un giro dura almeno TEMPO_MINIMO, poi si tiene il
+  migliore di GIRI_MISURA giri, meno sensibile alle interruzioni e agli altri processi.
+*/
+static double Misura(int algoritmo, Cifra *r, Cifra *q, const Cifra *a, const Cifra *b, int n)
+{
+    long ripetizioni = 1, i;
+    int giro = 0;
+    double inizio, durata, migliore = 0;
+    while (giro < GIRI_MISURA)
+    {
+        inizio = Adesso();
+        for (i = 0; i < ripetizioni; i++)
+        {
+            if (Esegui(algoritmo, r, q, a, b, n) != GRANDI_OK)
+            {
+                fprintf(stderr, "Memoria esaurita.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        durata = Adesso() - inizio;
+        if (durata < TEMPO_MINIMO && giro == 0)
+        {
+            ripetizioni *= 2;
+            continue;
+        }
+        if (giro == 0 || durata < migliore) migliore = durata;
+        giro++;
+    }
+    return migliore * 1e6 / ripetizioni;
+}
+
+int main(void)
+{
+    static double tempi[NUM_LUNGHEZZE][NUM_ALGORITMI];
+    Cifra *a = malloc(2 * MAX_LUNGHEZZA * sizeof(Cifra)), *b = malloc(MAX_LUNGHEZZA * sizeof(Cifra));
+    Cifra *r = malloc(2 * MAX_LUNGHEZZA * sizeof(Cifra)), *q = malloc((MAX_LUNGHEZZA + 1) * sizeof(Cifra));
+    int i, j, k, n;
+
+    if (a == NULL || b == NULL || r == NULL || q == NULL)
+    {
+        fprintf(stderr, "Memoria esaurita.\n");
+        return EXIT_FAILURE;
+    }
+    printf("Soglie di compilazione: Karatsuba %d, Toom-3 %d, Burnikel-Ziegler %d (foglia %d) cifre\n\n",
+           SOGLIA_KARATSUBA, SOGLIA_TOOM3, SOGLIA_BURNIKEL_ZIEGLER, FOGLIA_BURNIKEL_ZIEGLER);
+    printf("%8s", "cifre");
+    for (j = 0; j < NUM_ALGORITMI; j++) printf(" %17s", nomi_algoritmi[j]);
+    printf("   (microsecondi per chiamata; divisione 2n / n)\n");
+
+    for (i = 0; i < NUM_LUNGHEZZE; i++)
+    {
+        n = lunghezze[i];
+        for (k = 0; k < 2 * n; k++) a[k] = Casuale();
+        for (k = 0; k < n; k++) b[k] = Casuale();
+        b[n - 1] |= 1;   /* divisore di n cifre esatte */
+        if (a[2 * n - 1] >= b[n - 1]) a[2 * n - 1] = b[n - 1] - 1;   /* quoziente di n cifre */
+
+        printf("%8d", n);
+        for (j = 0; j < NUM_ALGORITMI; j++)
+        {
+            tempi[i][j] = Misura(j, r, q, a, b, n);
+            printf(" %17.2f", tempi[i][j]);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    /* Incrocio: prima lunghezza da cui l'algoritmo è più veloce del precedente a tutte le lunghezze maggiori */
+    printf("\n");
+    for (j = PRODOTTO_KARATSUBA; j < NUM_ALGORITMI; j++)
+    {
+        if (j == DIVISIONE_D) continue;
+        for (i = NUM_LUNGHEZZE; i > 0 && tempi[i - 1][j] < tempi[i - 1][j - 1]; i--);
+        if (i == NUM_LUNGHEZZE) printf("%s non supera %s fino a %d cifre\n", nomi_algoritmi[j], nomi_algoritmi[j - 1], MAX_LUNGHEZZA);
+        else printf("%s più veloce di %s da %d cifre\n", nomi_algoritmi[j], nomi_algoritmi[j - 1], lunghezze[i]);
+    }
+
+    free(a);
+    free(b);
+    free(r);
+    free(q);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,695 @@
+/*
+  Riproduzione deterministica del traffico catturato dai server della calcolatrice (opzione -R dei server, formato in
+  comune/cattura_g35.h).
+
+  Il file di cattura viene mappato in memoria e letto sul posto: i record di tutti i blocchi finiscono in un indice
+  ordinato per istante di arrivo, e ogni richiesta parte verso il server all'istante in cui era arrivata in origine,
+  scalato con -x VELOCITÀ (1 = tempi originali, 2 = al doppio della velocità, 0 = alla massima velocità). La latenza si
+  misura dall'invio effettivo e, come nel ciclo aperto di carico_g35.c, anche dall'istante previsto dal calendario:
+  un server che non tiene il ritmo originale accumula ritardo, e la latenza "corretta" lo mostra.
+
+  Flussi: le richieste TCP e locali di uno stesso client (indirizzo e porta; per i client locali il descrittore della
+  connessione) viaggiano su una stessa connessione persistente a messaggi binari, quelle UDP di uno stesso client da
+  una stessa socket UDP. Oltre -c flussi per trasporto le connessioni e le socket si condividono. Le richieste del
+  vecchio protocollo sono state catturate come messaggi binari equivalenti e si riproducono come tali.
+
+  Un thread invia secondo il calendario, un altro riceve da tutte le connessioni con poll(): le richieste in volo sono
+  al più -f. L'identificativo di ogni messaggio viene riscritto con l'indice della richiesta, e la risposta attesa si
+  calcola con RispondiRichiesta(), come fa il server: una risposta diversa è una discordanza. Le risposte
+  ESITO_SOVRACCARICO ed ESITO_LIMITE_SUPERATO non dipendono dalla richiesta e sono contate a parte; una richiesta senza
+  risposta dopo -t secondi è persa.
+
+  Un messaggio TCP deve stare nel buffer di sessione del server (DIM_MESSAGGIO_TCP byte): i batch del vecchio
+  protocollo più lunghi, catturati come un unico messaggio, non si possono riprodurre e vengono scartati.
+
+  Solo Linux. Compilazione: gcc riproduci_g35.c -o riproduci -O2 -pthread
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+
+#include "../comune/protocollo_g35.h"   /* messaggi e risposte attese */
+#include "../comune/cattura_g35.h"      /* formato del file di cattura */
+#include "../comune/istogramma_g35.h"
+
+#define PORTA_DEFAULT 48000
+#define CONNECT_OK_STRING "connessione avvenuta"
+#define DIM_BUFFER 256
+#define MAX_CANALI 1024                 /* connessioni (e socket UDP) massime */
+#define DIM_MESSAGGIO_TCP 4096          /* buffer di sessione del server TCP: i messaggi più lunghi non ci stanno */
+#define MAX_COPPIE_TCP ((DIM_MESSAGGIO_TCP - DIM_INTESTAZIONE - 4) / 8)
+#define DIM_MESSAGGIO_UDP 65507
+#define MAX_COPPIE_UDP ((DIM_MESSAGGIO_UDP - DIM_INTESTAZIONE - 4) / 8)
+#define DIM_INGRESSO (1 << 16)          /* risposte ricevute e non ancora complete, per connessione */
+#define MAX_DISCORDANZE_STAMPATE 10
+#define ANTICIPO_NS 50000               /* una richiesta prevista fra meno di così parte subito, senza dormire */
+
+/* Stato di una richiesta */
+enum { IN_ATTESA, IN_VOLO, COMPLETATA, PERSA };
+
+typedef struct
+{
+    unsigned char *messaggio;   /* nel file mappato (copia privata): l'id è riscritto con l'indice della richiesta */
+    uint64_t istante;           /* ns dall'inizio della cattura */
+    uint64_t previsto;          /* istante di invio previsto dal calendario (CLOCK_MONOTONIC) */
+    uint64_t invio;             /* istante di invio effettivo */
+    uint64_t latenza;           /* dall'invio effettivo alla risposta, 0 se non è arrivata */
+    uint32_t lunghezza;
+    uint32_t indirizzo;         /* origine catturata, network order */
+    uint16_t porta;
+    uint8_t trasporto;
+    uint8_t esito;              /* della risposta ricevuta */
+    int canale;
+    atomic_uchar stato;
+} Richiesta;
+
+typedef struct
+{
+    int sock;
+    int aperto;
+    int udp;
+    unsigned char *ingresso;    /* connessioni: byte delle risposte non ancora complete */
+    int ricevuti;
+} Canale;
+
+typedef struct
+{
+    uint32_t indirizzo;
+    uint16_t porta;
+    uint8_t trasporto;
+    uint8_t usata;
+    int canale;
+} VoceFlusso;
+
+/* Configurazione letta dalla riga di comando */
+typedef struct
+{
+    struct sockaddr_in server;
+    const char *locale;         /* -U: richieste TCP e locali sulla socket AF_UNIX del server */
+    double velocita;            /* -x: 0 = massima velocità */
+    int max_canali;             /* -c: connessioni (e socket UDP) per trasporto */
+    int finestra;               /* -f: richieste in volo */
+    double attesa;              /* -t: secondi dopo i quali una richiesta senza risposta è persa */
+    const char *uscita;         /* -o: latenza di ogni richiesta, in CSV */
+} Configurazione;
+
+static Configurazione configurazione;
+static Richiesta *richieste;
+static size_t num_richieste;
+static Canale canali[2 * MAX_CANALI];
+static int num_canali;
+
+/* Finestra delle richieste in volo: il thread di invio attende quando è piena */
+static pthread_mutex_t mutex_finestra = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finestra_libera = PTHREAD_COND_INITIALIZER;
+static int in_volo;
+static atomic_size_t inviate;   /* richieste già passate dal thread di invio (anche se l'invio è fallito) */
+
+/* Risultati, scritti solo dal thread di ricezione */
+static uint64_t completate, discordanti, rifiutate, perse, tardive, errori_invio;
+static Istogramma misurata, corretta;
+
+static uint64_t Adesso(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static int RiceviEsatti(int sock, void *buf, int len)
+{
+    int ricevuti = 0, n;
+    while (ricevuti < len)
+    {
+        n = recv(sock, (char *)buf + ricevuti, len - ricevuti, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ricevuti += n;
+    }
+    return 0;
+}
+
+static int InviaTutto(int sock, const void *buf, int len)
+{
+    int inviati = 0, n;
+    while (inviati < len)
+    {
+        n = send(sock, (const char *)buf + inviati, len - inviati, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        inviati += n;
+    }
+    return 0;
+}
+
+/* Riceve il saluto del server, una stringa terminata da '\0' */
+static int RiceviSaluto(int sock)
+{
+    char buf[DIM_BUFFER];
+    int len = 0, n;
+    while (len == 0 || buf[len - 1] != '\0')
+    {
+        if (len == (int)sizeof(buf)) return -1;
+        n = recv(sock, buf + len, sizeof(buf) - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len += n;
+    }
+    return strcmp(buf, CONNECT_OK_STRING) == 0 ? 0 : -1;
+}
+
+/* Connessione a messaggi binari: saluto e negoziazione, poi la connessione resta aperta per tutta la riproduzione.
+   Il saluto si attende al più -t secondi: il server iterativo non saluta finché serve un'altra connessione. */
+static int ApriConnessione(void)
+{
+    struct timeval attesa = { (time_t)configurazione.attesa, (long)((configurazione.attesa - (time_t)configurazione.attesa) * 1e6) };
+    struct timeval nessuna_attesa = { 0, 0 };
+    struct sockaddr_un locale;
+    unsigned char messaggio[DIM_INTESTAZIONE];
+    Intestazione intestazione;
+    int sock, attiva = 1, esito;
+
+    if (configurazione.locale != NULL)
+    {
+        memset(&locale, 0, sizeof(locale));
+        locale.sun_family = AF_UNIX;
+        snprintf(locale.sun_path, sizeof(locale.sun_path), "%s", configurazione.locale);
+        if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+        esito = connect(sock, (struct sockaddr *)&locale, sizeof(locale));
+    }
+    else
+    {
+        if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) return -1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &attiva, sizeof(attiva));
+        esito = connect(sock, (struct sockaddr *)&configurazione.server, sizeof(configurazione.server));
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &attesa, sizeof(attesa));
+    ScriviIntestazione(messaggio, OP_NEGOZIAZIONE, 0, 0, UINT32_MAX);
+    if (esito < 0 || RiceviSaluto(sock) < 0 || InviaTutto(sock, messaggio, DIM_INTESTAZIONE) < 0
+        || RiceviEsatti(sock, messaggio, DIM_INTESTAZIONE) < 0 || !LeggiIntestazione(messaggio, DIM_INTESTAZIONE, &intestazione)
+        || intestazione.flag_esito != ESITO_OK)
+    {
+        close(sock);
+        return -1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &nessuna_attesa, sizeof(nessuna_attesa));
+    return sock;
+}
+
+static int ApriUDP(void)
+{
+    int sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr *)&configurazione.server, sizeof(configurazione.server)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Ordine dell'indice: per istante, a parità nell'ordine del file (quello in cui il thread del server li ha scritti) */
+static int ConfrontaRichieste(const void *a, const void *b)
+{
+    const Richiesta *prima = a, *seconda = b;
+    if (prima->istante != seconda->istante) return prima->istante < seconda->istante ? -1 : 1;
+    return prima->messaggio < seconda->messaggio ? -1 : prima->messaggio > seconda->messaggio;
+}
+
+/*
+  Mappa il file e costruisce l'indice delle richieste. I record non validi (messaggio che non è un messaggio binario
+  completo) si saltano e si contano in *scartati, quelli troppo lunghi per un messaggio TCP in *lunghi.
+  Restituisce -1 se il file non è una cattura.
+*/
+static int CaricaCattura(const char *percorso, uint64_t *scartati, uint64_t *lunghi)
+{
+    struct stat stato;
+    TestaCattura testa;
+    unsigned char *file;
+    size_t capacita = 0, blocco, posizione;
+    int fd;
+
+    if ((fd = open(percorso, O_RDONLY)) < 0 || fstat(fd, &stato) < 0 || stato.st_size < DIM_TESTA_CATTURA) return -1;
+    /* Copia privata: gli identificativi si riscrivono sul posto senza toccare il file */
+    file = mmap(NULL, (size_t)stato.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) return -1;
+    memcpy(&testa, file, sizeof(testa));
+    if (memcmp(testa.magic, MAGIC_CATTURA, sizeof(testa.magic)) != 0 || testa.versione != VERSIONE_CATTURA
+        || testa.dim_blocco < sizeof(RecordCattura) || testa.dim_blocco % 8 != 0) return -1;
+    madvise(file, (size_t)stato.st_size, MADV_SEQUENTIAL);
+
+    *scartati = *lunghi = 0;
+    for (blocco = DIM_TESTA_CATTURA; blocco + testa.dim_blocco <= (size_t)stato.st_size; blocco += testa.dim_blocco)
+    {
+        for (posizione = 0; posizione + sizeof(RecordCattura) <= testa.dim_blocco; )
+        {
+            RecordCattura *record = (RecordCattura *)(file + blocco + posizione);
+            if (record->lunghezza == 0 || posizione + DimensioneRecordCattura(record->lunghezza) > testa.dim_blocco) break;
+            posizione += DimensioneRecordCattura(record->lunghezza);
+
+            unsigned char *messaggio = (unsigned char *)(record + 1);
+            if (LunghezzaMessaggio(messaggio, (int)record->lunghezza, (int)record->lunghezza) != (int)record->lunghezza)
+            {
+                (*scartati)++;
+                continue;
+            }
+            if (record->lunghezza > (record->trasporto == TRASPORTO_UDP ? DIM_MESSAGGIO_UDP : DIM_MESSAGGIO_TCP))
+            {
+                (*lunghi)++;
+                continue;
+            }
+            if (num_richieste == capacita)
+            {
+                capacita = capacita ? 2 * capacita : 65536;
+                if ((richieste = realloc(richieste, capacita * sizeof(Richiesta))) == NULL) return -1;
+            }
+            Richiesta *richiesta = &richieste[num_richieste++];
+            memset(richiesta, 0, sizeof(*richiesta));
+            richiesta->messaggio = messaggio;
+            richiesta->lunghezza = record->lunghezza;
+            richiesta->istante = record->istante;
+            richiesta->indirizzo = record->indirizzo;
+            richiesta->porta = record->porta;
+            richiesta->trasporto = record->trasporto;
+        }
+    }
+    qsort(richieste, num_richieste, sizeof(Richiesta), ConfrontaRichieste);
+    return 0;
+}
+
+/* Assegna a ogni richiesta il canale del suo flusso e apre i canali. -1 se una connessione non si apre. */
+static int AssegnaCanali(void)
+{
+    size_t dimensione = 1024, usate = 0, i, j;
+    int flussi[2] = { 0, 0 };
+    VoceFlusso *tabella = calloc(dimensione, sizeof(VoceFlusso));
+    if (tabella == NULL) return -1;
+
+    for (i = 0; i < num_richieste; i++)
+    {
+        Richiesta *richiesta = &richieste[i];
+        int udp = richiesta->trasporto == TRASPORTO_UDP;
+        uint32_t id = htonl((uint32_t)i);
+        memcpy(richiesta->messaggio + 8, &id, sizeof(id));
+
+        /* Tabella a indirizzamento aperto dei flussi, raddoppiata quando è piena a metà */
+        if (2 * (usate + 1) > dimensione)
+        {
+            VoceFlusso *vecchia = tabella;
+            size_t vecchia_dimensione = dimensione;
+            dimensione *= 2;
+            if ((tabella = calloc(dimensione, sizeof(VoceFlusso))) == NULL) return -1;
+            for (j = 0; j < vecchia_dimensione; j++)
+            {
+                if (!vecchia[j].usata) continue;
+                size_t casella = ((vecchia[j].indirizzo * 2654435761u) ^ vecchia[j].porta ^ ((uint32_t)vecchia[j].trasporto << 16)) & (dimensione - 1);
+                while (tabella[casella].usata) casella = (casella + 1) & (dimensione - 1);
+                tabella[casella] = vecchia[j];
+            }
+            free(vecchia);
+        }
+        size_t casella = ((richiesta->indirizzo * 2654435761u) ^ richiesta->porta ^ ((uint32_t)richiesta->trasporto << 16)) & (dimensione - 1);
+        while (tabella[casella].usata && (tabella[casella].indirizzo != richiesta->indirizzo || tabella[casella].porta != richiesta->porta
+                                          || tabella[casella].trasporto != richiesta->trasporto))
+            casella = (casella + 1) & (dimensione - 1);
+        if (!tabella[casella].usata)
+        {
+            tabella[casella].usata = 1;
+            tabella[casella].indirizzo = richiesta->indirizzo;
+            tabella[casella].porta = richiesta->porta;
+            tabella[casella].trasporto = richiesta->trasporto;
+            tabella[casella].canale = udp * MAX_CANALI + flussi[udp]++ % configurazione.max_canali;
+            usate++;
+        }
+        richiesta->canale = tabella[casella].canale;
+
+        Canale *canale = &canali[richiesta->canale];
+        if (canale->aperto) continue;
+        canale->udp = udp;
+        if ((canale->sock = udp ? ApriUDP() : ApriConnessione()) < 0 || (!udp && (canale->ingresso = malloc(DIM_INGRESSO)) == NULL))
+        {
+            free(tabella);
+            return -1;
+        }
+        canale->aperto = 1;
+    }
+    free(tabella);
+    for (i = 0; i < 2; i++) num_canali += flussi[i] < configurazione.max_canali ? flussi[i] : configurazione.max_canali;
+    return 0;
+}
+
+/* Limite di coppie del server che riceverà la richiesta, per calcolare la risposta attesa */
+static uint32_t MaxCoppie(const Richiesta *richiesta)
+{
+    return richiesta->trasporto == TRASPORTO_UDP ? MAX_COPPIE_UDP : MAX_COPPIE_TCP;
+}
+
+static void LiberaPosto(void)
+{
+    pthread_mutex_lock(&mutex_finestra);
+    in_volo--;
+    pthread_cond_signal(&finestra_libera);
+    pthread_mutex_unlock(&mutex_finestra);
+}
+
+/* Confronta la risposta alla richiesta 'indice' con quella attesa */
+static void ConcludiRichiesta(uint32_t indice, const unsigned char *risposta, int lunghezza, unsigned char *attesa)
+{
+    static unsigned long stampate;
+    Richiesta *richiesta;
+    Intestazione intestazione = { 0 };
+    unsigned char stato_in_volo = IN_VOLO;
+    uint64_t ora = Adesso();
+    int lunghezza_attesa;
+
+    if (indice >= num_richieste) return;
+    richiesta = &richieste[indice];
+    if (!atomic_compare_exchange_strong_explicit(&richiesta->stato, &stato_in_volo, COMPLETATA, memory_order_acquire, memory_order_relaxed))
+    {
+        tardive++;   /* già data per persa */
+        return;
+    }
+    richiesta->latenza = ora - richiesta->invio;
+    richiesta->esito = risposta[3];
+    RegistraValore(&misurata, richiesta->latenza);
+    /* Una richiesta partita in anticipo (meno di ANTICIPO_NS) si misura dall'invio anche per la latenza corretta */
+    RegistraValore(&corretta, ora - (richiesta->previsto < richiesta->invio ? richiesta->previsto : richiesta->invio));
+    completate++;
+
+    if (lunghezza == DIM_INTESTAZIONE && (risposta[3] == ESITO_SOVRACCARICO || risposta[3] == ESITO_LIMITE_SUPERATO)) rifiutate++;
+    else
+    {
+        LeggiIntestazione(richiesta->messaggio, (int)richiesta->lunghezza, &intestazione);
+        lunghezza_attesa = RispondiRichiesta(&intestazione, richiesta->messaggio + DIM_INTESTAZIONE, attesa, MaxCoppie(richiesta));
+        if (lunghezza_attesa != lunghezza || memcmp(attesa, risposta, (size_t)lunghezza) != 0)
+        {
+            discordanti++;
+            if (stampate++ < MAX_DISCORDANZE_STAMPATE)
+                printf("Discordanza: richiesta %u (op '%c', flag %u, %u byte): esito %u atteso %u, risposta di %d byte attesa di %d\n",
+                       indice, intestazione.operazione, intestazione.flag_esito, richiesta->lunghezza, risposta[3], attesa[3],
+                       lunghezza, lunghezza_attesa);
+        }
+    }
+    LiberaPosto();
+}
+
+/* Richieste in volo da più di -t secondi: perse. Restituisce il primo indice ancora da concludere. */
+static size_t ScadenzeRichieste(size_t primo, uint64_t ora)
+{
+    size_t limite = atomic_load_explicit(&inviate, memory_order_acquire), i;
+    uint64_t attesa = (uint64_t)(configurazione.attesa * 1e9);
+    int aperte = 0;
+
+    for (i = primo; i < limite; i++)
+    {
+        Richiesta *richiesta = &richieste[i];
+        unsigned char stato = atomic_load_explicit(&richiesta->stato, memory_order_acquire);
+        if (stato == IN_VOLO && ora - richiesta->invio > attesa
+            && atomic_compare_exchange_strong_explicit(&richiesta->stato, &stato, PERSA, memory_order_acquire, memory_order_relaxed))
+        {
+            perse++;
+            LiberaPosto();
+        }
+        else if (stato == IN_VOLO || stato == IN_ATTESA) aperte = 1;
+        if (!aperte) primo = i + 1;
+    }
+    return primo;
+}
+
+/* Thread di ricezione: risposte da tutti i canali, finché ogni richiesta è conclusa */
+static void *ThreadRicezione(void *arg)
+{
+    static struct pollfd attese[2 * MAX_CANALI];
+    static Canale *attivi[2 * MAX_CANALI];
+    unsigned char *datagramma = malloc(DIM_MESSAGGIO_UDP), *attesa = malloc(DIM_INTESTAZIONE + 4 + DIM_MESSAGGIO_UDP + MAX_BYTE_POTENZA);
+    Intestazione intestazione;
+    size_t primo = 0;
+    uint64_t ultimo_controllo = 0;
+    int n, i, lunghezza;
+    (void)arg;
+
+    n = 0;
+    for (i = 0; i < 2 * MAX_CANALI; i++)
+    {
+        if (!canali[i].aperto) continue;
+        attese[n].fd = canali[i].sock;
+        attese[n].events = POLLIN;
+        attivi[n++] = &canali[i];
+    }
+
+    while (primo < num_richieste)
+    {
+        int pronti = poll(attese, (nfds_t)n, 10);
+        uint64_t ora = Adesso();
+        if (ora - ultimo_controllo >= 10000000u || pronti <= 0)
+        {
+            primo = ScadenzeRichieste(primo, ora);
+            ultimo_controllo = ora;
+        }
+        for (i = 0; i < n && pronti > 0; i++)
+        {
+            Canale *canale = attivi[i];
+            if (attese[i].revents == 0) continue;
+            pronti--;
+            if (canale->udp)
+            {
+                lunghezza = (int)recv(canale->sock, datagramma, DIM_MESSAGGIO_UDP, MSG_DONTWAIT);
+                if (lunghezza > 0 && LeggiIntestazione(datagramma, lunghezza, &intestazione))
+                    ConcludiRichiesta(intestazione.id, datagramma, lunghezza, attesa);
+                continue;
+            }
+
+            lunghezza = (int)recv(canale->sock, canale->ingresso + canale->ricevuti, DIM_INGRESSO - canale->ricevuti, MSG_DONTWAIT);
+            if (lunghezza < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            if (lunghezza <= 0)
+            {
+                /* Connessione chiusa dal server: le sue richieste in volo scadranno come perse */
+                attese[i].fd = -1;
+                continue;
+            }
+            canale->ricevuti += lunghezza;
+            int consumati = 0, totale;
+            while ((totale = LunghezzaMessaggio(canale->ingresso + consumati, canale->ricevuti - consumati, DIM_INGRESSO)) > 0)
+            {
+                LeggiIntestazione(canale->ingresso + consumati, totale, &intestazione);
+                ConcludiRichiesta(intestazione.id, canale->ingresso + consumati, totale, attesa);
+                consumati += totale;
+            }
+            if (totale < 0)
+            {
+                printf("Risposta non valida su una connessione: la connessione non viene più letta.\n");
+                attese[i].fd = -1;
+                continue;
+            }
+            memmove(canale->ingresso, canale->ingresso + consumati, (size_t)(canale->ricevuti - consumati));
+            canale->ricevuti -= consumati;
+        }
+    }
+    free(datagramma);
+    free(attesa);
+    return NULL;
+}
+
+/* Thread principale: invia ogni richiesta al suo istante, nei limiti della finestra */
+static void Invia(uint64_t inizio)
+{
+    uint64_t primo_istante = num_richieste > 0 ? richieste[0].istante : 0;
+    struct timespec scadenza;
+    size_t i;
+
+    for (i = 0; i < num_richieste; i++)
+    {
+        Richiesta *richiesta = &richieste[i];
+        richiesta->previsto = inizio;
+        if (configurazione.velocita > 0)
+        {
+            richiesta->previsto += (uint64_t)((richiesta->istante - primo_istante) / configurazione.velocita);
+            if (richiesta->previsto > Adesso() + ANTICIPO_NS)   /* in ritardo o quasi: niente sonno */
+            {
+                scadenza.tv_sec = (time_t)(richiesta->previsto / 1000000000u);
+                scadenza.tv_nsec = (long)(richiesta->previsto % 1000000000u);
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &scadenza, NULL) == EINTR);
+            }
+        }
+
+        pthread_mutex_lock(&mutex_finestra);
+        while (in_volo >= configurazione.finestra) pthread_cond_wait(&finestra_libera, &mutex_finestra);
+        in_volo++;
+        pthread_mutex_unlock(&mutex_finestra);
+
+        /* Lo stato cambia prima dell'invio: la risposta può arrivare prima che send() ritorni */
+        richiesta->invio = Adesso();
+        if (configurazione.velocita == 0) richiesta->previsto = richiesta->invio;
+        atomic_store_explicit(&richiesta->stato, IN_VOLO, memory_order_release);
+        Canale *canale = &canali[richiesta->canale];
+        int esito = canale->udp ? (send(canale->sock, richiesta->messaggio, richiesta->lunghezza, 0) == (ssize_t)richiesta->lunghezza ? 0 : -1)
+                                : InviaTutto(canale->sock, richiesta->messaggio, (int)richiesta->lunghezza);
+        if (esito < 0)
+        {
+            unsigned char stato = IN_VOLO;
+            if (atomic_compare_exchange_strong(&richiesta->stato, &stato, PERSA))
+            {
+                __atomic_fetch_add(&errori_invio, 1, __ATOMIC_RELAXED);
+                LiberaPosto();
+            }
+        }
+        atomic_store_explicit(&inviate, i + 1, memory_order_release);
+    }
+}
+
+/* Latenza di ogni richiesta in CSV: indice, istante catturato, trasporto, operazione, latenza (ns, vuota se persa), esito */
+static int ScriviLatenze(const char *percorso)
+{
+    static const char *const trasporti[] = { "tcp", "udp", "locale" };
+    FILE *uscita = fopen(percorso, "w");
+    size_t i;
+    if (uscita == NULL) return -1;
+    setvbuf(uscita, NULL, _IOFBF, 1 << 20);
+    fprintf(uscita, "indice,istante_ns,trasporto,operazione,flag,latenza_ns,esito\n");
+    for (i = 0; i < num_richieste; i++)
+    {
+        const Richiesta *richiesta = &richieste[i];
+        fprintf(uscita, "%zu,%llu,%s,%c,%u,", i, (unsigned long long)richiesta->istante,
+                richiesta->trasporto <= TRASPORTO_LOCALE ? trasporti[richiesta->trasporto] : "?", richiesta->messaggio[2], richiesta->messaggio[3]);
+        if (atomic_load(&richiesta->stato) == COMPLETATA) fprintf(uscita, "%llu,%u\n", (unsigned long long)richiesta->latenza, richiesta->esito);
+        else fprintf(uscita, ",\n");
+    }
+    return fclose(uscita);
+}
+
+static void StampaLatenze(const char *nome, const Istogramma *istogramma)
+{
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f\n", nome,
+           istogramma->totale ? istogramma->somma / istogramma->totale / 1000.0 : 0.0,
+           PercentileIstogramma(istogramma, 50.0) / 1000.0, PercentileIstogramma(istogramma, 99.0) / 1000.0,
+           PercentileIstogramma(istogramma, 99.9) / 1000.0, PercentileIstogramma(istogramma, 100.0) / 1000.0);
+}
+
+static void Uso(const char *programma)
+{
+    printf("Uso: %s [-x velocità] [-h host | -U percorso] [-P porta] [-c connessioni] [-f finestra] [-t secondi] [-o file.csv] cattura\n", programma);
+    printf("  -x velocità  1 = tempi originali (default), 2 = il doppio più veloce, 0.5 = a metà, 0 = alla massima velocità\n");
+    printf("  -h host      server (default 127.0.0.1)\n");
+    printf("  -U percorso  richieste TCP e locali sulla socket AF_UNIX del server (-U del server) invece che su host e porta\n");
+    printf("  -P porta     porta del server, TCP e UDP (default %d)\n", PORTA_DEFAULT);
+    printf("  -c N         al più N connessioni, e N socket UDP, a cui si assegnano i client catturati (default 64, max %d)\n", MAX_CANALI);
+    printf("  -f N         richieste in volo al più (default 128; su UDP una finestra troppo ampia riempie il buffer del server)\n");
+    printf("  -t secondi   attesa della risposta prima di dare una richiesta per persa (default 2)\n");
+    printf("  -o file      latenza ed esito di ogni richiesta, in CSV\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1", *percorso = NULL;
+    int porta = PORTA_DEFAULT, i;
+    struct hostent *risolto;
+    uint64_t scartati, lunghi, inizio;
+    pthread_t ricevitore;
+
+    configurazione.velocita = 1;
+    configurazione.max_canali = 64;
+    configurazione.finestra = 128;
+    configurazione.attesa = 2;
+    for (i = 1; i < argc; i++)
+    {
+        int ha_valore = (i + 1 < argc);
+        if (strcmp(argv[i], "-x") == 0 && ha_valore) configurazione.velocita = atof(argv[++i]);
+        else if (strcmp(argv[i], "-h") == 0 && ha_valore) host = argv[++i];
+        else if (strcmp(argv[i], "-U") == 0 && ha_valore) configurazione.locale = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0 && ha_valore) porta = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && ha_valore) configurazione.max_canali = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-f") == 0 && ha_valore) configurazione.finestra = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && ha_valore) configurazione.attesa = atof(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && ha_valore) configurazione.uscita = argv[++i];
+        else if (argv[i][0] != '-' && percorso == NULL) percorso = argv[i];
+        else
+        {
+            Uso(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (percorso == NULL || configurazione.velocita < 0 || porta <= 0 || porta > 65535 || configurazione.max_canali < 1
+        || configurazione.max_canali > MAX_CANALI || configurazione.finestra < 1 || configurazione.attesa <= 0)
+    {
+        Uso(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if ((risolto = gethostbyname(host)) == NULL)
+    {
+        fprintf(stderr, "Risoluzione del nome fallita per %s.\n", host);
+        return EXIT_FAILURE;
+    }
+    configurazione.server.sin_family = AF_INET;
+    configurazione.server.sin_port = htons((uint16_t)porta);
+    configurazione.server.sin_addr = *(struct in_addr *)risolto->h_addr_list[0];
+
+    if (CaricaCattura(percorso, &scartati, &lunghi) < 0)
+    {
+        fprintf(stderr, "%s non è un file di cattura valido.\n", percorso);
+        return EXIT_FAILURE;
+    }
+    if (num_richieste == 0)
+    {
+        printf("Nessuna richiesta in %s.\n", percorso);
+        return EXIT_SUCCESS;
+    }
+    double originale = (richieste[num_richieste - 1].istante - richieste[0].istante) / 1e9;
+    printf("Cattura %s: %zu richieste in %.3f s", percorso, num_richieste, originale);
+    if (scartati > 0) printf(", %llu record non validi scartati", (unsigned long long)scartati);
+    if (lunghi > 0) printf(", %llu batch troppo lunghi per un messaggio scartati", (unsigned long long)lunghi);
+    printf("\n");
+    if (AssegnaCanali() < 0)
+    {
+        fprintf(stderr, "Impossibile aprire le connessioni verso il server (il server iterativo ne serve una alla volta: -c 1).\n");
+        return EXIT_FAILURE;
+    }
+    printf("Riproduzione verso %s:%d su %d connessioni e socket, ", inet_ntoa(configurazione.server.sin_addr), porta, num_canali);
+    if (configurazione.velocita > 0) printf("velocità %gx, ", configurazione.velocita);
+    else printf("alla massima velocità, ");
+    printf("finestra %d\n", configurazione.finestra);
+
+    AzzeraIstogramma(&misurata);
+    AzzeraIstogramma(&corretta);
+    if (pthread_create(&ricevitore, NULL, ThreadRicezione, NULL) != 0)
+    {
+        fprintf(stderr, "Impossibile avviare il thread di ricezione.\n");
+        return EXIT_FAILURE;
+    }
+    inizio = Adesso();
+    Invia(inizio);
+    pthread_join(ricevitore, NULL);
+    double secondi = (Adesso() - inizio) / 1e9;
+
+    printf("\nRichieste: %zu, completate: %llu in %.3f s -> %.1f richieste/s\n", num_richieste, (unsigned long long)completate,
+           secondi, completate / secondi);
+    printf("Discordanze: %llu, rifiutate dal server: %llu, perse: %llu", (unsigned long long)discordanti,
+           (unsigned long long)rifiutate, (unsigned long long)(perse + errori_invio));
+    if (tardive > 0) printf(" (%llu risposte arrivate dopo la scadenza)", (unsigned long long)tardive);
+    printf("\n\nLatenza (us)     media        p50        p99      p99.9        max\n");
+    StampaLatenze("misurata", &misurata);
+    if (configurazione.velocita > 0) StampaLatenze("corretta", &corretta);
+    if (configurazione.uscita != NULL && ScriviLatenze(configurazione.uscita) != 0)
+        fprintf(stderr, "Impossibile scrivere %s.\n", configurazione.uscita);
+    return discordanti == 0 && perse + errori_invio == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}